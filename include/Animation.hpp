@@ -0,0 +1,66 @@
+#pragma once
+#include "Camera.hpp"
+#include "Canvas.hpp"
+#include "Matrix.hpp"
+#include "Motion.hpp"
+#include "Tuple.hpp"
+#include "World.hpp"
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <vector>
+namespace RT {
+
+struct View {
+  Point from;
+  Point to;
+  Vector up;
+};
+
+// Keyframes sorted by time; evaluating before the first or after the last
+// key holds that key.
+template <typename T> class Track {
+public:
+  void key(Real time, T value);
+  [[nodiscard]] auto empty() const -> bool;
+  [[nodiscard]] auto at(Real time) const -> T;
+
+private:
+  std::vector<std::pair<Real, T>> keys;
+};
+
+extern template class Track<Pose>;
+extern template class Track<View>;
+
+using FrameRenderer = std::function<Canvas(const Camera &, const World &)>;
+using FrameWriter = std::function<void(int frame, const Canvas &image)>;
+
+// Renders frames of one world and camera whose transforms follow tracks.
+// Between frames only objects whose pose changed are refit, and each frame
+// is handed to the writer on its own thread while the next one renders.
+class Sequence {
+public:
+  Sequence(Camera &camera, World &world);
+  Camera &camera;
+  World &world;
+  Track<View> view;
+  FrameRenderer renderer;
+  void animate(size_t object, Track<Pose> track);
+  // Poses the camera and animated objects at time.
+  void pose(Real time);
+  // Renders frames evenly spaced from start to end inclusive. Frames are
+  // whole renders, so the world's edits are cleared after each one.
+  void render(int frames, Real start, Real end, const FrameWriter &write);
+  [[nodiscard]] auto refits() const -> size_t;
+
+private:
+  struct Animated {
+    size_t object;
+    Track<Pose> track;
+    std::optional<Pose> applied;
+  };
+  std::vector<Animated> animated;
+  size_t refitCount = 0;
+};
+
+} // namespace RT
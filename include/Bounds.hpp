@@ -0,0 +1,47 @@
+#pragma once
+#include "Matrix.hpp"
+#include "Ray.hpp"
+#include "Tuple.hpp"
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+namespace RT {
+
+class BoundingBox {
+public:
+  BoundingBox();
+  BoundingBox(Point min, Point max);
+  Point min;
+  Point max;
+  static auto infinite() -> BoundingBox;
+  void add(const Point &p);
+  void add(const BoundingBox &box);
+  [[nodiscard]] auto isEmpty() const -> bool;
+  [[nodiscard]] auto isFinite() const -> bool;
+  [[nodiscard]] auto contains(const Point &p) const -> bool;
+  [[nodiscard]] auto padded(Real amount) const -> BoundingBox;
+  [[nodiscard]] auto transform(const Transformation &m) const -> BoundingBox;
+  [[nodiscard]] auto intersects(const Ray &ray) const -> bool;
+  // The parameters at which ray's line enters and leaves the box.
+  [[nodiscard]] auto span(const Ray &ray) const
+      -> std::optional<std::pair<Real, Real>>;
+};
+
+constexpr size_t BOUNDS_BLOCK_SIZE = 64;
+
+class BoundsArray {
+public:
+  std::vector<Real> minX, minY, minZ;
+  std::vector<Real> maxX, maxY, maxZ;
+  void push(const BoundingBox &box);
+  void set(size_t i, const BoundingBox &box);
+  // Moves the last box into slot i and drops the last slot.
+  void remove(size_t i);
+  [[nodiscard]] auto at(size_t i) const -> BoundingBox;
+  [[nodiscard]] auto size() const -> size_t;
+  void hits(const Ray &ray, size_t first, size_t count,
+            unsigned char *mask) const;
+};
+
+} // namespace RT
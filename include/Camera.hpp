@@ -2,22 +2,205 @@
 #include "Canvas.hpp"
 #include "Matrix.hpp"
 #include "Ray.hpp"
+#include "Sampler.hpp"
 #include "World.hpp"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
 namespace RT {
 
+// Called on a render thread each time a tile lands in the framebuffer.
+using TileCallback = std::function<void(const Tile &tile, Real progress)>;
+// Called on a render thread with a finished tile's pixels, row by row.
+using TilePixelsCallback =
+    std::function<void(const Tile &tile, const std::vector<Color> &pixels)>;
+
+// Arbitrary output variables: images of each pixel's primary hit, filled
+// in the same pass as the colors. Multisampled pixels take their first
+// sample's hit.
+struct AOVImages {
+  AOVImages(int width, int height);
+  // Distance from the eye; infinity where nothing is hit.
+  FloatImage depth;
+  // World space normals facing the eye; 0 where nothing is hit.
+  FloatImage normal;
+  // ObjectIds of the top-level objects; -1 where nothing is hit.
+  FloatImage object;
+  // Surface colors before lighting; 0 where nothing is hit.
+  FloatImage albedo;
+  void write(int pixelX, int pixelY,
+             const std::optional<SurfaceSample> &surface);
+};
+
+// Called on a render thread once a finished tile's AOVs are in aovs. The
+// tile is in the AOV images' coordinates, which only differ from the
+// image's in crop renders.
+using TileAOVCallback =
+    std::function<void(const Tile &tile, const AOVImages &aovs)>;
+
+struct RenderOptions {
+  int tileSize = DEFAULT_TILE_SIZE;
+  unsigned threads = 0;
+  TileCallback onTile;
+  TilePixelsCallback onPixels;
+  // Pixel rectangles to trace, clipped to the image; empty traces it all.
+  // Pixels outside them stay black.
+  std::vector<Tile> regions;
+  // Whether the canvas only covers the bounding rectangle of the regions,
+  // with its top left corner at that rectangle's.
+  bool crop = false;
+  // Whether to fill AOV images covering the same pixels as the canvas.
+  bool aovs = false;
+  TileAOVCallback onAOVs;
+};
+
+// A render running on background threads. Progress is a lock-free pixel
+// counter; cancellation is checked between tiles and rows. Destroying the
+// handle cancels the render and waits for it. The world must outlive it.
+class RenderHandle {
+public:
+  RenderHandle(RenderHandle &&other) noexcept = default;
+  auto operator=(RenderHandle &&other) noexcept -> RenderHandle &;
+  RenderHandle(const RenderHandle &) = delete;
+  auto operator=(const RenderHandle &) -> RenderHandle & = delete;
+  ~RenderHandle();
+
+  [[nodiscard]] auto pixelsDone() const -> size_t;
+  [[nodiscard]] auto totalPixels() const -> size_t;
+  [[nodiscard]] auto progress() const -> Real;
+  // True once the render threads have exited, done or cancelled.
+  [[nodiscard]] auto finished() const -> bool;
+  void cancel();
+  [[nodiscard]] auto cancelled() const -> bool;
+  // Copy of the framebuffer; tiles not yet finished are black.
+  [[nodiscard]] auto snapshot() const -> Canvas;
+  // Blocks until the render finishes or stops after a cancel.
+  auto wait() -> const Canvas &;
+  // The AOV images, empty unless the options asked for them. They are only
+  // complete once wait returns.
+  [[nodiscard]] auto aovs() const -> const std::optional<AOVImages> &;
+
+private:
+  friend class Camera;
+  struct State;
+  explicit RenderHandle(std::unique_ptr<State> state);
+  void stop();
+  std::unique_ptr<State> state;
+};
+
+class Camera;
+
+constexpr size_t RAY_ROW_BLOCK = 64;
+constexpr int DEFAULT_LENS_SAMPLES = 16;
+constexpr int LENS_PILOT_SAMPLES = 4;
+
+// Camera rays with the inverse view transform applied once: the world
+// space origin, the center of pixel (0, 0) on the image plane and the
+// steps between neighbouring pixels. It copies what it needs, so later
+// changes to the camera are not seen.
+class RayGenerator {
+public:
+  explicit RayGenerator(const Camera &camera);
+  Point origin;
+  Point corner;
+  Vector stepX;
+  Vector stepY;
+  // The lens disk's axes in world space, scaled by the aperture radius.
+  Vector lensX;
+  Vector lensY;
+  Real focalDistance;
+  Real shutterOpen;
+  Real shutterClose;
+  int lensSamples;
+  SampleSequence sampling;
+  // Whether pixels take several samples of the lens or the shutter.
+  [[nodiscard]] auto multisampled() const -> bool;
+  // Pinhole rays are cast at shutterOpen.
+  [[nodiscard]] auto ray(int pixelX, int pixelY) const -> Ray;
+  // The ray of pixel (pixelX, pixelY) through the sample'th lens and
+  // shutter sample of the pixel's sampler, aimed at where the pinhole ray
+  // meets the focal plane.
+  [[nodiscard]] auto lensRay(int pixelX, int pixelY, int sample) const -> Ray;
+  // The sample'th ray of a pixel for renders that also anti-alias: sample
+  // 0 is the pixel's first lens sample, or its pinhole ray, and later ones
+  // are spread over the pixel by its sampler.
+  [[nodiscard]] auto sampleRay(int pixelX, int pixelY, int sample) const
+      -> Ray;
+  // Writes the rays of count pixels of row pixelY, from pixelX on, to out.
+  // Directions are built a block at a time as arrays of components, which
+  // the compiler turns into SIMD code; each matches ray() exactly.
+  void row(int pixelX, int pixelY, size_t count, Ray *out) const;
+
+private:
+  [[nodiscard]] auto throughLens(const Point &pixel,
+                                 const PixelSampler &sampler,
+                                 uint32_t sample) const -> Ray;
+};
+
+struct PixelEstimate {
+  Color color;
+  int samples;
+};
+
+// Averages up to rays.lensSamples lens rays of a pixel. When the first
+// LENS_PILOT_SAMPLES all miss, or all hit the same object within a pixel's
+// footprint of each other, the pixel is in focus and not blurred by motion,
+// and the estimate stops there. A given surface receives the first
+// sample's hit.
+[[nodiscard]] auto lensColor(const World &world, const RayGenerator &rays,
+                             int pixelX, int pixelY,
+                             std::optional<SurfaceSample> *surface = nullptr)
+    -> PixelEstimate;
+
 class Camera {
 public:
-  Camera(int hsize, int vsize, double fieldOfView,
+  Camera(int hsize, int vsize, Real fieldOfView,
          Transformation transform = identityMatrix<4>());
   int hsize;
   int vsize;
-  double fieldOfView;
+  Real fieldOfView;
   Transformation transform;
-  double pixelSize;
-  double halfWidth;
-  double halfHeight;
+  Real pixelSize;
+  Real halfWidth;
+  Real halfHeight;
+  // A thin lens of this radius focused focalDistance in front of the eye;
+  // an aperture of 0 is a pinhole camera. The wavefront renderer only
+  // supports the pinhole.
+  Real aperture = 0;
+  Real focalDistance = 1;
+  // Rays are spread over [shutterOpen, shutterClose] to blur moving
+  // shapes; an empty interval casts every ray at shutterOpen.
+  Real shutterOpen = 0;
+  Real shutterClose = 0;
+  // Samples per pixel through the lens and shutter.
+  int lensSamples = DEFAULT_LENS_SAMPLES;
+  // Where lens, shutter and anti-aliasing samples come from.
+  SampleSequence sampling = SampleSequence::Sobol;
   [[nodiscard]] auto rayForPixel(int pixelX, int pixelY) const -> Ray;
+  // Ray generation for the camera as it is now; renders make one per frame
+  // instead of inverting the transform for every pixel.
+  [[nodiscard]] auto rays() const -> RayGenerator;
   [[nodiscard]] auto render(const World &world) const -> Canvas;
+  [[nodiscard]] auto render(const World &world,
+                            const RenderOptions &options) const -> Canvas;
+  [[nodiscard]] auto renderAsync(const World &world,
+                                 RenderOptions options = {}) const
+      -> RenderHandle;
+  // Renders the same image as render(world) while recording, per tile,
+  // what the tile's rays depended on.
+  [[nodiscard]] auto render(const World &world, RenderRecord &record) const
+      -> Canvas;
+  // Brings image up to date with the edits made to world since record was
+  // taken, retracing only the tiles they can change; the result matches a
+  // full render exactly. Changes to the camera, its lens included, or the
+  // lights retrace everything. Returns the number of tiles retraced.
+  auto update(const World &world, RenderRecord &record, Canvas &image) const
+      -> size_t;
 };
 
 } // namespace RT
\ No newline at end of file
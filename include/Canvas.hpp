@@ -2,22 +2,98 @@
 #include "Tuple.hpp"
 #include "Util.hpp"
 #include <fstream>
+#include <mutex>
 #include <string>
 #include <vector>
 namespace RT {
 
+constexpr int DEFAULT_TILE_SIZE = 32;
+
+struct Tile {
+  int x;
+  int y;
+  int width;
+  int height;
+  auto operator==(const Tile &other) const -> bool = default;
+};
+
+// Row-major tiles covering a width x height image.
+auto splitTiles(int width, int height, int tileSize = DEFAULT_TILE_SIZE)
+    -> std::vector<Tile>;
+
+// The part of tile inside a width x height image, with zero size if none.
+auto clipTile(const Tile &tile, int width, int height) -> Tile;
+
+// Row-major tiles covering each region in turn, clipped to a width x height
+// image. Pixels in several regions are covered once per region.
+auto splitTiles(const std::vector<Tile> &regions, int width, int height,
+                int tileSize = DEFAULT_TILE_SIZE) -> std::vector<Tile>;
+
+// The smallest tile containing every non-empty one.
+auto boundingTile(const std::vector<Tile> &tiles) -> Tile;
+
 class Canvas {
 public:
   Canvas(int width, int height);
   void writePixel(int pixelX, int pixelY, Color color);
   [[nodiscard]] auto pixelAt(int pixelX, int pixelY) const -> Color;
+  // A copy of the pixels of region, which must lie inside the canvas.
+  [[nodiscard]] auto crop(const Tile &region) const -> Canvas;
   [[nodiscard]] auto PPMHeader() const -> std::vector<unsigned char>;
   [[nodiscard]] auto PPMBody() const -> std::vector<unsigned char>;
   [[nodiscard]] auto PPM() const -> std::vector<unsigned char>;
   void savePPM(const std::string &filename) const;
+  [[nodiscard]] static auto loadPPM(const std::string &filename) -> Canvas;
   int width, height;
 
 private:
   std::vector<Color> pixels;
 };
+
+// Single precision values with one or three channels per pixel, the
+// layout of a PFM file.
+class FloatImage {
+public:
+  FloatImage(int width, int height, int channels, float value = 0);
+  void set(int pixelX, int pixelY, int channel, float value);
+  [[nodiscard]] auto at(int pixelX, int pixelY, int channel) const -> float;
+  void savePFM(const std::string &filename) const;
+  [[nodiscard]] static auto loadPFM(const std::string &filename)
+      -> FloatImage;
+  int width, height, channels;
+
+private:
+  friend class PFMWriter;
+  std::vector<float> values;
+};
+
+// "PF" for three channels or "Pf" for one, the size, and a negative scale
+// for little-endian values.
+auto PFMHeader(int width, int height, int channels) -> std::string;
+
+// Writes a PFM file a tile at a time, in any order and from any thread.
+// The file is sized when it is opened, so tiles go straight to their rows;
+// pixels never written read as 0.
+class PFMWriter {
+public:
+  PFMWriter(const std::string &filename, int width, int height,
+            int channels);
+  PFMWriter(const PFMWriter &) = delete;
+  auto operator=(const PFMWriter &) -> PFMWriter & = delete;
+  ~PFMWriter();
+  // Copies tile of image, which has the file's size and channels, to the
+  // same place in the file. It runs on render threads, so a failed write
+  // does not throw: it is kept for error() and later tiles are dropped.
+  void write(const Tile &tile, const FloatImage &image) const;
+  // Why writing stopped, or empty while every tile has been written.
+  [[nodiscard]] auto error() const -> std::string;
+
+private:
+  int fd;
+  int width, height, channels;
+  size_t headerSize;
+  std::string filename;
+  mutable std::string failure;
+  mutable std::mutex mutex;
+};
 } // namespace RT
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+#include "Canvas.hpp"
+#include "Tuple.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+namespace RT {
+
+constexpr std::chrono::seconds CHECKPOINT_SYNC_INTERVAL{5};
+
+// An append-only file of finished tiles. Each record holds the tile's
+// pixels bit for bit, in the machine's byte order, and a checksum, so a
+// record cut short by a crash is recognised and dropped on resume.
+class Checkpoint {
+public:
+  // Opens filename for a width x height render identified by key, which
+  // should change whenever anything that affects the image does. With
+  // resume, the tiles of an earlier run of the same render are kept and
+  // a checkpoint of a different one throws; otherwise the file starts
+  // over.
+  Checkpoint(const std::string &filename, int width, int height,
+             uint64_t key, bool resume);
+  ~Checkpoint();
+  Checkpoint(const Checkpoint &) = delete;
+  auto operator=(const Checkpoint &) -> Checkpoint & = delete;
+  Checkpoint(Checkpoint &&) = delete;
+  auto operator=(Checkpoint &&) -> Checkpoint & = delete;
+
+  // Tiles restored from an earlier run.
+  [[nodiscard]] auto tiles() const -> const std::vector<Tile> &;
+  // The tiles of plan that were not restored.
+  [[nodiscard]] auto missing(const std::vector<Tile> &plan) const
+      -> std::vector<Tile>;
+  // Writes the restored pixels into canvas, which covers window of the
+  // image, or all of it.
+  void restore(Canvas &canvas) const;
+  void restore(Canvas &canvas, const Tile &window) const;
+  // Appends a finished tile; safe to call from several threads. The data
+  // is in the file when it returns, and forced to disk at most every
+  // CHECKPOINT_SYNC_INTERVAL. It runs on render threads, so a failed write
+  // does not throw: it is kept for error() and later tiles are dropped.
+  void save(const Tile &tile, const std::vector<Color> &pixels);
+  // Why saving stopped, or empty while every tile has been saved.
+  [[nodiscard]] auto error() const -> std::string;
+
+private:
+  int fd = -1;
+  int width;
+  int height;
+  std::vector<Tile> restored;
+  std::vector<Real> values;
+  std::string filename;
+  std::string failure;
+  mutable std::mutex mutex;
+  std::chrono::steady_clock::time_point lastSync;
+  auto load(const std::string &filename, uint64_t key) -> size_t;
+};
+
+} // namespace RT
@@ -0,0 +1,89 @@
+#pragma once
+#include "Canvas.hpp"
+#include "Tuple.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+namespace RT {
+
+// Endpoints are "unix:<path>" or "tcp:<host>:<port>"; port 0 picks a free
+// one, which Coordinator::endpoint() then reports.
+struct Endpoint {
+  enum class Kind { Unix, Tcp } kind;
+  std::string address;
+  int port;
+  static auto parse(const std::string &text) -> Endpoint;
+  [[nodiscard]] auto str() const -> std::string;
+};
+
+using TileRenderer = std::function<void(const Tile &, std::vector<Color> &)>;
+
+// Hands tiles to workers that connect to it and assembles their results.
+// Pixels travel as raw Reals, so every process must share the same build
+// and byte order; a farm render then matches a local render bit for bit.
+// Each side opens with a hello carrying key, which identifies the image,
+// and sizeof(Real); workers whose hello does not match get no tiles and
+// are dropped. A worker that returns nothing for jobTimeout is dropped as
+// hung and its tiles go to the others.
+class Coordinator {
+public:
+  explicit Coordinator(
+      const std::string &endpoint, uint64_t key = 0,
+      std::chrono::milliseconds jobTimeout = std::chrono::minutes(5));
+  ~Coordinator();
+  Coordinator(const Coordinator &) = delete;
+  auto operator=(const Coordinator &) -> Coordinator & = delete;
+  Coordinator(Coordinator &&) = delete;
+  auto operator=(Coordinator &&) -> Coordinator & = delete;
+
+  [[nodiscard]] auto endpoint() const -> std::string;
+  // Blocks until every tile is back. Tiles held by a worker that
+  // disconnects or hangs are handed to the others. Throws if no worker is
+  // connected for longer than idleTimeout.
+  void render(Canvas &canvas, const std::vector<Tile> &tiles,
+              std::chrono::milliseconds idleTimeout = std::chrono::minutes(1));
+  // As above for a canvas covering only window of the image: tiles land
+  // at their offset from the window's top left corner.
+  void render(Canvas &canvas, const std::vector<Tile> &tiles,
+              const Tile &window,
+              std::chrono::milliseconds idleTimeout = std::chrono::minutes(1));
+  // Tells connected workers to exit.
+  void shutdown();
+  [[nodiscard]] auto workerCount() const -> size_t;
+  [[nodiscard]] auto reassigned() const -> size_t;
+
+private:
+  struct Worker {
+    int fd;
+    std::vector<unsigned char> inbox;
+    std::deque<size_t> jobs;
+    bool greeted = false;
+    // When the job at the front of jobs started.
+    std::chrono::steady_clock::time_point started;
+  };
+  void accept();
+  void drop(size_t worker, std::deque<size_t> &pending);
+  Endpoint bound;
+  int listener;
+  uint64_t key;
+  std::chrono::milliseconds jobTimeout;
+  std::vector<Worker> workers;
+  size_t reassignedTiles = 0;
+};
+
+// Connects to a coordinator, retrying until connectTimeout, and renders the
+// tiles it is sent until it is told to stop. Returns the number of tiles
+// rendered. Throws if the coordinator's hello does not match key and this
+// build's Real. If the renderer throws, the connection is closed, so the
+// coordinator hands the worker's tiles to others, and the exception
+// propagates.
+auto runWorker(const std::string &endpoint, const TileRenderer &render,
+               uint64_t key = 0,
+               std::chrono::milliseconds connectTimeout =
+                   std::chrono::seconds(10)) -> size_t;
+
+} // namespace RT
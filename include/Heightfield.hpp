@@ -0,0 +1,101 @@
+#pragma once
+#include "Bounds.hpp"
+#include "MappedFile.hpp"
+#include "Ray.hpp"
+#include "Shape.hpp"
+#include "Tuple.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+namespace RT {
+
+enum class ElevationFormat { Float16, Float32 };
+
+auto halfToFloat(uint16_t half) -> float;
+auto floatToHalf(float value) -> uint16_t;
+
+// Elevation samples in depth rows of width samples, stored as little
+// endian float16 or float32, either in memory or memory mapped from a
+// headerless raw file such as a .r16/.r32 DEM export.
+class ElevationGrid {
+public:
+  static auto fromSamples(int width, int depth,
+                          const std::vector<float> &samples,
+                          ElevationFormat format = ElevationFormat::Float32)
+      -> std::shared_ptr<const ElevationGrid>;
+  static auto map(const std::string &filename, int width, int depth,
+                  ElevationFormat format, size_t offset = 0)
+      -> std::shared_ptr<const ElevationGrid>;
+  ElevationGrid(const ElevationGrid &) = delete;
+  auto operator=(const ElevationGrid &) -> ElevationGrid & = delete;
+  ElevationGrid(ElevationGrid &&) = delete;
+  auto operator=(ElevationGrid &&) -> ElevationGrid & = delete;
+  ~ElevationGrid() = default;
+
+  int width;
+  int depth;
+  ElevationFormat format;
+  [[nodiscard]] auto at(int x, int z) const -> float;
+  [[nodiscard]] auto bytes() const -> size_t;
+
+private:
+  ElevationGrid(int width, int depth, ElevationFormat format);
+  std::optional<MappedFile> file;
+  std::vector<unsigned char> owned;
+  const unsigned char *samples = nullptr;
+};
+
+constexpr int HEIGHTFIELD_LEAF_LEVEL = 2;
+
+// A terrain surface over the unit square of the xz plane, with sample
+// (x, z) of the grid at (x / (width - 1), elevation, z / (depth - 1)).
+// Each grid cell is split into two triangles along its diagonal and
+// shaded with normals interpolated from the grid. Rays walk the cells
+// they cross with a 2D DDA, descending a min/max pyramid whose leaves
+// cover 4x4 cells, so a ray only visits cells its height range reaches.
+class Heightfield final : public Shape {
+public:
+  explicit Heightfield(std::shared_ptr<const ElevationGrid> grid);
+  [[nodiscard]] auto grid() const -> const ElevationGrid &;
+  [[nodiscard]] auto pyramidLevels() const -> int;
+  [[nodiscard]] auto localNormalAt(const Point &point) const -> Vector override;
+  [[nodiscard]] auto localIntersect(const Ray &ray) const
+      -> std::vector<Intersection> override;
+  void intersectInto(const Ray &ray,
+                     std::vector<Intersection> &xs) const override;
+  [[nodiscard]] auto occludes(const Ray &ray, Real distance,
+                              std::vector<Intersection> &scratch) const
+      -> bool override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+
+private:
+  struct Level {
+    int width;
+    int depth;
+    std::vector<float> low;
+    std::vector<float> high;
+  };
+  struct GridRay {
+    Real ox, oy, oz;
+    Real dx, dy, dz;
+  };
+  std::shared_ptr<const ElevationGrid> samples;
+  // Levels from HEIGHTFIELD_LEAF_LEVEL up to a single node, shared by
+  // copies of the shape.
+  std::shared_ptr<const std::vector<Level>> pyramid;
+  [[nodiscard]] auto vertexNormal(int x, int z) const -> Vector;
+  [[nodiscard]] auto gridRay(const Ray &ray) const -> GridRay;
+  [[nodiscard]] auto levelSize(int level) const -> std::pair<int, int>;
+  [[nodiscard]] auto topLevel() const -> int;
+  template <typename Hit>
+  auto walk(const GridRay &ray, int level, int x0, int z0, int x1, int z1,
+            Real from, Real to, Hit &hit) const -> bool;
+  template <typename Hit>
+  auto cell(const GridRay &ray, int x, int z, Hit &hit) const -> bool;
+};
+
+} // namespace RT
@@ -0,0 +1,63 @@
+#pragma once
+#include "Bounds.hpp"
+#include "Light.hpp"
+#include "Tuple.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+namespace RT {
+
+struct LightSample {
+  const Light *light;
+  Real weight;
+};
+
+// Bounding volume hierarchy over point lights. A node's importance at a
+// shading point is an upper bound on what its lights can add there: the
+// summed luminance times the largest cosine any of them can make with the
+// normal. Nodes wholly behind the surface have importance zero, which is
+// exact, since such lights only contribute ambient.
+class LightTree {
+public:
+  explicit LightTree(const std::vector<Light> &lights);
+
+  struct Node {
+    BoundingBox bounds;
+    Color intensity;
+    Real power;
+    int left;
+    int right;
+    int parent;
+    int light;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<int> leaves;
+  Color totalIntensity;
+
+  [[nodiscard]] auto lightCount() const -> size_t;
+  [[nodiscard]] auto importance(const Node &node, const Point &point,
+                                const Vector &normal) const -> Real;
+  // Gathers every light whose node importance reaches the threshold; gives
+  // up and returns false once more than limit lights qualify.
+  [[nodiscard]] auto collect(const Point &point, const Vector &normal,
+                             Real threshold, size_t limit,
+                             std::vector<size_t> &out) const -> bool;
+  // Picks one light by descending the tree in proportion to importance.
+  // Returns the light's index and the probability it was chosen with.
+  [[nodiscard]] auto sample(const Point &point, const Vector &normal,
+                            Real threshold, Real u) const
+      -> std::optional<std::pair<size_t, Real>>;
+  [[nodiscard]] auto probability(const Point &point, const Vector &normal,
+                                 Real threshold, size_t light) const -> Real;
+
+private:
+  auto build(const std::vector<Light> &lights, std::vector<int> &order,
+             size_t first, size_t last, int parent) -> int;
+};
+
+auto shadingHash(const Point &point, uint64_t index) -> uint64_t;
+auto shadingUniform(const Point &point, uint64_t index) -> Real;
+
+} // namespace RT
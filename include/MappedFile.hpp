@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <string>
+namespace RT {
+
+// Read-only memory mapping of a whole file; pages are faulted in on access.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &filename);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  auto operator=(const MappedFile &) -> MappedFile & = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  auto operator=(MappedFile &&other) noexcept -> MappedFile &;
+  [[nodiscard]] auto data() const -> const unsigned char *;
+  [[nodiscard]] auto size() const -> size_t;
+
+private:
+  const unsigned char *bytes;
+  size_t length;
+};
+
+} // namespace RT
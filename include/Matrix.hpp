@@ -6,37 +6,37 @@ namespace RT {
 
 template <size_t m> class Matrix {
 private:
-  std::array<double, m * m> data;
+  std::array<Real, m * m> data;
 
 public:
   Matrix();
-  explicit Matrix(const std::array<double, m * m> &values);
-  auto operator()(int i, int j) const -> const double &;
-  auto operator()(int i, int j) -> double &;
+  explicit Matrix(const std::array<Real, m * m> &values);
+  auto operator()(int i, int j) const -> const Real &;
+  auto operator()(int i, int j) -> Real &;
   auto operator==(const Matrix<m> &other) const -> bool;
   [[nodiscard]] auto transpose() const -> Matrix<m>;
   [[nodiscard]] auto submatrix(int row, int col) const -> Matrix<m - 1>;
-  [[nodiscard]] auto minor(int row, int col) const -> double;
-  [[nodiscard]] auto cofactor(int row, int col) const -> double;
-  [[nodiscard]] auto determinant() const -> double;
+  [[nodiscard]] auto minor(int row, int col) const -> Real;
+  [[nodiscard]] auto cofactor(int row, int col) const -> Real;
+  [[nodiscard]] auto determinant() const -> Real;
   [[nodiscard]] auto isInvertible() const -> bool;
   [[nodiscard]] auto inverse() const -> Matrix<m>;
 };
 
 using Transformation = Matrix<4>;
 
-template <size_t m> Matrix<m>::Matrix() : data(std::array<double, m * m>(0)) {}
+template <size_t m> Matrix<m>::Matrix() : data(std::array<Real, m * m>(0)) {}
 
 template <size_t m>
-Matrix<m>::Matrix(const std::array<double, m * m> &values) : data(values) {}
+Matrix<m>::Matrix(const std::array<Real, m * m> &values) : data(values) {}
 
-template <size_t m> auto Matrix<m>::operator()(int i, int j) -> double & {
+template <size_t m> auto Matrix<m>::operator()(int i, int j) -> Real & {
   assert(i >= 0 && i < m && j >= 0 && j < m && "out of bounds");
   return data.at(i * m + j);
 }
 
 template <size_t m>
-auto Matrix<m>::operator()(int i, int j) const -> const double & {
+auto Matrix<m>::operator()(int i, int j) const -> const Real & {
   assert(i >= 0 && i < m && j >= 0 && j < m && "out of bounds");
   return data.at(i * m + j);
 }
@@ -53,7 +53,7 @@ auto Matrix<m>::operator==(const Matrix<m> &other) const -> bool {
 
 template <size_t m>
 auto operator+(const Matrix<m> &a, const Matrix<m> &b) -> Matrix<m> {
-  std::array<double, m * m> v;
+  std::array<Real, m * m> v;
   for (int i = 0; i < m * m; i++) {
     v[i] = a.data[i] + b.data[i];
   }
@@ -62,7 +62,7 @@ auto operator+(const Matrix<m> &a, const Matrix<m> &b) -> Matrix<m> {
 
 template <size_t m>
 auto operator-(const Matrix<m> &a, const Matrix<m> &b) -> Matrix<m> {
-  std::array<double, m * m> v;
+  std::array<Real, m * m> v;
   for (int i = 0; i < m * m; i++) {
     v[i] = a.data[i] - b.data[i];
   }
@@ -71,10 +71,10 @@ auto operator-(const Matrix<m> &a, const Matrix<m> &b) -> Matrix<m> {
 
 template <size_t m>
 auto operator*(const Matrix<m> &a, const Matrix<m> &b) -> Matrix<m> {
-  std::array<double, m * m> v{};
+  std::array<Real, m * m> v{};
   for (int i = 0; i < m; i++) {
     for (int j = 0; j < m; j++) {
-      double sum = 0;
+      Real sum = 0;
       for (int k = 0; k < m; k++) {
         sum += a(i, k) * b(k, j);
       }
@@ -86,9 +86,9 @@ auto operator*(const Matrix<m> &a, const Matrix<m> &b) -> Matrix<m> {
 
 template <size_t m>
 auto operator*(const Matrix<m> &a, const Tuple &b) -> Tuple {
-  std::array<double, 4> v{0, 0, 0, 0};
+  std::array<Real, 4> v{0, 0, 0, 0};
   for (int i = 0; i < m; i++) {
-    double sum = 0;
+    Real sum = 0;
     for (int j = 0; j < m; j++) {
       sum += a(i, j) * b(j);
     }
@@ -98,19 +98,19 @@ auto operator*(const Matrix<m> &a, const Tuple &b) -> Tuple {
 }
 
 template <size_t m> auto identityMatrix() -> Matrix<m> {
-  std::array<double, m * m> v{0};
+  std::array<Real, m * m> v{0};
   for (int i = 0; i < m; i++) {
     v.at(i * m + i) = 1;
   }
   return Matrix<m>(v);
 }
 
-template <> inline auto Matrix<2>::determinant() const -> double {
+template <> inline auto Matrix<2>::determinant() const -> Real {
   return data[0] * data[3] - data[1] * data[2];
 }
 
-template <size_t m> auto Matrix<m>::determinant() const -> double {
-  double det = 0;
+template <size_t m> auto Matrix<m>::determinant() const -> Real {
+  Real det = 0;
   for (int i = 0; i < m; i++) {
     det += data[i] * cofactor(0, i);
   }
@@ -122,8 +122,8 @@ template <size_t m> auto Matrix<m>::isInvertible() const -> bool {
 }
 
 template <size_t m> auto Matrix<m>::inverse() const -> Matrix<m> {
-  double det = determinant();
-  std::array<double, m * m> v;
+  Real det = determinant();
+  std::array<Real, m * m> v;
   for (int i = 0; i < m; i++) {
     for (int j = 0; j < m; j++) {
       v[i * m + j] = cofactor(j, i) / det;
@@ -134,7 +134,7 @@ template <size_t m> auto Matrix<m>::inverse() const -> Matrix<m> {
 
 template <size_t m>
 auto Matrix<m>::submatrix(int row, int col) const -> Matrix<m - 1> {
-  std::array<double, (m - 1) * (m - 1)> v;
+  std::array<Real, (m - 1) * (m - 1)> v;
   int k = 0;
   for (int i = 0; i < m; i++) {
     if (i == row) {
@@ -150,17 +150,17 @@ auto Matrix<m>::submatrix(int row, int col) const -> Matrix<m - 1> {
   return Matrix<m - 1>(v);
 }
 
-template <size_t m> auto Matrix<m>::minor(int row, int col) const -> double {
+template <size_t m> auto Matrix<m>::minor(int row, int col) const -> Real {
   auto sm = submatrix(row, col);
   return sm.determinant();
 }
 
-template <size_t m> auto Matrix<m>::cofactor(int row, int col) const -> double {
+template <size_t m> auto Matrix<m>::cofactor(int row, int col) const -> Real {
   return minor(row, col) * (1 - 2 * ((row + col) % 2));
 }
 
 template <size_t m> auto Matrix<m>::transpose() const -> Matrix<m> {
-  std::array<double, m * m> v;
+  std::array<Real, m * m> v;
   for (int i = 0; i < m; i++) {
     for (int j = 0; j < m; j++) {
       v[i * m + j] = data[j * m + i];
@@ -169,7 +169,20 @@ template <size_t m> auto Matrix<m>::transpose() const -> Matrix<m> {
   return Matrix<m>(v);
 }
 
-inline auto translation(double x, double y, double z) -> Transformation {
+// Exact comparison; operator== allows EPSILON.
+template <size_t m>
+auto identical(const Matrix<m> &a, const Matrix<m> &b) -> bool {
+  for (auto i = 0; i < static_cast<int>(m); i++) {
+    for (auto j = 0; j < static_cast<int>(m); j++) {
+      if (a(i, j) != b(i, j)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+inline auto translation(Real x, Real y, Real z) -> Transformation {
   auto m = identityMatrix<4>();
   m(0, 3) = x;
   m(1, 3) = y;
@@ -177,7 +190,7 @@ inline auto translation(double x, double y, double z) -> Transformation {
   return m;
 }
 
-inline auto scaling(double x, double y, double z) -> Transformation {
+inline auto scaling(Real x, Real y, Real z) -> Transformation {
   auto m = identityMatrix<4>();
   m(0, 0) = x;
   m(1, 1) = y;
@@ -185,7 +198,7 @@ inline auto scaling(double x, double y, double z) -> Transformation {
   return m;
 }
 
-inline auto rotationX(double r) -> Transformation {
+inline auto rotationX(Real r) -> Transformation {
   auto m = identityMatrix<4>();
   m(1, 1) = std::cos(r);
   m(1, 2) = -std::sin(r);
@@ -194,7 +207,7 @@ inline auto rotationX(double r) -> Transformation {
   return m;
 }
 
-inline auto rotationY(double r) -> Transformation {
+inline auto rotationY(Real r) -> Transformation {
   auto m = identityMatrix<4>();
   m(0, 0) = std::cos(r);
   m(0, 2) = std::sin(r);
@@ -203,7 +216,7 @@ inline auto rotationY(double r) -> Transformation {
   return m;
 }
 
-inline auto rotationZ(double r) -> Transformation {
+inline auto rotationZ(Real r) -> Transformation {
   auto m = identityMatrix<4>();
   m(0, 0) = std::cos(r);
   m(0, 1) = -std::sin(r);
@@ -212,8 +225,8 @@ inline auto rotationZ(double r) -> Transformation {
   return m;
 }
 
-inline auto shearing(double xy, double xz, double yx, double yz, double zx,
-                     double zy) -> Transformation {
+inline auto shearing(Real xy, Real xz, Real yx, Real yz, Real zx,
+                     Real zy) -> Transformation {
   auto m = identityMatrix<4>();
   m(0, 1) = xy;
   m(0, 2) = xz;
@@ -0,0 +1,55 @@
+#pragma once
+#include "Bounds.hpp"
+#include "Matrix.hpp"
+#include "Tuple.hpp"
+#include <cstddef>
+#include <vector>
+namespace RT {
+
+// Translation, Euler rotation (applied x, then y, then z) and scale,
+// interpolated component-wise between keyframes so rotations turn
+// instead of shearing.
+struct Pose {
+  Vector translation = vector(0, 0, 0);
+  Vector rotation = vector(0, 0, 0);
+  Vector scale = vector(1, 1, 1);
+  [[nodiscard]] auto transform() const -> Transformation;
+  // The inverse of transform(), built from the transposed rotation and
+  // reciprocal scale instead of a general 4x4 inverse.
+  [[nodiscard]] auto inverse() const -> Transformation;
+};
+
+auto lerp(const Tuple &a, const Tuple &b, Real t) -> Tuple;
+auto lerp(const Pose &a, const Pose &b, Real t) -> Pose;
+auto samePose(const Pose &a, const Pose &b) -> bool;
+
+// A shape's poses over the shutter interval. Each key caches its transform
+// and inverse; a time between keys interpolates the pose and inverts it in
+// closed form. Before the first or after the last key, that key holds.
+class Motion {
+public:
+  Motion() = default;
+  // Keys at times 0 and 1.
+  Motion(const Pose &start, const Pose &end);
+  void key(Real time, const Pose &pose);
+  [[nodiscard]] auto empty() const -> bool;
+  [[nodiscard]] auto pose(Real time) const -> Pose;
+  [[nodiscard]] auto transformAt(Real time) const -> Transformation;
+  [[nodiscard]] auto inverseAt(Real time) const -> Transformation;
+  // Bounds of box, in object space, carried along the whole motion.
+  [[nodiscard]] auto sweep(const BoundingBox &box) const -> BoundingBox;
+
+private:
+  struct Key {
+    Real time;
+    Pose pose;
+    Transformation transform;
+    Transformation inverse;
+  };
+  std::vector<Key> keys;
+  // The key at or before time, or keys.size() when time is between keys
+  // but on none; set next to the key after it.
+  [[nodiscard]] auto find(Real time, size_t &next) const -> size_t;
+};
+
+} // namespace RT
@@ -0,0 +1,21 @@
+#pragma once
+#include "Util.hpp"
+#include <cstddef>
+namespace RT {
+
+constexpr int DEFAULT_OCTAVES = 4;
+constexpr Real DEFAULT_LACUNARITY = 2;
+constexpr Real DEFAULT_GAIN = 0.5;
+
+auto perlinNoise(Real x, Real y, Real z) -> Real;
+void perlinNoise(size_t count, const Real *x, const Real *y, const Real *z,
+                 Real *out);
+void fbmNoise(size_t count, const Real *x, const Real *y, const Real *z,
+              Real *out, int octaves = DEFAULT_OCTAVES,
+              Real lacunarity = DEFAULT_LACUNARITY, Real gain = DEFAULT_GAIN);
+void turbulenceNoise(size_t count, const Real *x, const Real *y,
+                     const Real *z, Real *out, int octaves = DEFAULT_OCTAVES,
+                     Real lacunarity = DEFAULT_LACUNARITY,
+                     Real gain = DEFAULT_GAIN);
+
+} // namespace RT
@@ -0,0 +1,173 @@
+#pragma once
+#include "PerfCounters.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+namespace RT {
+
+constexpr size_t PARALLEL_GRAIN_SIZE = 256;
+
+inline auto workerCount(unsigned requested = 0) -> unsigned {
+  if (requested != 0) {
+    return requested;
+  }
+  return std::max(1U, std::thread::hardware_concurrency());
+}
+
+// Threads kept between loops, so stages that run many short ones, like the
+// wavefront renderer's, do not start and join threads for each. One job
+// runs at a time; it grows the pool to as many helpers as it asks for.
+class ThreadPool {
+public:
+  static auto shared() -> ThreadPool & {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  ThreadPool() : owner(getpid()) {}
+  ~ThreadPool() {
+    {
+      const std::scoped_lock lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+  ThreadPool(const ThreadPool &) = delete;
+  auto operator=(const ThreadPool &) -> ThreadPool & = delete;
+  ThreadPool(ThreadPool &&) = delete;
+  auto operator=(ThreadPool &&) -> ThreadPool & = delete;
+
+  // Runs task on the calling thread and on helpers pool threads, and
+  // returns once every copy has. Returns false without running it if
+  // another job holds the pool, the caller is inside a job, or the
+  // process is a child forked after the pool started.
+  auto run(size_t helpers, const std::function<void()> &task) -> bool {
+    if (insideJob() || getpid() != owner) {
+      return false;
+    }
+    std::unique_lock busy(jobMutex, std::try_to_lock);
+    if (!busy.owns_lock()) {
+      return false;
+    }
+    {
+      const std::scoped_lock lock(mutex);
+      while (threads.size() < helpers) {
+        threads.emplace_back([this] { work(); });
+      }
+      job = &task;
+      jobRegion = PerfCounters::openRegion();
+      unclaimed = helpers;
+      running = helpers;
+    }
+    wake.notify_all();
+    insideJob() = true;
+    std::exception_ptr failure;
+    try {
+      task();
+    } catch (...) {
+      failure = std::current_exception();
+    }
+    insideJob() = false;
+    std::unique_lock lock(mutex);
+    finished.wait(lock, [this] { return running == 0; });
+    job = nullptr;
+    if (failure) {
+      std::rethrow_exception(failure);
+    }
+    return true;
+  }
+
+private:
+  static auto insideJob() -> bool & {
+    thread_local bool inside = false;
+    return inside;
+  }
+
+  void work() {
+    insideJob() = true;
+    std::unique_lock lock(mutex);
+    while (true) {
+      wake.wait(lock, [this] { return stopping || unclaimed > 0; });
+      if (stopping) {
+        return;
+      }
+      unclaimed--;
+      const auto *task = job;
+      auto region = jobRegion;
+      lock.unlock();
+      {
+        const PerfShare share(region);
+        (*task)();
+      }
+      lock.lock();
+      if (--running == 0) {
+        finished.notify_one();
+      }
+    }
+  }
+
+  pid_t owner;
+  std::mutex jobMutex;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable finished;
+  std::vector<std::thread> threads;
+  const std::function<void()> *job = nullptr;
+  std::optional<PerfRegion> jobRegion;
+  size_t unclaimed = 0;
+  size_t running = 0;
+  bool stopping = false;
+};
+
+// Runs on the shared pool; a loop started while it is busy, including one
+// nested in another loop's body, starts its own threads instead.
+template <typename F>
+void parallelFor(size_t count, F &&body, unsigned threads = 0,
+                 size_t grain = PARALLEL_GRAIN_SIZE) {
+  if (count == 0) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+  auto chunks = (count + grain - 1) / grain;
+  auto workers = static_cast<size_t>(workerCount(threads));
+  workers = std::min(workers, chunks);
+  std::atomic<size_t> next{0};
+  auto run = [&]() {
+    for (auto chunk = next.fetch_add(1); chunk < chunks;
+         chunk = next.fetch_add(1)) {
+      auto end = std::min(count, (chunk + 1) * grain);
+      for (auto i = chunk * grain; i < end; i++) {
+        body(i);
+      }
+    }
+  };
+  if (workers <= 1) {
+    run();
+    return;
+  }
+  if (ThreadPool::shared().run(workers - 1, run)) {
+    return;
+  }
+  std::vector<std::thread> pool;
+  pool.reserve(workers - 1);
+  for (size_t t = 1; t < workers; t++) {
+    pool.emplace_back(run);
+  }
+  run();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+}
+
+} // namespace RT
@@ -1,15 +1,38 @@
 #pragma once
 #include "Matrix.hpp"
+#include "Noise.hpp"
+#include "Texture.hpp"
 #include "Tuple.hpp"
+#include <cstddef>
 #include <memory>
+#include <optional>
+#include <variant>
 namespace RT {
 
+class StripePattern;
+class TestPattern;
+class GradientPattern;
+class RingPattern;
+class CheckersPattern;
+class NoisePattern;
+class FbmPattern;
+class TurbulencePattern;
+class PerturbPattern;
+class ImagePattern;
+class CompiledPattern;
+
+using PatternKernel =
+    std::variant<StripePattern, TestPattern, GradientPattern, RingPattern,
+                 CheckersPattern, NoisePattern, FbmPattern, TurbulencePattern,
+                 PerturbPattern, ImagePattern>;
+
 class Pattern {
 public:
   Pattern() : transformation(identityMatrix<4>()){};
   [[nodiscard]] virtual auto patternAt(const RT::Point &p) const
       -> RT::Color = 0;
   [[nodiscard]] virtual auto clone() const -> std::unique_ptr<Pattern> = 0;
+  [[nodiscard]] virtual auto kernel() const -> std::optional<PatternKernel>;
   virtual ~Pattern() = default;
   Transformation transformation;
   Pattern(const Pattern &) = default;
@@ -18,7 +41,7 @@ public:
   auto operator=(Pattern &&) -> Pattern & = default;
 };
 
-class StripePattern : public Pattern {
+class StripePattern final : public Pattern {
 public:
   Color a;
   Color b;
@@ -26,6 +49,10 @@ public:
   StripePattern(Color a, Color b);
   [[nodiscard]] auto patternAt(const Point &p) const -> Color override;
   [[nodiscard]] auto clone() const -> std::unique_ptr<Pattern> override;
+  [[nodiscard]] auto kernel() const -> std::optional<PatternKernel> override;
+  void patternsAt(size_t count, const Real *x, const Real *y, const Real *z,
+                  Real *r, Real *g, Real *b) const;
+  [[nodiscard]] auto sameParameters(const StripePattern &other) const -> bool;
   ~StripePattern() override = default;
   StripePattern(const StripePattern &) = default;
   auto operator=(const StripePattern &) -> StripePattern & = default;
@@ -33,11 +60,15 @@ public:
   auto operator=(StripePattern &&) -> StripePattern & = default;
 };
 
-class TestPattern : public Pattern {
+class TestPattern final : public Pattern {
 public:
   TestPattern();
   [[nodiscard]] auto patternAt(const Point &p) const -> Color override;
   [[nodiscard]] auto clone() const -> std::unique_ptr<Pattern> override;
+  [[nodiscard]] auto kernel() const -> std::optional<PatternKernel> override;
+  void patternsAt(size_t count, const Real *x, const Real *y, const Real *z,
+                  Real *r, Real *g, Real *b) const;
+  [[nodiscard]] auto sameParameters(const TestPattern &other) const -> bool;
   ~TestPattern() override = default;
   TestPattern(const TestPattern &) = default;
   auto operator=(const TestPattern &) -> TestPattern & = default;
@@ -45,7 +76,7 @@ public:
   auto operator=(TestPattern &&) -> TestPattern & = default;
 };
 
-class GradientPattern : public Pattern {
+class GradientPattern final : public Pattern {
 
 public:
   Color a;
@@ -54,6 +85,10 @@ public:
   GradientPattern(Color a, Color b);
   [[nodiscard]] auto patternAt(const Point &p) const -> Color override;
   [[nodiscard]] auto clone() const -> std::unique_ptr<Pattern> override;
+  [[nodiscard]] auto kernel() const -> std::optional<PatternKernel> override;
+  void patternsAt(size_t count, const Real *x, const Real *y, const Real *z,
+                  Real *r, Real *g, Real *b) const;
+  [[nodiscard]] auto sameParameters(const GradientPattern &other) const -> bool;
   ~GradientPattern() override = default;
   GradientPattern(const GradientPattern &) = default;
   auto operator=(const GradientPattern &) -> GradientPattern & = default;
@@ -61,7 +96,7 @@ public:
   auto operator=(GradientPattern &&) -> GradientPattern & = default;
 };
 
-class RingPattern : public Pattern {
+class RingPattern final : public Pattern {
 public:
   Color a;
   Color b;
@@ -69,6 +104,10 @@ public:
   RingPattern(Color a, Color b);
   [[nodiscard]] auto patternAt(const Point &p) const -> Color override;
   [[nodiscard]] auto clone() const -> std::unique_ptr<Pattern> override;
+  [[nodiscard]] auto kernel() const -> std::optional<PatternKernel> override;
+  void patternsAt(size_t count, const Real *x, const Real *y, const Real *z,
+                  Real *r, Real *g, Real *b) const;
+  [[nodiscard]] auto sameParameters(const RingPattern &other) const -> bool;
   ~RingPattern() override = default;
   RingPattern(const RingPattern &) = default;
   auto operator=(const RingPattern &) -> RingPattern & = default;
@@ -76,7 +115,7 @@ public:
   auto operator=(RingPattern &&) -> RingPattern & = default;
 };
 
-class CheckersPattern : public Pattern {
+class CheckersPattern final : public Pattern {
 public:
   Color a;
   Color b;
@@ -84,6 +123,10 @@ public:
   CheckersPattern(Color a, Color b);
   [[nodiscard]] auto patternAt(const Point &p) const -> Color override;
   [[nodiscard]] auto clone() const -> std::unique_ptr<Pattern> override;
+  [[nodiscard]] auto kernel() const -> std::optional<PatternKernel> override;
+  void patternsAt(size_t count, const Real *x, const Real *y, const Real *z,
+                  Real *r, Real *g, Real *b) const;
+  [[nodiscard]] auto sameParameters(const CheckersPattern &other) const -> bool;
   ~CheckersPattern() override = default;
   CheckersPattern(const CheckersPattern &) = default;
   auto operator=(const CheckersPattern &) -> CheckersPattern & = default;
@@ -91,4 +134,141 @@ public:
   auto operator=(CheckersPattern &&) -> CheckersPattern & = default;
 };
 
+class NoisePattern final : public Pattern {
+public:
+  Color a;
+  Color b;
+  NoisePattern();
+  NoisePattern(Color a, Color b);
+  [[nodiscard]] auto patternAt(const Point &p) const -> Color override;
+  [[nodiscard]] auto clone() const -> std::unique_ptr<Pattern> override;
+  [[nodiscard]] auto kernel() const -> std::optional<PatternKernel> override;
+  void patternsAt(size_t count, const Real *x, const Real *y, const Real *z,
+                  Real *r, Real *g, Real *b) const;
+  [[nodiscard]] auto sameParameters(const NoisePattern &other) const -> bool;
+  ~NoisePattern() override = default;
+  NoisePattern(const NoisePattern &) = default;
+  auto operator=(const NoisePattern &) -> NoisePattern & = default;
+  NoisePattern(NoisePattern &&) = default;
+  auto operator=(NoisePattern &&) -> NoisePattern & = default;
+};
+
+class FbmPattern final : public Pattern {
+public:
+  Color a;
+  Color b;
+  int octaves;
+  Real lacunarity;
+  Real gain;
+  FbmPattern();
+  FbmPattern(Color a, Color b, int octaves = DEFAULT_OCTAVES,
+             Real lacunarity = DEFAULT_LACUNARITY, Real gain = DEFAULT_GAIN);
+  [[nodiscard]] auto patternAt(const Point &p) const -> Color override;
+  [[nodiscard]] auto clone() const -> std::unique_ptr<Pattern> override;
+  [[nodiscard]] auto kernel() const -> std::optional<PatternKernel> override;
+  void patternsAt(size_t count, const Real *x, const Real *y, const Real *z,
+                  Real *r, Real *g, Real *b) const;
+  [[nodiscard]] auto sameParameters(const FbmPattern &other) const -> bool;
+  ~FbmPattern() override = default;
+  FbmPattern(const FbmPattern &) = default;
+  auto operator=(const FbmPattern &) -> FbmPattern & = default;
+  FbmPattern(FbmPattern &&) = default;
+  auto operator=(FbmPattern &&) -> FbmPattern & = default;
+};
+
+class TurbulencePattern final : public Pattern {
+public:
+  Color a;
+  Color b;
+  int octaves;
+  Real lacunarity;
+  Real gain;
+  TurbulencePattern();
+  TurbulencePattern(Color a, Color b, int octaves = DEFAULT_OCTAVES,
+                    Real lacunarity = DEFAULT_LACUNARITY,
+                    Real gain = DEFAULT_GAIN);
+  [[nodiscard]] auto patternAt(const Point &p) const -> Color override;
+  [[nodiscard]] auto clone() const -> std::unique_ptr<Pattern> override;
+  [[nodiscard]] auto kernel() const -> std::optional<PatternKernel> override;
+  void patternsAt(size_t count, const Real *x, const Real *y, const Real *z,
+                  Real *r, Real *g, Real *b) const;
+  [[nodiscard]] auto sameParameters(const TurbulencePattern &other) const
+      -> bool;
+  ~TurbulencePattern() override = default;
+  TurbulencePattern(const TurbulencePattern &) = default;
+  auto operator=(const TurbulencePattern &) -> TurbulencePattern & = default;
+  TurbulencePattern(TurbulencePattern &&) = default;
+  auto operator=(TurbulencePattern &&) -> TurbulencePattern & = default;
+};
+
+constexpr Real DEFAULT_PERTURB_SCALE = 0.2;
+
+// Jitters the lookup point of another pattern by a noise vector field.
+class PerturbPattern final : public Pattern {
+public:
+  std::shared_ptr<Pattern> pattern;
+  Real scale;
+  explicit PerturbPattern(const Pattern &pattern,
+                          Real scale = DEFAULT_PERTURB_SCALE);
+  [[nodiscard]] auto patternAt(const Point &p) const -> Color override;
+  [[nodiscard]] auto clone() const -> std::unique_ptr<Pattern> override;
+  [[nodiscard]] auto kernel() const -> std::optional<PatternKernel> override;
+  void patternsAt(size_t count, const Real *x, const Real *y, const Real *z,
+                  Real *r, Real *g, Real *b) const;
+  [[nodiscard]] auto sameParameters(const PerturbPattern &other) const -> bool;
+  ~PerturbPattern() override = default;
+  PerturbPattern(const PerturbPattern &) = default;
+  auto operator=(const PerturbPattern &) -> PerturbPattern & = default;
+  PerturbPattern(PerturbPattern &&) = default;
+  auto operator=(PerturbPattern &&) -> PerturbPattern & = default;
+
+private:
+  std::shared_ptr<const CompiledPattern> compiled;
+};
+
+// Looks points up in an image through one of the primitive UV mappings.
+// lod picks the mip level (0 is full resolution); trilinear filtering
+// blends the two nearest levels.
+class ImagePattern final : public Pattern {
+public:
+  std::shared_ptr<const Texture> texture;
+  UVMapping mapping;
+  TextureFilter filter;
+  Real lod;
+  explicit ImagePattern(std::shared_ptr<const Texture> texture,
+                        UVMapping mapping = UVMapping::Planar,
+                        TextureFilter filter = TextureFilter::Bilinear,
+                        Real lod = 0);
+  [[nodiscard]] auto patternAt(const Point &p) const -> Color override;
+  [[nodiscard]] auto clone() const -> std::unique_ptr<Pattern> override;
+  [[nodiscard]] auto kernel() const -> std::optional<PatternKernel> override;
+  void patternsAt(size_t count, const Real *x, const Real *y, const Real *z,
+                  Real *r, Real *g, Real *b) const;
+  [[nodiscard]] auto sameParameters(const ImagePattern &other) const -> bool;
+  ~ImagePattern() override = default;
+  ImagePattern(const ImagePattern &) = default;
+  auto operator=(const ImagePattern &) -> ImagePattern & = default;
+  ImagePattern(ImagePattern &&) = default;
+  auto operator=(ImagePattern &&) -> ImagePattern & = default;
+};
+
+class CompiledPattern {
+public:
+  CompiledPattern(const Pattern &pattern,
+                  const Transformation &objectTransformation);
+  const Pattern *source;
+  Transformation objectTransformation;
+  Transformation patternTransformation;
+  Transformation worldToPattern;
+  std::optional<PatternKernel> kernel;
+  // Whether this still matches pattern on an object transformed by object:
+  // the same pattern, transformations and parameters. Pattern fields are
+  // written directly, so the parameters are compared rather than tracked.
+  [[nodiscard]] auto isCurrent(const Pattern *pattern,
+                               const Transformation &object) const -> bool;
+  [[nodiscard]] auto colorAt(const Point &worldPoint) const -> Color;
+  void colorsAt(size_t count, const Real *x, const Real *y, const Real *z,
+                Real *r, Real *g, Real *b) const;
+};
+
 } // namespace RT
@@ -0,0 +1,95 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+namespace RT {
+
+enum class PerfRegion {
+  RayGeneration,
+  Intersection,
+  Patterns,
+  Shading,
+  Shadows,
+  Encoding
+};
+
+constexpr size_t PERF_REGION_COUNT = 6;
+
+auto perfRegionName(PerfRegion region) -> const char *;
+
+struct PerfCounts {
+  uint64_t calls = 0;
+  uint64_t nanoseconds = 0;
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  uint64_t cacheMisses = 0;
+  uint64_t branchMisses = 0;
+  [[nodiscard]] auto ipc() const -> double;
+  [[nodiscard]] auto cacheMissesPerKiloInstruction() const -> double;
+  [[nodiscard]] auto branchMissesPerKiloInstruction() const -> double;
+};
+
+// Opt-in hardware counters (Linux perf_event_open) around named regions.
+// Each thread opens its own counters on first use, and they also count
+// the threads it spawns afterwards once those exit. parallelFor's pool
+// threads outlive the region, so they add their own counts to it through
+// PerfShare. When counters cannot be opened, regions still record calls
+// and wall-clock time.
+class PerfCounters {
+public:
+  static void enable();
+  static void disable();
+  [[nodiscard]] static auto enabled() -> bool;
+  // Whether hardware counters could be opened on this thread.
+  [[nodiscard]] static auto hardwareAvailable() -> bool;
+  [[nodiscard]] static auto counts(PerfRegion region) -> PerfCounts;
+  // The innermost region a PerfScope has open on this thread.
+  [[nodiscard]] static auto openRegion() -> std::optional<PerfRegion>;
+  static void reset();
+  static void report(std::ostream &out);
+
+private:
+  friend class PerfScope;
+  static std::atomic<bool> active;
+};
+
+// Adds the time and counter deltas between construction and destruction to
+// region. Costs one relaxed load when counters are disabled.
+class PerfScope {
+public:
+  explicit PerfScope(PerfRegion region);
+  ~PerfScope();
+  PerfScope(const PerfScope &) = delete;
+  auto operator=(const PerfScope &) -> PerfScope & = delete;
+  PerfScope(PerfScope &&) = delete;
+  auto operator=(PerfScope &&) -> PerfScope & = delete;
+
+private:
+  PerfRegion region;
+  bool running;
+  uint64_t start;
+  std::array<uint64_t, 4> counters{};
+  std::optional<PerfRegion> outer;
+};
+
+// Adds this thread's counter deltas between construction and destruction
+// to region, without a call or time, for work done on behalf of a PerfScope
+// open on another thread. Does nothing without a region.
+class PerfShare {
+public:
+  explicit PerfShare(std::optional<PerfRegion> region);
+  ~PerfShare();
+  PerfShare(const PerfShare &) = delete;
+  auto operator=(const PerfShare &) -> PerfShare & = delete;
+  PerfShare(PerfShare &&) = delete;
+  auto operator=(PerfShare &&) -> PerfShare & = delete;
+
+private:
+  std::optional<PerfRegion> region;
+  std::array<uint64_t, 4> counters{};
+};
+
+} // namespace RT
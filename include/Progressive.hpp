@@ -0,0 +1,79 @@
+#pragma once
+#include "Camera.hpp"
+#include "Canvas.hpp"
+#include "World.hpp"
+#include <chrono>
+#include <cstddef>
+#include <vector>
+namespace RT {
+
+constexpr int PREVIEW_BLOCK = 4;
+constexpr int DEFAULT_MAX_SAMPLES = 64;
+
+// Running sums of the samples of every pixel of an image.
+class SampleBuffer {
+public:
+  SampleBuffer(int width, int height);
+  int width;
+  int height;
+  void add(int pixelX, int pixelY, const Color &sample);
+  [[nodiscard]] auto samples(int pixelX, int pixelY) const -> int;
+  [[nodiscard]] auto mean(int pixelX, int pixelY) const -> Color;
+  // Squared standard error of the pixel's mean luminance; with a single
+  // sample, the squared largest luminance step to a neighbouring pixel.
+  [[nodiscard]] auto error(int pixelX, int pixelY) const -> Real;
+  // Pixel means; a pixel without samples shows the top left pixel of its
+  // PREVIEW_BLOCK square.
+  [[nodiscard]] auto image() const -> Canvas;
+
+private:
+  struct Pixel {
+    Real red = 0;
+    Real green = 0;
+    Real blue = 0;
+    Real luminance = 0;
+    Real luminanceSquares = 0;
+    int count = 0;
+  };
+  std::vector<Pixel> pixels;
+  [[nodiscard]] auto at(int pixelX, int pixelY) const -> const Pixel &;
+};
+
+struct ProgressiveOptions {
+  unsigned threads = 0;
+  int maxSamples = DEFAULT_MAX_SAMPLES;
+  // Share of the pixels, those with the largest error, given one more
+  // sample by each refinement pass.
+  Real refineFraction = 0.25;
+  // Pixels whose standard error is below this are left alone; the default
+  // is half a step of an 8 bit channel.
+  Real tolerance = Real{1} / 512;
+};
+
+struct ProgressiveReport {
+  Real samplesPerPixel = 0;
+  int minSamples = 0;
+  int maxSamples = 0;
+  int passes = 0;
+  // Whether refinement ran out of pixels to refine before the deadline.
+  bool converged = false;
+  std::chrono::steady_clock::duration elapsed{};
+};
+
+struct ProgressiveResult {
+  Canvas image;
+  ProgressiveReport report;
+};
+
+// Renders for about budget and returns the best image so far. A preview
+// pass traces one pixel per PREVIEW_BLOCK square and always finishes, so
+// the image is complete even if the budget is too short for it. The next
+// pass gives every pixel its first sample row by row, and later passes
+// add anti-aliasing, lens and shutter samples where the error is largest.
+// The deadline is checked before every pixel.
+[[nodiscard]] auto renderProgressive(const Camera &camera, const World &world,
+                                     std::chrono::steady_clock::duration budget,
+                                     const ProgressiveOptions &options = {})
+    -> ProgressiveResult;
+
+} // namespace RT
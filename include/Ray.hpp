@@ -8,10 +8,13 @@ class Ray {
 public:
   Point origin;
   Vector direction;
+  // When in the shutter interval the ray is cast; moving shapes are posed
+  // at this time.
+  Real time = 0;
 
   Ray();
-  Ray(Tuple origin, Tuple direction);
-  [[nodiscard]] auto position(double t) const -> Point;
+  Ray(Tuple origin, Tuple direction, Real time = 0);
+  [[nodiscard]] auto position(Real t) const -> Point;
   [[nodiscard]] auto transform(const Transformation &m) const -> Ray;
 };
 
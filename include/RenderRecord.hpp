@@ -0,0 +1,77 @@
+#pragma once
+#include "Bounds.hpp"
+#include "Light.hpp"
+#include "Matrix.hpp"
+#include "Ray.hpp"
+#include "Sampler.hpp"
+#include "Tuple.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+namespace RT {
+
+constexpr int TRACE_GRID_SIZE = 16;
+constexpr int DEFAULT_TRACE_TILE_SIZE = 16;
+
+// A coarse voxel grid over the finite part of a scene. Rays are marked
+// into a per-tile bitset of the cells they cross, and an edit's bounds
+// are tested against it with a one cell margin, so rounding in either
+// walk can only make the test more conservative.
+class TraceGrid {
+public:
+  TraceGrid() = default;
+  explicit TraceGrid(const BoundingBox &box);
+  BoundingBox box;
+  [[nodiscard]] auto words() const -> size_t;
+  [[nodiscard]] auto covers(const BoundingBox &bounds) const -> bool;
+  // Marks the cells crossed by ray between parameters from and to, which
+  // may be infinite.
+  void mark(std::vector<uint64_t> &cells, const Ray &ray, Real from,
+            Real to) const;
+  [[nodiscard]] auto overlaps(const std::vector<uint64_t> &cells,
+                              const BoundingBox &bounds) const -> bool;
+
+private:
+  [[nodiscard]] auto cell(Real value, int axis) const -> int;
+  Vector size = vector(0, 0, 0);
+};
+
+struct TileTrace {
+  std::vector<uint64_t> cells;
+  // Indices of the objects whose material a ray of the tile depended on,
+  // sorted.
+  std::vector<size_t> objects;
+};
+
+// World reports to the recorder set on the current thread, if any.
+struct TraceRecorder {
+  const TraceGrid *grid;
+  TileTrace *tile;
+  void line(const Ray &ray, Real from, Real to) const;
+  void touched(size_t object) const;
+};
+
+extern thread_local const TraceRecorder *traceRecorder;
+
+// What Camera::render(world, record) traced, tile by tile, so that
+// Camera::update can retrace only the tiles later edits can change.
+struct RenderRecord {
+  int tileSize = DEFAULT_TRACE_TILE_SIZE;
+  int width = 0;
+  int height = 0;
+  const void *world = nullptr;
+  size_t edits = 0;
+  Transformation camera = identityMatrix<4>();
+  Real aperture = 0;
+  Real focalDistance = 0;
+  Real shutterOpen = 0;
+  Real shutterClose = 0;
+  int lensSamples = 0;
+  SampleSequence sampling = SampleSequence::Sobol;
+  std::vector<Light> lights;
+  TraceGrid grid;
+  std::vector<TileTrace> tiles;
+  [[nodiscard]] auto tileColumns() const -> int;
+};
+
+} // namespace RT
@@ -0,0 +1,154 @@
+#pragma once
+#include "Bounds.hpp"
+#include "Ray.hpp"
+#include "Shape.hpp"
+#include "Tuple.hpp"
+#include "Util.hpp"
+#include <memory>
+#include <optional>
+#include <vector>
+namespace RT {
+
+// A node of a signed distance function tree. distance is negative inside
+// and bounds the distance to the surface from below; lipschitz bounds how
+// fast it changes, so a ray can advance distance / lipschitz without
+// crossing the surface. bounds must be finite.
+class SDFNode {
+public:
+  SDFNode() = default;
+  SDFNode(const SDFNode &) = default;
+  auto operator=(const SDFNode &) -> SDFNode & = default;
+  SDFNode(SDFNode &&) = default;
+  auto operator=(SDFNode &&) -> SDFNode & = default;
+  virtual ~SDFNode() = default;
+  [[nodiscard]] virtual auto distance(const Point &p) const -> Real = 0;
+  [[nodiscard]] virtual auto bounds() const -> BoundingBox = 0;
+  [[nodiscard]] virtual auto lipschitz() const -> Real;
+  // The analytic gradient at p, or nullopt to use central differences.
+  [[nodiscard]] virtual auto gradient(const Point &p) const
+      -> std::optional<Vector>;
+};
+
+using SDF = std::shared_ptr<const SDFNode>;
+
+class SDFSphere final : public SDFNode {
+public:
+  explicit SDFSphere(Real radius = 1);
+  Real radius;
+  [[nodiscard]] auto distance(const Point &p) const -> Real override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  [[nodiscard]] auto gradient(const Point &p) const
+      -> std::optional<Vector> override;
+};
+
+// A box with the given half extents, its edges rounded by radius.
+class SDFBox final : public SDFNode {
+public:
+  explicit SDFBox(Vector halfExtents, Real radius = 0);
+  Vector halfExtents;
+  Real radius;
+  [[nodiscard]] auto distance(const Point &p) const -> Real override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+};
+
+// A torus around the y axis.
+class SDFTorus final : public SDFNode {
+public:
+  SDFTorus(Real majorRadius, Real minorRadius);
+  Real majorRadius;
+  Real minorRadius;
+  [[nodiscard]] auto distance(const Point &p) const -> Real override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  [[nodiscard]] auto gradient(const Point &p) const
+      -> std::optional<Vector> override;
+};
+
+// The distance estimator of a Mandelbulb of the given power. It is only
+// approximately 1-Lipschitz, so the bound can be raised for finer detail.
+class SDFMandelbulb final : public SDFNode {
+public:
+  explicit SDFMandelbulb(Real power = 8, int iterations = 8,
+                         Real lipschitzBound = 1);
+  Real power;
+  int iterations;
+  Real lipschitzBound;
+  [[nodiscard]] auto distance(const Point &p) const -> Real override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  [[nodiscard]] auto lipschitz() const -> Real override;
+};
+
+enum class SDFOperation { Union, Intersection, Difference };
+
+class SDFCombine final : public SDFNode {
+public:
+  SDFCombine(SDFOperation operation, SDF a, SDF b);
+  SDFOperation operation;
+  SDF a;
+  SDF b;
+  [[nodiscard]] auto distance(const Point &p) const -> Real override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  [[nodiscard]] auto lipschitz() const -> Real override;
+  [[nodiscard]] auto gradient(const Point &p) const
+      -> std::optional<Vector> override;
+};
+
+// A union whose seam is blended over a distance of about smoothness.
+class SDFSmoothUnion final : public SDFNode {
+public:
+  SDFSmoothUnion(SDF a, SDF b, Real smoothness);
+  SDF a;
+  SDF b;
+  Real smoothness;
+  [[nodiscard]] auto distance(const Point &p) const -> Real override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  [[nodiscard]] auto lipschitz() const -> Real override;
+};
+
+// Moves and uniformly scales a child; non-uniform scaling belongs in the
+// shape's transformation, which the tracer accounts for.
+class SDFTransform final : public SDFNode {
+public:
+  SDFTransform(SDF child, Vector offset, Real scale = 1);
+  SDF child;
+  Vector offset;
+  Real scale;
+  [[nodiscard]] auto distance(const Point &p) const -> Real override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  [[nodiscard]] auto lipschitz() const -> Real override;
+  [[nodiscard]] auto gradient(const Point &p) const
+      -> std::optional<Vector> override;
+
+private:
+  [[nodiscard]] auto local(const Point &p) const -> Point;
+};
+
+constexpr int DEFAULT_SDF_STEPS = 256;
+
+// Sphere traces an SDF tree inside its bounds. Every surface crossing on
+// the ray's line is reported, entries and exits alike, so refraction and
+// CSG see closed solids; a ray that runs out of steps reports the
+// crossings found so far.
+class SDFShape final : public Shape {
+public:
+  explicit SDFShape(SDF sdf, int maxSteps = DEFAULT_SDF_STEPS,
+                    Real tolerance = EPSILON / 10);
+  SDF sdf;
+  int maxSteps;
+  Real tolerance;
+  [[nodiscard]] auto localNormalAt(const Point &point) const -> Vector override;
+  [[nodiscard]] auto localIntersect(const Ray &ray) const
+      -> std::vector<Intersection> override;
+  void intersectInto(const Ray &ray,
+                     std::vector<Intersection> &xs) const override;
+  [[nodiscard]] auto occludes(const Ray &ray, Real distance,
+                              std::vector<Intersection> &scratch) const
+      -> bool override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  // Appends the crossings of ray with parameters in [from, to] to xs,
+  // stopping after the first one when firstOnly is set, and returns the
+  // number of distance evaluations used.
+  auto march(const Ray &ray, Real from, Real to, std::vector<Intersection> &xs,
+             bool firstOnly = false) const -> int;
+};
+
+} // namespace RT
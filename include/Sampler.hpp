@@ -0,0 +1,65 @@
+#pragma once
+#include "Util.hpp"
+#include <array>
+#include <cstdint>
+#include <utility>
+namespace RT {
+
+// Every random number is a pure function of what it is for: the pixel,
+// the sample index and the dimension. No generator state is shared, so
+// images do not depend on tile order or thread count.
+
+constexpr int BLUE_NOISE_SIZE = 32;
+
+// SplitMix64's finalizer.
+auto hashMix(uint64_t h) -> uint64_t;
+// Maps 32 or 64 random bits to [0, 1).
+auto toUniform(uint32_t bits) -> Real;
+auto toUniform(uint64_t bits) -> Real;
+// Philox4x32-10 of Salmon et al., a counter-based generator: each counter
+// gives four independent 32 bit outputs under a key.
+auto philox(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key)
+    -> std::array<uint32_t, 4>;
+
+auto reverseBits(uint32_t bits) -> uint32_t;
+// The first two dimensions of the Sobol sequence, as 32 bit fractions.
+auto sobol(uint32_t index, unsigned dimension) -> uint32_t;
+// Burley's hash-based nested uniform (Owen) scramble; it keeps the
+// stratification of Sobol points over power-of-two prefixes.
+auto owenScramble(uint32_t bits, uint32_t seed) -> uint32_t;
+// A BLUE_NOISE_SIZE square void-and-cluster threshold mask, tiled over
+// the plane: neighbouring values differ as much as possible.
+auto blueNoise(int x, int y) -> Real;
+
+enum class SampleSequence {
+  // Independent uniforms from philox.
+  Random,
+  // Sobol points Owen-scrambled per pixel.
+  Sobol,
+  // The same scrambled Sobol points in every pixel, shifted per pixel by
+  // blue noise, so that error at low sample counts looks like blue noise.
+  BlueNoise
+};
+
+// The samples of one pixel. Each dimension is its own 2D pattern, padded
+// with an independent scramble, so adding a dimension never disturbs
+// another.
+class PixelSampler {
+public:
+  PixelSampler(int pixelX, int pixelY,
+               SampleSequence sequence = SampleSequence::Sobol,
+               uint32_t seed = 0);
+  [[nodiscard]] auto get2D(uint32_t sample, uint32_t dimension) const
+      -> std::pair<Real, Real>;
+  [[nodiscard]] auto get1D(uint32_t sample, uint32_t dimension) const
+      -> Real;
+
+private:
+  int pixelX;
+  int pixelY;
+  SampleSequence sequence;
+  uint32_t seed;
+  uint64_t pixelSeed;
+};
+
+} // namespace RT
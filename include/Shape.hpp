@@ -1,6 +1,8 @@
 #pragma once
+#include "Bounds.hpp"
 #include "Light.hpp"
 #include "Matrix.hpp"
+#include "Motion.hpp"
 #include "Pattern.hpp"
 #include "Ray.hpp"
 #include "Tuple.hpp"
@@ -16,20 +18,20 @@ namespace RT {
 class Material {
 public:
   Material();
-  Material(Color color, double ambient, double diffuse, double specular,
-           double shininess, double reflective, double transparency,
-           double refractiveIndex);
+  Material(Color color, Real ambient, Real diffuse, Real specular,
+           Real shininess, Real reflective, Real transparency,
+           Real refractiveIndex);
   Material(const Material &m);
   ~Material() = default;                     // Add destructor
   Material(Material &&m) noexcept = default; // Add move constructor
   Color color;
-  double ambient;
-  double diffuse;
-  double specular;
-  double shininess;
-  double reflective;
-  double transparency;
-  double refractiveIndex;
+  Real ambient;
+  Real diffuse;
+  Real specular;
+  Real shininess;
+  Real reflective;
+  Real transparency;
+  Real refractiveIndex;
   std::unique_ptr<Pattern> pattern;
   auto operator==(const Material &m) const -> bool;
   auto operator!=(const Material &m) const -> bool;
@@ -37,6 +39,10 @@ public:
   auto operator=(Material &&m) noexcept -> Material &;
 };
 
+class Shape;
+
+using Intersection = std::pair<Real, const Shape *>;
+
 class Shape {
 public:
   Shape() : transformation(identityMatrix<4>()){};
@@ -48,21 +54,45 @@ public:
   auto operator=(Shape &&other) noexcept -> Shape & = default;
   Transformation transformation;
   Material material;
+  // When set, the pose at a ray's time replaces transformation. Only
+  // objects added to a World move; CSG children keep their transformation.
+  std::shared_ptr<const Motion> motion;
+  // The CSG shape this one is a child of, if any.
+  const Shape *parent = nullptr;
+  // transformation, or the pose at time, composed with those of every
+  // parent.
+  [[nodiscard]] auto worldTransformation(Real time = 0) const
+      -> Transformation;
   [[nodiscard]] auto lighting(const Light &light, const Point &point,
                               const Vector &eye, const Vector &normal,
                               bool inShadow = false) const -> Tuple;
-  [[nodiscard]] auto patternAt(const Point &point) const -> Color;
+  [[nodiscard]] auto lighting(const Color &surface, const Light &light,
+                              const Point &point, const Vector &eye,
+                              const Vector &normal, bool inShadow = false) const
+      -> Tuple;
+  [[nodiscard]] auto patternAt(const Point &point, Real time = 0) const
+      -> Color;
   [[nodiscard]] virtual auto localNormalAt(const Point &point) const
       -> Vector = 0;
-  [[nodiscard]] auto normalAt(const Point &point) const -> Vector;
+  [[nodiscard]] auto normalAt(const Point &point, Real time = 0) const
+      -> Vector;
   [[nodiscard]] virtual auto localIntersect(const Ray &ray) const
-      -> std::vector<std::pair<double, const Shape *>> = 0;
+      -> std::vector<std::pair<Real, const Shape *>> = 0;
   [[nodiscard]] auto intersect(const Ray &ray) const
-      -> std::vector<std::pair<double, const Shape *>>;
+      -> std::vector<std::pair<Real, const Shape *>>;
+  // Appends the object space hits of ray to xs.
+  virtual void intersectInto(const Ray &ray,
+                             std::vector<Intersection> &xs) const;
+  // Whether ray, in object space, hits the shape at some 0 <= t < distance.
+  // scratch is overwritten so callers can reuse it between queries.
+  [[nodiscard]] virtual auto occludes(const Ray &ray, Real distance,
+                                      std::vector<Intersection> &scratch) const
+      -> bool;
+  [[nodiscard]] virtual auto bounds() const -> BoundingBox;
   virtual ~Shape() = default;
 };
 
-class Sphere : public Shape {
+class Sphere final : public Shape {
 public:
   Sphere() = default;
   Sphere(const Transformation &transformation, const Material &material)
@@ -73,11 +103,14 @@ public:
   auto operator=(Sphere &&other) noexcept -> Sphere & = default;
   [[nodiscard]] auto localNormalAt(const Point &point) const -> Vector override;
   [[nodiscard]] auto localIntersect(const Ray &ray) const
-      -> std::vector<std::pair<double, const Shape *>> override;
+      -> std::vector<std::pair<Real, const Shape *>> override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  void intersectInto(const Ray &ray,
+                     std::vector<Intersection> &xs) const override;
   ~Sphere() override = default;
 };
 
-class Plane : public Shape {
+class Plane final : public Shape {
 public:
   Plane() = default;
   Plane(const Transformation &transformation, const Material &material)
@@ -88,11 +121,14 @@ public:
   auto operator=(Plane &&other) noexcept -> Plane & = default;
   [[nodiscard]] auto localNormalAt(const Point &point) const -> Vector override;
   [[nodiscard]] auto localIntersect(const Ray &ray) const
-      -> std::vector<std::pair<double, const Shape *>> override;
+      -> std::vector<std::pair<Real, const Shape *>> override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  void intersectInto(const Ray &ray,
+                     std::vector<Intersection> &xs) const override;
   ~Plane() override = default;
 };
 
-class Cube : public Shape {
+class Cube final : public Shape {
 public:
   Cube() = default;
   Cube(const Transformation &transformation, const Material &material)
@@ -103,18 +139,21 @@ public:
   auto operator=(Cube &&other) noexcept -> Cube & = default;
   [[nodiscard]] auto localNormalAt(const Point &point) const -> Vector override;
   [[nodiscard]] auto localIntersect(const Ray &ray) const
-      -> std::vector<std::pair<double, const Shape *>> override;
+      -> std::vector<std::pair<Real, const Shape *>> override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  void intersectInto(const Ray &ray,
+                     std::vector<Intersection> &xs) const override;
   ~Cube() override = default;
 };
 
-class Cylinder : public Shape {
+class Cylinder final : public Shape {
 public:
   Cylinder()
-      : minimum(-std::numeric_limits<double>::infinity()),
-        maximum(std::numeric_limits<double>::infinity()), closed(false){};
+      : minimum(-std::numeric_limits<Real>::infinity()),
+        maximum(std::numeric_limits<Real>::infinity()), closed(false){};
   Cylinder(const Transformation &transformation, const Material &material,
-           double min = -std::numeric_limits<double>::infinity(),
-           double max = std::numeric_limits<double>::infinity(),
+           Real min = -std::numeric_limits<Real>::infinity(),
+           Real max = std::numeric_limits<Real>::infinity(),
            bool closed = false)
       : Shape(transformation, material), minimum(min), maximum(max),
         closed(closed){};
@@ -122,27 +161,29 @@ public:
   auto operator=(const Cylinder &other) -> Cylinder & = default;
   Cylinder(Cylinder &&other) noexcept = default;
   auto operator=(Cylinder &&other) noexcept -> Cylinder & = default;
-  double minimum;
-  double maximum;
+  Real minimum;
+  Real maximum;
   bool closed;
   [[nodiscard]] auto localNormalAt(const Point &point) const -> Vector override;
   [[nodiscard]] auto localIntersect(const Ray &ray) const
-      -> std::vector<std::pair<double, const Shape *>> override;
+      -> std::vector<std::pair<Real, const Shape *>> override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  void intersectInto(const Ray &ray,
+                     std::vector<Intersection> &xs) const override;
   ~Cylinder() override = default;
 
 private:
-  [[nodiscard]] auto intersectCaps(const Ray &ray) const
-      -> std::vector<std::pair<double, const Shape *>>;
+  void intersectCaps(const Ray &ray, std::vector<Intersection> &xs) const;
 };
 
-class Cone : public Shape {
+class Cone final : public Shape {
 public:
   Cone()
-      : minimum(-std::numeric_limits<double>::infinity()),
-        maximum(std::numeric_limits<double>::infinity()), closed(false){};
+      : minimum(-std::numeric_limits<Real>::infinity()),
+        maximum(std::numeric_limits<Real>::infinity()), closed(false){};
   Cone(const Transformation &transformation, const Material &material,
-       double min = -std::numeric_limits<double>::infinity(),
-       double max = std::numeric_limits<double>::infinity(),
+       Real min = -std::numeric_limits<Real>::infinity(),
+       Real max = std::numeric_limits<Real>::infinity(),
        bool closed = false)
       : Shape(transformation, material), minimum(min), maximum(max),
         closed(closed){};
@@ -150,28 +191,73 @@ public:
   auto operator=(const Cone &other) -> Cone & = default;
   Cone(Cone &&other) noexcept = default;
   auto operator=(Cone &&other) noexcept -> Cone & = default;
-  double minimum;
-  double maximum;
+  Real minimum;
+  Real maximum;
   bool closed;
   [[nodiscard]] auto localNormalAt(const Point &point) const -> Vector override;
   [[nodiscard]] auto localIntersect(const Ray &ray) const
-      -> std::vector<std::pair<double, const Shape *>> override;
+      -> std::vector<std::pair<Real, const Shape *>> override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  void intersectInto(const Ray &ray,
+                     std::vector<Intersection> &xs) const override;
 
   ~Cone() override = default;
 
 private:
-  [[nodiscard]] auto intersectCaps(const Ray &ray) const
-      -> std::vector<std::pair<double, const Shape *>>;
+  void intersectCaps(const Ray &ray, std::vector<Intersection> &xs) const;
 };
 
-using Intersection = std::pair<double, const Shape *>;
+enum class CSGOperation { Union, Intersection, Difference };
+
+// Constructive solid geometry over two shapes, either of which may be a CSG
+// shape itself. Hits point at the leaf that was hit, whose parent links
+// lead back here for its normal and pattern. The children's inverses and
+// bounds are cached when they are combined; call refit after moving one.
+class CSG : public Shape {
+public:
+  CSG(CSGOperation operation, std::unique_ptr<Shape> left,
+      std::unique_ptr<Shape> right);
+  CSG(const CSG &other) = delete;
+  auto operator=(const CSG &other) -> CSG & = delete;
+  CSG(CSG &&other) noexcept;
+  auto operator=(CSG &&other) noexcept -> CSG &;
+  CSGOperation operation;
+  [[nodiscard]] auto left() const -> const Shape &;
+  [[nodiscard]] auto right() const -> const Shape &;
+  void refit();
+  [[nodiscard]] static auto intersectionAllowed(CSGOperation operation,
+                                                bool leftHit, bool insideLeft,
+                                                bool insideRight) -> bool;
+  [[nodiscard]] auto localNormalAt(const Point &point) const -> Vector override;
+  [[nodiscard]] auto localIntersect(const Ray &ray) const
+      -> std::vector<std::pair<Real, const Shape *>> override;
+  void intersectInto(const Ray &ray,
+                     std::vector<Intersection> &xs) const override;
+  [[nodiscard]] auto occludes(const Ray &ray, Real distance,
+                              std::vector<Intersection> &scratch) const
+      -> bool override;
+  [[nodiscard]] auto bounds() const -> BoundingBox override;
+  ~CSG() override = default;
+
+private:
+  std::unique_ptr<Shape> leftShape;
+  std::unique_ptr<Shape> rightShape;
+  Transformation leftInverse = identityMatrix<4>();
+  Transformation rightInverse = identityMatrix<4>();
+  BoundingBox leftBounds;
+  BoundingBox rightBounds;
+  [[nodiscard]] auto childHits(const Ray &ray,
+                               std::vector<Intersection> &xs) const
+      -> std::optional<size_t>;
+};
 
 class Computations {
 public:
   Computations(const Intersection &i, const Ray &r,
                const std::vector<Intersection> &xs = {});
-  double t;
-  double n1, n2;
+  Real t;
+  Real time;
+  Real n1, n2;
   const Shape *object;
   Point point;
   Point overPoint;
@@ -179,7 +265,7 @@ public:
   Vector eye;
   Vector normal;
   Vector reflect;
-  [[nodiscard]] auto schlick() const -> double;
+  [[nodiscard]] auto schlick() const -> Real;
   bool inside;
 };
 
@@ -188,12 +274,50 @@ auto intersections(Intersections... is) -> std::vector<Intersection> {
   return std::vector<Intersection>{is...};
 }
 
-constexpr double REFRACTIVE_INDEX_FOR_GLASS = 1.5;
+constexpr Real REFRACTIVE_INDEX_FOR_GLASS = 1.5;
 
 auto hit(const std::vector<Intersection> &xs) -> std::optional<Intersection>;
 
+template <typename T> class ShapeArray {
+public:
+  std::vector<T> shapes;
+  std::vector<Transformation> inverses;
+  std::vector<std::optional<CompiledPattern>> patterns;
+  BoundsArray bounds;
+  void push(T shape);
+  // Recomputes the cached inverse, pattern and bounds of shape i after its
+  // transformation or material changed.
+  void refit(size_t i);
+  // Moves the last shape into slot i and drops the last slot, so only that
+  // shape changes index.
+  void remove(size_t i);
+  [[nodiscard]] auto indexOf(const Shape *shape) const -> std::optional<size_t>;
+  [[nodiscard]] auto size() const -> size_t;
+  // ray in the object space of shape i, posed at the ray's time if the
+  // shape moves.
+  [[nodiscard]] auto toObject(size_t i, const Ray &ray) const -> Ray;
+  void intersect(const Ray &ray, std::vector<Intersection> &xs) const;
+  void intersectOne(size_t i, const Ray &ray,
+                    std::vector<Intersection> &xs) const;
+  [[nodiscard]] auto occludesOne(size_t i, const Ray &ray, Real distance,
+                                 std::vector<Intersection> &scratch) const
+      -> bool;
+  // The first shape found with a hit at 0 <= t < distance, not necessarily
+  // the nearest.
+  [[nodiscard]] auto occluder(const Ray &ray, Real distance,
+                              std::vector<Intersection> &scratch) const
+      -> std::optional<size_t>;
+};
+
+extern template class ShapeArray<Sphere>;
+extern template class ShapeArray<Plane>;
+extern template class ShapeArray<Cube>;
+extern template class ShapeArray<Cylinder>;
+extern template class ShapeArray<Cone>;
+extern template class ShapeArray<std::unique_ptr<Shape>>;
+
 auto glassSphere(Transformation transform = identityMatrix<4>(),
-                 double transparency = 1.0,
-                 double refractiveIndex = REFRACTIVE_INDEX_FOR_GLASS) -> Sphere;
+                 Real transparency = 1.0,
+                 Real refractiveIndex = REFRACTIVE_INDEX_FOR_GLASS) -> Sphere;
 
 } // namespace RT
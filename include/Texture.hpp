@@ -0,0 +1,148 @@
+#pragma once
+#include "MappedFile.hpp"
+#include "Tuple.hpp"
+#include "Util.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+namespace RT {
+
+struct UV {
+  Real u;
+  Real v;
+};
+
+enum class UVMapping { Planar, Spherical, Cylindrical, Cubic };
+
+// Face order is also the order of the faces in a cubic texture strip.
+enum class CubeFace { Left, Front, Right, Back, Up, Down };
+
+auto planarMap(const Point &p) -> UV;
+auto sphericalMap(const Point &p) -> UV;
+auto cylindricalMap(const Point &p) -> UV;
+auto cubeFace(const Point &p) -> CubeFace;
+auto cubeFaceMap(CubeFace face, const Point &p) -> UV;
+// Maps onto a horizontal strip of six square faces in CubeFace order.
+auto cubicMap(const Point &p) -> UV;
+auto uvMap(UVMapping mapping, const Point &p) -> UV;
+
+constexpr int TEXTURE_TILE_SIZE = 32;
+constexpr size_t DEFAULT_TEXTURE_CACHE_BYTES = size_t{256} << 20;
+constexpr size_t TEXTURE_TILE_HANDLES = 64;
+
+struct TextureTile {
+  std::vector<float> rgb;
+  // The cache's clock when a thread last used the tile through its own
+  // handles, which bypass the cache's recency list.
+  mutable std::atomic<uint64_t> used{0};
+};
+
+// Decoded texture tiles shared by every texture, bounded by bytes resident
+// and evicted least recently used first. Each thread also keeps weak handles
+// to the last TEXTURE_TILE_HANDLES tiles it used, so most texel fetches skip
+// the lock; those uses are stamped on the tile by touch, and eviction moves
+// a tile used since it was last ordered to the front instead of dropping
+// it. Hits and misses count the lookups that reach the cache.
+class TextureCache {
+public:
+  explicit TextureCache(size_t capacity = DEFAULT_TEXTURE_CACHE_BYTES);
+  static auto shared() -> std::shared_ptr<TextureCache>;
+
+  struct Key {
+    uint64_t texture;
+    int level;
+    int x;
+    int y;
+    auto operator==(const Key &other) const -> bool = default;
+  };
+  struct KeyHash {
+    auto operator()(const Key &key) const -> size_t;
+  };
+
+  [[nodiscard]] auto find(const Key &key)
+      -> std::shared_ptr<const TextureTile>;
+  void insert(const Key &key, std::shared_ptr<const TextureTile> tile);
+  // Records a use of tile that did not go through find.
+  void touch(const TextureTile &tile) const;
+  void erase(uint64_t texture);
+  void setCapacity(size_t bytes);
+  [[nodiscard]] auto capacity() const -> size_t;
+  [[nodiscard]] auto resident() const -> size_t;
+  [[nodiscard]] auto hits() const -> size_t;
+  [[nodiscard]] auto misses() const -> size_t;
+
+private:
+  struct Entry {
+    Key key;
+    std::shared_ptr<const TextureTile> tile;
+    // The clock when the entry was last moved to the front.
+    uint64_t stamp;
+  };
+  void evict();
+  mutable std::mutex mutex;
+  std::list<Entry> entries;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+  size_t limit;
+  size_t bytes = 0;
+  size_t hitCount = 0;
+  size_t missCount = 0;
+  // Advanced by every find and insert; only written under the mutex.
+  std::atomic<uint64_t> clock{0};
+};
+
+enum class TextureFilter { Nearest, Bilinear, Trilinear };
+
+// A mip-mapped image read lazily from a PPM or PFM file. Binary files are
+// memory mapped and only decoded a tile at a time; each mip level is built
+// from the level below on first use and then lives in the tile cache.
+class Texture {
+public:
+  static auto load(const std::string &filename,
+                   std::shared_ptr<TextureCache> cache = TextureCache::shared())
+      -> std::shared_ptr<const Texture>;
+  ~Texture();
+  Texture(const Texture &) = delete;
+  auto operator=(const Texture &) -> Texture & = delete;
+  Texture(Texture &&) = delete;
+  auto operator=(Texture &&) -> Texture & = delete;
+
+  int width;
+  int height;
+  [[nodiscard]] auto levels() const -> int;
+  [[nodiscard]] auto levelWidth(int level) const -> int;
+  [[nodiscard]] auto levelHeight(int level) const -> int;
+  [[nodiscard]] auto texel(int level, int x, int y) const -> Color;
+  [[nodiscard]] auto sample(const UV &uv, Real lod = 0,
+                            TextureFilter filter = TextureFilter::Bilinear) const
+      -> Color;
+
+private:
+  enum class Format { Bytes8, Bytes16, Float32, Decoded };
+  Texture(const std::string &filename, std::shared_ptr<TextureCache> cache);
+  [[nodiscard]] auto tile(int level, int x, int y) const
+      -> std::shared_ptr<const TextureTile>;
+  [[nodiscard]] auto buildTile(int level, int x, int y) const
+      -> std::shared_ptr<const TextureTile>;
+  [[nodiscard]] auto sourceTexel(int x, int y) const -> std::array<float, 3>;
+  [[nodiscard]] auto bilinear(int level, Real u, Real v) const -> Color;
+  std::shared_ptr<TextureCache> cache;
+  uint64_t id;
+  std::optional<MappedFile> file;
+  std::vector<float> decoded;
+  Format format = Format::Decoded;
+  size_t offset = 0;
+  int channels = 3;
+  float maxValue = 1;
+  bool littleEndian = true;
+  bool bottomUp = false;
+};
+
+} // namespace RT
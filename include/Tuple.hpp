@@ -7,43 +7,49 @@
 namespace RT {
 class Tuple {
 private:
-  std::array<double, 4> data;
+  std::array<Real, 4> data;
 
 public:
   Tuple();
   Tuple(const Tuple &t);
   Tuple(Tuple &&t) noexcept;
-  Tuple(double x, double y, double z, double w);
-  double &x, &y, &z, &w;
-  double &red, &green, &blue;
+  Tuple(Real x, Real y, Real z, Real w);
+  Real &x, &y, &z, &w;
+  Real &red, &green, &blue;
   [[nodiscard]] auto isPoint() const -> bool;
   [[nodiscard]] auto isVector() const -> bool;
   auto operator+(const Tuple &t) const -> Tuple;
   auto operator-(const Tuple &t) const -> Tuple;
   auto operator-() const -> Tuple;
-  auto operator*(const double &scalar) const -> Tuple;
-  auto operator/(const double &scalar) const -> Tuple;
+  auto operator*(const Real &scalar) const -> Tuple;
+  auto operator/(const Real &scalar) const -> Tuple;
   auto operator==(const Tuple &t) const -> bool;
   auto operator!=(const Tuple &t) const -> bool;
   friend auto operator<<(std::ostream &os, const Tuple &t) -> std::ostream &;
   auto operator=(const Tuple &t) -> Tuple &;
   auto operator=(Tuple &&t) noexcept -> Tuple &;
-  auto operator()(int i) const -> const double &;
-  auto operator()(int i) -> double &;
-  [[nodiscard]] auto magnitude() const -> double;
+  auto operator()(int i) const -> const Real &;
+  auto operator()(int i) -> Real &;
+  [[nodiscard]] auto magnitude() const -> Real;
   [[nodiscard]] auto reflect(const Tuple &normal) const -> Tuple;
   [[nodiscard]] auto norm() const -> Tuple;
   auto normalize() -> Tuple &;
   ~Tuple() = default;
 };
-auto point(double x, double y, double z) -> Tuple;
-auto vector(double x, double y, double z) -> Tuple;
-auto color(double r, double g, double b) -> Tuple;
-auto dot(const Tuple &a, const Tuple &b) -> double;
+auto point(Real x, Real y, Real z) -> Tuple;
+auto vector(Real x, Real y, Real z) -> Tuple;
+auto color(Real r, Real g, Real b) -> Tuple;
+auto dot(const Tuple &a, const Tuple &b) -> Real;
 auto cross(const Tuple &a, const Tuple &b) -> Tuple;
-auto operator*(const double &scalar, const Tuple &t) -> Tuple;
+auto operator*(const Real &scalar, const Tuple &t) -> Tuple;
 auto hadamard(const Tuple &a, const Tuple &b) -> Tuple;
+// Exact comparison; operator== allows EPSILON.
+auto identical(const Tuple &a, const Tuple &b) -> bool;
 using Color = Tuple;
 using Vector = Tuple;
 using Point = Tuple;
+// Rec. 709 luma weights.
+inline auto luminance(const Color &c) -> Real {
+  return Real{0.2126} * c.red + Real{0.7152} * c.green + Real{0.0722} * c.blue;
+}
 } // namespace RT
@@ -1,8 +1,22 @@
 #pragma once
 #include <cmath>
+#ifdef RT_SINGLE_PRECISION
+#define EPSILON (1e-3F)
+#else
 #define EPSILON (1e-4)
+#endif
 namespace RT {
-template <typename T> auto approxEqual(const T &a, const T &b) -> bool {
+#ifdef RT_SINGLE_PRECISION
+using Real = float;
+#else
+using Real = double;
+#endif
+template <typename T, typename U>
+auto approxEqual(const T &a, const U &b) -> bool {
   return std::abs(a - b) < EPSILON;
 }
+inline auto fastFloor(Real v) -> int {
+  auto i = static_cast<int>(v);
+  return i - static_cast<int>(v < static_cast<Real>(i));
+}
 } // namespace RT
@@ -0,0 +1,60 @@
+#pragma once
+#include "Camera.hpp"
+#include "Canvas.hpp"
+#include "Ray.hpp"
+#include "Shape.hpp"
+#include "World.hpp"
+#include <cstddef>
+#include <vector>
+namespace RT {
+
+// Renders in stages over batches of rays: generation, intersection,
+// shading and shadows. Rays go through the camera's pinhole only, one per
+// pixel at shutterOpen; its aperture, lens samples and sampler are
+// ignored, so a thin lens camera needs Camera::render.
+class Wavefront {
+public:
+  static constexpr size_t DEFAULT_BATCH_SIZE = size_t{1} << 16;
+
+  explicit Wavefront(const Camera &camera,
+                     size_t batchSize = DEFAULT_BATCH_SIZE,
+                     unsigned threads = 0);
+  const Camera &camera;
+  size_t batchSize;
+  unsigned threads;
+  [[nodiscard]] auto render(const World &world) const -> Canvas;
+
+  struct PathRay {
+    Ray ray;
+    Real weight;
+    int pixel;
+    int remaining;
+  };
+
+  struct ShadowRay {
+    Point point;
+    Real time;
+    const Light *light;
+    Real weight;
+    Color lit;
+    Color unlit;
+    int pixel;
+  };
+
+  [[nodiscard]] auto generate(size_t first, size_t count) const
+      -> std::vector<PathRay>;
+  [[nodiscard]] auto intersect(const World &world,
+                               const std::vector<PathRay> &paths) const
+      -> std::vector<std::pair<size_t, Computations>>;
+  void sortHits(std::vector<std::pair<size_t, Computations>> &hits) const;
+  void shade(const World &world,
+             const std::vector<std::pair<size_t, Computations>> &hits,
+             const std::vector<PathRay> &paths,
+             std::vector<ShadowRay> &shadowRays,
+             std::vector<PathRay> &secondaryRays) const;
+  void traceShadows(const World &world,
+                    const std::vector<ShadowRay> &shadowRays,
+                    std::vector<Color> &pixels) const;
+};
+
+} // namespace RT
@@ -1,22 +1,88 @@
 #pragma once
 #include "Light.hpp"
+#include "LightTree.hpp"
+#include "RenderRecord.hpp"
 #include "Shape.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <optional>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
 namespace RT {
 
+enum class ShapeType { Sphere, Plane, Cube, Cylinder, Cone, Other };
+
+// Objects are numbered in the order they are added. An ID stays with its
+// object until the object is removed and is never handed out again.
+using ObjectId = size_t;
+
+// One change made through World::add, remove, setTransform or setMaterial.
+// Moves, additions and removals carry the object's world bounds before and
+// after; a removed object's after bounds are empty.
+struct SceneEdit {
+  size_t object;
+  bool moved;
+  BoundingBox before;
+  BoundingBox after;
+};
+
+// What a ray's hit looks like before lighting, for AOV images.
+struct SurfaceSample {
+  // Distance from the ray's origin, in world units.
+  Real depth;
+  // The shading normal, facing the ray.
+  Vector normal;
+  // The top-level object hit.
+  ObjectId object;
+  Color albedo;
+};
+
+struct ShadowCacheStats {
+  size_t lookups;
+  size_t hits;
+  [[nodiscard]] auto hitRate() const -> Real;
+};
+
 class World {
 public:
   static constexpr int MAX_RECURSION_DEPTH = 5;
 
   explicit World(bool defaultWorld = true);
   std::vector<Light> lights;
-  void add(std::unique_ptr<Shape> object);
+  // Shapes of the built-in types are stored by value in one array per
+  // type; anything else stays behind its pointer.
+  auto add(std::unique_ptr<Shape> object) -> ObjectId;
+  // Swaps the last object of the same type into the removed one's slot.
+  // References to objects of that type are invalidated.
+  void remove(ObjectId id);
+  [[nodiscard]] auto contains(ObjectId id) const -> bool;
+  // Whether object is one of this world's objects or part of one.
   [[nodiscard]] auto contains(const Shape &object) const -> bool;
+  // The number of IDs handed out, removed objects included.
   [[nodiscard]] auto count() const -> size_t;
+  // The returned shape may be edited in place at any later time, so from
+  // then on its compiled pattern is checked against it before each use;
+  // objects never handed out this way skip that check.
+  [[nodiscard]] auto object(ObjectId id) -> Shape &;
+  [[nodiscard]] auto object(ObjectId id) const -> const Shape &;
+  // Moves an object and refits only its cached inverse and bounds. Changing
+  // object(index).transformation directly leaves them stale and is missed
+  // by Camera::update; setMaterial is the same for materials.
+  void setTransform(ObjectId id, const Transformation &transform);
+  void setMaterial(ObjectId id, const Material &material);
+  [[nodiscard]] auto bounds(ObjectId id) const -> BoundingBox;
+  // The edits not yet cleared, oldest first; the first is edit number
+  // editCount() - edits().size().
+  [[nodiscard]] auto edits() const -> const std::vector<SceneEdit> &;
+  // Every edit made to the world, cleared ones included.
+  [[nodiscard]] auto editCount() const -> size_t;
+  // Drops the edits made so far. Camera::update brings a record taken
+  // before some of them up to date with a full render.
+  void clearEdits();
   [[nodiscard]] auto intersect(const Ray &ray) const
       -> std::vector<Intersection>;
   [[nodiscard]] auto shadeHit(const Computations &comps,
@@ -25,17 +91,100 @@ public:
   [[nodiscard]] auto colorAt(const Ray &ray,
                              int remaining = MAX_RECURSION_DEPTH) const
       -> Color;
+  // Also reports the ray's own hit, if any, in primary.
+  [[nodiscard]] auto colorAt(const Ray &ray,
+                             std::optional<Intersection> &primary,
+                             int remaining = MAX_RECURSION_DEPTH) const
+      -> Color;
+  // Also describes that hit in surface, from the Computations the shading
+  // builds anyway; surface is empty when the ray misses.
+  [[nodiscard]] auto colorAt(const Ray &ray,
+                             std::optional<Intersection> &primary,
+                             std::optional<SurfaceSample> &surface,
+                             int remaining = MAX_RECURSION_DEPTH) const
+      -> Color;
   [[nodiscard]] auto reflectedColor(const Computations &comps,
                                     int remaining = MAX_RECURSION_DEPTH) const
       -> Color;
   [[nodiscard]] auto refractedColor(const Computations &comps,
                                     int remaining = MAX_RECURSION_DEPTH) const
       -> Color;
-  [[nodiscard]] auto isShadowed(const Point &point, const Light &l) const
-      -> bool;
+  // Each thread remembers, per light of this world, the shape that last
+  // blocked a shadow ray and tests it before the full query. A remembered
+  // shape only ever confirms a shadow, so results never depend on which
+  // thread or tile shaded a point before.
+  [[nodiscard]] auto isShadowed(const Point &point, const Light &l,
+                                Real time = 0) const -> bool;
+  // Counting lookups and hits makes every shadow ray of every thread write
+  // the same counters, so it is off unless enabled here, before rendering.
+  void countShadowCache(bool enabled = true);
+  [[nodiscard]] auto shadowCacheStats() const -> ShadowCacheStats;
+  void resetShadowCacheStats();
+  [[nodiscard]] static auto refractedRay(const Computations &comps)
+      -> std::optional<Ray>;
+  // Bounds shadow rays per shading point to shadowRays: lights are culled
+  // through a light tree, and when more than shadowRays remain that many
+  // are importance sampled and weighted by their probability. Ambient is
+  // still summed over every light. Call again after changing lights.
+  void sampleLights(size_t shadowRays, Real threshold = 0);
+  [[nodiscard]] auto samplesLights() const -> bool;
+  [[nodiscard]] auto maxLightSamples() const -> size_t;
+  [[nodiscard]] auto lightSamples(const Point &point,
+                                  const Vector &normal) const
+      -> std::vector<LightSample>;
+  [[nodiscard]] auto ambientLight(const Shape &object,
+                                  const Color &surface) const -> Color;
+  [[nodiscard]] auto surfaceColor(const Shape &object, const Point &point,
+                                  Real time = 0) const -> Color;
+  void surfaceColors(const Shape &object, size_t count, const Real *x,
+                     const Real *y, const Real *z, Real *r, Real *g, Real *b,
+                     Real time = 0) const;
 
 private:
-  std::vector<std::unique_ptr<Shape>> objects;
+  ShapeArray<Sphere> spheres;
+  ShapeArray<Plane> planes;
+  ShapeArray<Cube> cubes;
+  ShapeArray<Cylinder> cylinders;
+  ShapeArray<Cone> cones;
+  ShapeArray<std::unique_ptr<Shape>> others;
+  // Slot of each shape in others, so locating a hit skips a linear scan.
+  std::unordered_map<const Shape *, size_t> otherSlots;
+  // Type and slot of each ID, empty once the object is removed.
+  std::vector<std::optional<std::pair<ShapeType, size_t>>> objects;
+  std::array<std::vector<ObjectId>, 6> slotObjects;
+  // Per ID, whether the non-const object() has handed the object out.
+  std::vector<bool> exposed;
+  std::vector<SceneEdit> editLog;
+  size_t clearedEdits = 0;
+  uint64_t worldId;
+  bool countingShadowCache = false;
+  mutable std::atomic<size_t> shadowLookups{0};
+  mutable std::atomic<size_t> shadowHits{0};
+  std::optional<LightTree> lightTree;
+  size_t lightSampleCount = 0;
+  Real lightThreshold = 0;
+  [[nodiscard]] auto compiledPattern(const Shape &object) const
+      -> const CompiledPattern *;
+  [[nodiscard]] auto slotOf(ObjectId id) const -> std::pair<ShapeType, size_t>;
+  // The object without exposing it, for edits the world refits itself.
+  [[nodiscard]] auto storedObject(ObjectId id) -> Shape &;
+  [[nodiscard]] auto locate(const Shape *object) const
+      -> std::optional<std::pair<ShapeType, size_t>>;
+  void refit(ObjectId id);
+  [[nodiscard]] auto shadeHit(const Computations &comps, const Color &base,
+                              int remaining) const -> Color;
+  [[nodiscard]] auto trace(const Ray &ray,
+                           std::optional<Intersection> &primary,
+                           std::optional<SurfaceSample> *surface,
+                           int remaining) const -> Color;
+  void record(const Ray &ray, const std::vector<Intersection> &xs,
+              const std::optional<Intersection> &hit) const;
+  [[nodiscard]] auto occludes(std::pair<ShapeType, size_t> object,
+                              const Ray &ray, Real distance,
+                              std::vector<Intersection> &xs) const -> bool;
+  [[nodiscard]] auto firstOccluder(const Ray &ray, Real distance,
+                                   std::vector<Intersection> &xs) const
+      -> std::optional<std::pair<ShapeType, size_t>>;
 };
 
 } // namespace RT
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "Animation.hpp"
+#include "Wavefront.hpp"
+#include <algorithm>
+#include <exception>
+#include <thread>
+namespace RT {
+
+auto lerp(const View &a, const View &b, Real t) -> View {
+  return {lerp(a.from, b.from, t), lerp(a.to, b.to, t), lerp(a.up, b.up, t)};
+}
+
+template <typename T> void Track<T>::key(Real time, T value) {
+  auto at = std::upper_bound(
+      keys.begin(), keys.end(), time,
+      [](Real t, const std::pair<Real, T> &k) { return t < k.first; });
+  keys.insert(at, {time, std::move(value)});
+}
+
+template <typename T> auto Track<T>::empty() const -> bool {
+  return keys.empty();
+}
+
+template <typename T> auto Track<T>::at(Real time) const -> T {
+  if (time <= keys.front().first) {
+    return keys.front().second;
+  }
+  if (time >= keys.back().first) {
+    return keys.back().second;
+  }
+  auto next = std::upper_bound(
+      keys.begin(), keys.end(), time,
+      [](Real t, const std::pair<Real, T> &k) { return t < k.first; });
+  auto previous = next - 1;
+  auto t = (time - previous->first) / (next->first - previous->first);
+  return lerp(previous->second, next->second, t);
+}
+
+template class Track<Pose>;
+template class Track<View>;
+
+Sequence::Sequence(Camera &camera, World &world)
+    : camera(camera), world(world),
+      renderer([](const Camera &c, const World &w) {
+        return Wavefront(c).render(w);
+      }) {}
+
+void Sequence::animate(size_t object, Track<Pose> track) {
+  animated.push_back({object, std::move(track), std::nullopt});
+}
+
+void Sequence::pose(Real time) {
+  if (!view.empty()) {
+    auto v = view.at(time);
+    camera.transform = viewTransform(v.from, v.to, v.up);
+  }
+  for (auto &a : animated) {
+    if (a.track.empty()) {
+      continue;
+    }
+    auto p = a.track.at(time);
+    if (a.applied.has_value() && samePose(a.applied.value(), p)) {
+      continue;
+    }
+    world.setTransform(a.object, p.transform());
+    a.applied = p;
+    refitCount++;
+  }
+}
+
+void Sequence::render(int frames, Real start, Real end,
+                      const FrameWriter &write) {
+  std::thread writer;
+  std::exception_ptr failure;
+  for (auto frame = 0; frame < frames; frame++) {
+    auto time = frames > 1 ? start + (end - start) * frame / (frames - 1)
+                           : start;
+    pose(time);
+    auto image = renderer(camera, world);
+    world.clearEdits();
+    if (writer.joinable()) {
+      writer.join();
+    }
+    if (failure) {
+      break;
+    }
+    writer = std::thread([&write, &failure, frame, image = std::move(image)] {
+      try {
+        write(frame, image);
+      } catch (...) {
+        failure = std::current_exception();
+      }
+    });
+  }
+  if (writer.joinable()) {
+    writer.join();
+  }
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+}
+
+auto Sequence::refits() const -> size_t { return refitCount; }
+
+} // namespace RT
@@ -0,0 +1,180 @@
+#include "Bounds.hpp"
+#include <algorithm>
+#include <initializer_list>
+#include <limits>
+#include <utility>
+
+namespace RT {
+
+constexpr Real INF = std::numeric_limits<Real>::infinity();
+
+// The test is against the whole line so that intersections behind the
+// origin are kept, as World::intersect reports them for refraction.
+inline auto slabHit(Real ox, Real oy, Real oz, Real ix, Real iy, Real iz,
+                    Real x0, Real y0, Real z0, Real x1, Real y1, Real z1)
+    -> bool {
+  auto ax = (x0 - ox) * ix;
+  auto bx = (x1 - ox) * ix;
+  auto ay = (y0 - oy) * iy;
+  auto by = (y1 - oy) * iy;
+  auto az = (z0 - oz) * iz;
+  auto bz = (z1 - oz) * iz;
+  auto enter = std::max({std::min(ax, bx), std::min(ay, by), std::min(az, bz)});
+  auto exit = std::min({std::max(ax, bx), std::max(ay, by), std::max(az, bz)});
+  return !(enter > exit);
+}
+
+BoundingBox::BoundingBox()
+    : min(point(INF, INF, INF)), max(point(-INF, -INF, -INF)) {}
+
+BoundingBox::BoundingBox(Point min, Point max)
+    : min(std::move(min)), max(std::move(max)) {}
+
+auto BoundingBox::infinite() -> BoundingBox {
+  return {point(-INF, -INF, -INF), point(INF, INF, INF)};
+}
+
+void BoundingBox::add(const Point &p) {
+  min.x = std::min(min.x, p.x);
+  min.y = std::min(min.y, p.y);
+  min.z = std::min(min.z, p.z);
+  max.x = std::max(max.x, p.x);
+  max.y = std::max(max.y, p.y);
+  max.z = std::max(max.z, p.z);
+}
+
+void BoundingBox::add(const BoundingBox &box) {
+  if (box.isEmpty()) {
+    return;
+  }
+  add(box.min);
+  add(box.max);
+}
+
+auto BoundingBox::isEmpty() const -> bool {
+  return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+auto BoundingBox::isFinite() const -> bool {
+  return std::isfinite(min.x) && std::isfinite(min.y) &&
+         std::isfinite(min.z) && std::isfinite(max.x) &&
+         std::isfinite(max.y) && std::isfinite(max.z);
+}
+
+auto BoundingBox::contains(const Point &p) const -> bool {
+  return min.x <= p.x && p.x <= max.x && min.y <= p.y && p.y <= max.y &&
+         min.z <= p.z && p.z <= max.z;
+}
+
+auto BoundingBox::padded(Real amount) const -> BoundingBox {
+  if (isEmpty()) {
+    return *this;
+  }
+  return {min - vector(amount, amount, amount),
+          max + vector(amount, amount, amount)};
+}
+
+auto BoundingBox::transform(const Transformation &m) const -> BoundingBox {
+  if (isEmpty()) {
+    return *this;
+  }
+  if (!isFinite()) {
+    return infinite();
+  }
+  BoundingBox result;
+  for (auto corner = 0; corner < 8; corner++) {
+    result.add(m * point((corner & 1) != 0 ? max.x : min.x,
+                         (corner & 2) != 0 ? max.y : min.y,
+                         (corner & 4) != 0 ? max.z : min.z));
+  }
+  return result;
+}
+
+auto BoundingBox::intersects(const Ray &ray) const -> bool {
+  if (isEmpty()) {
+    return false;
+  }
+  return slabHit(ray.origin.x, ray.origin.y, ray.origin.z,
+                 1 / ray.direction.x, 1 / ray.direction.y, 1 / ray.direction.z,
+                 min.x, min.y, min.z, max.x, max.y, max.z);
+}
+
+auto BoundingBox::span(const Ray &ray) const
+    -> std::optional<std::pair<Real, Real>> {
+  if (isEmpty()) {
+    return std::nullopt;
+  }
+  auto enter = -INF;
+  auto exit = INF;
+  for (auto axis = 0; axis < 3; axis++) {
+    auto o = ray.origin(axis);
+    auto d = ray.direction(axis);
+    if (d == 0) {
+      if (o < min(axis) || o > max(axis)) {
+        return std::nullopt;
+      }
+      continue;
+    }
+    auto t0 = (min(axis) - o) / d;
+    auto t1 = (max(axis) - o) / d;
+    enter = std::max(enter, std::min(t0, t1));
+    exit = std::min(exit, std::max(t0, t1));
+  }
+  if (enter > exit) {
+    return std::nullopt;
+  }
+  return std::make_pair(enter, exit);
+}
+
+void BoundsArray::push(const BoundingBox &box) {
+  minX.push_back(box.min.x);
+  minY.push_back(box.min.y);
+  minZ.push_back(box.min.z);
+  maxX.push_back(box.max.x);
+  maxY.push_back(box.max.y);
+  maxZ.push_back(box.max.z);
+}
+
+void BoundsArray::set(size_t i, const BoundingBox &box) {
+  minX[i] = box.min.x;
+  minY[i] = box.min.y;
+  minZ[i] = box.min.z;
+  maxX[i] = box.max.x;
+  maxY[i] = box.max.y;
+  maxZ[i] = box.max.z;
+}
+
+void BoundsArray::remove(size_t i) {
+  for (auto *v : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ}) {
+    (*v)[i] = v->back();
+    v->pop_back();
+  }
+}
+
+auto BoundsArray::at(size_t i) const -> BoundingBox {
+  return {point(minX[i], minY[i], minZ[i]), point(maxX[i], maxY[i], maxZ[i])};
+}
+
+auto BoundsArray::size() const -> size_t { return minX.size(); }
+
+void BoundsArray::hits(const Ray &ray, size_t first, size_t count,
+                       unsigned char *mask) const {
+  const Real ox = ray.origin.x;
+  const Real oy = ray.origin.y;
+  const Real oz = ray.origin.z;
+  const Real ix = 1 / ray.direction.x;
+  const Real iy = 1 / ray.direction.y;
+  const Real iz = 1 / ray.direction.z;
+  const Real *x0 = minX.data() + first;
+  const Real *y0 = minY.data() + first;
+  const Real *z0 = minZ.data() + first;
+  const Real *x1 = maxX.data() + first;
+  const Real *y1 = maxY.data() + first;
+  const Real *z1 = maxZ.data() + first;
+  for (size_t i = 0; i < count; i++) {
+    mask[i] = static_cast<unsigned char>(
+        slabHit(ox, oy, oz, ix, iy, iz, x0[i], y0[i], z0[i], x1[i], y1[i], z1[i]));
+  }
+}
+
+} // namespace RT
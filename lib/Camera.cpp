@@ -1,15 +1,21 @@
 #include "Camera.hpp"
 #include "Matrix.hpp"
-#include <format>
-#include <iostream>
+#include "Parallel.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <optional>
+#include <utility>
 namespace RT {
 
-Camera::Camera(int hsize, int vsize, double fieldOfView,
+Camera::Camera(int hsize, int vsize, Real fieldOfView,
                Transformation transform)
     : hsize(hsize), vsize(vsize), fieldOfView(fieldOfView),
       transform(transform) {
   auto halfView = std::tan(fieldOfView / 2);
-  const double aspect = static_cast<double>(hsize) / vsize;
+  const Real aspect = static_cast<Real>(hsize) / vsize;
   if (aspect >= 1) {
     halfWidth = halfView;
     halfHeight = halfView / aspect;
@@ -20,42 +26,495 @@ Camera::Camera(int hsize, int vsize, double fieldOfView,
   pixelSize = (halfWidth * 2) / hsize;
 }
 
+RayGenerator::RayGenerator(const Camera &camera) {
+  const Real pixelOffset = 0.5;
+  auto inverse = camera.transform.inverse();
+  origin = inverse * point(0, 0, 0);
+  corner = inverse * point(camera.halfWidth - pixelOffset * camera.pixelSize,
+                           camera.halfHeight - pixelOffset * camera.pixelSize,
+                           -1);
+  stepX = inverse * vector(-camera.pixelSize, 0, 0);
+  stepY = inverse * vector(0, -camera.pixelSize, 0);
+  lensX = inverse * vector(camera.aperture, 0, 0);
+  lensY = inverse * vector(0, camera.aperture, 0);
+  focalDistance = camera.focalDistance;
+  shutterOpen = camera.shutterOpen;
+  shutterClose = std::max(camera.shutterClose, camera.shutterOpen);
+  sampling = camera.sampling;
+  lensSamples = camera.aperture > 0 || shutterClose > shutterOpen
+                    ? std::max(camera.lensSamples, 1)
+                    : 1;
+}
+
+auto RayGenerator::multisampled() const -> bool { return lensSamples > 1; }
+
+auto RayGenerator::ray(int pixelX, int pixelY) const -> Ray {
+  Ray r;
+  row(pixelX, pixelY, 1, &r);
+  return r;
+}
+
+void RayGenerator::row(int pixelX, int pixelY, size_t count, Ray *out) const {
+  std::array<Real, RAY_ROW_BLOCK> dx;
+  std::array<Real, RAY_ROW_BLOCK> dy;
+  std::array<Real, RAY_ROW_BLOCK> dz;
+  auto y = static_cast<Real>(pixelY);
+  auto baseX = corner.x + y * stepY.x - origin.x;
+  auto baseY = corner.y + y * stepY.y - origin.y;
+  auto baseZ = corner.z + y * stepY.z - origin.z;
+  for (size_t first = 0; first < count; first += RAY_ROW_BLOCK) {
+    auto n = std::min(RAY_ROW_BLOCK, count - first);
+    auto x0 = static_cast<Real>(pixelX) + static_cast<Real>(first);
+    for (size_t i = 0; i < n; i++) {
+      auto x = x0 + static_cast<Real>(i);
+      dx[i] = baseX + x * stepX.x;
+      dy[i] = baseY + x * stepX.y;
+      dz[i] = baseZ + x * stepX.z;
+    }
+    for (size_t i = 0; i < n; i++) {
+      auto length = std::sqrt(dx[i] * dx[i] + dy[i] * dy[i] + dz[i] * dz[i]);
+      dx[i] /= length;
+      dy[i] /= length;
+      dz[i] /= length;
+    }
+    for (size_t i = 0; i < n; i++) {
+      auto &r = out[first + i];
+      r.origin = origin;
+      r.direction = vector(dx[i], dy[i], dz[i]);
+      r.time = shutterOpen;
+    }
+  }
+}
+
+constexpr uint32_t FILM_DIMENSION = 0;
+constexpr uint32_t LENS_DIMENSION = 1;
+constexpr uint32_t TIME_DIMENSION = 2;
+
+// Shirley and Chiu's concentric map keeps the sequence's strata intact on
+// the disk.
+auto concentricDisk(Real u, Real v) -> std::pair<Real, Real> {
+  auto a = 2 * u - 1;
+  auto b = 2 * v - 1;
+  if (a == 0 && b == 0) {
+    return {0, 0};
+  }
+  if (std::abs(a) > std::abs(b)) {
+    auto theta = std::numbers::pi_v<Real> / 4 * (b / a);
+    return {a * std::cos(theta), a * std::sin(theta)};
+  }
+  auto theta =
+      std::numbers::pi_v<Real> / 2 - std::numbers::pi_v<Real> / 4 * (a / b);
+  return {b * std::cos(theta), b * std::sin(theta)};
+}
+
+auto RayGenerator::lensRay(int pixelX, int pixelY, int sample) const -> Ray {
+  return throughLens(corner + stepX * static_cast<Real>(pixelX) +
+                         stepY * static_cast<Real>(pixelY),
+                     PixelSampler(pixelX, pixelY, sampling),
+                     static_cast<uint32_t>(sample));
+}
+
+auto RayGenerator::sampleRay(int pixelX, int pixelY, int sample) const
+    -> Ray {
+  if (sample == 0) {
+    return multisampled() ? lensRay(pixelX, pixelY, 0) : ray(pixelX, pixelY);
+  }
+  const PixelSampler sampler(pixelX, pixelY, sampling);
+  auto index = static_cast<uint32_t>(sample);
+  auto [u, v] = sampler.get2D(index, FILM_DIMENSION);
+  auto pixel = corner + stepX * (static_cast<Real>(pixelX) + u - Real{0.5}) +
+               stepY * (static_cast<Real>(pixelY) + v - Real{0.5});
+  if (!multisampled()) {
+    return {origin, (pixel - origin).norm(), shutterOpen};
+  }
+  return throughLens(pixel, sampler, index);
+}
+
+auto RayGenerator::throughLens(const Point &pixel, const PixelSampler &sampler,
+                               uint32_t sample) const -> Ray {
+  auto focus = origin + (pixel - origin) * focalDistance;
+  auto [lensU, lensV] = sampler.get2D(sample, LENS_DIMENSION);
+  auto [u, v] = concentricDisk(lensU, lensV);
+  auto eye = origin + lensX * u + lensY * v;
+  auto time = shutterOpen + (shutterClose - shutterOpen) *
+                                sampler.get1D(sample, TIME_DIMENSION);
+  return {eye, (focus - eye).norm(), time};
+}
+
+auto lensColor(const World &world, const RayGenerator &rays, int pixelX,
+               int pixelY, std::optional<SurfaceSample> *surface)
+    -> PixelEstimate {
+  auto total = color(0, 0, 0);
+  auto firstHit = false;
+  Intersection first{0, nullptr};
+  auto firstPoint = point(0, 0, 0);
+  auto pixelWidth = rays.stepX.magnitude();
+  auto agree = true;
+  auto samples = 0;
+  for (; samples < rays.lensSamples; samples++) {
+    if (samples == LENS_PILOT_SAMPLES && agree) {
+      break;
+    }
+    auto ray = rays.lensRay(pixelX, pixelY, samples);
+    std::optional<Intersection> primary;
+    if (samples == 0 && surface != nullptr) {
+      total = total + world.colorAt(ray, primary, *surface);
+    } else {
+      total = total + world.colorAt(ray, primary);
+    }
+    if (samples == 0) {
+      firstHit = primary.has_value();
+      if (firstHit) {
+        first = primary.value();
+        firstPoint = ray.position(first.first);
+      }
+    } else if (agree) {
+      agree = firstHit == primary.has_value() &&
+              (!firstHit ||
+               (first.second == primary->second &&
+                (ray.position(primary->first) - firstPoint).magnitude() <=
+                    pixelWidth * std::max(first.first, primary->first)));
+    }
+  }
+  return {total / static_cast<Real>(samples), samples};
+}
+
+AOVImages::AOVImages(int width, int height)
+    : depth(width, height, 1, std::numeric_limits<float>::infinity()),
+      normal(width, height, 3), object(width, height, 1, -1),
+      albedo(width, height, 3) {}
+
+void AOVImages::write(int pixelX, int pixelY,
+                      const std::optional<SurfaceSample> &surface) {
+  if (!surface.has_value()) {
+    return;
+  }
+  depth.set(pixelX, pixelY, 0, static_cast<float>(surface->depth));
+  object.set(pixelX, pixelY, 0, static_cast<float>(surface->object));
+  const std::array<Real, 3> n{surface->normal.x, surface->normal.y,
+                              surface->normal.z};
+  const std::array<Real, 3> a{surface->albedo.red, surface->albedo.green,
+                              surface->albedo.blue};
+  for (auto c = 0; c < 3; c++) {
+    normal.set(pixelX, pixelY, c, static_cast<float>(n[c]));
+    albedo.set(pixelX, pixelY, c, static_cast<float>(a[c]));
+  }
+}
+
 auto Camera::rayForPixel(int pixelX, int pixelY) const -> Ray {
-  const double pixelOffset = 0.5;
-  auto xOffset = (pixelX + pixelOffset) * pixelSize;
-  auto yOffset = (pixelY + pixelOffset) * pixelSize;
-  auto worldX = halfWidth - xOffset;
-  auto worldY = halfHeight - yOffset;
-  auto pixel = transform.inverse() * point(worldX, worldY, -1);
-  auto origin = transform.inverse() * point(0, 0, 0);
-  auto direction = (pixel - origin).norm();
-  return {origin, direction};
+  return rays().ray(pixelX, pixelY);
+}
+
+auto Camera::rays() const -> RayGenerator { return RayGenerator(*this); }
+
+struct RenderHandle::State {
+  State(const Camera &camera, const World &world, RenderOptions options)
+      : camera(camera), world(world), options(std::move(options)),
+        tiles(this->options.regions.empty()
+                  ? splitTiles(camera.hsize, camera.vsize,
+                               this->options.tileSize)
+                  : splitTiles(this->options.regions, camera.hsize,
+                               camera.vsize, this->options.tileSize)),
+        window(this->options.crop ? boundingTile(tiles)
+                                  : Tile{0, 0, camera.hsize, camera.vsize}),
+        image(window.width, window.height) {
+    if (this->options.aovs) {
+      aovs.emplace(window.width, window.height);
+    }
+    for (const auto &tile : tiles) {
+      total += static_cast<size_t>(tile.width) * tile.height;
+    }
+  }
+  Camera camera;
+  RayGenerator rays{camera};
+  const World &world;
+  RenderOptions options;
+  std::vector<Tile> tiles;
+  // The part of the image the canvas covers.
+  Tile window;
+  mutable std::mutex imageMutex;
+  Canvas image;
+  // Written without the lock: each pixel belongs to one tile.
+  std::optional<AOVImages> aovs;
+  size_t total = 0;
+  std::atomic<size_t> pixels{0};
+  std::atomic<bool> stopRequested{false};
+  std::atomic<bool> done{false};
+  std::thread driver;
+
+  void traceRowWithAOVs(const Tile &tile, int y, const std::vector<Ray> &row,
+                        std::vector<Color> &buffer) {
+    std::optional<Intersection> primary;
+    std::optional<SurfaceSample> surface;
+    for (auto x = 0; x < tile.width; x++) {
+      buffer.push_back(
+          rays.multisampled()
+              ? lensColor(world, rays, tile.x + x, tile.y + y, &surface).color
+              : world.colorAt(row[static_cast<size_t>(x)], primary,
+                              surface));
+      aovs->write(tile.x - window.x + x, tile.y - window.y + y, surface);
+    }
+  }
+
+  void renderTile(const Tile &tile) {
+    std::vector<Color> buffer;
+    buffer.reserve(static_cast<size_t>(tile.width) * tile.height);
+    std::vector<Ray> row(static_cast<size_t>(tile.width));
+    auto rows = 0;
+    for (; rows < tile.height; rows++) {
+      if (stopRequested.load(std::memory_order_relaxed)) {
+        break;
+      }
+      rays.row(tile.x, tile.y + rows, row.size(), row.data());
+      if (aovs.has_value()) {
+        traceRowWithAOVs(tile, rows, row, buffer);
+        continue;
+      }
+      for (auto x = 0; x < tile.width; x++) {
+        buffer.push_back(
+            rays.multisampled()
+                ? lensColor(world, rays, tile.x + x, tile.y + rows).color
+                : world.colorAt(row[static_cast<size_t>(x)]));
+      }
+    }
+    {
+      const std::lock_guard lock(imageMutex);
+      for (auto y = 0; y < rows; y++) {
+        for (auto x = 0; x < tile.width; x++) {
+          image.writePixel(tile.x - window.x + x, tile.y - window.y + y,
+                           buffer[static_cast<size_t>(y) * tile.width + x]);
+        }
+      }
+    }
+    auto finished = pixels.fetch_add(static_cast<size_t>(rows) * tile.width,
+                                     std::memory_order_relaxed) +
+                    static_cast<size_t>(rows) * tile.width;
+    if (rows == tile.height && options.onPixels) {
+      options.onPixels(tile, buffer);
+    }
+    if (rows == tile.height && aovs.has_value() && options.onAOVs) {
+      options.onAOVs(Tile{tile.x - window.x, tile.y - window.y, tile.width,
+                          tile.height},
+                     *aovs);
+    }
+    if (rows == tile.height && options.onTile) {
+      options.onTile(tile, static_cast<Real>(finished) /
+                               static_cast<Real>(std::max<size_t>(total, 1)));
+    }
+  }
+};
+
+RenderHandle::RenderHandle(std::unique_ptr<State> state)
+    : state(std::move(state)) {}
+
+auto RenderHandle::operator=(RenderHandle &&other) noexcept
+    -> RenderHandle & {
+  stop();
+  state = std::move(other.state);
+  return *this;
+}
+
+RenderHandle::~RenderHandle() { stop(); }
+
+void RenderHandle::stop() {
+  if (state) {
+    state->stopRequested = true;
+    if (state->driver.joinable()) {
+      state->driver.join();
+    }
+  }
+}
+
+auto RenderHandle::pixelsDone() const -> size_t {
+  return state->pixels.load(std::memory_order_relaxed);
+}
+
+auto RenderHandle::totalPixels() const -> size_t { return state->total; }
+
+auto RenderHandle::progress() const -> Real {
+  return static_cast<Real>(pixelsDone()) /
+         static_cast<Real>(std::max<size_t>(state->total, 1));
+}
+
+auto RenderHandle::finished() const -> bool { return state->done.load(); }
+
+void RenderHandle::cancel() { state->stopRequested = true; }
+
+auto RenderHandle::cancelled() const -> bool {
+  return state->stopRequested.load();
+}
+
+auto RenderHandle::snapshot() const -> Canvas {
+  const std::lock_guard lock(state->imageMutex);
+  return state->image;
+}
+
+auto RenderHandle::wait() -> const Canvas & {
+  if (state->driver.joinable()) {
+    state->driver.join();
+  }
+  return state->image;
+}
+
+auto RenderHandle::aovs() const -> const std::optional<AOVImages> & {
+  return state->aovs;
+}
+
+auto Camera::renderAsync(const World &world, RenderOptions options) const
+    -> RenderHandle {
+  auto state = std::make_unique<RenderHandle::State>(*this, world,
+                                                     std::move(options));
+  auto *s = state.get();
+  s->driver = std::thread([s] {
+    parallelFor(
+        s->tiles.size(),
+        [s](size_t i) {
+          if (!s->stopRequested.load(std::memory_order_relaxed)) {
+            s->renderTile(s->tiles[i]);
+          }
+        },
+        s->options.threads, 1);
+    s->done = true;
+  });
+  return RenderHandle(std::move(state));
 }
 
 auto Camera::render(const World &world) const -> Canvas {
+  return renderAsync(world).wait();
+}
+
+auto Camera::render(const World &world, const RenderOptions &options) const
+    -> Canvas {
+  return renderAsync(world, options).wait();
+}
+
+auto sameLights(const std::vector<Light> &a, const std::vector<Light> &b)
+    -> bool {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                    [](const Light &l, const Light &m) {
+                      return identical(l.position, m.position) &&
+                             identical(l.intensity, m.intensity);
+                    });
+}
+
+void traceTile(const RayGenerator &rays, const World &world,
+               RenderRecord &record, size_t tile, Canvas &image) {
+  auto &trace = record.tiles[tile];
+  trace.cells.assign(record.grid.words(), 0);
+  trace.objects.clear();
+  const TraceRecorder recorder{&record.grid, &trace};
+  traceRecorder = &recorder;
+  auto columns = static_cast<size_t>(record.tileColumns());
+  auto x0 = static_cast<int>(tile % columns) * record.tileSize;
+  auto y0 = static_cast<int>(tile / columns) * record.tileSize;
+  auto x1 = std::min(x0 + record.tileSize, record.width);
+  auto y1 = std::min(y0 + record.tileSize, record.height);
+  std::vector<Ray> row(static_cast<size_t>(std::max(x1 - x0, 0)));
+  for (auto y = y0; y < y1; y++) {
+    rays.row(x0, y, row.size(), row.data());
+    for (auto x = x0; x < x1; x++) {
+      image.writePixel(x, y,
+                       rays.multisampled()
+                           ? lensColor(world, rays, x, y).color
+                           : world.colorAt(row[static_cast<size_t>(x - x0)]));
+    }
+  }
+  traceRecorder = nullptr;
+  std::sort(trace.objects.begin(), trace.objects.end());
+  trace.objects.erase(std::unique(trace.objects.begin(), trace.objects.end()),
+                      trace.objects.end());
+}
+
+auto Camera::render(const World &world, RenderRecord &record) const
+    -> Canvas {
+  record.width = hsize;
+  record.height = vsize;
+  record.world = &world;
+  record.edits = world.editCount();
+  record.camera = transform;
+  record.aperture = aperture;
+  record.focalDistance = focalDistance;
+  record.shutterOpen = shutterOpen;
+  record.shutterClose = shutterClose;
+  record.lensSamples = lensSamples;
+  record.sampling = sampling;
+  record.lights = world.lights;
+  BoundingBox scene;
+  for (size_t i = 0; i < world.count(); i++) {
+    if (!world.contains(i)) {
+      continue;
+    }
+    auto box = world.bounds(i);
+    if (box.isFinite()) {
+      scene.add(box);
+    }
+  }
+  record.grid = TraceGrid(scene.padded(EPSILON));
+  auto rows = (vsize + record.tileSize - 1) / record.tileSize;
+  record.tiles.assign(static_cast<size_t>(record.tileColumns()) * rows, {});
   Canvas image(hsize, vsize);
-  const double pixelProgress = 1.0 / (hsize * vsize);
-  double progress = 0;
-  const int barWidth = 10;
-  std ::cout << "Rendering: [";
-  for (int i = 0; i < barWidth; i++) {
-    std::cout << " ";
-  }
-  std::cout << "]\rRendering: [" << std::flush;
-  for (auto y = 0; y < vsize; y++) {
-    for (auto x = 0; x < hsize; x++) {
-      auto ray = rayForPixel(x, y);
-      auto color = world.colorAt(ray);
-      image.writePixel(x, y, color);
-      progress += pixelProgress;
-      if (progress >= 1.0 / barWidth) {
-        progress -= 1.0 / barWidth;
-        std::cout << "=" << std::flush;
-      }
-    }
-  }
-  std::cout << "=]\n";
+  auto generator = rays();
+  parallelFor(
+      record.tiles.size(),
+      [&](size_t tile) { traceTile(generator, world, record, tile, image); },
+      0, 1);
   return image;
 }
 
+auto Camera::update(const World &world, RenderRecord &record,
+                    Canvas &image) const -> size_t {
+  const auto &edits = world.edits();
+  auto count = world.editCount();
+  auto cleared = count - edits.size();
+  auto full = record.world != &world || record.width != hsize ||
+              record.height != vsize || image.width != hsize ||
+              image.height != vsize || record.edits > count ||
+              record.edits < cleared ||
+              !identical(record.camera, transform) ||
+              record.aperture != aperture ||
+              record.focalDistance != focalDistance ||
+              record.shutterOpen != shutterOpen ||
+              record.shutterClose != shutterClose ||
+              record.lensSamples != lensSamples ||
+              record.sampling != sampling ||
+              !sameLights(record.lights, world.lights);
+  std::vector<size_t> dirty;
+  if (!full) {
+    std::vector<bool> marked(record.tiles.size(), false);
+    for (auto e = record.edits - cleared; e < edits.size() && !full; e++) {
+      const auto &edit = edits[e];
+      if (edit.moved && (!record.grid.covers(edit.before) ||
+                         !record.grid.covers(edit.after))) {
+        full = true;
+        break;
+      }
+      for (size_t tile = 0; tile < record.tiles.size(); tile++) {
+        const auto &trace = record.tiles[tile];
+        marked[tile] =
+            marked[tile] ||
+            std::binary_search(trace.objects.begin(), trace.objects.end(),
+                               edit.object) ||
+            (edit.moved && (record.grid.overlaps(trace.cells, edit.before) ||
+                            record.grid.overlaps(trace.cells, edit.after)));
+      }
+    }
+    for (size_t tile = 0; tile < marked.size(); tile++) {
+      if (marked[tile]) {
+        dirty.push_back(tile);
+      }
+    }
+  }
+  if (full) {
+    image = render(world, record);
+    return record.tiles.size();
+  }
+  auto generator = rays();
+  parallelFor(
+      dirty.size(),
+      [&](size_t i) { traceTile(generator, world, record, dirty[i], image); },
+      0, 1);
+  record.edits = count;
+  return dirty.size();
+}
+
 } // namespace RT
\ No newline at end of file
@@ -1,9 +1,74 @@
 #include "Canvas.hpp"
+#include "PerfCounters.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <unistd.h>
 #include <utility>
 
 namespace RT {
 
+auto splitTiles(int width, int height, int tileSize) -> std::vector<Tile> {
+  tileSize = std::max(tileSize, 1);
+  std::vector<Tile> tiles;
+  for (auto y = 0; y < height; y += tileSize) {
+    for (auto x = 0; x < width; x += tileSize) {
+      tiles.push_back(Tile{x, y, std::min(tileSize, width - x),
+                           std::min(tileSize, height - y)});
+    }
+  }
+  return tiles;
+}
+
+auto clipTile(const Tile &tile, int width, int height) -> Tile {
+  auto x0 = std::clamp(tile.x, 0, width);
+  auto y0 = std::clamp(tile.y, 0, height);
+  auto x1 = std::clamp(tile.x + std::max(tile.width, 0), 0, width);
+  auto y1 = std::clamp(tile.y + std::max(tile.height, 0), 0, height);
+  return {x0, y0, x1 - x0, y1 - y0};
+}
+
+auto splitTiles(const std::vector<Tile> &regions, int width, int height,
+                int tileSize) -> std::vector<Tile> {
+  std::vector<Tile> tiles;
+  for (const auto &region : regions) {
+    auto clipped = clipTile(region, width, height);
+    for (auto tile : splitTiles(clipped.width, clipped.height, tileSize)) {
+      tile.x += clipped.x;
+      tile.y += clipped.y;
+      tiles.push_back(tile);
+    }
+  }
+  return tiles;
+}
+
+auto boundingTile(const std::vector<Tile> &tiles) -> Tile {
+  auto x0 = std::numeric_limits<int>::max();
+  auto y0 = std::numeric_limits<int>::max();
+  auto x1 = std::numeric_limits<int>::min();
+  auto y1 = std::numeric_limits<int>::min();
+  for (const auto &tile : tiles) {
+    if (tile.width <= 0 || tile.height <= 0) {
+      continue;
+    }
+    x0 = std::min(x0, tile.x);
+    y0 = std::min(y0, tile.y);
+    x1 = std::max(x1, tile.x + tile.width);
+    y1 = std::max(y1, tile.y + tile.height);
+  }
+  if (x1 < x0) {
+    return {0, 0, 0, 0};
+  }
+  return {x0, y0, x1 - x0, y1 - y0};
+}
+
 Canvas::Canvas(int width, int height) : width(width), height(height) {
   pixels =
       std::vector<Color>(static_cast<size_t>(height * width), color(0, 0, 0));
@@ -14,6 +79,15 @@ void Canvas::writePixel(int x, int y, Color c) {
 auto Canvas::pixelAt(int x, int y) const -> Color {
   return pixels[y * width + x];
 }
+auto Canvas::crop(const Tile &region) const -> Canvas {
+  Canvas result(region.width, region.height);
+  for (auto y = 0; y < region.height; y++) {
+    for (auto x = 0; x < region.width; x++) {
+      result.writePixel(x, y, pixelAt(region.x + x, region.y + y));
+    }
+  }
+  return result;
+}
 auto Canvas::PPMHeader() const -> std::vector<unsigned char> {
   std::string headerString =
       "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
@@ -24,7 +98,8 @@ auto Canvas::PPMHeader() const -> std::vector<unsigned char> {
 constexpr int MAX_COLOR_VALUE = 255;
 
 auto Canvas::PPMBody() const -> std::vector<unsigned char> {
-  auto normalize = [](double d) {
+  const PerfScope scope(PerfRegion::Encoding);
+  auto normalize = [](Real d) {
     return static_cast<unsigned char>(
         std::max(std::min(static_cast<int>(std::lrint(MAX_COLOR_VALUE * d)),
                           MAX_COLOR_VALUE),
@@ -58,4 +133,213 @@ void Canvas::savePPM(const std::string &filename) const {
   file.close();
 }
 
-} // namespace RT
\ No newline at end of file
+auto Canvas::loadPPM(const std::string &filename) -> Canvas {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("cannot open " + filename);
+  }
+  std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+  size_t pos = 0;
+  auto nextToken = [&]() {
+    while (pos < data.size()) {
+      if (data[pos] == '#') {
+        while (pos < data.size() && data[pos] != '\n') {
+          pos++;
+        }
+      } else if (std::isspace(data[pos]) != 0) {
+        pos++;
+      } else {
+        break;
+      }
+    }
+    std::string token;
+    while (pos < data.size() && std::isspace(data[pos]) == 0) {
+      token.push_back(static_cast<char>(data[pos++]));
+    }
+    if (token.empty()) {
+      throw std::runtime_error("truncated PPM header in " + filename);
+    }
+    return token;
+  };
+  auto magic = nextToken();
+  if (magic != "P6" && magic != "P3") {
+    throw std::runtime_error(filename + " is not a PPM file");
+  }
+  auto width = std::stoi(nextToken());
+  auto height = std::stoi(nextToken());
+  auto maxValue = std::stoi(nextToken());
+  if (width <= 0 || height <= 0 || maxValue <= 0 || maxValue > 65535) {
+    throw std::runtime_error("invalid PPM header in " + filename);
+  }
+  Canvas canvas(width, height);
+  auto samples = static_cast<size_t>(width) * height * 3;
+  std::vector<Real> values(samples);
+  if (magic == "P3") {
+    for (auto &value : values) {
+      value = static_cast<Real>(std::stoi(nextToken()));
+    }
+  } else {
+    pos++;
+    auto bytes = maxValue < 256 ? 1 : 2;
+    if (data.size() < pos + samples * bytes) {
+      throw std::runtime_error("truncated PPM body in " + filename);
+    }
+    for (size_t i = 0; i < samples; i++) {
+      auto value = static_cast<unsigned>(data[pos + i * bytes]);
+      if (bytes == 2) {
+        value = (value << 8U) | data[pos + i * bytes + 1];
+      }
+      values[i] = static_cast<Real>(value);
+    }
+  }
+  for (size_t i = 0; i < canvas.pixels.size(); i++) {
+    canvas.pixels[i] = color(values[i * 3] / maxValue,
+                             values[i * 3 + 1] / maxValue,
+                             values[i * 3 + 2] / maxValue);
+  }
+  return canvas;
+}
+
+FloatImage::FloatImage(int width, int height, int channels, float value)
+    : width(width), height(height), channels(channels),
+      values(static_cast<size_t>(width) * height * channels, value) {
+  if (channels != 1 && channels != 3) {
+    throw std::invalid_argument("a float image has 1 or 3 channels");
+  }
+}
+
+void FloatImage::set(int pixelX, int pixelY, int channel, float value) {
+  values[(static_cast<size_t>(pixelY) * width + pixelX) * channels +
+         channel] = value;
+}
+
+auto FloatImage::at(int pixelX, int pixelY, int channel) const -> float {
+  return values[(static_cast<size_t>(pixelY) * width + pixelX) * channels +
+                channel];
+}
+
+auto PFMHeader(int width, int height, int channels) -> std::string {
+  auto scale = std::endian::native == std::endian::little ? "-1.0" : "1.0";
+  return std::string(channels == 3 ? "PF" : "Pf") + "\n" +
+         std::to_string(width) + " " + std::to_string(height) + "\n" +
+         scale + "\n";
+}
+
+void FloatImage::savePFM(const std::string &filename) const {
+  const PFMWriter writer(filename, width, height, channels);
+  writer.write(Tile{0, 0, width, height}, *this);
+  auto failure = writer.error();
+  if (!failure.empty()) {
+    throw std::runtime_error(failure);
+  }
+}
+
+auto FloatImage::loadPFM(const std::string &filename) -> FloatImage {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("cannot open " + filename);
+  }
+  std::string magic;
+  int width = 0;
+  int height = 0;
+  double scale = 0;
+  file >> magic >> width >> height >> scale;
+  if (!file || (magic != "PF" && magic != "Pf")) {
+    throw std::runtime_error(filename + " is not a PFM file");
+  }
+  if (width <= 0 || height <= 0 || scale == 0) {
+    throw std::runtime_error("invalid PFM header in " + filename);
+  }
+  file.get();
+  FloatImage image(width, height, magic == "PF" ? 3 : 1);
+  auto rowValues = static_cast<size_t>(width) * image.channels;
+  for (auto y = height - 1; y >= 0; y--) {
+    file.read(reinterpret_cast<char *>(image.values.data() + y * rowValues),
+              static_cast<std::streamsize>(rowValues * sizeof(float)));
+  }
+  if (!file) {
+    throw std::runtime_error("truncated PFM body in " + filename);
+  }
+  if ((scale < 0) != (std::endian::native == std::endian::little)) {
+    for (auto &value : image.values) {
+      uint32_t bits = 0;
+      std::memcpy(&bits, &value, sizeof(bits));
+      bits = ((bits & 0xffU) << 24U) | ((bits & 0xff00U) << 8U) |
+             ((bits >> 8U) & 0xff00U) | (bits >> 24U);
+      std::memcpy(&value, &bits, sizeof(bits));
+    }
+  }
+  return image;
+}
+
+auto writeAt(int fd, const char *data, size_t size, off_t offset) -> bool {
+  while (size > 0) {
+    auto written = pwrite(fd, data, size, offset);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+    offset += written;
+  }
+  return true;
+}
+
+PFMWriter::PFMWriter(const std::string &filename, int width, int height,
+                     int channels)
+    : fd(open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)),
+      width(width), height(height), channels(channels), filename(filename) {
+  if (fd < 0) {
+    throw std::runtime_error("cannot open " + filename);
+  }
+  auto header = PFMHeader(width, height, channels);
+  headerSize = header.size();
+  auto size = headerSize +
+              static_cast<size_t>(width) * height * channels * sizeof(float);
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0 ||
+      !writeAt(fd, header.data(), header.size(), 0)) {
+    close(fd);
+    throw std::runtime_error("cannot write " + filename);
+  }
+}
+
+PFMWriter::~PFMWriter() { close(fd); }
+
+// PFM rows run from the bottom of the image up.
+void PFMWriter::write(const Tile &tile, const FloatImage &image) const {
+  const PerfScope scope(PerfRegion::Encoding);
+  {
+    const std::lock_guard lock(mutex);
+    if (!failure.empty()) {
+      return;
+    }
+  }
+  auto rowBytes = static_cast<size_t>(tile.width) * channels * sizeof(float);
+  for (auto y = tile.y; y < tile.y + tile.height; y++) {
+    auto first = (static_cast<size_t>(y) * width + tile.x) * channels;
+    auto row = static_cast<size_t>(height - 1 - y);
+    auto offset = headerSize +
+                  (row * width + tile.x) * channels * sizeof(float);
+    if (!writeAt(fd,
+                 reinterpret_cast<const char *>(image.values.data() + first),
+                 rowBytes, static_cast<off_t>(offset))) {
+      const std::string reason = std::strerror(errno);
+      const std::lock_guard lock(mutex);
+      if (failure.empty()) {
+        failure = "cannot write PFM rows to " + filename + ": " + reason;
+      }
+      return;
+    }
+  }
+}
+
+auto PFMWriter::error() const -> std::string {
+  const std::lock_guard lock(mutex);
+  return failure;
+}
+
+} // namespace RT
@@ -0,0 +1,209 @@
+#include "Checkpoint.hpp"
+#include "MappedFile.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace RT {
+
+constexpr std::array<char, 8> CHECKPOINT_MAGIC{'R', 'T', 'C', 'K',
+                                               'P', 'T', '0', '1'};
+
+struct CheckpointHeader {
+  std::array<char, 8> magic;
+  uint32_t realBytes;
+  int32_t width;
+  int32_t height;
+  uint32_t reserved;
+  uint64_t key;
+};
+
+constexpr size_t RECORD_TILE_BYTES = 4 * sizeof(int32_t);
+
+auto checkpointChecksum(const unsigned char *data, size_t size) -> uint64_t {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < size; i++) {
+    h ^= data[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+auto writeAll(int fd, const unsigned char *data, size_t size) -> bool {
+  while (size > 0) {
+    auto written = write(fd, data, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+Checkpoint::Checkpoint(const std::string &filename, int width, int height,
+                       uint64_t key, bool resume)
+    : width(width), height(height), filename(filename),
+      lastSync(std::chrono::steady_clock::now()) {
+  struct stat info {};
+  size_t valid = 0;
+  if (resume && stat(filename.c_str(), &info) == 0 && info.st_size > 0) {
+    valid = load(filename, key);
+  }
+  auto flags = O_WRONLY | O_CREAT | O_APPEND | (valid == 0 ? O_TRUNC : 0);
+  fd = open(filename.c_str(), flags, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("cannot open checkpoint " + filename);
+  }
+  if (valid > 0) {
+    if (ftruncate(fd, static_cast<off_t>(valid)) != 0) {
+      close(fd);
+      throw std::runtime_error("cannot truncate checkpoint " + filename);
+    }
+    return;
+  }
+  CheckpointHeader header{CHECKPOINT_MAGIC, sizeof(Real), width, height, 0,
+                          key};
+  std::array<unsigned char, sizeof(CheckpointHeader)> bytes{};
+  std::memcpy(bytes.data(), &header, sizeof(header));
+  if (!writeAll(fd, bytes.data(), bytes.size())) {
+    close(fd);
+    throw std::runtime_error("cannot write checkpoint " + filename);
+  }
+}
+
+Checkpoint::~Checkpoint() {
+  if (fd >= 0) {
+    fdatasync(fd);
+    close(fd);
+  }
+}
+
+// Returns the length of the header and the whole records after it; a
+// record that is short or fails its checksum ends the file.
+auto Checkpoint::load(const std::string &filename, uint64_t key) -> size_t {
+  const MappedFile file(filename);
+  CheckpointHeader header{};
+  if (file.size() < sizeof(header)) {
+    return 0;
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (header.magic != CHECKPOINT_MAGIC) {
+    throw std::runtime_error(filename + " is not a checkpoint");
+  }
+  if (header.realBytes != sizeof(Real) || header.width != width ||
+      header.height != height || header.key != key) {
+    throw std::runtime_error(filename + " is a checkpoint of another render");
+  }
+  auto offset = sizeof(header);
+  while (file.size() - offset >= RECORD_TILE_BYTES) {
+    const auto *record = file.data() + offset;
+    std::array<int32_t, 4> rect{};
+    std::memcpy(rect.data(), record, RECORD_TILE_BYTES);
+    const Tile tile{rect[0], rect[1], rect[2], rect[3]};
+    if (tile.width <= 0 || tile.height <= 0 ||
+        !(clipTile(tile, width, height) == tile)) {
+      break;
+    }
+    auto count = static_cast<size_t>(tile.width) * tile.height * 3;
+    auto length = RECORD_TILE_BYTES + count * sizeof(Real);
+    if (file.size() - offset < length + sizeof(uint64_t)) {
+      break;
+    }
+    uint64_t checksum = 0;
+    std::memcpy(&checksum, record + length, sizeof(checksum));
+    if (checksum != checkpointChecksum(record, length)) {
+      break;
+    }
+    auto first = values.size();
+    values.resize(first + count);
+    std::memcpy(values.data() + first, record + RECORD_TILE_BYTES,
+                count * sizeof(Real));
+    restored.push_back(tile);
+    offset += length + sizeof(checksum);
+  }
+  return offset;
+}
+
+auto Checkpoint::tiles() const -> const std::vector<Tile> & {
+  return restored;
+}
+
+auto Checkpoint::missing(const std::vector<Tile> &plan) const
+    -> std::vector<Tile> {
+  std::vector<Tile> result;
+  for (const auto &tile : plan) {
+    if (std::find(restored.begin(), restored.end(), tile) == restored.end()) {
+      result.push_back(tile);
+    }
+  }
+  return result;
+}
+
+void Checkpoint::restore(Canvas &canvas) const {
+  restore(canvas, Tile{0, 0, canvas.width, canvas.height});
+}
+
+void Checkpoint::restore(Canvas &canvas, const Tile &window) const {
+  const auto *v = values.data();
+  for (const auto &tile : restored) {
+    for (auto y = tile.y; y < tile.y + tile.height; y++) {
+      for (auto x = tile.x; x < tile.x + tile.width; x++, v += 3) {
+        auto cx = x - window.x;
+        auto cy = y - window.y;
+        if (cx >= 0 && cy >= 0 && cx < canvas.width && cy < canvas.height) {
+          canvas.writePixel(cx, cy, color(v[0], v[1], v[2]));
+        }
+      }
+    }
+  }
+}
+
+void Checkpoint::save(const Tile &tile, const std::vector<Color> &pixels) {
+  auto count = static_cast<size_t>(tile.width) * tile.height;
+  std::vector<unsigned char> record(RECORD_TILE_BYTES +
+                                    count * 3 * sizeof(Real) +
+                                    sizeof(uint64_t));
+  const std::array<int32_t, 4> rect{tile.x, tile.y, tile.width, tile.height};
+  std::memcpy(record.data(), rect.data(), RECORD_TILE_BYTES);
+  auto *out = record.data() + RECORD_TILE_BYTES;
+  for (size_t i = 0; i < count; i++) {
+    const std::array<Real, 3> rgb{pixels[i].red, pixels[i].green,
+                                  pixels[i].blue};
+    std::memcpy(out, rgb.data(), sizeof(rgb));
+    out += sizeof(rgb);
+  }
+  auto checksum = checkpointChecksum(
+      record.data(), record.size() - sizeof(uint64_t));
+  std::memcpy(out, &checksum, sizeof(checksum));
+
+  const std::lock_guard lock(mutex);
+  if (!failure.empty()) {
+    return;
+  }
+  if (!writeAll(fd, record.data(), record.size())) {
+    failure = "cannot append to checkpoint " + filename + ": " +
+              std::strerror(errno);
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  if (now - lastSync >= CHECKPOINT_SYNC_INTERVAL) {
+    fdatasync(fd);
+    lastSync = now;
+  }
+}
+
+auto Checkpoint::error() const -> std::string {
+  const std::lock_guard lock(mutex);
+  return failure;
+}
+
+} // namespace RT
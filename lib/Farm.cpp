@@ -0,0 +1,488 @@
+#include "Farm.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace RT {
+
+enum class Message : uint32_t { Job = 1, Result = 2, Stop = 3, Hello = 4 };
+
+constexpr size_t HEADER_BYTES = 2 * sizeof(uint32_t);
+constexpr size_t HELLO_BYTES = sizeof(uint64_t) + sizeof(uint32_t);
+constexpr size_t TILE_BYTES = 4 * sizeof(int32_t);
+constexpr size_t JOBS_PER_WORKER = 2;
+constexpr int POLL_INTERVAL_MS = 100;
+constexpr int RECEIVE_CHUNK = 1 << 16;
+
+auto Endpoint::parse(const std::string &text) -> Endpoint {
+  if (text.starts_with("unix:")) {
+    return {Kind::Unix, text.substr(5), 0};
+  }
+  auto rest = text.starts_with("tcp:") ? text.substr(4) : text;
+  auto colon = rest.rfind(':');
+  if (colon == std::string::npos) {
+    throw std::invalid_argument("endpoint needs a port: " + text);
+  }
+  return {Kind::Tcp, rest.substr(0, colon), std::stoi(rest.substr(colon + 1))};
+}
+
+auto Endpoint::str() const -> std::string {
+  if (kind == Kind::Unix) {
+    return "unix:" + address;
+  }
+  return "tcp:" + address + ":" + std::to_string(port);
+}
+
+auto unixAddress(const std::string &path) -> sockaddr_un {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::invalid_argument("socket path too long: " + path);
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+auto tcpAddresses(const Endpoint &endpoint, bool passive) -> addrinfo * {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+  addrinfo *found = nullptr;
+  auto port = std::to_string(endpoint.port);
+  auto status = getaddrinfo(
+      endpoint.address.empty() ? nullptr : endpoint.address.c_str(),
+      port.c_str(), &hints, &found);
+  if (status != 0) {
+    throw std::runtime_error("cannot resolve " + endpoint.str() + ": " +
+                             gai_strerror(status));
+  }
+  return found;
+}
+
+auto sendAll(int fd, const unsigned char *data, size_t size) -> bool {
+  while (size > 0) {
+    auto sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    data += sent;
+    size -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+auto receiveAll(int fd, unsigned char *data, size_t size) -> bool {
+  while (size > 0) {
+    auto received = recv(fd, data, size, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    data += received;
+    size -= static_cast<size_t>(received);
+  }
+  return true;
+}
+
+auto sendMessage(int fd, Message type, const std::vector<unsigned char> &body)
+    -> bool {
+  std::vector<unsigned char> message(HEADER_BYTES);
+  auto kind = static_cast<uint32_t>(type);
+  auto length = static_cast<uint32_t>(body.size());
+  std::memcpy(message.data(), &kind, sizeof(kind));
+  std::memcpy(message.data() + sizeof(kind), &length, sizeof(length));
+  message.insert(message.end(), body.begin(), body.end());
+  return sendAll(fd, message.data(), message.size());
+}
+
+void writeTile(unsigned char *out, const Tile &tile) {
+  const std::array<int32_t, 4> fields{tile.x, tile.y, tile.width, tile.height};
+  std::memcpy(out, fields.data(), TILE_BYTES);
+}
+
+auto readTile(const unsigned char *in) -> Tile {
+  std::array<int32_t, 4> fields{};
+  std::memcpy(fields.data(), in, TILE_BYTES);
+  return {fields[0], fields[1], fields[2], fields[3]};
+}
+
+auto sendHello(int fd, uint64_t key) -> bool {
+  std::vector<unsigned char> hello(HELLO_BYTES);
+  auto realBytes = static_cast<uint32_t>(sizeof(Real));
+  std::memcpy(hello.data(), &key, sizeof(key));
+  std::memcpy(hello.data() + sizeof(key), &realBytes, sizeof(realBytes));
+  return sendMessage(fd, Message::Hello, hello);
+}
+
+auto helloMatches(const unsigned char *body, size_t length, uint64_t key)
+    -> bool {
+  if (length != HELLO_BYTES) {
+    return false;
+  }
+  uint64_t theirKey = 0;
+  uint32_t realBytes = 0;
+  std::memcpy(&theirKey, body, sizeof(theirKey));
+  std::memcpy(&realBytes, body + sizeof(theirKey), sizeof(realBytes));
+  return theirKey == key && realBytes == sizeof(Real);
+}
+
+Coordinator::Coordinator(const std::string &endpoint, uint64_t key,
+                         std::chrono::milliseconds jobTimeout)
+    : bound(Endpoint::parse(endpoint)), listener(-1), key(key),
+      jobTimeout(jobTimeout) {
+  if (bound.kind == Endpoint::Kind::Unix) {
+    auto address = unixAddress(bound.address);
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(bound.address.c_str());
+    if (listener < 0 ||
+        bind(listener, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) != 0) {
+      close(listener);
+      throw std::runtime_error("cannot bind " + bound.str());
+    }
+  } else {
+    auto *found = tcpAddresses(bound, true);
+    for (auto *a = found; a != nullptr; a = a->ai_next) {
+      listener = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+      if (listener < 0) {
+        continue;
+      }
+      int yes = 1;
+      setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+      if (bind(listener, a->ai_addr, a->ai_addrlen) == 0) {
+        break;
+      }
+      close(listener);
+      listener = -1;
+    }
+    freeaddrinfo(found);
+    if (listener < 0) {
+      throw std::runtime_error("cannot bind " + bound.str());
+    }
+    sockaddr_storage address{};
+    socklen_t length = sizeof(address);
+    getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length);
+    if (address.ss_family == AF_INET6) {
+      bound.port = ntohs(reinterpret_cast<sockaddr_in6 *>(&address)->sin6_port);
+    } else {
+      bound.port = ntohs(reinterpret_cast<sockaddr_in *>(&address)->sin_port);
+    }
+  }
+  if (listen(listener, SOMAXCONN) != 0) {
+    close(listener);
+    throw std::runtime_error("cannot listen on " + bound.str());
+  }
+  fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+}
+
+Coordinator::~Coordinator() {
+  shutdown();
+  close(listener);
+  if (bound.kind == Endpoint::Kind::Unix) {
+    unlink(bound.address.c_str());
+  }
+}
+
+auto Coordinator::endpoint() const -> std::string { return bound.str(); }
+
+auto Coordinator::workerCount() const -> size_t { return workers.size(); }
+
+auto Coordinator::reassigned() const -> size_t { return reassignedTiles; }
+
+void Coordinator::accept() {
+  while (true) {
+    auto fd = ::accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      return;
+    }
+    if (bound.kind == Endpoint::Kind::Tcp) {
+      int yes = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    }
+    if (!sendHello(fd, key)) {
+      close(fd);
+      continue;
+    }
+    workers.push_back(Worker{fd, {}, {}});
+  }
+}
+
+void Coordinator::drop(size_t worker, std::deque<size_t> &pending) {
+  auto &w = workers[worker];
+  for (auto job : w.jobs) {
+    pending.push_front(job);
+    reassignedTiles++;
+  }
+  close(w.fd);
+  workers.erase(workers.begin() + static_cast<std::ptrdiff_t>(worker));
+}
+
+void Coordinator::render(Canvas &canvas, const std::vector<Tile> &tiles,
+                         std::chrono::milliseconds idleTimeout) {
+  render(canvas, tiles, Tile{0, 0, canvas.width, canvas.height}, idleTimeout);
+}
+
+void Coordinator::render(Canvas &canvas, const std::vector<Tile> &tiles,
+                         const Tile &window,
+                         std::chrono::milliseconds idleTimeout) {
+  std::deque<size_t> pending;
+  for (size_t i = 0; i < tiles.size(); i++) {
+    pending.push_back(i);
+  }
+  std::vector<bool> done(tiles.size(), false);
+  auto remaining = tiles.size();
+  auto lastSeen = std::chrono::steady_clock::now();
+  std::vector<unsigned char> job(TILE_BYTES);
+  std::vector<unsigned char> chunk(RECEIVE_CHUNK);
+  while (remaining > 0) {
+    for (size_t w = 0; w < workers.size();) {
+      auto alive = true;
+      while (alive && workers[w].greeted &&
+             workers[w].jobs.size() < JOBS_PER_WORKER && !pending.empty()) {
+        auto next = pending.front();
+        pending.pop_front();
+        if (workers[w].jobs.empty()) {
+          workers[w].started = std::chrono::steady_clock::now();
+        }
+        workers[w].jobs.push_back(next);
+        writeTile(job.data(), tiles[next]);
+        alive = sendMessage(workers[w].fd, Message::Job, job);
+      }
+      if (alive) {
+        w++;
+      } else {
+        drop(w, pending);
+      }
+    }
+
+    std::vector<pollfd> fds{{listener, POLLIN, 0}};
+    for (const auto &w : workers) {
+      fds.push_back({w.fd, POLLIN, 0});
+    }
+    poll(fds.data(), fds.size(), POLL_INTERVAL_MS);
+
+    std::vector<size_t> dead;
+    for (size_t w = 0; w < workers.size(); w++) {
+      if (fds[w + 1].revents == 0) {
+        continue;
+      }
+      auto &worker = workers[w];
+      auto received = recv(worker.fd, chunk.data(), chunk.size(), MSG_DONTWAIT);
+      if (received <= 0) {
+        if (received == 0 || (errno != EAGAIN && errno != EINTR)) {
+          dead.push_back(w);
+        }
+        continue;
+      }
+      worker.inbox.insert(worker.inbox.end(), chunk.begin(),
+                          chunk.begin() + received);
+      size_t used = 0;
+      auto rejected = false;
+      while (!rejected && worker.inbox.size() - used >= HEADER_BYTES) {
+        uint32_t kind = 0;
+        uint32_t length = 0;
+        std::memcpy(&kind, worker.inbox.data() + used, sizeof(kind));
+        std::memcpy(&length, worker.inbox.data() + used + sizeof(kind),
+                    sizeof(length));
+        if (worker.inbox.size() - used - HEADER_BYTES < length) {
+          break;
+        }
+        const auto *body = worker.inbox.data() + used + HEADER_BYTES;
+        used += HEADER_BYTES + length;
+        if (!worker.greeted) {
+          worker.greeted = static_cast<Message>(kind) == Message::Hello &&
+                           helloMatches(body, length, key);
+          rejected = !worker.greeted;
+          continue;
+        }
+        if (static_cast<Message>(kind) != Message::Result ||
+            length < TILE_BYTES) {
+          continue;
+        }
+        auto tile = readTile(body);
+        auto it = std::find_if(
+            worker.jobs.begin(), worker.jobs.end(),
+            [&](size_t index) { return tiles[index] == tile; });
+        auto pixels = static_cast<size_t>(tile.width) * tile.height;
+        if (it == worker.jobs.end() ||
+            length != TILE_BYTES + pixels * 3 * sizeof(Real)) {
+          continue;
+        }
+        auto index = *it;
+        worker.jobs.erase(it);
+        worker.started = std::chrono::steady_clock::now();
+        if (done[index]) {
+          continue;
+        }
+        const auto *values = body + TILE_BYTES;
+        for (auto y = 0; y < tile.height; y++) {
+          for (auto x = 0; x < tile.width; x++) {
+            std::array<Real, 3> rgb{};
+            std::memcpy(rgb.data(), values, sizeof(rgb));
+            values += sizeof(rgb);
+            canvas.writePixel(tile.x - window.x + x, tile.y - window.y + y,
+                              color(rgb[0], rgb[1], rgb[2]));
+          }
+        }
+        done[index] = true;
+        remaining--;
+      }
+      if (rejected) {
+        dead.push_back(w);
+        continue;
+      }
+      worker.inbox.erase(worker.inbox.begin(),
+                         worker.inbox.begin() +
+                             static_cast<std::ptrdiff_t>(used));
+    }
+    auto now = std::chrono::steady_clock::now();
+    for (size_t w = 0; w < workers.size(); w++) {
+      const auto &worker = workers[w];
+      if (!worker.jobs.empty() && now - worker.started > jobTimeout) {
+        dead.push_back(w);
+      }
+    }
+    std::ranges::sort(dead);
+    dead.erase(std::unique(dead.begin(), dead.end()), dead.end());
+    for (auto it = dead.rbegin(); it != dead.rend(); it++) {
+      drop(*it, pending);
+    }
+    if ((fds[0].revents & POLLIN) != 0) {
+      accept();
+    }
+
+    if (std::ranges::any_of(workers,
+                            [](const Worker &w) { return w.greeted; })) {
+      lastSeen = now;
+    } else if (now - lastSeen > idleTimeout) {
+      throw std::runtime_error("no workers connected to " + bound.str());
+    }
+  }
+}
+
+void Coordinator::shutdown() {
+  for (const auto &w : workers) {
+    sendMessage(w.fd, Message::Stop, {});
+    close(w.fd);
+  }
+  workers.clear();
+}
+
+auto connectTo(const Endpoint &endpoint) -> int {
+  if (endpoint.kind == Endpoint::Kind::Unix) {
+    auto address = unixAddress(endpoint.address);
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&address),
+                           sizeof(address)) == 0) {
+      return fd;
+    }
+    close(fd);
+    return -1;
+  }
+  auto *found = tcpAddresses(endpoint, false);
+  auto fd = -1;
+  for (auto *a = found; a != nullptr && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(found);
+  if (fd >= 0) {
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+  }
+  return fd;
+}
+
+auto runWorker(const std::string &endpoint, const TileRenderer &render,
+               uint64_t key, std::chrono::milliseconds connectTimeout)
+    -> size_t {
+  auto target = Endpoint::parse(endpoint);
+  auto deadline = std::chrono::steady_clock::now() + connectTimeout;
+  auto fd = connectTo(target);
+  while (fd < 0) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      throw std::runtime_error("cannot connect to " + target.str());
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+    fd = connectTo(target);
+  }
+  size_t rendered = 0;
+  auto greeted = false;
+  std::array<unsigned char, HEADER_BYTES> header{};
+  std::vector<unsigned char> body;
+  std::vector<Color> pixels;
+  if (!sendHello(fd, key)) {
+    close(fd);
+    return rendered;
+  }
+  while (receiveAll(fd, header.data(), header.size())) {
+    uint32_t kind = 0;
+    uint32_t length = 0;
+    std::memcpy(&kind, header.data(), sizeof(kind));
+    std::memcpy(&length, header.data() + sizeof(kind), sizeof(length));
+    body.resize(length);
+    if (!receiveAll(fd, body.data(), length) ||
+        static_cast<Message>(kind) == Message::Stop) {
+      break;
+    }
+    if (!greeted) {
+      if (static_cast<Message>(kind) != Message::Hello ||
+          !helloMatches(body.data(), length, key)) {
+        close(fd);
+        throw std::runtime_error(target.str() +
+                                 " is rendering a different image or build");
+      }
+      greeted = true;
+      continue;
+    }
+    if (static_cast<Message>(kind) != Message::Job || length != TILE_BYTES) {
+      continue;
+    }
+    auto tile = readTile(body.data());
+    auto count = static_cast<size_t>(tile.width) * tile.height;
+    pixels.assign(count, color(0, 0, 0));
+    try {
+      render(tile, pixels);
+    } catch (...) {
+      close(fd);
+      throw;
+    }
+    std::vector<unsigned char> result(TILE_BYTES + count * 3 * sizeof(Real));
+    writeTile(result.data(), tile);
+    auto *out = result.data() + TILE_BYTES;
+    for (const auto &p : pixels) {
+      const std::array<Real, 3> rgb{p.red, p.green, p.blue};
+      std::memcpy(out, rgb.data(), sizeof(rgb));
+      out += sizeof(rgb);
+    }
+    if (!sendMessage(fd, Message::Result, result)) {
+      break;
+    }
+    rendered++;
+  }
+  close(fd);
+  return rendered;
+}
+
+} // namespace RT
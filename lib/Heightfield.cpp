@@ -0,0 +1,432 @@
+#include "Heightfield.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace RT {
+
+auto halfToFloat(uint16_t half) -> float {
+  auto sign = static_cast<uint32_t>(half & 0x8000U) << 16U;
+  auto exponent = (half >> 10U) & 0x1FU;
+  auto mantissa = static_cast<uint32_t>(half & 0x3FFU);
+  uint32_t bits = 0;
+  if (exponent == 0) {
+    if (mantissa != 0) {
+      auto value = std::ldexp(static_cast<float>(mantissa), -24);
+      return sign != 0 ? -value : value;
+    }
+    bits = sign;
+  } else if (exponent == 0x1FU) {
+    bits = sign | 0x7F800000U | (mantissa << 13U);
+  } else {
+    bits = sign | ((exponent + 112U) << 23U) | (mantissa << 13U);
+  }
+  float value = 0;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Rounds to the nearest half, ties to even.
+auto floatToHalf(float value) -> uint16_t {
+  uint32_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  auto sign = static_cast<uint16_t>((bits >> 16U) & 0x8000U);
+  auto exponent = static_cast<int>((bits >> 23U) & 0xFFU);
+  auto mantissa = bits & 0x7FFFFFU;
+  if (exponent == 0xFF) {
+    return static_cast<uint16_t>(sign | 0x7C00U | (mantissa != 0 ? 0x200U : 0U));
+  }
+  auto e = exponent - 127 + 15;
+  if (e >= 0x1F) {
+    return static_cast<uint16_t>(sign | 0x7C00U);
+  }
+  auto round = [](uint32_t kept, uint32_t rest, uint32_t halfway) {
+    return rest > halfway || (rest == halfway && (kept & 1U) != 0) ? kept + 1
+                                                                   : kept;
+  };
+  if (e <= 0) {
+    if (e < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000U;
+    auto shift = static_cast<uint32_t>(14 - e);
+    auto kept = mantissa >> shift;
+    auto rest = mantissa & ((1U << shift) - 1);
+    return static_cast<uint16_t>(sign |
+                                 round(kept, rest, 1U << (shift - 1)));
+  }
+  auto kept = (static_cast<uint32_t>(e) << 10U) | (mantissa >> 13U);
+  return static_cast<uint16_t>(sign | round(kept, mantissa & 0x1FFFU, 0x1000U));
+}
+
+auto sampleBytes(ElevationFormat format) -> size_t {
+  return format == ElevationFormat::Float16 ? 2 : 4;
+}
+
+ElevationGrid::ElevationGrid(int width, int depth, ElevationFormat format)
+    : width(width), depth(depth), format(format) {
+  if (width < 2 || depth < 2) {
+    throw std::invalid_argument("an elevation grid needs at least 2x2 samples");
+  }
+}
+
+auto ElevationGrid::fromSamples(int width, int depth,
+                                const std::vector<float> &samples,
+                                ElevationFormat format)
+    -> std::shared_ptr<const ElevationGrid> {
+  std::shared_ptr<ElevationGrid> grid(new ElevationGrid(width, depth, format));
+  auto count = static_cast<size_t>(width) * static_cast<size_t>(depth);
+  if (samples.size() != count) {
+    throw std::invalid_argument("elevation sample count does not match grid");
+  }
+  grid->owned.resize(count * sampleBytes(format));
+  for (size_t i = 0; i < count; i++) {
+    if (format == ElevationFormat::Float16) {
+      auto half = floatToHalf(samples[i]);
+      std::memcpy(grid->owned.data() + i * 2, &half, sizeof(half));
+    } else {
+      std::memcpy(grid->owned.data() + i * 4, &samples[i], sizeof(float));
+    }
+  }
+  grid->samples = grid->owned.data();
+  return grid;
+}
+
+auto ElevationGrid::map(const std::string &filename, int width, int depth,
+                        ElevationFormat format, size_t offset)
+    -> std::shared_ptr<const ElevationGrid> {
+  std::shared_ptr<ElevationGrid> grid(new ElevationGrid(width, depth, format));
+  grid->file.emplace(filename);
+  auto needed = static_cast<size_t>(width) * static_cast<size_t>(depth) *
+                sampleBytes(format);
+  if (grid->file->size() < offset + needed) {
+    throw std::runtime_error("truncated elevation grid in " + filename);
+  }
+  grid->samples = grid->file->data() + offset;
+  return grid;
+}
+
+// Samples are stored little endian, as on every host this builds for.
+auto ElevationGrid::at(int x, int z) const -> float {
+  auto index = static_cast<size_t>(z) * static_cast<size_t>(width) +
+               static_cast<size_t>(x);
+  if (format == ElevationFormat::Float16) {
+    uint16_t half = 0;
+    std::memcpy(&half, samples + index * 2, sizeof(half));
+    return halfToFloat(half);
+  }
+  float value = 0;
+  std::memcpy(&value, samples + index * 4, sizeof(value));
+  return value;
+}
+
+auto ElevationGrid::bytes() const -> size_t {
+  return static_cast<size_t>(width) * static_cast<size_t>(depth) *
+         sampleBytes(format);
+}
+
+Heightfield::Heightfield(std::shared_ptr<const ElevationGrid> grid)
+    : samples(std::move(grid)) {
+  assert(samples != nullptr && "Elevation grid is null");
+  auto levels = std::make_shared<std::vector<Level>>();
+  auto leafSize = 1 << HEIGHTFIELD_LEAF_LEVEL;
+  auto cellsX = samples->width - 1;
+  auto cellsZ = samples->depth - 1;
+  Level leaf{(cellsX + leafSize - 1) / leafSize,
+             (cellsZ + leafSize - 1) / leafSize,
+             {},
+             {}};
+  auto nodes = static_cast<size_t>(leaf.width) * leaf.depth;
+  leaf.low.assign(nodes, std::numeric_limits<float>::infinity());
+  leaf.high.assign(nodes, -std::numeric_limits<float>::infinity());
+  // One pass over the samples in file order; a sample on a leaf boundary
+  // belongs to the leaves on both sides.
+  for (auto z = 0; z < samples->depth; z++) {
+    auto z0 = std::min(z / leafSize, leaf.depth - 1);
+    auto z1 = z % leafSize == 0 && z > 0 ? z / leafSize - 1 : z0;
+    for (auto x = 0; x < samples->width; x++) {
+      auto h = samples->at(x, z);
+      auto x0 = std::min(x / leafSize, leaf.width - 1);
+      auto x1 = x % leafSize == 0 && x > 0 ? x / leafSize - 1 : x0;
+      for (auto nz : {z0, z1}) {
+        for (auto nx : {x0, x1}) {
+          auto i = static_cast<size_t>(nz) * leaf.width + nx;
+          leaf.low[i] = std::min(leaf.low[i], h);
+          leaf.high[i] = std::max(leaf.high[i], h);
+        }
+      }
+    }
+  }
+  levels->push_back(std::move(leaf));
+  while (levels->back().width > 1 || levels->back().depth > 1) {
+    const auto &below = levels->back();
+    Level level{(below.width + 1) / 2, (below.depth + 1) / 2, {}, {}};
+    auto count = static_cast<size_t>(level.width) * level.depth;
+    level.low.assign(count, std::numeric_limits<float>::infinity());
+    level.high.assign(count, -std::numeric_limits<float>::infinity());
+    for (auto z = 0; z < below.depth; z++) {
+      for (auto x = 0; x < below.width; x++) {
+        auto from = static_cast<size_t>(z) * below.width + x;
+        auto to = static_cast<size_t>(z / 2) * level.width + x / 2;
+        level.low[to] = std::min(level.low[to], below.low[from]);
+        level.high[to] = std::max(level.high[to], below.high[from]);
+      }
+    }
+    levels->push_back(std::move(level));
+  }
+  pyramid = std::move(levels);
+}
+
+auto Heightfield::grid() const -> const ElevationGrid & { return *samples; }
+
+auto Heightfield::pyramidLevels() const -> int {
+  return static_cast<int>(pyramid->size());
+}
+
+auto Heightfield::topLevel() const -> int {
+  return HEIGHTFIELD_LEAF_LEVEL + pyramidLevels() - 1;
+}
+
+auto Heightfield::levelSize(int level) const -> std::pair<int, int> {
+  if (level == 0) {
+    return {samples->width - 1, samples->depth - 1};
+  }
+  const auto &l = (*pyramid)[static_cast<size_t>(level -
+                                                 HEIGHTFIELD_LEAF_LEVEL)];
+  return {l.width, l.depth};
+}
+
+auto Heightfield::bounds() const -> BoundingBox {
+  const auto &top = pyramid->back();
+  return {point(0, top.low[0], 0), point(1, top.high[0], 1)};
+}
+
+auto Heightfield::gridRay(const Ray &ray) const -> GridRay {
+  auto sx = static_cast<Real>(samples->width - 1);
+  auto sz = static_cast<Real>(samples->depth - 1);
+  return {ray.origin.x * sx,    ray.origin.y, ray.origin.z * sz,
+          ray.direction.x * sx, ray.direction.y, ray.direction.z * sz};
+}
+
+// Grid space scales x and z to cell units, which leaves ray parameters
+// unchanged, so hits are reported in the object ray's t.
+template <typename Hit>
+auto Heightfield::cell(const GridRay &ray, int x, int z, Hit &hit) const
+    -> bool {
+  constexpr Real slack = 1e-7;
+  const std::array<Real, 3> o{ray.ox, ray.oy, ray.oz};
+  const std::array<Real, 3> d{ray.dx, ray.dy, ray.dz};
+  auto vertex = [&](int vx, int vz) -> std::array<Real, 3> {
+    return {static_cast<Real>(vx), samples->at(vx, vz), static_cast<Real>(vz)};
+  };
+  auto sub = [](const std::array<Real, 3> &a, const std::array<Real, 3> &b) {
+    return std::array<Real, 3>{a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+  };
+  auto crossed = [](const std::array<Real, 3> &a,
+                    const std::array<Real, 3> &b) {
+    return std::array<Real, 3>{a[1] * b[2] - a[2] * b[1],
+                               a[2] * b[0] - a[0] * b[2],
+                               a[0] * b[1] - a[1] * b[0]};
+  };
+  auto dotted = [](const std::array<Real, 3> &a, const std::array<Real, 3> &b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  };
+  auto p00 = vertex(x, z);
+  auto p10 = vertex(x + 1, z);
+  auto p11 = vertex(x + 1, z + 1);
+  auto p01 = vertex(x, z + 1);
+  auto triangle = [&](const std::array<Real, 3> &a,
+                      const std::array<Real, 3> &b,
+                      const std::array<Real, 3> &c) -> std::optional<Real> {
+    auto e1 = sub(b, a);
+    auto e2 = sub(c, a);
+    auto p = crossed(d, e2);
+    auto det = dotted(e1, p);
+    if (std::abs(det) < std::numeric_limits<Real>::min()) {
+      return std::nullopt;
+    }
+    auto inverse = 1 / det;
+    auto s = sub(o, a);
+    auto u = dotted(s, p) * inverse;
+    if (u < -slack || u > 1 + slack) {
+      return std::nullopt;
+    }
+    auto q = crossed(s, e1);
+    auto v = dotted(d, q) * inverse;
+    if (v < -slack || u + v > 1 + slack) {
+      return std::nullopt;
+    }
+    return dotted(e2, q) * inverse;
+  };
+  for (const auto &t : {triangle(p00, p10, p11), triangle(p00, p11, p01)}) {
+    if (t.has_value() && hit(t.value())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// A 2D DDA over the nodes of level inside [x0, x1) x [z0, z1) for ray
+// parameters [from, to]. Nodes whose height range the ray's height over
+// the node misses are skipped; the rest are walked one level down, and
+// cells are tested against their two triangles. Returns once hit does.
+template <typename Hit>
+auto Heightfield::walk(const GridRay &ray, int level, int x0, int z0, int x1,
+                       int z1, Real from, Real to, Hit &hit) const -> bool {
+  constexpr Real inf = std::numeric_limits<Real>::infinity();
+  constexpr Real slack = 1e-6;
+  auto size = static_cast<Real>(1 << level);
+  const Level *nodes =
+      level == 0
+          ? nullptr
+          : &(*pyramid)[static_cast<size_t>(level - HEIGHTFIELD_LEAF_LEVEL)];
+  auto child = level == HEIGHTFIELD_LEAF_LEVEL ? 0 : level - 1;
+  auto [childWidth, childDepth] = levelSize(child);
+  auto scale = 1 << (level - child);
+
+  auto ix = std::clamp(
+      static_cast<int>(std::floor((ray.ox + from * ray.dx) / size)), x0,
+      x1 - 1);
+  auto iz = std::clamp(
+      static_cast<int>(std::floor((ray.oz + from * ray.dz) / size)), z0,
+      z1 - 1);
+  auto stepX = ray.dx > 0 ? 1 : (ray.dx < 0 ? -1 : 0);
+  auto stepZ = ray.dz > 0 ? 1 : (ray.dz < 0 ? -1 : 0);
+  auto nextX = stepX == 0 ? inf
+                          : ((ix + (stepX > 0 ? 1 : 0)) * size - ray.ox) /
+                                ray.dx;
+  auto nextZ = stepZ == 0 ? inf
+                          : ((iz + (stepZ > 0 ? 1 : 0)) * size - ray.oz) /
+                                ray.dz;
+  auto deltaX = stepX == 0 ? inf : size / std::abs(ray.dx);
+  auto deltaZ = stepZ == 0 ? inf : size / std::abs(ray.dz);
+  auto t = from;
+  while (true) {
+    auto exit = std::min({nextX, nextZ, to});
+    auto y0 = ray.oy + t * ray.dy;
+    auto y1 = ray.oy + exit * ray.dy;
+    Real low = 0;
+    Real high = 0;
+    if (nodes == nullptr) {
+      auto a = samples->at(ix, iz);
+      auto b = samples->at(ix + 1, iz);
+      auto c = samples->at(ix, iz + 1);
+      auto e = samples->at(ix + 1, iz + 1);
+      low = std::min({a, b, c, e});
+      high = std::max({a, b, c, e});
+    } else {
+      auto i = static_cast<size_t>(iz) * nodes->width + ix;
+      low = nodes->low[i];
+      high = nodes->high[i];
+    }
+    if (std::max(y0, y1) >= low - slack && std::min(y0, y1) <= high + slack) {
+      if (nodes == nullptr) {
+        if (cell(ray, ix, iz, hit)) {
+          return true;
+        }
+      } else if (walk(ray, child, ix * scale, iz * scale,
+                      std::min((ix + 1) * scale, childWidth),
+                      std::min((iz + 1) * scale, childDepth), t, exit, hit)) {
+        return true;
+      }
+    }
+    if (exit >= to) {
+      return false;
+    }
+    if (nextX < nextZ) {
+      ix += stepX;
+      if (ix < x0 || ix >= x1) {
+        return false;
+      }
+      t = nextX;
+      nextX += deltaX;
+    } else {
+      iz += stepZ;
+      if (iz < z0 || iz >= z1) {
+        return false;
+      }
+      t = nextZ;
+      nextZ += deltaZ;
+    }
+  }
+}
+
+auto Heightfield::localIntersect(const Ray &ray) const
+    -> std::vector<Intersection> {
+  std::vector<Intersection> xs;
+  intersectInto(ray, xs);
+  return xs;
+}
+
+void Heightfield::intersectInto(const Ray &ray,
+                                std::vector<Intersection> &xs) const {
+  auto span = bounds().span(ray);
+  if (!span.has_value()) {
+    return;
+  }
+  // A ray through an edge or vertex hits every triangle sharing it; those
+  // are met one after another and reported once.
+  auto first = xs.size();
+  auto collect = [&](Real t) {
+    if (xs.size() == first ||
+        std::abs(xs.back().first - t) > EPSILON * Real{1e-2}) {
+      xs.emplace_back(t, this);
+    }
+    return false;
+  };
+  walk(gridRay(ray), topLevel(), 0, 0, 1, 1, span->first, span->second,
+       collect);
+}
+
+auto Heightfield::occludes(const Ray &ray, Real distance,
+                           std::vector<Intersection> & /*scratch*/) const
+    -> bool {
+  auto span = bounds().span(ray);
+  if (!span.has_value()) {
+    return false;
+  }
+  auto from = std::max(span->first, Real{0});
+  auto to = std::min(span->second, distance);
+  if (from > to) {
+    return false;
+  }
+  auto blocks = [&](Real t) { return t >= 0 && t < distance; };
+  return walk(gridRay(ray), topLevel(), 0, 0, 1, 1, from, to, blocks);
+}
+
+auto Heightfield::vertexNormal(int x, int z) const -> Vector {
+  auto left = std::max(x - 1, 0);
+  auto right = std::min(x + 1, samples->width - 1);
+  auto back = std::max(z - 1, 0);
+  auto front = std::min(z + 1, samples->depth - 1);
+  auto slopeX = (samples->at(right, z) - samples->at(left, z)) *
+                static_cast<Real>(samples->width - 1) / (right - left);
+  auto slopeZ = (samples->at(x, front) - samples->at(x, back)) *
+                static_cast<Real>(samples->depth - 1) / (front - back);
+  return vector(-slopeX, 1, -slopeZ).norm();
+}
+
+// Interpolates the vertex normals of the triangle under point with its
+// barycentric weights in the xz plane.
+auto Heightfield::localNormalAt(const Point &p) const -> Vector {
+  auto gx = p.x * (samples->width - 1);
+  auto gz = p.z * (samples->depth - 1);
+  auto x = std::clamp(static_cast<int>(std::floor(gx)), 0, samples->width - 2);
+  auto z = std::clamp(static_cast<int>(std::floor(gz)), 0, samples->depth - 2);
+  auto fx = std::clamp(gx - x, Real{0}, Real{1});
+  auto fz = std::clamp(gz - z, Real{0}, Real{1});
+  if (fx >= fz) {
+    return vertexNormal(x, z) * (1 - fx) +
+           vertexNormal(x + 1, z) * (fx - fz) +
+           vertexNormal(x + 1, z + 1) * fz;
+  }
+  return vertexNormal(x, z) * (1 - fz) + vertexNormal(x + 1, z + 1) * fx +
+         vertexNormal(x, z + 1) * (fz - fx);
+}
+
+} // namespace RT
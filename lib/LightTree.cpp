@@ -0,0 +1,209 @@
+#include "LightTree.hpp"
+#include "Sampler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace RT {
+
+// Keeps grazing lights samplable: the cosine bound ignores the specular
+// lobe, which can still be bright where the diffuse term is almost zero.
+constexpr Real LIGHT_COSINE_FLOOR = 0.05;
+
+LightTree::LightTree(const std::vector<Light> &lights)
+    : totalIntensity(color(0, 0, 0)) {
+  leaves.assign(lights.size(), -1);
+  for (const auto &light : lights) {
+    totalIntensity = totalIntensity + light.intensity;
+  }
+  if (lights.empty()) {
+    return;
+  }
+  std::vector<int> order(lights.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = static_cast<int>(i);
+  }
+  nodes.reserve(lights.size() * 2);
+  build(lights, order, 0, order.size(), -1);
+}
+
+auto LightTree::build(const std::vector<Light> &lights,
+                      std::vector<int> &order, size_t first, size_t last,
+                      int parent) -> int {
+  auto index = static_cast<int>(nodes.size());
+  nodes.push_back(Node{BoundingBox(), color(0, 0, 0), 0, -1, -1, parent, -1});
+  BoundingBox bounds;
+  auto intensity = color(0, 0, 0);
+  for (auto i = first; i < last; i++) {
+    bounds.add(lights[order[i]].position);
+    intensity = intensity + lights[order[i]].intensity;
+  }
+  if (last - first == 1) {
+    leaves[order[first]] = index;
+    nodes[index].light = order[first];
+  } else {
+    auto extent = bounds.max - bounds.min;
+    auto axis = 0;
+    if (extent.y > extent.x) {
+      axis = 1;
+    }
+    if (extent.z > extent(axis)) {
+      axis = 2;
+    }
+    auto middle = first + (last - first) / 2;
+    std::nth_element(order.begin() + static_cast<std::ptrdiff_t>(first),
+                     order.begin() + static_cast<std::ptrdiff_t>(middle),
+                     order.begin() + static_cast<std::ptrdiff_t>(last),
+                     [&](int a, int b) {
+                       return lights[a].position(axis) <
+                              lights[b].position(axis);
+                     });
+    auto left = build(lights, order, first, middle, index);
+    auto right = build(lights, order, middle, last, index);
+    nodes[index].left = left;
+    nodes[index].right = right;
+  }
+  nodes[index].bounds = bounds;
+  nodes[index].intensity = intensity;
+  nodes[index].power = luminance(intensity);
+  return index;
+}
+
+auto LightTree::lightCount() const -> size_t { return leaves.size(); }
+
+auto LightTree::importance(const Node &node, const Point &point,
+                           const Vector &normal) const -> Real {
+  if (node.power <= 0) {
+    return 0;
+  }
+  const auto &b = node.bounds;
+  Real nearest = -1;
+  for (auto corner = 0; corner < 8; corner++) {
+    auto c = RT::point((corner & 1) != 0 ? b.max.x : b.min.x,
+                       (corner & 2) != 0 ? b.max.y : b.min.y,
+                       (corner & 4) != 0 ? b.max.z : b.min.z);
+    nearest = std::max(nearest, dot(c - point, normal));
+  }
+  if (nearest < 0) {
+    return 0;
+  }
+  auto center = RT::point((b.min.x + b.max.x) / 2, (b.min.y + b.max.y) / 2,
+                          (b.min.z + b.max.z) / 2);
+  auto radius = (b.max - center).magnitude();
+  auto toCenter = center - point;
+  auto distance = toCenter.magnitude();
+  Real cosine = 1;
+  if (distance > radius) {
+    auto theta = std::acos(
+        std::clamp(dot(toCenter, normal) / distance, Real{-1}, Real{1}));
+    auto spread = std::asin(radius / distance);
+    cosine = theta > spread ? std::cos(theta - spread) : 1;
+  }
+  return node.power * std::max(cosine, LIGHT_COSINE_FLOOR);
+}
+
+auto LightTree::collect(const Point &point, const Vector &normal,
+                        Real threshold, size_t limit,
+                        std::vector<size_t> &out) const -> bool {
+  out.clear();
+  if (nodes.empty()) {
+    return true;
+  }
+  std::vector<int> stack{0};
+  while (!stack.empty()) {
+    const auto &node = nodes[stack.back()];
+    stack.pop_back();
+    auto weight = importance(node, point, normal);
+    if (weight <= 0 || weight < threshold) {
+      continue;
+    }
+    if (node.light >= 0) {
+      out.push_back(static_cast<size_t>(node.light));
+      if (out.size() > limit) {
+        return false;
+      }
+      continue;
+    }
+    stack.push_back(node.right);
+    stack.push_back(node.left);
+  }
+  return true;
+}
+
+auto LightTree::sample(const Point &point, const Vector &normal,
+                       Real threshold, Real u) const
+    -> std::optional<std::pair<size_t, Real>> {
+  if (nodes.empty()) {
+    return std::nullopt;
+  }
+  auto rootWeight = importance(nodes[0], point, normal);
+  if (rootWeight <= 0 || rootWeight < threshold) {
+    return std::nullopt;
+  }
+  auto cull = [&](const Node &node) {
+    auto weight = importance(node, point, normal);
+    return weight < threshold ? 0 : weight;
+  };
+  Real pdf = 1;
+  const auto *node = &nodes[0];
+  while (node->light < 0) {
+    auto left = cull(nodes[node->left]);
+    auto right = cull(nodes[node->right]);
+    if (left + right <= 0) {
+      return std::nullopt;
+    }
+    auto pLeft = left / (left + right);
+    if (u < pLeft) {
+      u = u / pLeft;
+      pdf *= pLeft;
+      node = &nodes[node->left];
+    } else {
+      u = (u - pLeft) / (1 - pLeft);
+      pdf *= 1 - pLeft;
+      node = &nodes[node->right];
+    }
+    u = std::min(u, std::nextafter(Real{1}, Real{0}));
+  }
+  return std::make_pair(static_cast<size_t>(node->light), pdf);
+}
+
+auto LightTree::probability(const Point &point, const Vector &normal,
+                            Real threshold, size_t light) const -> Real {
+  auto cull = [&](const Node &node) {
+    auto weight = importance(node, point, normal);
+    return weight < threshold ? 0 : weight;
+  };
+  auto index = leaves[light];
+  if (cull(nodes[0]) <= 0) {
+    return 0;
+  }
+  Real pdf = 1;
+  while (nodes[index].parent >= 0) {
+    const auto &parent = nodes[nodes[index].parent];
+    auto left = cull(nodes[parent.left]);
+    auto right = cull(nodes[parent.right]);
+    if (left + right <= 0) {
+      return 0;
+    }
+    pdf *= (index == parent.left ? left : right) / (left + right);
+    index = nodes[index].parent;
+  }
+  return pdf;
+}
+
+auto shadingHash(const Point &point, uint64_t index) -> uint64_t {
+  uint64_t h = hashMix(index + 0x9e3779b97f4a7c15ULL);
+  for (auto i = 0; i < 3; i++) {
+    auto v = static_cast<double>(point(i));
+    uint64_t bits = 0;
+    std::memcpy(&bits, &v, sizeof(bits));
+    h = hashMix(h ^ bits);
+  }
+  return h;
+}
+
+auto shadingUniform(const Point &point, uint64_t index) -> Real {
+  return toUniform(shadingHash(point, index));
+}
+
+} // namespace RT
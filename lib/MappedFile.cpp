@@ -0,0 +1,54 @@
+#include "MappedFile.hpp"
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace RT {
+
+MappedFile::MappedFile(const std::string &filename)
+    : bytes(nullptr), length(0) {
+  auto fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("cannot open " + filename);
+  }
+  struct stat info {};
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw std::runtime_error("cannot stat " + filename);
+  }
+  length = static_cast<size_t>(info.st_size);
+  if (length > 0) {
+    auto *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("cannot map " + filename);
+    }
+    bytes = static_cast<const unsigned char *>(mapped);
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (bytes != nullptr) {
+    munmap(const_cast<unsigned char *>(bytes), length);
+  }
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : bytes(std::exchange(other.bytes, nullptr)),
+      length(std::exchange(other.length, 0)) {}
+
+auto MappedFile::operator=(MappedFile &&other) noexcept -> MappedFile & {
+  std::swap(bytes, other.bytes);
+  std::swap(length, other.length);
+  return *this;
+}
+
+auto MappedFile::data() const -> const unsigned char * { return bytes; }
+
+auto MappedFile::size() const -> size_t { return length; }
+
+} // namespace RT
@@ -0,0 +1,135 @@
+#include "Motion.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+namespace RT {
+
+auto Pose::transform() const -> Transformation {
+  return scaling(scale.x, scale.y, scale.z) >>= rotationX(rotation.x) >>=
+         rotationY(rotation.y) >>= rotationZ(rotation.z) >>=
+         RT::translation(translation.x, translation.y, translation.z);
+}
+
+// transform() is T * R * S, whose upper 3x3 is R with column i scaled by
+// scale(i); the inverse is S^-1 * R^T followed by the inverse translation.
+auto Pose::inverse() const -> Transformation {
+  auto m = transform();
+  const std::array<Real, 3> s{scale.x, scale.y, scale.z};
+  auto result = identityMatrix<4>();
+  for (auto i = 0; i < 3; i++) {
+    for (auto j = 0; j < 3; j++) {
+      result(i, j) = m(j, i) / (s[i] * s[i]);
+    }
+  }
+  for (auto i = 0; i < 3; i++) {
+    result(i, 3) = -(result(i, 0) * m(0, 3) + result(i, 1) * m(1, 3) +
+                     result(i, 2) * m(2, 3));
+  }
+  return result;
+}
+
+auto lerp(const Tuple &a, const Tuple &b, Real t) -> Tuple {
+  return a + (b - a) * t;
+}
+
+auto lerp(const Pose &a, const Pose &b, Real t) -> Pose {
+  return {lerp(a.translation, b.translation, t),
+          lerp(a.rotation, b.rotation, t), lerp(a.scale, b.scale, t)};
+}
+
+auto samePose(const Pose &a, const Pose &b) -> bool {
+  return identical(a.translation, b.translation) &&
+         identical(a.rotation, b.rotation) && identical(a.scale, b.scale);
+}
+
+Motion::Motion(const Pose &start, const Pose &end) {
+  key(0, start);
+  key(1, end);
+}
+
+void Motion::key(Real time, const Pose &pose) {
+  auto at = std::upper_bound(
+      keys.begin(), keys.end(), time,
+      [](Real t, const Key &k) { return t < k.time; });
+  keys.insert(at, {time, pose, pose.transform(), pose.inverse()});
+}
+
+auto Motion::empty() const -> bool { return keys.empty(); }
+
+auto Motion::find(Real time, size_t &next) const -> size_t {
+  assert(!keys.empty() && "motion has no keys");
+  if (time <= keys.front().time) {
+    return 0;
+  }
+  if (time >= keys.back().time) {
+    return keys.size() - 1;
+  }
+  auto after = std::upper_bound(
+      keys.begin(), keys.end(), time,
+      [](Real t, const Key &k) { return t < k.time; });
+  next = static_cast<size_t>(after - keys.begin());
+  return (after - 1)->time == time ? next - 1 : keys.size();
+}
+
+auto Motion::pose(Real time) const -> Pose {
+  size_t next = 0;
+  auto at = find(time, next);
+  if (at < keys.size()) {
+    return keys[at].pose;
+  }
+  const auto &a = keys[next - 1];
+  const auto &b = keys[next];
+  return lerp(a.pose, b.pose, (time - a.time) / (b.time - a.time));
+}
+
+auto Motion::transformAt(Real time) const -> Transformation {
+  size_t next = 0;
+  auto at = find(time, next);
+  return at < keys.size() ? keys[at].transform : pose(time).transform();
+}
+
+auto Motion::inverseAt(Real time) const -> Transformation {
+  size_t next = 0;
+  auto at = find(time, next);
+  return at < keys.size() ? keys[at].inverse : pose(time).inverse();
+}
+
+// Between two keys a point moves by the interpolated translation plus its
+// scaled and rotated offset. Without rotation that path is linear, so the
+// boxes at the keys bound it; with rotation the offset stays within the
+// larger of the two scaled corner distances, since scale is linear.
+auto Motion::sweep(const BoundingBox &box) const -> BoundingBox {
+  if (keys.empty() || box.isEmpty() || !box.isFinite()) {
+    return keys.empty() ? box : box.transform(keys.front().transform);
+  }
+  BoundingBox result;
+  for (const auto &k : keys) {
+    result.add(box.transform(k.transform));
+  }
+  auto reach = [&](const Pose &p) {
+    Real r = 0;
+    for (auto corner = 0; corner < 8; corner++) {
+      auto x = ((corner & 1) != 0 ? box.max.x : box.min.x) * p.scale.x;
+      auto y = ((corner & 2) != 0 ? box.max.y : box.min.y) * p.scale.y;
+      auto z = ((corner & 4) != 0 ? box.max.z : box.min.z) * p.scale.z;
+      r = std::max(r, std::sqrt(x * x + y * y + z * z));
+    }
+    return r;
+  };
+  for (size_t i = 1; i < keys.size(); i++) {
+    const auto &a = keys[i - 1].pose;
+    const auto &b = keys[i].pose;
+    if (identical(a.rotation, b.rotation)) {
+      continue;
+    }
+    auto r = std::max(reach(a), reach(b));
+    BoundingBox moved;
+    moved.add(a.translation + point(0, 0, 0));
+    moved.add(b.translation + point(0, 0, 0));
+    result.add(moved.padded(r));
+  }
+  return result;
+}
+
+} // namespace RT
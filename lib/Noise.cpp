@@ -0,0 +1,180 @@
+#include "Noise.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace RT {
+
+constexpr size_t NOISE_BLOCK_SIZE = 32;
+constexpr size_t NOISE_CORNERS = 8;
+
+// Ken Perlin's reference permutation, doubled so lattice lookups never wrap.
+// At 512 bytes it stays resident in L1 for the whole shading pass.
+constexpr std::array<uint8_t, 256> BASE_PERMUTATION{
+    151, 160, 137, 91,  90,  15,  131, 13,  201, 95,  96,  53,  194, 233, 7,
+    225, 140, 36,  103, 30,  69,  142, 8,   99,  37,  240, 21,  10,  23,  190,
+    6,   148, 247, 120, 234, 75,  0,   26,  197, 62,  94,  252, 219, 203, 117,
+    35,  11,  32,  57,  177, 33,  88,  237, 149, 56,  87,  174, 20,  125, 136,
+    171, 168, 68,  175, 74,  165, 71,  134, 139, 48,  27,  166, 77,  146, 158,
+    231, 83,  111, 229, 122, 60,  211, 133, 230, 220, 105, 92,  41,  55,  46,
+    245, 40,  244, 102, 143, 54,  65,  25,  63,  161, 1,   216, 80,  73,  209,
+    76,  132, 187, 208, 89,  18,  169, 200, 196, 135, 130, 116, 188, 159, 86,
+    164, 100, 109, 198, 173, 186, 3,   64,  52,  217, 226, 250, 124, 123, 5,
+    202, 38,  147, 118, 126, 255, 82,  85,  212, 207, 206, 59,  227, 47,  16,
+    58,  17,  182, 189, 28,  42,  223, 183, 170, 213, 119, 248, 152, 2,   44,
+    154, 163, 70,  221, 153, 101, 155, 167, 43,  172, 9,   129, 22,  39,  253,
+    19,  98,  108, 110, 79,  113, 224, 232, 178, 185, 112, 104, 218, 246, 97,
+    228, 251, 34,  242, 193, 238, 210, 144, 12,  191, 179, 162, 241, 81,  51,
+    145, 235, 249, 14,  239, 107, 49,  192, 214, 31,  181, 199, 106, 157, 184,
+    84,  204, 176, 115, 121, 50,  45,  127, 4,   150, 254, 138, 236, 205, 93,
+    222, 114, 67,  29,  24,  72,  243, 141, 128, 195, 78,  66,  215, 61,  156,
+    180};
+
+constexpr auto doubledPermutation() -> std::array<uint8_t, 512> {
+  std::array<uint8_t, 512> p{};
+  for (size_t i = 0; i < p.size(); i++) {
+    p[i] = BASE_PERMUTATION[i & 255];
+  }
+  return p;
+}
+
+alignas(64) constexpr std::array<uint8_t, 512> PERMUTATION =
+    doubledPermutation();
+
+// The sixteen gradient directions of improved noise, as components.
+alignas(16) constexpr std::array<int8_t, 16> GRADIENT_X{
+    1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0, 1, 0, -1, 0};
+alignas(16) constexpr std::array<int8_t, 16> GRADIENT_Y{
+    1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 1, -1, 1, -1, 1, -1};
+alignas(16) constexpr std::array<int8_t, 16> GRADIENT_Z{
+    0, 0, 0, 0, 1, 1, -1, -1, 1, 1, -1, -1, 0, 1, 0, -1};
+
+inline auto fade(Real t) -> Real {
+  return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+inline auto lerp(Real t, Real a, Real b) -> Real { return a + t * (b - a); }
+
+// Evaluates at most NOISE_BLOCK_SIZE points. Hashing is a short scalar pass
+// over the permutation table; everything after it is straight-line
+// arithmetic over arrays, which the compiler turns into SIMD code.
+void perlinBlock(size_t count, const Real *x, const Real *y, const Real *z,
+                 Real *out) {
+  std::array<std::array<Real, NOISE_BLOCK_SIZE>, NOISE_CORNERS> gx;
+  std::array<std::array<Real, NOISE_BLOCK_SIZE>, NOISE_CORNERS> gy;
+  std::array<std::array<Real, NOISE_BLOCK_SIZE>, NOISE_CORNERS> gz;
+  std::array<Real, NOISE_BLOCK_SIZE> fx;
+  std::array<Real, NOISE_BLOCK_SIZE> fy;
+  std::array<Real, NOISE_BLOCK_SIZE> fz;
+  const auto *p = PERMUTATION.data();
+  for (size_t i = 0; i < count; i++) {
+    auto ix = fastFloor(x[i]);
+    auto iy = fastFloor(y[i]);
+    auto iz = fastFloor(z[i]);
+    fx[i] = x[i] - static_cast<Real>(ix);
+    fy[i] = y[i] - static_cast<Real>(iy);
+    fz[i] = z[i] - static_cast<Real>(iz);
+    auto X = ix & 255;
+    auto Y = iy & 255;
+    auto Z = iz & 255;
+    auto A = p[X] + Y;
+    auto AA = p[A] + Z;
+    auto AB = p[A + 1] + Z;
+    auto B = p[X + 1] + Y;
+    auto BA = p[B] + Z;
+    auto BB = p[B + 1] + Z;
+    const std::array<int, NOISE_CORNERS> hashes{
+        p[AA],     p[BA],     p[AB],     p[BB],
+        p[AA + 1], p[BA + 1], p[AB + 1], p[BB + 1]};
+    for (size_t c = 0; c < NOISE_CORNERS; c++) {
+      auto h = hashes[c] & 15;
+      gx[c][i] = GRADIENT_X[h];
+      gy[c][i] = GRADIENT_Y[h];
+      gz[c][i] = GRADIENT_Z[h];
+    }
+  }
+  for (size_t i = 0; i < count; i++) {
+    auto x0 = fx[i];
+    auto y0 = fy[i];
+    auto z0 = fz[i];
+    auto x1 = x0 - 1;
+    auto y1 = y0 - 1;
+    auto z1 = z0 - 1;
+    auto n000 = gx[0][i] * x0 + gy[0][i] * y0 + gz[0][i] * z0;
+    auto n100 = gx[1][i] * x1 + gy[1][i] * y0 + gz[1][i] * z0;
+    auto n010 = gx[2][i] * x0 + gy[2][i] * y1 + gz[2][i] * z0;
+    auto n110 = gx[3][i] * x1 + gy[3][i] * y1 + gz[3][i] * z0;
+    auto n001 = gx[4][i] * x0 + gy[4][i] * y0 + gz[4][i] * z1;
+    auto n101 = gx[5][i] * x1 + gy[5][i] * y0 + gz[5][i] * z1;
+    auto n011 = gx[6][i] * x0 + gy[6][i] * y1 + gz[6][i] * z1;
+    auto n111 = gx[7][i] * x1 + gy[7][i] * y1 + gz[7][i] * z1;
+    auto u = fade(x0);
+    auto v = fade(y0);
+    auto w = fade(z0);
+    out[i] = lerp(w, lerp(v, lerp(u, n000, n100), lerp(u, n010, n110)),
+                  lerp(v, lerp(u, n001, n101), lerp(u, n011, n111)));
+  }
+}
+
+auto perlinNoise(Real x, Real y, Real z) -> Real {
+  Real out = 0;
+  perlinBlock(1, &x, &y, &z, &out);
+  return out;
+}
+
+void perlinNoise(size_t count, const Real *x, const Real *y, const Real *z,
+                 Real *out) {
+  for (size_t first = 0; first < count; first += NOISE_BLOCK_SIZE) {
+    auto n = std::min(NOISE_BLOCK_SIZE, count - first);
+    perlinBlock(n, x + first, y + first, z + first, out + first);
+  }
+}
+
+template <bool Absolute>
+void octaveSum(size_t count, const Real *x, const Real *y, const Real *z,
+               Real *out, int octaves, Real lacunarity, Real gain) {
+  std::array<Real, NOISE_BLOCK_SIZE> sx;
+  std::array<Real, NOISE_BLOCK_SIZE> sy;
+  std::array<Real, NOISE_BLOCK_SIZE> sz;
+  std::array<Real, NOISE_BLOCK_SIZE> octave;
+  Real total = 0;
+  Real amplitude = 1;
+  for (auto o = 0; o < octaves; o++) {
+    total += amplitude;
+    amplitude *= gain;
+  }
+  const Real normalize = total > 0 ? 1 / total : 0;
+  for (size_t first = 0; first < count; first += NOISE_BLOCK_SIZE) {
+    auto n = std::min(NOISE_BLOCK_SIZE, count - first);
+    auto *sum = out + first;
+    std::fill(sum, sum + n, Real{0});
+    Real frequency = 1;
+    amplitude = normalize;
+    for (auto o = 0; o < octaves; o++) {
+      for (size_t i = 0; i < n; i++) {
+        sx[i] = x[first + i] * frequency;
+        sy[i] = y[first + i] * frequency;
+        sz[i] = z[first + i] * frequency;
+      }
+      perlinBlock(n, sx.data(), sy.data(), sz.data(), octave.data());
+      for (size_t i = 0; i < n; i++) {
+        sum[i] += amplitude * (Absolute ? std::abs(octave[i]) : octave[i]);
+      }
+      frequency *= lacunarity;
+      amplitude *= gain;
+    }
+  }
+}
+
+void fbmNoise(size_t count, const Real *x, const Real *y, const Real *z,
+              Real *out, int octaves, Real lacunarity, Real gain) {
+  octaveSum<false>(count, x, y, z, out, octaves, lacunarity, gain);
+}
+
+void turbulenceNoise(size_t count, const Real *x, const Real *y,
+                     const Real *z, Real *out, int octaves, Real lacunarity,
+                     Real gain) {
+  octaveSum<true>(count, x, y, z, out, octaves, lacunarity, gain);
+}
+
+} // namespace RT
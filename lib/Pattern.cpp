@@ -1,8 +1,16 @@
 #include "Pattern.hpp"
+#include <algorithm>
+#include <array>
 #include <memory>
+#include <type_traits>
+#include <variant>
 
 namespace RT {
 
+auto Pattern::kernel() const -> std::optional<PatternKernel> {
+  return std::nullopt;
+}
+
 StripePattern::StripePattern() : a(RT::color(1, 1, 1)), b(RT::color(0, 0, 0)){};
 StripePattern::StripePattern(Color a, Color b)
     : a(std::move(a)), b(std::move(b)){};
@@ -78,4 +86,452 @@ auto CheckersPattern::clone() const -> std::unique_ptr<Pattern> {
   return std::make_unique<CheckersPattern>(*this);
 }
 
-} // namespace RT
\ No newline at end of file
+auto StripePattern::kernel() const -> std::optional<PatternKernel> {
+  return *this;
+}
+
+void StripePattern::patternsAt(size_t count, const Real *x, const Real * /*y*/,
+                               const Real * /*z*/, Real *r, Real *g,
+                               Real *b) const {
+  const std::array<Real, 2> red{a.red, this->b.red};
+  const std::array<Real, 2> green{a.green, this->b.green};
+  const std::array<Real, 2> blue{a.blue, this->b.blue};
+  for (size_t i = 0; i < count; i++) {
+    auto odd = static_cast<size_t>(fastFloor(x[i]) & 1);
+    r[i] = red[odd];
+    g[i] = green[odd];
+    b[i] = blue[odd];
+  }
+}
+
+auto TestPattern::kernel() const -> std::optional<PatternKernel> {
+  return *this;
+}
+
+void TestPattern::patternsAt(size_t count, const Real *x, const Real *y,
+                             const Real *z, Real *r, Real *g, Real *b) const {
+  for (size_t i = 0; i < count; i++) {
+    r[i] = x[i];
+    g[i] = y[i];
+    b[i] = z[i];
+  }
+}
+
+auto GradientPattern::kernel() const -> std::optional<PatternKernel> {
+  return *this;
+}
+
+void GradientPattern::patternsAt(size_t count, const Real *x,
+                                 const Real * /*y*/, const Real * /*z*/,
+                                 Real *r, Real *g, Real *b) const {
+  const Real ar = a.red;
+  const Real ag = a.green;
+  const Real ab = a.blue;
+  const Real dr = this->b.red - ar;
+  const Real dg = this->b.green - ag;
+  const Real db = this->b.blue - ab;
+  for (size_t i = 0; i < count; i++) {
+    auto fraction = x[i] - static_cast<Real>(fastFloor(x[i]));
+    r[i] = ar + dr * fraction;
+    g[i] = ag + dg * fraction;
+    b[i] = ab + db * fraction;
+  }
+}
+
+auto RingPattern::kernel() const -> std::optional<PatternKernel> {
+  return *this;
+}
+
+void RingPattern::patternsAt(size_t count, const Real *x, const Real * /*y*/,
+                             const Real *z, Real *r, Real *g, Real *b) const {
+  const std::array<Real, 2> red{a.red, this->b.red};
+  const std::array<Real, 2> green{a.green, this->b.green};
+  const std::array<Real, 2> blue{a.blue, this->b.blue};
+  for (size_t i = 0; i < count; i++) {
+    auto ring = fastFloor(std::sqrt(x[i] * x[i] + z[i] * z[i]));
+    auto odd = static_cast<size_t>(ring & 1);
+    r[i] = red[odd];
+    g[i] = green[odd];
+    b[i] = blue[odd];
+  }
+}
+
+auto CheckersPattern::kernel() const -> std::optional<PatternKernel> {
+  return *this;
+}
+
+void CheckersPattern::patternsAt(size_t count, const Real *x, const Real *y,
+                                 const Real *z, Real *r, Real *g,
+                                 Real *b) const {
+  const std::array<Real, 2> red{a.red, this->b.red};
+  const std::array<Real, 2> green{a.green, this->b.green};
+  const std::array<Real, 2> blue{a.blue, this->b.blue};
+  for (size_t i = 0; i < count; i++) {
+    auto sum = fastFloor(x[i]) + fastFloor(y[i]) + fastFloor(z[i]);
+    auto odd = static_cast<size_t>(sum & 1);
+    r[i] = red[odd];
+    g[i] = green[odd];
+    b[i] = blue[odd];
+  }
+}
+
+void blendColors(size_t count, const Color &a, const Color &b,
+                 const Real *t, Real *r, Real *g, Real *bl) {
+  const Real ar = a.red;
+  const Real ag = a.green;
+  const Real ab = a.blue;
+  const Real dr = b.red - ar;
+  const Real dg = b.green - ag;
+  const Real db = b.blue - ab;
+  for (size_t i = 0; i < count; i++) {
+    auto f = std::clamp(t[i], Real{0}, Real{1});
+    r[i] = ar + dr * f;
+    g[i] = ag + dg * f;
+    bl[i] = ab + db * f;
+  }
+}
+
+// The scalar path of patterns whose batch path is the whole definition.
+template <typename Kernel>
+auto patternColorAt(const Kernel &pattern, const Point &p) -> Color {
+  Real r = 0;
+  Real g = 0;
+  Real b = 0;
+  pattern.patternsAt(1, &p.x, &p.y, &p.z, &r, &g, &b);
+  return color(r, g, b);
+}
+
+NoisePattern::NoisePattern() : a(RT::color(1, 1, 1)), b(RT::color(0, 0, 0)){};
+
+NoisePattern::NoisePattern(Color a, Color b)
+    : a(std::move(a)), b(std::move(b)){};
+
+auto NoisePattern::patternAt(const Point &p) const -> Color {
+  return patternColorAt(*this, p);
+}
+
+auto NoisePattern::clone() const -> std::unique_ptr<Pattern> {
+  return std::make_unique<NoisePattern>(*this);
+}
+
+auto NoisePattern::kernel() const -> std::optional<PatternKernel> {
+  return *this;
+}
+
+void NoisePattern::patternsAt(size_t count, const Real *x, const Real *y,
+                              const Real *z, Real *r, Real *g,
+                              Real *b) const {
+  // The blend factor is staged in the red channel before it is overwritten.
+  perlinNoise(count, x, y, z, r);
+  for (size_t i = 0; i < count; i++) {
+    r[i] = (r[i] + 1) / 2;
+  }
+  blendColors(count, a, this->b, r, r, g, b);
+}
+
+FbmPattern::FbmPattern()
+    : a(RT::color(1, 1, 1)), b(RT::color(0, 0, 0)), octaves(DEFAULT_OCTAVES),
+      lacunarity(DEFAULT_LACUNARITY), gain(DEFAULT_GAIN){};
+
+FbmPattern::FbmPattern(Color a, Color b, int octaves, Real lacunarity,
+                       Real gain)
+    : a(std::move(a)), b(std::move(b)), octaves(octaves),
+      lacunarity(lacunarity), gain(gain){};
+
+auto FbmPattern::patternAt(const Point &p) const -> Color {
+  return patternColorAt(*this, p);
+}
+
+auto FbmPattern::clone() const -> std::unique_ptr<Pattern> {
+  return std::make_unique<FbmPattern>(*this);
+}
+
+auto FbmPattern::kernel() const -> std::optional<PatternKernel> {
+  return *this;
+}
+
+void FbmPattern::patternsAt(size_t count, const Real *x, const Real *y,
+                            const Real *z, Real *r, Real *g, Real *b) const {
+  fbmNoise(count, x, y, z, r, octaves, lacunarity, gain);
+  for (size_t i = 0; i < count; i++) {
+    r[i] = (r[i] + 1) / 2;
+  }
+  blendColors(count, a, this->b, r, r, g, b);
+}
+
+TurbulencePattern::TurbulencePattern()
+    : a(RT::color(1, 1, 1)), b(RT::color(0, 0, 0)), octaves(DEFAULT_OCTAVES),
+      lacunarity(DEFAULT_LACUNARITY), gain(DEFAULT_GAIN){};
+
+TurbulencePattern::TurbulencePattern(Color a, Color b, int octaves,
+                                     Real lacunarity, Real gain)
+    : a(std::move(a)), b(std::move(b)), octaves(octaves),
+      lacunarity(lacunarity), gain(gain){};
+
+auto TurbulencePattern::patternAt(const Point &p) const -> Color {
+  return patternColorAt(*this, p);
+}
+
+auto TurbulencePattern::clone() const -> std::unique_ptr<Pattern> {
+  return std::make_unique<TurbulencePattern>(*this);
+}
+
+auto TurbulencePattern::kernel() const -> std::optional<PatternKernel> {
+  return *this;
+}
+
+void TurbulencePattern::patternsAt(size_t count, const Real *x, const Real *y,
+                                   const Real *z, Real *r, Real *g,
+                                   Real *b) const {
+  turbulenceNoise(count, x, y, z, r, octaves, lacunarity, gain);
+  blendColors(count, a, this->b, r, r, g, b);
+}
+
+// The wrapped pattern is compiled once, so nested lookups stay on the batch
+// path instead of going through patternAt per point.
+PerturbPattern::PerturbPattern(const Pattern &pattern, Real scale)
+    : pattern(pattern.clone()), scale(scale),
+      compiled(std::make_shared<const CompiledPattern>(*this->pattern,
+                                                       identityMatrix<4>())){};
+
+auto PerturbPattern::patternAt(const Point &p) const -> Color {
+  return patternColorAt(*this, p);
+}
+
+auto PerturbPattern::clone() const -> std::unique_ptr<Pattern> {
+  auto copy = std::make_unique<PerturbPattern>(*pattern, scale);
+  copy->transformation = transformation;
+  return copy;
+}
+
+// The copy shares the compiled wrapped pattern unless pattern has been
+// replaced or edited since it was compiled.
+auto PerturbPattern::kernel() const -> std::optional<PatternKernel> {
+  PerturbPattern copy(*this);
+  if (!compiled->isCurrent(pattern.get(), identityMatrix<4>())) {
+    copy.compiled =
+        std::make_shared<const CompiledPattern>(*pattern, identityMatrix<4>());
+  }
+  return copy;
+}
+
+constexpr size_t PERTURB_BLOCK_SIZE = 64;
+// Decorrelates the three displacement components.
+constexpr std::array<Real, 3> PERTURB_OFFSET_Y{5.2, 1.3, 7.9};
+constexpr std::array<Real, 3> PERTURB_OFFSET_Z{-3.7, 9.1, 2.8};
+
+void PerturbPattern::patternsAt(size_t count, const Real *x, const Real *y,
+                                const Real *z, Real *r, Real *g,
+                                Real *b) const {
+  std::array<Real, PERTURB_BLOCK_SIZE> ox{};
+  std::array<Real, PERTURB_BLOCK_SIZE> oy{};
+  std::array<Real, PERTURB_BLOCK_SIZE> oz{};
+  std::array<Real, PERTURB_BLOCK_SIZE> dx{};
+  std::array<Real, PERTURB_BLOCK_SIZE> dy{};
+  std::array<Real, PERTURB_BLOCK_SIZE> dz{};
+  auto current = compiled->isCurrent(pattern.get(), identityMatrix<4>());
+  for (size_t first = 0; first < count; first += PERTURB_BLOCK_SIZE) {
+    auto n = std::min(PERTURB_BLOCK_SIZE, count - first);
+    const auto *px = x + first;
+    const auto *py = y + first;
+    const auto *pz = z + first;
+    perlinNoise(n, px, py, pz, dx.data());
+    for (size_t i = 0; i < n; i++) {
+      ox[i] = px[i] + PERTURB_OFFSET_Y[0];
+      oy[i] = py[i] + PERTURB_OFFSET_Y[1];
+      oz[i] = pz[i] + PERTURB_OFFSET_Y[2];
+    }
+    perlinNoise(n, ox.data(), oy.data(), oz.data(), dy.data());
+    for (size_t i = 0; i < n; i++) {
+      ox[i] = px[i] + PERTURB_OFFSET_Z[0];
+      oy[i] = py[i] + PERTURB_OFFSET_Z[1];
+      oz[i] = pz[i] + PERTURB_OFFSET_Z[2];
+    }
+    perlinNoise(n, ox.data(), oy.data(), oz.data(), dz.data());
+    for (size_t i = 0; i < n; i++) {
+      ox[i] = px[i] + scale * dx[i];
+      oy[i] = py[i] + scale * dy[i];
+      oz[i] = pz[i] + scale * dz[i];
+    }
+    if (current) {
+      compiled->colorsAt(n, ox.data(), oy.data(), oz.data(), r + first,
+                         g + first, b + first);
+      continue;
+    }
+    auto inverse = pattern->transformation.inverse();
+    for (size_t i = 0; i < n; i++) {
+      auto c = pattern->patternAt(inverse * point(ox[i], oy[i], oz[i]));
+      r[first + i] = c.red;
+      g[first + i] = c.green;
+      b[first + i] = c.blue;
+    }
+  }
+}
+
+ImagePattern::ImagePattern(std::shared_ptr<const Texture> texture,
+                           UVMapping mapping, TextureFilter filter, Real lod)
+    : texture(std::move(texture)), mapping(mapping), filter(filter),
+      lod(lod){};
+
+auto ImagePattern::patternAt(const Point &p) const -> Color {
+  return texture->sample(uvMap(mapping, p), lod, filter);
+}
+
+auto ImagePattern::clone() const -> std::unique_ptr<Pattern> {
+  return std::make_unique<ImagePattern>(*this);
+}
+
+auto ImagePattern::kernel() const -> std::optional<PatternKernel> {
+  return *this;
+}
+
+void ImagePattern::patternsAt(size_t count, const Real *x, const Real *y,
+                              const Real *z, Real *r, Real *g,
+                              Real *b) const {
+  for (size_t i = 0; i < count; i++) {
+    auto c = texture->sample(uvMap(mapping, point(x[i], y[i], z[i])), lod,
+                             filter);
+    r[i] = c.red;
+    g[i] = c.green;
+    b[i] = c.blue;
+  }
+}
+
+CompiledPattern::CompiledPattern(const Pattern &pattern,
+                                 const Transformation &objectTransformation)
+    : source(&pattern), objectTransformation(objectTransformation),
+      patternTransformation(pattern.transformation),
+      worldToPattern((objectTransformation * pattern.transformation).inverse()),
+      kernel(pattern.kernel()) {}
+
+auto sameMatrix(const Transformation &a, const Transformation &b) -> bool {
+  for (auto i = 0; i < 4; i++) {
+    for (auto j = 0; j < 4; j++) {
+      if (a(i, j) != b(i, j)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+auto StripePattern::sameParameters(const StripePattern &other) const
+    -> bool {
+  return identical(a, other.a) && identical(b, other.b);
+}
+
+auto TestPattern::sameParameters(const TestPattern & /*other*/) const
+    -> bool {
+  return true;
+}
+
+auto GradientPattern::sameParameters(const GradientPattern &other) const
+    -> bool {
+  return identical(a, other.a) && identical(b, other.b);
+}
+
+auto RingPattern::sameParameters(const RingPattern &other) const -> bool {
+  return identical(a, other.a) && identical(b, other.b);
+}
+
+auto CheckersPattern::sameParameters(const CheckersPattern &other) const
+    -> bool {
+  return identical(a, other.a) && identical(b, other.b);
+}
+
+auto NoisePattern::sameParameters(const NoisePattern &other) const -> bool {
+  return identical(a, other.a) && identical(b, other.b);
+}
+
+auto FbmPattern::sameParameters(const FbmPattern &other) const -> bool {
+  return identical(a, other.a) && identical(b, other.b) &&
+         octaves == other.octaves && lacunarity == other.lacunarity &&
+         gain == other.gain;
+}
+
+auto TurbulencePattern::sameParameters(const TurbulencePattern &other) const
+    -> bool {
+  return identical(a, other.a) && identical(b, other.b) &&
+         octaves == other.octaves && lacunarity == other.lacunarity &&
+         gain == other.gain;
+}
+
+auto PerturbPattern::sameParameters(const PerturbPattern &other) const
+    -> bool {
+  return scale == other.scale &&
+         compiled->isCurrent(other.pattern.get(), identityMatrix<4>());
+}
+
+auto ImagePattern::sameParameters(const ImagePattern &other) const -> bool {
+  return texture == other.texture && mapping == other.mapping &&
+         filter == other.filter && lod == other.lod;
+}
+
+auto CompiledPattern::isCurrent(const Pattern *pattern,
+                                const Transformation &object) const -> bool {
+  if (pattern != source || !sameMatrix(object, objectTransformation) ||
+      !sameMatrix(pattern->transformation, patternTransformation)) {
+    return false;
+  }
+  return !kernel.has_value() ||
+         std::visit(
+             [pattern](const auto &k) {
+               using Kernel = std::decay_t<decltype(k)>;
+               const auto *current = dynamic_cast<const Kernel *>(pattern);
+               return current != nullptr && k.sameParameters(*current);
+             },
+             kernel.value());
+}
+
+auto CompiledPattern::colorAt(const Point &worldPoint) const -> Color {
+  Real x = worldPoint.x;
+  Real y = worldPoint.y;
+  Real z = worldPoint.z;
+  Real r = 0;
+  Real g = 0;
+  Real b = 0;
+  colorsAt(1, &x, &y, &z, &r, &g, &b);
+  return color(r, g, b);
+}
+
+constexpr size_t PATTERN_BLOCK_SIZE = 64;
+
+void CompiledPattern::colorsAt(size_t count, const Real *x, const Real *y,
+                               const Real *z, Real *r, Real *g,
+                               Real *b) const {
+  std::array<Real, PATTERN_BLOCK_SIZE> px{};
+  std::array<Real, PATTERN_BLOCK_SIZE> py{};
+  std::array<Real, PATTERN_BLOCK_SIZE> pz{};
+  const auto &m = worldToPattern;
+  const Real m00 = m(0, 0), m01 = m(0, 1), m02 = m(0, 2), m03 = m(0, 3);
+  const Real m10 = m(1, 0), m11 = m(1, 1), m12 = m(1, 2), m13 = m(1, 3);
+  const Real m20 = m(2, 0), m21 = m(2, 1), m22 = m(2, 2), m23 = m(2, 3);
+  for (size_t first = 0; first < count; first += PATTERN_BLOCK_SIZE) {
+    auto n = std::min(PATTERN_BLOCK_SIZE, count - first);
+    for (size_t i = 0; i < n; i++) {
+      auto wx = x[first + i];
+      auto wy = y[first + i];
+      auto wz = z[first + i];
+      px[i] = m00 * wx + m01 * wy + m02 * wz + m03;
+      py[i] = m10 * wx + m11 * wy + m12 * wz + m13;
+      pz[i] = m20 * wx + m21 * wy + m22 * wz + m23;
+    }
+    if (kernel.has_value()) {
+      std::visit(
+          [&](const auto &k) {
+            k.patternsAt(n, px.data(), py.data(), pz.data(), r + first,
+                         g + first, b + first);
+          },
+          kernel.value());
+    } else {
+      for (size_t i = 0; i < n; i++) {
+        auto c = source->patternAt(point(px[i], py[i], pz[i]));
+        r[first + i] = c.red;
+        g[first + i] = c.green;
+        b[first + i] = c.blue;
+      }
+    }
+  }
+}
+
+} // namespace RT
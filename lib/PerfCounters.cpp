@@ -0,0 +1,247 @@
+#include "PerfCounters.hpp"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace RT {
+
+constexpr size_t PERF_COUNTER_COUNT = 4;
+
+std::atomic<bool> PerfCounters::active{false};
+
+struct RegionTotals {
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> nanoseconds{0};
+  std::array<std::atomic<uint64_t>, PERF_COUNTER_COUNT> counters{};
+};
+
+std::array<RegionTotals, PERF_REGION_COUNT> regionTotals;
+
+auto openCounter(uint32_t type, uint64_t config) -> int {
+  perf_event_attr attr{};
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+// Counters of the current thread, opened on first use.
+struct ThreadCounters {
+  std::array<int, PERF_COUNTER_COUNT> fds{-1, -1, -1, -1};
+  bool opened = false;
+  bool available = false;
+
+  ThreadCounters() = default;
+  ThreadCounters(const ThreadCounters &) = delete;
+  auto operator=(const ThreadCounters &) -> ThreadCounters & = delete;
+  ThreadCounters(ThreadCounters &&) = delete;
+  auto operator=(ThreadCounters &&) -> ThreadCounters & = delete;
+  ~ThreadCounters() {
+    for (auto fd : fds) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  auto open() -> bool {
+    if (!opened) {
+      opened = true;
+      fds = {openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES),
+             openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS),
+             openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES),
+             openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES)};
+      available = fds[0] >= 0 && fds[1] >= 0;
+    }
+    return available;
+  }
+
+  void read(std::array<uint64_t, PERF_COUNTER_COUNT> &values) const {
+    for (size_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+      uint64_t value = 0;
+      if (fds[i] < 0 || ::read(fds[i], &value, sizeof(value)) !=
+                            static_cast<ssize_t>(sizeof(value))) {
+        value = 0;
+      }
+      values[i] = value;
+    }
+  }
+};
+
+thread_local ThreadCounters threadCounters;
+thread_local std::optional<PerfRegion> openScopeRegion;
+
+auto nowNanoseconds() -> uint64_t {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+auto perfRegionName(PerfRegion region) -> const char * {
+  switch (region) {
+  case PerfRegion::RayGeneration:
+    return "ray generation";
+  case PerfRegion::Intersection:
+    return "intersection";
+  case PerfRegion::Patterns:
+    return "patterns";
+  case PerfRegion::Shading:
+    return "shading";
+  case PerfRegion::Shadows:
+    return "shadows";
+  case PerfRegion::Encoding:
+    return "encoding";
+  }
+  return "unknown";
+}
+
+auto perKilo(uint64_t events, uint64_t instructions) -> double {
+  return instructions == 0 ? 0
+                           : 1000.0 * static_cast<double>(events) /
+                                 static_cast<double>(instructions);
+}
+
+auto PerfCounts::ipc() const -> double {
+  return cycles == 0 ? 0
+                     : static_cast<double>(instructions) /
+                           static_cast<double>(cycles);
+}
+
+auto PerfCounts::cacheMissesPerKiloInstruction() const -> double {
+  return perKilo(cacheMisses, instructions);
+}
+
+auto PerfCounts::branchMissesPerKiloInstruction() const -> double {
+  return perKilo(branchMisses, instructions);
+}
+
+void PerfCounters::enable() { active = true; }
+
+void PerfCounters::disable() { active = false; }
+
+auto PerfCounters::enabled() -> bool { return active.load(); }
+
+auto PerfCounters::hardwareAvailable() -> bool {
+  return threadCounters.open();
+}
+
+auto PerfCounters::counts(PerfRegion region) -> PerfCounts {
+  const auto &totals = regionTotals[static_cast<size_t>(region)];
+  return {totals.calls.load(),       totals.nanoseconds.load(),
+          totals.counters[0].load(), totals.counters[1].load(),
+          totals.counters[2].load(), totals.counters[3].load()};
+}
+
+auto PerfCounters::openRegion() -> std::optional<PerfRegion> {
+  return openScopeRegion;
+}
+
+void PerfCounters::reset() {
+  for (auto &totals : regionTotals) {
+    totals.calls = 0;
+    totals.nanoseconds = 0;
+    for (auto &c : totals.counters) {
+      c = 0;
+    }
+  }
+}
+
+void PerfCounters::report(std::ostream &out) {
+  auto hardware = hardwareAvailable();
+  out << std::left << std::setw(16) << "region" << std::right << std::setw(10)
+      << "calls" << std::setw(12) << "ms";
+  if (hardware) {
+    out << std::setw(8) << "IPC" << std::setw(14) << "cache MPKI"
+        << std::setw(14) << "branch MPKI";
+  }
+  out << "\n";
+  for (size_t r = 0; r < PERF_REGION_COUNT; r++) {
+    auto region = static_cast<PerfRegion>(r);
+    auto c = counts(region);
+    if (c.calls == 0) {
+      continue;
+    }
+    out << std::left << std::setw(16) << perfRegionName(region) << std::right
+        << std::setw(10) << c.calls << std::setw(12) << std::fixed
+        << std::setprecision(2) << static_cast<double>(c.nanoseconds) / 1e6;
+    if (hardware) {
+      out << std::setw(8) << c.ipc() << std::setw(14)
+          << c.cacheMissesPerKiloInstruction() << std::setw(14)
+          << c.branchMissesPerKiloInstruction();
+    }
+    out << "\n";
+  }
+  if (!hardware) {
+    out << "(hardware counters unavailable; wall-clock time only)\n";
+  }
+}
+
+PerfScope::PerfScope(PerfRegion region)
+    : region(region),
+      running(PerfCounters::active.load(std::memory_order_relaxed)),
+      start(0) {
+  if (!running) {
+    return;
+  }
+  if (threadCounters.open()) {
+    threadCounters.read(counters);
+  }
+  outer = openScopeRegion;
+  openScopeRegion = region;
+  start = nowNanoseconds();
+}
+
+PerfScope::~PerfScope() {
+  if (!running) {
+    return;
+  }
+  auto elapsed = nowNanoseconds() - start;
+  openScopeRegion = outer;
+  auto &totals = regionTotals[static_cast<size_t>(region)];
+  totals.calls.fetch_add(1, std::memory_order_relaxed);
+  totals.nanoseconds.fetch_add(elapsed, std::memory_order_relaxed);
+  if (!threadCounters.available) {
+    return;
+  }
+  std::array<uint64_t, PERF_COUNTER_COUNT> end{};
+  threadCounters.read(end);
+  for (size_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+    totals.counters[i].fetch_add(end[i] - counters[i],
+                                 std::memory_order_relaxed);
+  }
+}
+
+PerfShare::PerfShare(std::optional<PerfRegion> region) : region(region) {
+  if (!region.has_value()) {
+    return;
+  }
+  if (!threadCounters.open()) {
+    this->region.reset();
+    return;
+  }
+  threadCounters.read(counters);
+}
+
+PerfShare::~PerfShare() {
+  if (!region.has_value()) {
+    return;
+  }
+  std::array<uint64_t, PERF_COUNTER_COUNT> end{};
+  threadCounters.read(end);
+  auto &totals = regionTotals[static_cast<size_t>(region.value())];
+  for (size_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+    totals.counters[i].fetch_add(end[i] - counters[i],
+                                 std::memory_order_relaxed);
+  }
+}
+
+} // namespace RT
@@ -0,0 +1,188 @@
+#include "Progressive.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <utility>
+namespace RT {
+
+SampleBuffer::SampleBuffer(int width, int height)
+    : width(width), height(height),
+      pixels(static_cast<size_t>(width) * height) {}
+
+auto SampleBuffer::at(int x, int y) const -> const Pixel & {
+  return pixels[static_cast<size_t>(y) * width + x];
+}
+
+void SampleBuffer::add(int x, int y, const Color &sample) {
+  auto &p = pixels[static_cast<size_t>(y) * width + x];
+  auto l = luminance(sample);
+  p.red += sample.red;
+  p.green += sample.green;
+  p.blue += sample.blue;
+  p.luminance += l;
+  p.luminanceSquares += l * l;
+  p.count++;
+}
+
+auto SampleBuffer::samples(int x, int y) const -> int { return at(x, y).count; }
+
+auto SampleBuffer::mean(int x, int y) const -> Color {
+  const auto &p = at(x, y);
+  if (p.count == 0) {
+    return color(0, 0, 0);
+  }
+  auto n = static_cast<Real>(p.count);
+  return color(p.red / n, p.green / n, p.blue / n);
+}
+
+auto SampleBuffer::error(int x, int y) const -> Real {
+  const auto &p = at(x, y);
+  if (p.count == 0) {
+    return std::numeric_limits<Real>::infinity();
+  }
+  auto n = static_cast<Real>(p.count);
+  auto average = p.luminance / n;
+  if (p.count > 1) {
+    auto variance = (p.luminanceSquares - n * average * average) / (n - 1);
+    return std::max(variance, Real{0}) / n;
+  }
+  Real step = 0;
+  const std::array<std::pair<int, int>, 4> neighbours{
+      {{x - 1, y}, {x + 1, y}, {x, y - 1}, {x, y + 1}}};
+  for (auto [nx, ny] : neighbours) {
+    if (nx < 0 || ny < 0 || nx >= width || ny >= height) {
+      continue;
+    }
+    const auto &q = at(nx, ny);
+    if (q.count > 0) {
+      step = std::max(step,
+                      std::abs(q.luminance / static_cast<Real>(q.count) -
+                               average));
+    }
+  }
+  return step * step;
+}
+
+auto SampleBuffer::image() const -> Canvas {
+  Canvas canvas(width, height);
+  for (auto y = 0; y < height; y++) {
+    for (auto x = 0; x < width; x++) {
+      canvas.writePixel(x, y,
+                        at(x, y).count > 0
+                            ? mean(x, y)
+                            : mean(x - x % PREVIEW_BLOCK,
+                                   y - y % PREVIEW_BLOCK));
+    }
+  }
+  return canvas;
+}
+
+auto renderProgressive(const Camera &camera, const World &world,
+                       std::chrono::steady_clock::duration budget,
+                       const ProgressiveOptions &options)
+    -> ProgressiveResult {
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  auto deadline = start + budget;
+  auto rays = camera.rays();
+  SampleBuffer buffer(camera.hsize, camera.vsize);
+  auto trace = [&](int x, int y) {
+    auto ray = rays.sampleRay(x, y, buffer.samples(x, y));
+    buffer.add(x, y, world.colorAt(ray));
+  };
+  ProgressiveReport report;
+
+  auto blockRows = (camera.vsize + PREVIEW_BLOCK - 1) / PREVIEW_BLOCK;
+  parallelFor(
+      static_cast<size_t>(blockRows),
+      [&](size_t row) {
+        auto y = static_cast<int>(row) * PREVIEW_BLOCK;
+        for (auto x = 0; x < camera.hsize; x += PREVIEW_BLOCK) {
+          trace(x, y);
+        }
+      },
+      options.threads, 1);
+  report.passes++;
+
+  if (Clock::now() < deadline) {
+    report.passes++;
+    parallelFor(
+        static_cast<size_t>(camera.vsize),
+        [&](size_t row) {
+          auto y = static_cast<int>(row);
+          for (auto x = 0; x < camera.hsize; x++) {
+            if (Clock::now() >= deadline) {
+              return;
+            }
+            if (buffer.samples(x, y) == 0) {
+              trace(x, y);
+            }
+          }
+        },
+        options.threads, 1);
+  }
+
+  auto pixelCount = static_cast<size_t>(camera.hsize) * camera.vsize;
+  auto quota = std::max<size_t>(
+      1, static_cast<size_t>(options.refineFraction *
+                             static_cast<Real>(pixelCount)));
+  auto threshold = options.tolerance * options.tolerance;
+  std::vector<std::pair<Real, size_t>> candidates;
+  while (Clock::now() < deadline) {
+    candidates.clear();
+    for (size_t i = 0; i < pixelCount; i++) {
+      auto x = static_cast<int>(i % camera.hsize);
+      auto y = static_cast<int>(i / camera.hsize);
+      auto e = buffer.error(x, y);
+      if (buffer.samples(x, y) < options.maxSamples && e > threshold) {
+        candidates.emplace_back(e, i);
+      }
+    }
+    if (candidates.empty()) {
+      report.converged = true;
+      break;
+    }
+    if (candidates.size() > quota) {
+      std::nth_element(candidates.begin(), candidates.begin() + quota,
+                       candidates.end(), std::greater<>());
+      candidates.resize(quota);
+    }
+    // Back to image order, so neighbouring rays run together.
+    std::sort(
+        candidates.begin(), candidates.end(),
+        [](const auto &a, const auto &b) { return a.second < b.second; });
+    report.passes++;
+    parallelFor(
+        candidates.size(),
+        [&](size_t k) {
+          if (Clock::now() < deadline) {
+            auto i = candidates[k].second;
+            trace(static_cast<int>(i % camera.hsize),
+                  static_cast<int>(i / camera.hsize));
+          }
+        },
+        options.threads, static_cast<size_t>(camera.hsize));
+  }
+
+  report.minSamples = std::numeric_limits<int>::max();
+  size_t total = 0;
+  for (auto y = 0; y < camera.vsize; y++) {
+    for (auto x = 0; x < camera.hsize; x++) {
+      auto n = buffer.samples(x, y);
+      report.minSamples = std::min(report.minSamples, n);
+      report.maxSamples = std::max(report.maxSamples, n);
+      total += static_cast<size_t>(n);
+    }
+  }
+  report.minSamples = std::min(report.minSamples, report.maxSamples);
+  report.samplesPerPixel =
+      static_cast<Real>(total) /
+      static_cast<Real>(std::max<size_t>(pixelCount, 1));
+  report.elapsed = Clock::now() - start;
+  return {buffer.image(), report};
+}
+
+} // namespace RT
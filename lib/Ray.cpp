@@ -6,13 +6,13 @@ namespace RT {
 
 Ray::Ray() : origin(point(0, 0, 0)), direction(vector(0, 0, 0)) {}
 
-Ray::Ray(Point origin, Vector direction)
-    : origin(std::move(origin)), direction(std::move(direction)) {}
+Ray::Ray(Point origin, Vector direction, Real time)
+    : origin(std::move(origin)), direction(std::move(direction)), time(time) {}
 
-auto Ray::position(double t) const -> Point { return origin + direction * t; }
+auto Ray::position(Real t) const -> Point { return origin + direction * t; }
 
 auto Ray::transform(const Transformation &m) const -> Ray {
-  return {m * origin, m * direction};
+  return {m * origin, m * direction, time};
 }
 
 } // namespace RT
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include "RenderRecord.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace RT {
+
+constexpr size_t TRACE_GRID_CELLS =
+    static_cast<size_t>(TRACE_GRID_SIZE) * TRACE_GRID_SIZE * TRACE_GRID_SIZE;
+
+thread_local const TraceRecorder *traceRecorder = nullptr;
+
+TraceGrid::TraceGrid(const BoundingBox &box) : box(box) {
+  if (box.isEmpty() || !box.isFinite()) {
+    this->box = BoundingBox();
+    return;
+  }
+  auto extent = box.max - box.min;
+  auto cellSize = [](Real e) {
+    return std::max(e / TRACE_GRID_SIZE, Real{EPSILON});
+  };
+  size = vector(cellSize(extent.x), cellSize(extent.y), cellSize(extent.z));
+}
+
+auto TraceGrid::words() const -> size_t { return (TRACE_GRID_CELLS + 63) / 64; }
+
+auto TraceGrid::covers(const BoundingBox &bounds) const -> bool {
+  return !box.isEmpty() && bounds.isFinite() &&
+         (bounds.isEmpty() ||
+          (box.contains(bounds.min) && box.contains(bounds.max)));
+}
+
+auto TraceGrid::cell(Real value, int axis) const -> int {
+  auto c = static_cast<int>(std::floor((value - box.min(axis)) / size(axis)));
+  return std::clamp(c, 0, TRACE_GRID_SIZE - 1);
+}
+
+void TraceGrid::mark(std::vector<uint64_t> &cells, const Ray &ray, Real from,
+                     Real to) const {
+  if (box.isEmpty()) {
+    return;
+  }
+  constexpr Real inf = std::numeric_limits<Real>::infinity();
+  auto enter = from;
+  auto exit = to;
+  for (auto axis = 0; axis < 3; axis++) {
+    auto o = ray.origin(axis);
+    auto d = ray.direction(axis);
+    if (d == 0) {
+      if (o < box.min(axis) || o > box.max(axis)) {
+        return;
+      }
+      continue;
+    }
+    auto t0 = (box.min(axis) - o) / d;
+    auto t1 = (box.max(axis) - o) / d;
+    enter = std::max(enter, std::min(t0, t1));
+    exit = std::min(exit, std::max(t0, t1));
+  }
+  if (enter > exit) {
+    return;
+  }
+  auto start = ray.position(enter);
+  std::array<int, 3> c{cell(start.x, 0), cell(start.y, 1), cell(start.z, 2)};
+  std::array<int, 3> step{};
+  std::array<Real, 3> next{};
+  std::array<Real, 3> delta{};
+  for (auto axis = 0; axis < 3; axis++) {
+    auto d = ray.direction(axis);
+    step[axis] = d > 0 ? 1 : (d < 0 ? -1 : 0);
+    if (step[axis] == 0) {
+      next[axis] = inf;
+      delta[axis] = inf;
+      continue;
+    }
+    auto boundary = box.min(axis) + (c[axis] + (step[axis] > 0 ? 1 : 0)) *
+                                        size(axis);
+    next[axis] = (boundary - ray.origin(axis)) / d;
+    delta[axis] = size(axis) / std::abs(d);
+  }
+  while (true) {
+    auto index = (static_cast<size_t>(c[2]) * TRACE_GRID_SIZE + c[1]) *
+                     TRACE_GRID_SIZE +
+                 c[0];
+    cells[index / 64] |= uint64_t{1} << (index % 64);
+    auto axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2)
+                                  : (next[1] < next[2] ? 1 : 2);
+    if (next[axis] > exit) {
+      return;
+    }
+    c[axis] += step[axis];
+    if (c[axis] < 0 || c[axis] >= TRACE_GRID_SIZE) {
+      return;
+    }
+    next[axis] += delta[axis];
+  }
+}
+
+auto TraceGrid::overlaps(const std::vector<uint64_t> &cells,
+                         const BoundingBox &bounds) const -> bool {
+  if (box.isEmpty() || bounds.isEmpty()) {
+    return false;
+  }
+  std::array<int, 3> lo{};
+  std::array<int, 3> hi{};
+  for (auto axis = 0; axis < 3; axis++) {
+    lo[axis] = std::max(cell(bounds.min(axis), axis) - 1, 0);
+    hi[axis] = std::min(cell(bounds.max(axis), axis) + 1, TRACE_GRID_SIZE - 1);
+  }
+  for (auto z = lo[2]; z <= hi[2]; z++) {
+    for (auto y = lo[1]; y <= hi[1]; y++) {
+      for (auto x = lo[0]; x <= hi[0]; x++) {
+        auto index =
+            (static_cast<size_t>(z) * TRACE_GRID_SIZE + y) * TRACE_GRID_SIZE +
+            x;
+        if ((cells[index / 64] & (uint64_t{1} << (index % 64))) != 0) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+void TraceRecorder::line(const Ray &ray, Real from, Real to) const {
+  grid->mark(tile->cells, ray, from, to);
+}
+
+void TraceRecorder::touched(size_t object) const {
+  tile->objects.push_back(object);
+}
+
+auto RenderRecord::tileColumns() const -> int {
+  return (width + tileSize - 1) / tileSize;
+}
+
+} // namespace RT
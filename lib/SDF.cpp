@@ -0,0 +1,313 @@
+#include "SDF.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+namespace RT {
+
+auto SDFNode::lipschitz() const -> Real { return 1; }
+
+auto SDFNode::gradient(const Point & /*p*/) const -> std::optional<Vector> {
+  return std::nullopt;
+}
+
+SDFSphere::SDFSphere(Real radius) : radius(radius) {}
+
+auto SDFSphere::distance(const Point &p) const -> Real {
+  return std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z) - radius;
+}
+
+auto SDFSphere::bounds() const -> BoundingBox {
+  return {point(-radius, -radius, -radius), point(radius, radius, radius)};
+}
+
+auto SDFSphere::gradient(const Point &p) const -> std::optional<Vector> {
+  return vector(p.x, p.y, p.z);
+}
+
+SDFBox::SDFBox(Vector halfExtents, Real radius)
+    : halfExtents(std::move(halfExtents)), radius(radius) {}
+
+auto SDFBox::distance(const Point &p) const -> Real {
+  auto qx = std::abs(p.x) - halfExtents.x + radius;
+  auto qy = std::abs(p.y) - halfExtents.y + radius;
+  auto qz = std::abs(p.z) - halfExtents.z + radius;
+  auto ox = std::max(qx, Real{0});
+  auto oy = std::max(qy, Real{0});
+  auto oz = std::max(qz, Real{0});
+  return std::sqrt(ox * ox + oy * oy + oz * oz) +
+         std::min(std::max({qx, qy, qz}), Real{0}) - radius;
+}
+
+auto SDFBox::bounds() const -> BoundingBox {
+  return {point(-halfExtents.x, -halfExtents.y, -halfExtents.z),
+          point(halfExtents.x, halfExtents.y, halfExtents.z)};
+}
+
+SDFTorus::SDFTorus(Real majorRadius, Real minorRadius)
+    : majorRadius(majorRadius), minorRadius(minorRadius) {}
+
+auto SDFTorus::distance(const Point &p) const -> Real {
+  auto ring = std::sqrt(p.x * p.x + p.z * p.z) - majorRadius;
+  return std::sqrt(ring * ring + p.y * p.y) - minorRadius;
+}
+
+auto SDFTorus::bounds() const -> BoundingBox {
+  auto outer = majorRadius + minorRadius;
+  return {point(-outer, -minorRadius, -outer),
+          point(outer, minorRadius, outer)};
+}
+
+auto SDFTorus::gradient(const Point &p) const -> std::optional<Vector> {
+  auto radial = std::sqrt(p.x * p.x + p.z * p.z);
+  if (radial == 0) {
+    return std::nullopt;
+  }
+  auto scale = majorRadius / radial;
+  return vector(p.x - p.x * scale, p.y, p.z - p.z * scale);
+}
+
+SDFMandelbulb::SDFMandelbulb(Real power, int iterations, Real lipschitzBound)
+    : power(power), iterations(iterations), lipschitzBound(lipschitzBound) {}
+
+auto SDFMandelbulb::distance(const Point &p) const -> Real {
+  constexpr Real bailout = 2;
+  auto x = p.x;
+  auto y = p.y;
+  auto z = p.z;
+  Real dr = 1;
+  Real r = 0;
+  for (auto i = 0; i < iterations; i++) {
+    r = std::sqrt(x * x + y * y + z * z);
+    if (r > bailout || r == 0) {
+      break;
+    }
+    auto theta = std::acos(z / r) * power;
+    auto phi = std::atan2(y, x) * power;
+    dr = std::pow(r, power - 1) * power * dr + 1;
+    auto zr = std::pow(r, power);
+    x = zr * std::sin(theta) * std::cos(phi) + p.x;
+    y = zr * std::sin(theta) * std::sin(phi) + p.y;
+    z = zr * std::cos(theta) + p.z;
+  }
+  if (r == 0) {
+    return 0;
+  }
+  return Real{0.5} * std::log(r) * r / dr;
+}
+
+auto SDFMandelbulb::bounds() const -> BoundingBox {
+  return {point(-1.2, -1.2, -1.2), point(1.2, 1.2, 1.2)};
+}
+
+auto SDFMandelbulb::lipschitz() const -> Real { return lipschitzBound; }
+
+SDFCombine::SDFCombine(SDFOperation operation, SDF a, SDF b)
+    : operation(operation), a(std::move(a)), b(std::move(b)) {}
+
+auto SDFCombine::distance(const Point &p) const -> Real {
+  auto da = a->distance(p);
+  auto db = b->distance(p);
+  switch (operation) {
+  case SDFOperation::Union:
+    return std::min(da, db);
+  case SDFOperation::Intersection:
+    return std::max(da, db);
+  case SDFOperation::Difference:
+    break;
+  }
+  return std::max(da, -db);
+}
+
+auto SDFCombine::bounds() const -> BoundingBox {
+  auto box = a->bounds();
+  if (operation == SDFOperation::Union) {
+    box.add(b->bounds());
+  } else if (operation == SDFOperation::Intersection) {
+    auto other = b->bounds();
+    box = BoundingBox(point(std::max(box.min.x, other.min.x),
+                            std::max(box.min.y, other.min.y),
+                            std::max(box.min.z, other.min.z)),
+                      point(std::min(box.max.x, other.max.x),
+                            std::min(box.max.y, other.max.y),
+                            std::min(box.max.z, other.max.z)));
+  }
+  return box.isEmpty() ? BoundingBox() : box;
+}
+
+auto SDFCombine::lipschitz() const -> Real {
+  return std::max(a->lipschitz(), b->lipschitz());
+}
+
+auto SDFCombine::gradient(const Point &p) const -> std::optional<Vector> {
+  auto da = a->distance(p);
+  auto db = b->distance(p);
+  switch (operation) {
+  case SDFOperation::Union:
+    return da < db ? a->gradient(p) : b->gradient(p);
+  case SDFOperation::Intersection:
+    return da > db ? a->gradient(p) : b->gradient(p);
+  case SDFOperation::Difference:
+    break;
+  }
+  if (da > -db) {
+    return a->gradient(p);
+  }
+  auto g = b->gradient(p);
+  if (!g.has_value()) {
+    return std::nullopt;
+  }
+  return -g.value();
+}
+
+SDFSmoothUnion::SDFSmoothUnion(SDF a, SDF b, Real smoothness)
+    : a(std::move(a)), b(std::move(b)), smoothness(smoothness) {}
+
+auto SDFSmoothUnion::distance(const Point &p) const -> Real {
+  auto da = a->distance(p);
+  auto db = b->distance(p);
+  if (smoothness <= 0) {
+    return std::min(da, db);
+  }
+  auto h = std::clamp(Real{0.5} + Real{0.5} * (db - da) / smoothness, Real{0},
+                      Real{1});
+  return db + (da - db) * h - smoothness * h * (1 - h);
+}
+
+// The blend only ever adds material within smoothness / 4 of the seam.
+auto SDFSmoothUnion::bounds() const -> BoundingBox {
+  auto box = a->bounds();
+  box.add(b->bounds());
+  return box.isEmpty() ? box : box.padded(smoothness / 4);
+}
+
+auto SDFSmoothUnion::lipschitz() const -> Real {
+  return std::max(a->lipschitz(), b->lipschitz());
+}
+
+SDFTransform::SDFTransform(SDF child, Vector offset, Real scale)
+    : child(std::move(child)), offset(std::move(offset)), scale(scale) {
+  assert(scale > 0 && "SDF scale must be positive");
+}
+
+auto SDFTransform::local(const Point &p) const -> Point {
+  return point((p.x - offset.x) / scale, (p.y - offset.y) / scale,
+               (p.z - offset.z) / scale);
+}
+
+auto SDFTransform::distance(const Point &p) const -> Real {
+  return child->distance(local(p)) * scale;
+}
+
+auto SDFTransform::bounds() const -> BoundingBox {
+  auto box = child->bounds();
+  if (box.isEmpty()) {
+    return box;
+  }
+  return {point(box.min.x * scale + offset.x, box.min.y * scale + offset.y,
+                box.min.z * scale + offset.z),
+          point(box.max.x * scale + offset.x, box.max.y * scale + offset.y,
+                box.max.z * scale + offset.z)};
+}
+
+auto SDFTransform::lipschitz() const -> Real { return child->lipschitz(); }
+
+auto SDFTransform::gradient(const Point &p) const -> std::optional<Vector> {
+  return child->gradient(local(p));
+}
+
+SDFShape::SDFShape(SDF sdf, int maxSteps, Real tolerance)
+    : sdf(std::move(sdf)), maxSteps(maxSteps), tolerance(tolerance) {
+  assert(this->sdf != nullptr && "SDF is null");
+  assert(this->sdf->bounds().isFinite() && "SDF bounds must be finite");
+}
+
+auto SDFShape::localNormalAt(const Point &p) const -> Vector {
+  auto analytic = sdf->gradient(p);
+  if (analytic.has_value()) {
+    return analytic.value();
+  }
+  auto h = tolerance;
+  auto dx = vector(h, 0, 0);
+  auto dy = vector(0, h, 0);
+  auto dz = vector(0, 0, h);
+  return vector(sdf->distance(p + dx) - sdf->distance(p - dx),
+                sdf->distance(p + dy) - sdf->distance(p - dy),
+                sdf->distance(p + dz) - sdf->distance(p - dz));
+}
+
+auto SDFShape::localIntersect(const Ray &ray) const
+    -> std::vector<Intersection> {
+  std::vector<Intersection> xs;
+  intersectInto(ray, xs);
+  return xs;
+}
+
+auto SDFShape::bounds() const -> BoundingBox { return sdf->bounds(); }
+
+void SDFShape::intersectInto(const Ray &ray,
+                             std::vector<Intersection> &xs) const {
+  auto span = bounds().span(ray);
+  if (span.has_value()) {
+    march(ray, span->first, span->second, xs);
+  }
+}
+
+auto SDFShape::occludes(const Ray &ray, Real distance,
+                        std::vector<Intersection> &scratch) const -> bool {
+  scratch.clear();
+  auto span = bounds().span(ray);
+  if (!span.has_value() || span->second < 0 || span->first >= distance) {
+    return false;
+  }
+  march(ray, std::max(span->first, Real{0}), std::min(span->second, distance),
+        scratch, true);
+  return !scratch.empty() && scratch.front().first < distance;
+}
+
+// Steps are |distance| / lipschitz in space, scaled by the length of the
+// object space direction, so they never skip a surface. Within tolerance
+// of the surface the ray records a crossing and then walks out of that
+// band in tolerance sized steps; leaving on the side it came from means it
+// only grazed the surface, which is reported as a double crossing.
+auto SDFShape::march(const Ray &ray, Real from, Real to,
+                     std::vector<Intersection> &xs, bool firstOnly) const
+    -> int {
+  auto speed = ray.direction.magnitude();
+  if (speed == 0 || maxSteps <= 0) {
+    return 0;
+  }
+  auto stepScale = 1 / (sdf->lipschitz() * speed);
+  auto bandStep = tolerance / speed;
+  auto t = from;
+  auto d = sdf->distance(ray.position(t));
+  auto steps = 1;
+  auto inside = d < 0;
+  while (t <= to && steps < maxSteps) {
+    if (std::abs(d) >= tolerance) {
+      t += std::abs(d) * stepScale;
+      d = sdf->distance(ray.position(t));
+      steps++;
+      continue;
+    }
+    auto crossing = t;
+    while (std::abs(d) < tolerance && t <= to && steps < maxSteps) {
+      t += bandStep;
+      d = sdf->distance(ray.position(t));
+      steps++;
+    }
+    xs.emplace_back(crossing, this);
+    if (firstOnly) {
+      break;
+    }
+    if ((d < 0) == inside) {
+      xs.emplace_back(crossing, this);
+    } else {
+      inside = d < 0;
+    }
+  }
+  return steps;
+}
+
+} // namespace RT
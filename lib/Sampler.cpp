@@ -0,0 +1,219 @@
+#include "Sampler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace RT {
+
+constexpr uint64_t GOLDEN_GAMMA = 0x9e3779b97f4a7c15ULL;
+constexpr int BLUE_NOISE_PIXELS = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+constexpr Real BLUE_NOISE_SIGMA = 1.5;
+
+auto hashMix(uint64_t h) -> uint64_t {
+  h ^= h >> 30U;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27U;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31U;
+  return h;
+}
+
+auto toUniform(uint32_t bits) -> Real {
+  auto u = static_cast<double>(bits) * 0x1.0p-32;
+  return std::min(static_cast<Real>(u), std::nextafter(Real{1}, Real{0}));
+}
+
+auto toUniform(uint64_t bits) -> Real {
+  auto u = static_cast<double>(bits >> 11U) * 0x1.0p-53;
+  return std::min(static_cast<Real>(u), std::nextafter(Real{1}, Real{0}));
+}
+
+auto philox(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key)
+    -> std::array<uint32_t, 4> {
+  constexpr uint64_t multiplier0 = 0xD2511F53U;
+  constexpr uint64_t multiplier1 = 0xCD9E8D57U;
+  constexpr uint32_t weyl0 = 0x9E3779B9U;
+  constexpr uint32_t weyl1 = 0xBB67AE85U;
+  for (auto round = 0; round < 10; round++) {
+    auto p0 = multiplier0 * counter[0];
+    auto p1 = multiplier1 * counter[2];
+    counter = {static_cast<uint32_t>(p1 >> 32U) ^ counter[1] ^ key[0],
+               static_cast<uint32_t>(p1),
+               static_cast<uint32_t>(p0 >> 32U) ^ counter[3] ^ key[1],
+               static_cast<uint32_t>(p0)};
+    key[0] += weyl0;
+    key[1] += weyl1;
+  }
+  return counter;
+}
+
+auto reverseBits(uint32_t bits) -> uint32_t {
+  bits = (bits << 16U) | (bits >> 16U);
+  bits = ((bits & 0x00ff00ffU) << 8U) | ((bits & 0xff00ff00U) >> 8U);
+  bits = ((bits & 0x0f0f0f0fU) << 4U) | ((bits & 0xf0f0f0f0U) >> 4U);
+  bits = ((bits & 0x33333333U) << 2U) | ((bits & 0xccccccccU) >> 2U);
+  bits = ((bits & 0x55555555U) << 1U) | ((bits & 0xaaaaaaaaU) >> 1U);
+  return bits;
+}
+
+// Dimension 0 is the van der Corput sequence; dimension 1 has the
+// direction numbers of the polynomial x + 1.
+auto sobol(uint32_t index, unsigned dimension) -> uint32_t {
+  if (dimension == 0) {
+    return reverseBits(index);
+  }
+  uint32_t result = 0;
+  for (uint32_t v = 1U << 31U; index != 0; index >>= 1U, v ^= v >> 1U) {
+    if ((index & 1U) != 0) {
+      result ^= v;
+    }
+  }
+  return result;
+}
+
+auto owenScramble(uint32_t bits, uint32_t seed) -> uint32_t {
+  bits = reverseBits(bits);
+  bits += seed;
+  bits ^= bits * 0x6c50b47cU;
+  bits ^= bits * 0xb82f1e52U;
+  bits ^= bits * 0xc7afe638U;
+  bits ^= bits * 0x8d22f6e6U;
+  return reverseBits(bits);
+}
+
+// Ulichney's void-and-cluster method on a torus: settle a sparse random
+// pattern, then rank its points by removing the tightest clusters and
+// the remaining pixels by filling the largest voids.
+auto makeBlueNoise() -> std::vector<Real> {
+  constexpr int size = BLUE_NOISE_SIZE;
+  constexpr int pixels = BLUE_NOISE_PIXELS;
+  std::vector<Real> kernel(pixels);
+  for (auto dy = 0; dy < size; dy++) {
+    for (auto dx = 0; dx < size; dx++) {
+      auto x = static_cast<Real>(std::min(dx, size - dx));
+      auto y = static_cast<Real>(std::min(dy, size - dy));
+      kernel[dy * size + dx] = std::exp(
+          -(x * x + y * y) / (2 * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+    }
+  }
+  std::vector<bool> on(pixels, false);
+  std::vector<Real> energy(pixels, 0);
+  auto toggle = [&](int i, bool value) {
+    on[i] = value;
+    auto sign = value ? Real{1} : Real{-1};
+    for (auto j = 0; j < pixels; j++) {
+      auto dx = (j % size - i % size + size) % size;
+      auto dy = (j / size - i / size + size) % size;
+      energy[j] += sign * kernel[dy * size + dx];
+    }
+  };
+  auto extreme = [&](bool value, bool largest) {
+    auto best = -1;
+    for (auto i = 0; i < pixels; i++) {
+      if (on[i] == value &&
+          (best < 0 || (largest ? energy[i] > energy[best]
+                                : energy[i] < energy[best]))) {
+        best = i;
+      }
+    }
+    return best;
+  };
+
+  const auto initial = pixels / 10;
+  auto count = 0;
+  for (uint64_t k = 0; count < initial; k++) {
+    auto i = static_cast<int>(hashMix(k + GOLDEN_GAMMA) % pixels);
+    if (!on[i]) {
+      toggle(i, true);
+      count++;
+    }
+  }
+  while (true) {
+    auto cluster = extreme(true, true);
+    toggle(cluster, false);
+    auto hole = extreme(false, false);
+    toggle(hole, true);
+    if (hole == cluster) {
+      break;
+    }
+  }
+
+  std::vector<int> rank(pixels, 0);
+  auto settled = on;
+  auto settledEnergy = energy;
+  for (auto n = count; n > 0; n--) {
+    auto cluster = extreme(true, true);
+    toggle(cluster, false);
+    rank[cluster] = n - 1;
+  }
+  on = settled;
+  energy = settledEnergy;
+  for (auto n = count; n < pixels; n++) {
+    auto hole = extreme(false, false);
+    toggle(hole, true);
+    rank[hole] = n;
+  }
+
+  std::vector<Real> mask(pixels);
+  for (auto i = 0; i < pixels; i++) {
+    mask[i] = (static_cast<Real>(rank[i]) + Real{0.5}) / pixels;
+  }
+  return mask;
+}
+
+auto blueNoise(int x, int y) -> Real {
+  static const auto mask = makeBlueNoise();
+  x = (x % BLUE_NOISE_SIZE + BLUE_NOISE_SIZE) % BLUE_NOISE_SIZE;
+  y = (y % BLUE_NOISE_SIZE + BLUE_NOISE_SIZE) % BLUE_NOISE_SIZE;
+  return mask[y * BLUE_NOISE_SIZE + x];
+}
+
+PixelSampler::PixelSampler(int pixelX, int pixelY, SampleSequence sequence,
+                           uint32_t seed)
+    : pixelX(pixelX), pixelY(pixelY), sequence(sequence), seed(seed),
+      pixelSeed(hashMix((static_cast<uint64_t>(static_cast<uint32_t>(pixelX))
+                         << 32U) ^
+                        static_cast<uint32_t>(pixelY) ^
+                        hashMix(seed + GOLDEN_GAMMA))) {}
+
+// Channel c of the blue noise is the mask shifted along the R2 sequence,
+// which keeps the shifted masks far apart.
+auto blueNoiseShift(int x, int y, uint32_t channel) -> Real {
+  constexpr double r2x = 0.7548776662466927;
+  constexpr double r2y = 0.5698402909980532;
+  auto c = static_cast<double>(channel);
+  return blueNoise(
+      x + static_cast<int>(std::fmod(c * r2x, 1.0) * BLUE_NOISE_SIZE),
+      y + static_cast<int>(std::fmod(c * r2y, 1.0) * BLUE_NOISE_SIZE));
+}
+
+auto PixelSampler::get2D(uint32_t sample, uint32_t dimension) const
+    -> std::pair<Real, Real> {
+  if (sequence == SampleSequence::Random) {
+    auto bits = philox({static_cast<uint32_t>(pixelX),
+                        static_cast<uint32_t>(pixelY), sample, dimension},
+                       {seed, 0x5eedU});
+    return {toUniform(bits[0]), toUniform(bits[1])};
+  }
+  auto base = sequence == SampleSequence::Sobol ? pixelSeed
+                                                : hashMix(seed + GOLDEN_GAMMA);
+  auto h = hashMix(base + GOLDEN_GAMMA * (dimension + 1));
+  auto index = owenScramble(sample, static_cast<uint32_t>(h));
+  auto u = toUniform(
+      owenScramble(sobol(index, 0), static_cast<uint32_t>(h >> 32U)));
+  auto v = toUniform(owenScramble(sobol(index, 1),
+                                  static_cast<uint32_t>(hashMix(h))));
+  if (sequence == SampleSequence::BlueNoise) {
+    u += blueNoiseShift(pixelX, pixelY, 2 * dimension);
+    v += blueNoiseShift(pixelX, pixelY, 2 * dimension + 1);
+    u = u < 1 ? u : u - 1;
+    v = v < 1 ? v : v - 1;
+  }
+  return {u, v};
+}
+
+auto PixelSampler::get1D(uint32_t sample, uint32_t dimension) const -> Real {
+  return get2D(sample, dimension).first;
+}
+
+} // namespace RT
@@ -3,17 +3,21 @@
 #include "Matrix.hpp"
 #include "Pattern.hpp"
 #include "World.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
 #include <cmath>
 #include <istream>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 namespace RT {
 
-const double DEFAULT_AMBIENT = 0.1;
-const double DEFAULT_DIFFUSE = 0.9;
-const double DEFAULT_SPECULAR = 0.9;
-const double DEFAULT_SHININESS = 200;
+const Real DEFAULT_AMBIENT = 0.1;
+const Real DEFAULT_DIFFUSE = 0.9;
+const Real DEFAULT_SPECULAR = 0.9;
+const Real DEFAULT_SHININESS = 200;
 
 Material::Material()
     : color(RT::color(1, 1, 1)), ambient(DEFAULT_AMBIENT),
@@ -21,9 +25,9 @@ Material::Material()
       shininess(DEFAULT_SHININESS), reflective(0), transparency(0),
       refractiveIndex(1.0) {}
 
-Material::Material(Color color, double ambient, double diffuse, double specular,
-                   double shininess, double reflective, double transparency,
-                   double refractiveIndex)
+Material::Material(Color color, Real ambient, Real diffuse, Real specular,
+                   Real shininess, Real reflective, Real transparency,
+                   Real refractiveIndex)
     : color(std::move(color)), ambient(ambient), diffuse(diffuse),
       specular(specular), shininess(shininess), reflective(reflective),
       transparency(transparency), refractiveIndex(refractiveIndex) {}
@@ -52,28 +56,56 @@ auto Material::operator!=(const Material &m) const -> bool {
   return !(*this == m);
 }
 
-auto Shape::patternAt(const Point &point) const -> Color {
-  assert(material.pattern != nullptr && "Pattern is null");
-  auto objectPoint = transformation.inverse() * point;
-  auto patternPoint = material.pattern->transformation.inverse() * objectPoint;
+auto Shape::worldTransformation(Real time) const -> Transformation {
+  auto own = motion ? motion->transformAt(time) : transformation;
+  if (parent == nullptr) {
+    return own;
+  }
+  return parent->worldTransformation(time) * own;
+}
 
+auto Shape::patternAt(const Point &point, Real time) const -> Color {
+  assert(material.pattern != nullptr && "Pattern is null");
+  auto patternPoint =
+      (worldTransformation(time) * material.pattern->transformation)
+          .inverse() *
+      point;
   return material.pattern->patternAt(patternPoint);
 }
 
-auto Shape::normalAt(const Point &point) const -> Vector {
-  auto objectPoint = transformation.inverse() * point;
+auto Shape::normalAt(const Point &point, Real time) const -> Vector {
+  auto inverse = motion && parent == nullptr
+                     ? motion->inverseAt(time)
+                     : worldTransformation(time).inverse();
+  auto objectPoint = inverse * point;
   auto objectNormal = localNormalAt(objectPoint);
-  auto worldNormal = transformation.inverse().transpose() * objectNormal;
+  auto worldNormal = inverse.transpose() * objectNormal;
   worldNormal.w = 0;
   return worldNormal.norm();
 }
 
 auto Shape::intersect(const Ray &ray) const
-    -> std::vector<std::pair<double, const Shape *>> {
-  auto localRay = ray.transform(transformation.inverse());
+    -> std::vector<std::pair<Real, const Shape *>> {
+  auto localRay = ray.transform(motion ? motion->inverseAt(ray.time)
+                                       : transformation.inverse());
   return localIntersect(localRay);
 }
 
+void Shape::intersectInto(const Ray &ray, std::vector<Intersection> &xs) const {
+  auto local = localIntersect(ray);
+  xs.insert(xs.end(), local.begin(), local.end());
+}
+
+auto Shape::occludes(const Ray &ray, Real distance,
+                     std::vector<Intersection> &scratch) const -> bool {
+  scratch.clear();
+  intersectInto(ray, scratch);
+  return std::any_of(scratch.begin(), scratch.end(),
+                     [&](const Intersection &i) {
+                       return i.first >= 0 && i.first < distance;
+                     });
+}
+
 auto Sphere::localNormalAt(const Point &p) const -> Vector {
   return (p - point(0, 0, 0));
 }
@@ -84,14 +116,16 @@ auto Plane::localNormalAt(const Point & /*p*/) const -> Vector {
 
 auto Shape::lighting(const Light &light, const Point &point, const Vector &eye,
                      const Vector &normal, bool inShadow) const -> Tuple {
-  RT::Color localcolor;
   if (material.pattern) {
-    localcolor = patternAt(point);
-  } else {
-    localcolor = material.color;
+    return lighting(patternAt(point), light, point, eye, normal, inShadow);
   }
+  return lighting(material.color, light, point, eye, normal, inShadow);
+}
 
-  auto effectiveColor = hadamard(localcolor, light.intensity);
+auto Shape::lighting(const Color &surface, const Light &light,
+                     const Point &point, const Vector &eye,
+                     const Vector &normal, bool inShadow) const -> Tuple {
+  auto effectiveColor = hadamard(surface, light.intensity);
   auto ambient = effectiveColor * material.ambient;
 
   if (inShadow) {
@@ -114,26 +148,48 @@ auto Shape::lighting(const Light &light, const Point &point, const Vector &eye,
   return ambient + diffuse + specular;
 }
 
+auto Shape::bounds() const -> BoundingBox { return BoundingBox::infinite(); }
+
 auto Sphere::localIntersect(const Ray &ray) const -> std::vector<Intersection> {
   std::vector<Intersection> xs;
+  intersectInto(ray, xs);
+  return xs;
+}
+
+auto Sphere::bounds() const -> BoundingBox {
+  return {point(-1, -1, -1), point(1, 1, 1)};
+}
+
+void Sphere::intersectInto(const Ray &ray,
+                           std::vector<Intersection> &xs) const {
   auto sphere_to_ray = ray.origin - point(0, 0, 0);
   auto a = dot(ray.direction, ray.direction);
   auto b = 2 * dot(ray.direction, sphere_to_ray);
   auto c = dot(sphere_to_ray, sphere_to_ray) - 1;
   auto discriminant = b * b - 4 * a * c;
   if (discriminant >= 0) {
-    xs.emplace_back((-b - sqrt(discriminant)) / (2 * a), this);
-    xs.emplace_back((-b + sqrt(discriminant)) / (2 * a), this);
+    xs.emplace_back((-b - std::sqrt(discriminant)) / (2 * a), this);
+    xs.emplace_back((-b + std::sqrt(discriminant)) / (2 * a), this);
   }
-  return xs;
 }
 
 auto Plane::localIntersect(const Ray &ray) const -> std::vector<Intersection> {
+  std::vector<Intersection> xs;
+  intersectInto(ray, xs);
+  return xs;
+}
+
+auto Plane::bounds() const -> BoundingBox {
+  constexpr auto inf = std::numeric_limits<Real>::infinity();
+  return {point(-inf, 0, -inf), point(inf, 0, inf)};
+}
+
+void Plane::intersectInto(const Ray &ray,
+                          std::vector<Intersection> &xs) const {
   if (std::abs(ray.direction.y) < EPSILON) {
-    return {};
+    return;
   }
-  auto t = -ray.origin.y / ray.direction.y;
-  return {Intersection(t, this)};
+  xs.emplace_back(-ray.origin.y / ray.direction.y, this);
 }
 
 auto hit(const std::vector<Intersection> &xs) -> std::optional<Intersection> {
@@ -154,7 +210,7 @@ auto hit(const std::vector<Intersection> &xs) -> std::optional<Intersection> {
 
 Computations::Computations(const Intersection &i, const Ray &r,
                            const std::vector<Intersection> &xsp)
-    : t(i.first), object(i.second) {
+    : t(i.first), time(r.time), object(i.second) {
   const std::vector<Intersection> &xs = [&]() {
     if (xsp.empty()) {
       return std::vector<Intersection>{i};
@@ -191,7 +247,7 @@ Computations::Computations(const Intersection &i, const Ray &r,
 
   point = r.position(t);
   eye = -r.direction;
-  normal = object->normalAt(point);
+  normal = object->normalAt(point, time);
   if (dot(eye, normal) < 0) {
     inside = true;
     normal = -normal;
@@ -236,8 +292,8 @@ auto Material::operator=(Material &&m) noexcept -> Material & {
   return *this;
 }
 
-auto glassSphere(Transformation transform, double transparency,
-                 double refractiveIndex) -> Sphere {
+auto glassSphere(Transformation transform, Real transparency,
+                 Real refractiveIndex) -> Sphere {
   auto s = Sphere();
   s.transformation = transform;
   s.material.transparency = transparency;
@@ -245,7 +301,7 @@ auto glassSphere(Transformation transform, double transparency,
   return s;
 }
 
-auto Computations::schlick() const -> double {
+auto Computations::schlick() const -> Real {
   auto cos = dot(eye, normal);
   if (n1 > n2) {
     auto n = n1 / n2;
@@ -274,11 +330,11 @@ auto Cube::localNormalAt(const Point &p) const -> Vector {
   return vector(0, 0, p.z);
 }
 
-auto checkAxis(double origin, double direction) -> std::pair<double, double> {
+auto checkAxis(Real origin, Real direction) -> std::pair<Real, Real> {
   auto tmin_numerator = -1 - origin;
   auto tmax_numerator = 1 - origin;
-  double tmin = NAN;
-  double tmax = NAN;
+  Real tmin = NAN;
+  Real tmax = NAN;
   if (std::abs(direction) >= EPSILON) {
     tmin = tmin_numerator / direction;
     tmax = tmax_numerator / direction;
@@ -293,16 +349,27 @@ auto checkAxis(double origin, double direction) -> std::pair<double, double> {
 }
 
 auto Cube::localIntersect(const Ray &ray) const
-    -> std::vector<std::pair<double, const Shape *>> {
+    -> std::vector<std::pair<Real, const Shape *>> {
+  std::vector<Intersection> xs;
+  intersectInto(ray, xs);
+  return xs;
+}
+
+auto Cube::bounds() const -> BoundingBox {
+  return {point(-1, -1, -1), point(1, 1, 1)};
+}
+
+void Cube::intersectInto(const Ray &ray, std::vector<Intersection> &xs) const {
   auto [xtmin, xtmax] = checkAxis(ray.origin.x, ray.direction.x);
   auto [ytmin, ytmax] = checkAxis(ray.origin.y, ray.direction.y);
   auto [ztmin, ztmax] = checkAxis(ray.origin.z, ray.direction.z);
   auto tmin = std::max({xtmin, ytmin, ztmin});
   auto tmax = std::min({xtmax, ytmax, ztmax});
   if (tmin > tmax) {
-    return {};
+    return;
   }
-  return {{tmin, this}, {tmax, this}};
+  xs.emplace_back(tmin, this);
+  xs.emplace_back(tmax, this);
 }
 
 auto Cylinder::localNormalAt(const Point &p) const -> Vector {
@@ -316,17 +383,18 @@ auto Cylinder::localNormalAt(const Point &p) const -> Vector {
   return vector(p.x, 0, p.z);
 }
 
-auto checkCap(const Ray &ray, double t, double radius) -> bool {
+// Rays through the rim hit the cap as well as the side; EPSILON keeps the
+// cap hit when rounding puts the rim just outside.
+auto checkCap(const Ray &ray, Real t, Real radius) -> bool {
   auto x = ray.origin.x + t * ray.direction.x;
   auto z = ray.origin.z + t * ray.direction.z;
-  return x * x + z * z <= radius * radius;
+  return x * x + z * z <= radius * radius + EPSILON;
 }
 
-auto Cylinder::intersectCaps(const Ray &ray) const
-    -> std::vector<std::pair<double, const Shape *>> {
-  std::vector<std::pair<double, const Shape *>> xs;
+void Cylinder::intersectCaps(const Ray &ray,
+                             std::vector<Intersection> &xs) const {
   if (!closed || approxEqual(ray.direction.y, 0.0)) {
-    return xs;
+    return;
   }
   auto t = (minimum - ray.origin.y) / ray.direction.y;
   if (checkCap(ray, t, 1)) {
@@ -336,23 +404,33 @@ auto Cylinder::intersectCaps(const Ray &ray) const
   if (checkCap(ray, t, 1)) {
     xs.emplace_back(t, this);
   }
-  return xs;
 }
 
 auto Cylinder::localIntersect(const Ray &ray) const
-    -> std::vector<std::pair<double, const Shape *>> {
-  std::vector<std::pair<double, const Shape *>> xs = intersectCaps(ray);
+    -> std::vector<std::pair<Real, const Shape *>> {
+  std::vector<Intersection> xs;
+  intersectInto(ray, xs);
+  return xs;
+}
+
+auto Cylinder::bounds() const -> BoundingBox {
+  return {point(-1, minimum, -1), point(1, maximum, 1)};
+}
+
+void Cylinder::intersectInto(const Ray &ray,
+                             std::vector<Intersection> &xs) const {
+  intersectCaps(ray, xs);
   auto a =
       ray.direction.x * ray.direction.x + ray.direction.z * ray.direction.z;
   if (approxEqual(a, 0.0)) {
-    return xs;
+    return;
   }
   auto b =
       2 * ray.origin.x * ray.direction.x + 2 * ray.origin.z * ray.direction.z;
   auto c = ray.origin.x * ray.origin.x + ray.origin.z * ray.origin.z - 1;
   auto discriminant = b * b - 4 * a * c;
   if (discriminant < 0) {
-    return xs;
+    return;
   }
 
   auto t1 = (-b - std::sqrt(discriminant)) / (2 * a);
@@ -370,14 +448,11 @@ auto Cylinder::localIntersect(const Ray &ray) const
   if (minimum < y2 && y2 < maximum) {
     xs.emplace_back(t2, this);
   }
-  return xs;
 }
 
-auto Cone::intersectCaps(const Ray &ray) const
-    -> std::vector<std::pair<double, const Shape *>> {
-  std::vector<std::pair<double, const Shape *>> xs;
+void Cone::intersectCaps(const Ray &ray, std::vector<Intersection> &xs) const {
   if (!closed || approxEqual(ray.direction.y, 0.0)) {
-    return xs;
+    return;
   }
   auto t = (minimum - ray.origin.y) / ray.direction.y;
   if (checkCap(ray, t, minimum)) {
@@ -387,7 +462,6 @@ auto Cone::intersectCaps(const Ray &ray) const
   if (checkCap(ray, t, maximum)) {
     xs.emplace_back(t, this);
   }
-  return xs;
 }
 
 auto Cone::localNormalAt(const Point &p) const -> Vector {
@@ -406,8 +480,19 @@ auto Cone::localNormalAt(const Point &p) const -> Vector {
 }
 
 auto Cone::localIntersect(const Ray &ray) const
-    -> std::vector<std::pair<double, const Shape *>> {
-  std::vector<std::pair<double, const Shape *>> xs = intersectCaps(ray);
+    -> std::vector<std::pair<Real, const Shape *>> {
+  std::vector<Intersection> xs;
+  intersectInto(ray, xs);
+  return xs;
+}
+
+auto Cone::bounds() const -> BoundingBox {
+  auto radius = std::max(std::abs(minimum), std::abs(maximum));
+  return {point(-radius, minimum, -radius), point(radius, maximum, radius)};
+}
+
+void Cone::intersectInto(const Ray &ray, std::vector<Intersection> &xs) const {
+  intersectCaps(ray, xs);
   auto a = ray.direction.x * ray.direction.x -
            ray.direction.y * ray.direction.y +
            ray.direction.z * ray.direction.z;
@@ -420,13 +505,15 @@ auto Cone::localIntersect(const Ray &ray) const
     if (!approxEqual(b, 0.0)) {
       xs.emplace_back(-c / (2 * b), this);
     }
-    return xs;
+    return;
   }
 
+  // Tangent rays have a discriminant of 0, which rounding can push below.
   auto discriminant = b * b - 4 * a * c;
-  if (discriminant < 0) {
-    return xs;
+  if (discriminant < -EPSILON) {
+    return;
   }
+  discriminant = std::max(discriminant, Real{0});
 
   auto t1 = (-b - std::sqrt(discriminant)) / (2 * a);
   auto t2 = (-b + std::sqrt(discriminant)) / (2 * a);
@@ -443,7 +530,364 @@ auto Cone::localIntersect(const Ray &ray) const
   if (minimum < y2 && y2 < maximum) {
     xs.emplace_back(t2, this);
   }
+}
+
+CSG::CSG(CSGOperation operation, std::unique_ptr<Shape> left,
+         std::unique_ptr<Shape> right)
+    : operation(operation), leftShape(std::move(left)),
+      rightShape(std::move(right)) {
+  assert(leftShape != nullptr && rightShape != nullptr && "CSG child is null");
+  leftShape->parent = this;
+  rightShape->parent = this;
+  refit();
+}
+
+CSG::CSG(CSG &&other) noexcept
+    : Shape(std::move(other)), operation(other.operation),
+      leftShape(std::move(other.leftShape)),
+      rightShape(std::move(other.rightShape)), leftInverse(other.leftInverse),
+      rightInverse(other.rightInverse), leftBounds(other.leftBounds),
+      rightBounds(other.rightBounds) {
+  leftShape->parent = this;
+  rightShape->parent = this;
+}
+
+auto CSG::operator=(CSG &&other) noexcept -> CSG & {
+  Shape::operator=(std::move(other));
+  operation = other.operation;
+  leftShape = std::move(other.leftShape);
+  rightShape = std::move(other.rightShape);
+  leftInverse = other.leftInverse;
+  rightInverse = other.rightInverse;
+  leftBounds = other.leftBounds;
+  rightBounds = other.rightBounds;
+  leftShape->parent = this;
+  rightShape->parent = this;
+  return *this;
+}
+
+auto CSG::left() const -> const Shape & { return *leftShape; }
+
+auto CSG::right() const -> const Shape & { return *rightShape; }
+
+void CSG::refit() {
+  leftInverse = leftShape->transformation.inverse();
+  rightInverse = rightShape->transformation.inverse();
+  leftBounds = leftShape->bounds()
+                   .transform(leftShape->transformation)
+                   .padded(EPSILON);
+  rightBounds = rightShape->bounds()
+                    .transform(rightShape->transformation)
+                    .padded(EPSILON);
+}
+
+auto CSG::intersectionAllowed(CSGOperation operation, bool leftHit,
+                              bool insideLeft, bool insideRight) -> bool {
+  switch (operation) {
+  case CSGOperation::Union:
+    return (leftHit && !insideRight) || (!leftHit && !insideLeft);
+  case CSGOperation::Intersection:
+    return (leftHit && insideRight) || (!leftHit && insideLeft);
+  case CSGOperation::Difference:
+    return (leftHit && !insideRight) || (!leftHit && insideLeft);
+  }
+  return false;
+}
+
+auto CSG::localNormalAt(const Point & /*point*/) const -> Vector {
+  assert(false && "CSG hits report the child that was hit");
+  return vector(0, 0, 0);
+}
+
+auto CSG::localIntersect(const Ray &ray) const -> std::vector<Intersection> {
+  std::vector<Intersection> xs;
+  intersectInto(ray, xs);
   return xs;
 }
 
+auto CSG::bounds() const -> BoundingBox {
+  switch (operation) {
+  case CSGOperation::Union: {
+    auto box = leftBounds;
+    box.add(rightBounds);
+    return box;
+  }
+  case CSGOperation::Intersection: {
+    if (leftBounds.isEmpty() || rightBounds.isEmpty()) {
+      return {};
+    }
+    auto box = BoundingBox(point(std::max(leftBounds.min.x, rightBounds.min.x),
+                                 std::max(leftBounds.min.y, rightBounds.min.y),
+                                 std::max(leftBounds.min.z, rightBounds.min.z)),
+                           point(std::min(leftBounds.max.x, rightBounds.max.x),
+                                 std::min(leftBounds.max.y, rightBounds.max.y),
+                                 std::min(leftBounds.max.z, rightBounds.max.z)));
+    return box.isEmpty() ? BoundingBox() : box;
+  }
+  case CSGOperation::Difference:
+    break;
+  }
+  return leftBounds;
+}
+
+// Appends the hits of both children to xs, left ones first, and returns
+// where the right ones start. Children whose bounds the ray misses are
+// skipped, and nothing is returned when that already empties the result.
+auto CSG::childHits(const Ray &ray, std::vector<Intersection> &xs) const
+    -> std::optional<size_t> {
+  auto hitsLeft = leftBounds.intersects(ray);
+  auto hitsRight = rightBounds.intersects(ray);
+  if ((!hitsLeft && operation != CSGOperation::Union) ||
+      (!hitsRight && operation == CSGOperation::Intersection)) {
+    return std::nullopt;
+  }
+  if (hitsLeft) {
+    leftShape->intersectInto(ray.transform(leftInverse), xs);
+  }
+  auto middle = xs.size();
+  if (hitsRight) {
+    rightShape->intersectInto(ray.transform(rightInverse), xs);
+  }
+  return middle;
+}
+
+auto byDistance(const Intersection &a, const Intersection &b) -> bool {
+  return a.first < b.first;
+}
+
+// Walks the sorted hits of both children in one pass, tracking whether
+// the ray is inside each, and passes every hit the operation keeps to
+// visit until it returns true.
+template <typename Visit>
+void mergeCSGHits(CSGOperation operation,
+                  std::vector<Intersection>::const_iterator left,
+                  std::vector<Intersection>::const_iterator leftEnd,
+                  std::vector<Intersection>::const_iterator right,
+                  std::vector<Intersection>::const_iterator rightEnd,
+                  Visit visit) {
+  auto insideLeft = false;
+  auto insideRight = false;
+  while (left != leftEnd || right != rightEnd) {
+    auto leftHit =
+        right == rightEnd || (left != leftEnd && left->first <= right->first);
+    const auto &i = leftHit ? *left++ : *right++;
+    if (CSG::intersectionAllowed(operation, leftHit, insideLeft,
+                                 insideRight) &&
+        visit(i)) {
+      return;
+    }
+    if (leftHit) {
+      insideLeft = !insideLeft;
+    } else {
+      insideRight = !insideRight;
+    }
+  }
+}
+
+// Merged hits of the CSG being filtered on this thread. Children are done
+// intersecting by the time their parent merges, so nesting can share it.
+thread_local std::vector<Intersection> csgMerged;
+
+void CSG::intersectInto(const Ray &ray, std::vector<Intersection> &xs) const {
+  auto base = xs.size();
+  auto middle = childHits(ray, xs);
+  if (!middle.has_value()) {
+    return;
+  }
+  auto split = middle.value();
+  auto leftOnly = split == xs.size();
+  auto rightOnly = split == base;
+  if (leftOnly || rightOnly) {
+    // A lone child's hits all survive a union, and the left's a difference.
+    if (operation == CSGOperation::Union ||
+        (leftOnly && operation == CSGOperation::Difference)) {
+      return;
+    }
+    xs.resize(base);
+    return;
+  }
+  auto first = xs.begin() + static_cast<std::ptrdiff_t>(base);
+  auto mid = xs.begin() + static_cast<std::ptrdiff_t>(split);
+  std::sort(first, mid, byDistance);
+  std::sort(mid, xs.end(), byDistance);
+  csgMerged.clear();
+  mergeCSGHits(operation, first, mid, mid, xs.cend(),
+               [](const Intersection &i) {
+                 csgMerged.push_back(i);
+                 return false;
+               });
+  xs.resize(base);
+  xs.insert(xs.end(), csgMerged.begin(), csgMerged.end());
+}
+
+auto CSG::occludes(const Ray &ray, Real distance,
+                   std::vector<Intersection> &scratch) const -> bool {
+  scratch.clear();
+  auto middle = childHits(ray, scratch);
+  if (!middle.has_value()) {
+    return false;
+  }
+  auto split = static_cast<std::ptrdiff_t>(middle.value());
+  auto mid = scratch.begin() + split;
+  std::sort(scratch.begin(), mid, byDistance);
+  std::sort(mid, scratch.end(), byDistance);
+  auto occluded = false;
+  mergeCSGHits(operation, scratch.cbegin(), scratch.cbegin() + split,
+               scratch.cbegin() + split, scratch.cend(),
+               [&](const Intersection &i) {
+                 if (i.first < 0) {
+                   return false;
+                 }
+                 occluded = i.first < distance;
+                 return true;
+               });
+  return occluded;
+}
+
+inline auto shapeOf(const Shape &shape) -> const Shape & { return shape; }
+
+inline auto shapeOf(const std::unique_ptr<Shape> &shape) -> const Shape & {
+  return *shape;
+}
+
+// A moving shape is bounded over its whole motion.
+auto worldBounds(const Shape &shape) -> BoundingBox {
+  auto box = shape.motion ? shape.motion->sweep(shape.bounds())
+                          : shape.bounds().transform(shape.transformation);
+  return box.padded(EPSILON);
+}
+
+template <typename T> void ShapeArray<T>::push(T shape) {
+  const auto &s = shapeOf(shape);
+  inverses.push_back(s.transformation.inverse());
+  if (s.material.pattern) {
+    patterns.emplace_back(CompiledPattern(*s.material.pattern, s.transformation));
+  } else {
+    patterns.emplace_back();
+  }
+  bounds.push(worldBounds(s));
+  shapes.push_back(std::move(shape));
+}
+
+template <typename T> void ShapeArray<T>::refit(size_t i) {
+  const auto &s = shapeOf(shapes[i]);
+  inverses[i] = s.transformation.inverse();
+  if (s.material.pattern) {
+    patterns[i].emplace(*s.material.pattern, s.transformation);
+  } else {
+    patterns[i].reset();
+  }
+  bounds.set(i, worldBounds(s));
+}
+
+template <typename T> void ShapeArray<T>::remove(size_t i) {
+  if (i + 1 != shapes.size()) {
+    shapes[i] = std::move(shapes.back());
+    inverses[i] = inverses.back();
+    patterns[i] = std::move(patterns.back());
+  }
+  shapes.pop_back();
+  inverses.pop_back();
+  patterns.pop_back();
+  bounds.remove(i);
+}
+
+template <typename T>
+auto ShapeArray<T>::indexOf(const Shape *shape) const -> std::optional<size_t> {
+  if constexpr (std::is_same_v<T, std::unique_ptr<Shape>>) {
+    for (size_t i = 0; i < shapes.size(); i++) {
+      if (shapes[i].get() == shape) {
+        return i;
+      }
+    }
+  } else {
+    const void *first = shapes.data();
+    const void *last = shapes.data() + shapes.size();
+    const void *address = shape;
+    if (!std::less<const void *>()(address, first) &&
+        std::less<const void *>()(address, last)) {
+      return static_cast<size_t>(static_cast<const T *>(shape) - shapes.data());
+    }
+  }
+  return std::nullopt;
+}
+
+template <typename T> auto ShapeArray<T>::size() const -> size_t {
+  return shapes.size();
+}
+
+template <typename T>
+auto ShapeArray<T>::toObject(size_t i, const Ray &ray) const -> Ray {
+  const auto &motion = shapeOf(shapes[i]).motion;
+  return ray.transform(motion ? motion->inverseAt(ray.time) : inverses[i]);
+}
+
+template <typename T>
+void ShapeArray<T>::intersect(const Ray &ray,
+                              std::vector<Intersection> &xs) const {
+  std::array<unsigned char, BOUNDS_BLOCK_SIZE> mask{};
+  for (size_t first = 0; first < shapes.size(); first += BOUNDS_BLOCK_SIZE) {
+    auto count = std::min(BOUNDS_BLOCK_SIZE, shapes.size() - first);
+    bounds.hits(ray, first, count, mask.data());
+    for (size_t i = 0; i < count; i++) {
+      if (mask[i] == 0) {
+        continue;
+      }
+      auto localRay = toObject(first + i, ray);
+      if constexpr (std::is_same_v<T, std::unique_ptr<Shape>>) {
+        shapes[first + i]->intersectInto(localRay, xs);
+      } else {
+        shapes[first + i].intersectInto(localRay, xs);
+      }
+    }
+  }
+}
+
+template <typename T>
+void ShapeArray<T>::intersectOne(size_t i, const Ray &ray,
+                                 std::vector<Intersection> &xs) const {
+  auto localRay = toObject(i, ray);
+  if constexpr (std::is_same_v<T, std::unique_ptr<Shape>>) {
+    shapes[i]->intersectInto(localRay, xs);
+  } else {
+    shapes[i].intersectInto(localRay, xs);
+  }
+}
+
+template <typename T>
+auto ShapeArray<T>::occludesOne(size_t i, const Ray &ray, Real distance,
+                                std::vector<Intersection> &scratch) const
+    -> bool {
+  auto localRay = toObject(i, ray);
+  if constexpr (std::is_same_v<T, std::unique_ptr<Shape>>) {
+    return shapes[i]->occludes(localRay, distance, scratch);
+  } else {
+    return shapes[i].occludes(localRay, distance, scratch);
+  }
+}
+
+template <typename T>
+auto ShapeArray<T>::occluder(const Ray &ray, Real distance,
+                             std::vector<Intersection> &scratch) const
+    -> std::optional<size_t> {
+  std::array<unsigned char, BOUNDS_BLOCK_SIZE> mask{};
+  for (size_t first = 0; first < shapes.size(); first += BOUNDS_BLOCK_SIZE) {
+    auto count = std::min(BOUNDS_BLOCK_SIZE, shapes.size() - first);
+    bounds.hits(ray, first, count, mask.data());
+    for (size_t i = 0; i < count; i++) {
+      if (mask[i] != 0 && occludesOne(first + i, ray, distance, scratch)) {
+        return first + i;
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+template class ShapeArray<Sphere>;
+template class ShapeArray<Plane>;
+template class ShapeArray<Cube>;
+template class ShapeArray<Cylinder>;
+template class ShapeArray<Cone>;
+template class ShapeArray<std::unique_ptr<Shape>>;
+
 } // namespace RT
@@ -0,0 +1,505 @@
+#include "Texture.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <cstring>
+#include <numbers>
+#include <stdexcept>
+#include <utility>
+
+namespace RT {
+
+constexpr Real TWO_PI = 2 * std::numbers::pi_v<Real>;
+
+inline auto positiveMod(Real value, Real modulus) -> Real {
+  auto r = std::fmod(value, modulus);
+  return r < 0 ? r + modulus : r;
+}
+
+inline auto wrap(int value, int size) -> int {
+  auto r = value % size;
+  return r < 0 ? r + size : r;
+}
+
+auto planarMap(const Point &p) -> UV {
+  return {positiveMod(p.x, 1), positiveMod(p.z, 1)};
+}
+
+auto sphericalMap(const Point &p) -> UV {
+  auto theta = std::atan2(p.x, p.z);
+  auto radius = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+  auto phi = std::acos(std::clamp(p.y / radius, Real{-1}, Real{1}));
+  auto rawU = theta / TWO_PI;
+  return {1 - (rawU + Real{0.5}), 1 - phi / std::numbers::pi_v<Real>};
+}
+
+auto cylindricalMap(const Point &p) -> UV {
+  auto theta = std::atan2(p.x, p.z);
+  auto rawU = theta / TWO_PI;
+  return {1 - (rawU + Real{0.5}), positiveMod(p.y, 1)};
+}
+
+auto cubeFace(const Point &p) -> CubeFace {
+  auto coord = std::max({std::abs(p.x), std::abs(p.y), std::abs(p.z)});
+  if (coord == p.x) {
+    return CubeFace::Right;
+  }
+  if (coord == -p.x) {
+    return CubeFace::Left;
+  }
+  if (coord == p.y) {
+    return CubeFace::Up;
+  }
+  if (coord == -p.y) {
+    return CubeFace::Down;
+  }
+  if (coord == p.z) {
+    return CubeFace::Front;
+  }
+  return CubeFace::Back;
+}
+
+auto cubeFaceMap(CubeFace face, const Point &p) -> UV {
+  auto half = [](Real value) { return positiveMod(value, 2) / 2; };
+  switch (face) {
+  case CubeFace::Front:
+    return {half(p.x + 1), half(p.y + 1)};
+  case CubeFace::Back:
+    return {half(1 - p.x), half(p.y + 1)};
+  case CubeFace::Left:
+    return {half(p.z + 1), half(p.y + 1)};
+  case CubeFace::Right:
+    return {half(1 - p.z), half(p.y + 1)};
+  case CubeFace::Up:
+    return {half(p.x + 1), half(1 - p.z)};
+  case CubeFace::Down:
+    return {half(p.x + 1), half(p.z + 1)};
+  }
+  return {0, 0};
+}
+
+auto cubicMap(const Point &p) -> UV {
+  auto face = cubeFace(p);
+  auto uv = cubeFaceMap(face, p);
+  return {(static_cast<Real>(face) + uv.u) / 6, uv.v};
+}
+
+auto uvMap(UVMapping mapping, const Point &p) -> UV {
+  switch (mapping) {
+  case UVMapping::Planar:
+    return planarMap(p);
+  case UVMapping::Spherical:
+    return sphericalMap(p);
+  case UVMapping::Cylindrical:
+    return cylindricalMap(p);
+  case UVMapping::Cubic:
+    return cubicMap(p);
+  }
+  return planarMap(p);
+}
+
+constexpr size_t TILE_FLOATS =
+    static_cast<size_t>(TEXTURE_TILE_SIZE) * TEXTURE_TILE_SIZE * 3;
+constexpr size_t TILE_BYTES = TILE_FLOATS * sizeof(float);
+
+TextureCache::TextureCache(size_t capacity) : limit(capacity) {}
+
+auto TextureCache::shared() -> std::shared_ptr<TextureCache> {
+  static auto cache = std::make_shared<TextureCache>();
+  return cache;
+}
+
+auto TextureCache::KeyHash::operator()(const Key &key) const -> size_t {
+  auto h = std::hash<uint64_t>()(key.texture);
+  for (auto part : {key.level, key.x, key.y}) {
+    h ^= std::hash<int>()(part) + 0x9e3779b97f4a7c15ULL + (h << 6U) + (h >> 2U);
+  }
+  return h;
+}
+
+auto TextureCache::find(const Key &key) -> std::shared_ptr<const TextureTile> {
+  std::lock_guard lock(mutex);
+  auto it = index.find(key);
+  if (it == index.end()) {
+    missCount++;
+    return nullptr;
+  }
+  hitCount++;
+  entries.splice(entries.begin(), entries, it->second);
+  it->second->stamp = clock.fetch_add(1, std::memory_order_relaxed) + 1;
+  return it->second->tile;
+}
+
+void TextureCache::insert(const Key &key,
+                          std::shared_ptr<const TextureTile> tile) {
+  std::lock_guard lock(mutex);
+  if (index.contains(key)) {
+    return;
+  }
+  entries.push_front(Entry{
+      key, std::move(tile), clock.fetch_add(1, std::memory_order_relaxed) + 1});
+  index.emplace(key, entries.begin());
+  bytes += TILE_BYTES;
+  evict();
+}
+
+// Checked against the value already there, so threads sharing a tile
+// mostly read its stamp instead of writing it.
+void TextureCache::touch(const TextureTile &tile) const {
+  auto now = clock.load(std::memory_order_relaxed);
+  if (tile.used.load(std::memory_order_relaxed) != now) {
+    tile.used.store(now, std::memory_order_relaxed);
+  }
+}
+
+// The most recent tile always stays, so a lookup never loses the tile it
+// just built even under a tiny budget. A tile used through a handle since
+// it was last ordered goes back behind it instead; the clock stands still
+// under the lock, so each tile is spared at most twice per call.
+void TextureCache::evict() {
+  while (bytes > limit && entries.size() > 1) {
+    auto &last = entries.back();
+    auto used = last.tile->used.load(std::memory_order_relaxed);
+    if (used > last.stamp) {
+      last.stamp = used;
+      entries.splice(std::next(entries.begin()), entries,
+                     std::prev(entries.end()));
+      continue;
+    }
+    index.erase(entries.back().key);
+    entries.pop_back();
+    bytes -= TILE_BYTES;
+  }
+}
+
+void TextureCache::erase(uint64_t texture) {
+  std::lock_guard lock(mutex);
+  for (auto it = entries.begin(); it != entries.end();) {
+    if (it->key.texture == texture) {
+      index.erase(it->key);
+      it = entries.erase(it);
+      bytes -= TILE_BYTES;
+    } else {
+      it++;
+    }
+  }
+}
+
+void TextureCache::setCapacity(size_t capacity) {
+  std::lock_guard lock(mutex);
+  limit = capacity;
+  evict();
+}
+
+auto TextureCache::capacity() const -> size_t {
+  std::lock_guard lock(mutex);
+  return limit;
+}
+
+auto TextureCache::resident() const -> size_t {
+  std::lock_guard lock(mutex);
+  return bytes;
+}
+
+auto TextureCache::hits() const -> size_t {
+  std::lock_guard lock(mutex);
+  return hitCount;
+}
+
+auto TextureCache::misses() const -> size_t {
+  std::lock_guard lock(mutex);
+  return missCount;
+}
+
+auto nextTextureId() -> uint64_t {
+  static std::atomic<uint64_t> next{0};
+  return next++;
+}
+
+auto Texture::load(const std::string &filename,
+                   std::shared_ptr<TextureCache> cache)
+    -> std::shared_ptr<const Texture> {
+  return std::shared_ptr<const Texture>(new Texture(filename, std::move(cache)));
+}
+
+Texture::Texture(const std::string &filename,
+                 std::shared_ptr<TextureCache> cache)
+    : width(0), height(0), cache(std::move(cache)), id(nextTextureId()),
+      file(std::in_place, filename) {
+  const auto *data = file->data();
+  auto size = file->size();
+  size_t pos = 0;
+  auto nextToken = [&]() {
+    while (pos < size) {
+      if (data[pos] == '#') {
+        while (pos < size && data[pos] != '\n') {
+          pos++;
+        }
+      } else if (std::isspace(data[pos]) != 0) {
+        pos++;
+      } else {
+        break;
+      }
+    }
+    std::string token;
+    while (pos < size && std::isspace(data[pos]) == 0) {
+      token.push_back(static_cast<char>(data[pos++]));
+    }
+    if (token.empty()) {
+      throw std::runtime_error("truncated texture header in " + filename);
+    }
+    return token;
+  };
+  auto magic = nextToken();
+  if (magic != "P6" && magic != "P3" && magic != "PF" && magic != "Pf") {
+    throw std::runtime_error(filename + " is not a PPM or PFM file");
+  }
+  width = std::stoi(nextToken());
+  height = std::stoi(nextToken());
+  size_t bytesPerSample = 0;
+  if (magic == "PF" || magic == "Pf") {
+    auto scale = std::stof(nextToken());
+    format = Format::Float32;
+    channels = magic == "PF" ? 3 : 1;
+    littleEndian = scale < 0;
+    bottomUp = true;
+    bytesPerSample = sizeof(float);
+  } else {
+    maxValue = std::stof(nextToken());
+    if (maxValue <= 0 || maxValue > 65535) {
+      throw std::runtime_error("invalid PPM header in " + filename);
+    }
+    format = maxValue < 256 ? Format::Bytes8 : Format::Bytes16;
+    bytesPerSample = maxValue < 256 ? 1 : 2;
+  }
+  if (width <= 0 || height <= 0) {
+    throw std::runtime_error("invalid texture size in " + filename);
+  }
+  auto samples = static_cast<size_t>(width) * height * channels;
+  if (magic == "P3") {
+    decoded.resize(samples);
+    for (auto &value : decoded) {
+      value = static_cast<float>(std::stoi(nextToken())) / maxValue;
+    }
+    format = Format::Decoded;
+    file.reset();
+    return;
+  }
+  offset = pos + 1;
+  if (size < offset + samples * bytesPerSample) {
+    throw std::runtime_error("truncated texture body in " + filename);
+  }
+}
+
+Texture::~Texture() { cache->erase(id); }
+
+auto Texture::levels() const -> int {
+  auto size = std::max(width, height);
+  auto count = 1;
+  while (size > 1) {
+    size /= 2;
+    count++;
+  }
+  return count;
+}
+
+auto Texture::levelWidth(int level) const -> int {
+  return std::max(1, width >> level);
+}
+
+auto Texture::levelHeight(int level) const -> int {
+  return std::max(1, height >> level);
+}
+
+auto Texture::sourceTexel(int x, int y) const -> std::array<float, 3> {
+  auto row = bottomUp ? height - 1 - y : y;
+  auto first = (static_cast<size_t>(row) * width + x) * channels;
+  std::array<float, 3> rgb{};
+  for (auto c = 0; c < 3; c++) {
+    auto sample = first + (channels == 1 ? 0 : c);
+    switch (format) {
+    case Format::Decoded:
+      rgb[c] = decoded[sample];
+      break;
+    case Format::Bytes8:
+      rgb[c] = static_cast<float>(file->data()[offset + sample]) / maxValue;
+      break;
+    case Format::Bytes16: {
+      const auto *bytes = file->data() + offset + sample * 2;
+      auto value = (static_cast<unsigned>(bytes[0]) << 8U) | bytes[1];
+      rgb[c] = static_cast<float>(value) / maxValue;
+      break;
+    }
+    case Format::Float32: {
+      uint32_t bits = 0;
+      std::memcpy(&bits, file->data() + offset + sample * sizeof(float),
+                  sizeof(bits));
+      if (littleEndian != (std::endian::native == std::endian::little)) {
+        bits = ((bits & 0xFFU) << 24U) | ((bits & 0xFF00U) << 8U) |
+               ((bits >> 8U) & 0xFF00U) | (bits >> 24U);
+      }
+      rgb[c] = std::bit_cast<float>(bits);
+      break;
+    }
+    }
+  }
+  return rgb;
+}
+
+auto Texture::buildTile(int level, int x, int y) const
+    -> std::shared_ptr<const TextureTile> {
+  auto built = std::make_shared<TextureTile>();
+  built->rgb.assign(TILE_FLOATS, 0);
+  auto w = levelWidth(level);
+  auto h = levelHeight(level);
+  auto x0 = x * TEXTURE_TILE_SIZE;
+  auto y0 = y * TEXTURE_TILE_SIZE;
+  auto columns = std::min(TEXTURE_TILE_SIZE, w - x0);
+  auto rows = std::min(TEXTURE_TILE_SIZE, h - y0);
+  std::shared_ptr<const TextureTile> parent;
+  auto parentX = -1;
+  auto parentY = -1;
+  auto parentTexel = [&](int px, int py) {
+    px = std::min(px, levelWidth(level - 1) - 1);
+    py = std::min(py, levelHeight(level - 1) - 1);
+    auto tx = px / TEXTURE_TILE_SIZE;
+    auto ty = py / TEXTURE_TILE_SIZE;
+    if (tx != parentX || ty != parentY) {
+      parent = tile(level - 1, tx, ty);
+      parentX = tx;
+      parentY = ty;
+    }
+    auto i = static_cast<size_t>((py % TEXTURE_TILE_SIZE) * TEXTURE_TILE_SIZE +
+                                 px % TEXTURE_TILE_SIZE) *
+             3;
+    return &parent->rgb[i];
+  };
+  for (auto row = 0; row < rows; row++) {
+    for (auto column = 0; column < columns; column++) {
+      auto *out =
+          &built->rgb[static_cast<size_t>(row * TEXTURE_TILE_SIZE + column) *
+                      3];
+      if (level == 0) {
+        auto rgb = sourceTexel(x0 + column, y0 + row);
+        std::copy(rgb.begin(), rgb.end(), out);
+        continue;
+      }
+      auto px = (x0 + column) * 2;
+      auto py = (y0 + row) * 2;
+      for (auto [dx, dy] : {std::pair{0, 0}, {1, 0}, {0, 1}, {1, 1}}) {
+        const auto *in = parentTexel(px + dx, py + dy);
+        for (auto c = 0; c < 3; c++) {
+          out[c] += in[c] / 4;
+        }
+      }
+    }
+  }
+  return built;
+}
+
+// A direct-mapped table per thread. Texture IDs are never reused, and a
+// tile the cache evicts is freed, so a handle is never stale.
+struct TileHandles {
+  struct Slot {
+    TextureCache::Key key{~uint64_t{0}, 0, 0, 0};
+    std::weak_ptr<const TextureTile> tile;
+  };
+  std::array<Slot, TEXTURE_TILE_HANDLES> slots;
+};
+
+thread_local TileHandles tileHandles;
+
+auto Texture::tile(int level, int x, int y) const
+    -> std::shared_ptr<const TextureTile> {
+  TextureCache::Key key{id, level, x, y};
+  auto &slot = tileHandles.slots[TextureCache::KeyHash()(key) %
+                                 TEXTURE_TILE_HANDLES];
+  if (slot.key == key) {
+    auto held = slot.tile.lock();
+    if (held != nullptr) {
+      cache->touch(*held);
+      return held;
+    }
+  }
+  auto found = cache->find(key);
+  if (found == nullptr) {
+    found = buildTile(level, x, y);
+    cache->insert(key, found);
+  }
+  slot.key = key;
+  slot.tile = found;
+  return found;
+}
+
+auto Texture::texel(int level, int x, int y) const -> Color {
+  auto t = tile(level, x / TEXTURE_TILE_SIZE, y / TEXTURE_TILE_SIZE);
+  const auto *rgb =
+      &t->rgb[static_cast<size_t>((y % TEXTURE_TILE_SIZE) * TEXTURE_TILE_SIZE +
+                                  x % TEXTURE_TILE_SIZE) *
+              3];
+  return color(rgb[0], rgb[1], rgb[2]);
+}
+
+auto Texture::bilinear(int level, Real u, Real v) const -> Color {
+  auto w = levelWidth(level);
+  auto h = levelHeight(level);
+  auto fx = u * static_cast<Real>(w) - Real{0.5};
+  auto fy = (1 - v) * static_cast<Real>(h) - Real{0.5};
+  auto ix = fastFloor(fx);
+  auto iy = fastFloor(fy);
+  auto tx = fx - static_cast<Real>(ix);
+  auto ty = fy - static_cast<Real>(iy);
+  auto x0 = wrap(ix, w);
+  auto x1 = wrap(ix + 1, w);
+  auto y0 = wrap(iy, h);
+  auto y1 = wrap(iy + 1, h);
+  std::shared_ptr<const TextureTile> current;
+  auto currentX = -1;
+  auto currentY = -1;
+  auto fetch = [&](int x, int y) {
+    auto cx = x / TEXTURE_TILE_SIZE;
+    auto cy = y / TEXTURE_TILE_SIZE;
+    if (cx != currentX || cy != currentY) {
+      current = tile(level, cx, cy);
+      currentX = cx;
+      currentY = cy;
+    }
+    const auto *rgb = &current->rgb[static_cast<size_t>(
+                                        (y % TEXTURE_TILE_SIZE) *
+                                            TEXTURE_TILE_SIZE +
+                                        x % TEXTURE_TILE_SIZE) *
+                                    3];
+    return color(rgb[0], rgb[1], rgb[2]);
+  };
+  auto top = fetch(x0, y0) * (1 - tx) + fetch(x1, y0) * tx;
+  auto bottom = fetch(x0, y1) * (1 - tx) + fetch(x1, y1) * tx;
+  return top * (1 - ty) + bottom * ty;
+}
+
+auto Texture::sample(const UV &uv, Real lod, TextureFilter filter) const
+    -> Color {
+  auto top = static_cast<Real>(levels() - 1);
+  lod = std::clamp(lod, Real{0}, top);
+  if (filter == TextureFilter::Trilinear) {
+    auto fine = fastFloor(lod);
+    auto coarse = std::min(fine + 1, levels() - 1);
+    auto t = lod - static_cast<Real>(fine);
+    auto c = bilinear(fine, uv.u, uv.v);
+    if (t == 0) {
+      return c;
+    }
+    return c * (1 - t) + bilinear(coarse, uv.u, uv.v) * t;
+  }
+  auto level = static_cast<int>(std::lround(lod));
+  if (filter == TextureFilter::Bilinear) {
+    return bilinear(level, uv.u, uv.v);
+  }
+  auto w = levelWidth(level);
+  auto h = levelHeight(level);
+  return texel(level, wrap(fastFloor(uv.u * static_cast<Real>(w)), w),
+               wrap(fastFloor((1 - uv.v) * static_cast<Real>(h)), h));
+}
+
+} // namespace RT
@@ -10,7 +10,7 @@ Tuple::Tuple()
 Tuple::Tuple(const Tuple &t)
     : data{t.x, t.y, t.z, t.w}, x(data[0]), y(data[1]), z(data[2]), w(data[3]),
       red(data[0]), green(data[1]), blue(data[2]) {}
-Tuple::Tuple(double x, double y, double z, double w)
+Tuple::Tuple(Real x, Real y, Real z, Real w)
     : data{x, y, z, w}, x(data[0]), y(data[1]), z(data[2]), w(data[3]),
       red(data[0]), green(data[1]), blue(data[2]) {}
 
@@ -40,15 +40,15 @@ auto Tuple::operator-(const Tuple &t) const -> Tuple {
 
 auto Tuple::operator-() const -> Tuple { return {-x, -y, -z, -w}; }
 
-auto Tuple::operator*(const double &scalar) const -> Tuple {
+auto Tuple::operator*(const Real &scalar) const -> Tuple {
   return {x * scalar, y * scalar, z * scalar, w * scalar};
 }
 
-auto operator*(const double &scalar, const Tuple &t) -> Tuple {
+auto operator*(const Real &scalar, const Tuple &t) -> Tuple {
   return t * scalar;
 }
 
-auto Tuple::operator/(const double &scalar) const -> Tuple {
+auto Tuple::operator/(const Real &scalar) const -> Tuple {
   return {x / scalar, y / scalar, z / scalar, w / scalar};
 }
 
@@ -70,7 +70,7 @@ auto Tuple::operator=(const Tuple &t) -> Tuple & {
   return *this;
 }
 
-auto Tuple::magnitude() const -> double {
+auto Tuple::magnitude() const -> Real {
   return std::sqrt(x * x + y * y + z * z + w * w);
 }
 auto Tuple::norm() const -> Tuple { return *this / magnitude(); }
@@ -84,7 +84,7 @@ auto Tuple::normalize() -> Tuple & {
   return *this;
 }
 
-auto dot(const Tuple &a, const Tuple &b) -> double {
+auto dot(const Tuple &a, const Tuple &b) -> Real {
   return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
 }
 
@@ -93,22 +93,26 @@ auto cross(const Tuple &a, const Tuple &b) -> Tuple {
                 a.x * b.y - a.y * b.x);
 }
 
-auto point(double x, double y, double z) -> Tuple { return {x, y, z, 1.0}; }
+auto point(Real x, Real y, Real z) -> Tuple { return {x, y, z, 1.0}; }
 
-auto vector(double x, double y, double z) -> Tuple { return {x, y, z, 0.0}; }
+auto vector(Real x, Real y, Real z) -> Tuple { return {x, y, z, 0.0}; }
 
-auto color(double r, double g, double b) -> Tuple { return {r, g, b, 0.0}; }
+auto color(Real r, Real g, Real b) -> Tuple { return {r, g, b, 0.0}; }
 
 auto hadamard(const Tuple &a, const Tuple &b) -> Tuple {
   return {a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w};
 }
 
-auto Tuple::operator()(int i) -> double & {
+auto identical(const Tuple &a, const Tuple &b) -> bool {
+  return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+auto Tuple::operator()(int i) -> Real & {
   assert(i >= 0 && i < 4 && "out of bounds");
   return data.at(i);
 }
 
-auto Tuple::operator()(int i) const -> const double & {
+auto Tuple::operator()(int i) const -> const Real & {
   assert(i >= 0 && i < 4 && "out of bounds");
   return data.at(i);
 }
@@ -0,0 +1,265 @@
+#include "Wavefront.hpp"
+#include "Parallel.hpp"
+#include "PerfCounters.hpp"
+#include <algorithm>
+#include <optional>
+#include <typeindex>
+#include <utility>
+
+namespace RT {
+
+constexpr size_t SHADE_RUN_SIZE = 1024;
+
+Wavefront::Wavefront(const Camera &camera, size_t batchSize, unsigned threads)
+    : camera(camera), batchSize(std::max<size_t>(batchSize, 1)),
+      threads(threads) {}
+
+auto Wavefront::generate(size_t first, size_t count) const
+    -> std::vector<PathRay> {
+  const PerfScope scope(PerfRegion::RayGeneration);
+  std::vector<PathRay> paths(count);
+  auto rays = camera.rays();
+  parallelFor(
+      count,
+      [&](size_t i) {
+        auto index = static_cast<int>(first + i);
+        auto &path = paths[i];
+        path.ray = rays.ray(index % camera.hsize, index / camera.hsize);
+        path.weight = 1;
+        path.pixel = static_cast<int>(i);
+        path.remaining = World::MAX_RECURSION_DEPTH;
+      },
+      threads);
+  return paths;
+}
+
+auto Wavefront::intersect(const World &world,
+                          const std::vector<PathRay> &paths) const
+    -> std::vector<std::pair<size_t, Computations>> {
+  const PerfScope scope(PerfRegion::Intersection);
+  std::vector<std::optional<Computations>> found(paths.size());
+  parallelFor(
+      paths.size(),
+      [&](size_t i) {
+        auto xs = world.intersect(paths[i].ray);
+        auto h = hit(xs);
+        if (h.has_value()) {
+          found[i].emplace(h.value(), paths[i].ray, xs);
+        }
+      },
+      threads);
+  std::vector<std::pair<size_t, Computations>> hits;
+  for (size_t i = 0; i < found.size(); i++) {
+    if (found[i].has_value()) {
+      hits.emplace_back(i, std::move(found[i].value()));
+    }
+  }
+  return hits;
+}
+
+void Wavefront::sortHits(
+    std::vector<std::pair<size_t, Computations>> &hits) const {
+  const PerfScope scope(PerfRegion::Shading);
+  std::vector<size_t> order(hits.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  auto key = [&](size_t i) {
+    const auto *object = hits[i].second.object;
+    return std::make_pair(std::type_index(typeid(*object)), &object->material);
+  };
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return key(a) < key(b); });
+  std::vector<std::pair<size_t, Computations>> sorted;
+  sorted.reserve(hits.size());
+  for (auto i : order) {
+    sorted.push_back(std::move(hits[i]));
+  }
+  hits = std::move(sorted);
+}
+
+void Wavefront::shade(const World &world,
+                      const std::vector<std::pair<size_t, Computations>> &hits,
+                      const std::vector<PathRay> &paths,
+                      std::vector<ShadowRay> &shadowRays,
+                      std::vector<PathRay> &secondaryRays) const {
+  std::vector<size_t> runs;
+  for (size_t i = 0; i < hits.size(); i++) {
+    if (i == 0 || hits[i].second.object != hits[i - 1].second.object ||
+        hits[i].second.time != hits[i - 1].second.time ||
+        i - runs.back() == SHADE_RUN_SIZE) {
+      runs.push_back(i);
+    }
+  }
+  runs.push_back(hits.size());
+  std::vector<Color> surfaces(hits.size());
+  {
+    const PerfScope scope(PerfRegion::Patterns);
+    parallelFor(
+        runs.size() - 1,
+        [&](size_t run) {
+          auto first = runs[run];
+          auto count = runs[run + 1] - first;
+          std::vector<Real> soa(count * 6);
+          auto *x = soa.data();
+          auto *y = x + count;
+          auto *z = y + count;
+          auto *r = z + count;
+          auto *g = r + count;
+          auto *b = g + count;
+          for (size_t i = 0; i < count; i++) {
+            const auto &p = hits[first + i].second.overPoint;
+            x[i] = p.x;
+            y[i] = p.y;
+            z[i] = p.z;
+          }
+          world.surfaceColors(*hits[first].second.object, count, x, y, z, r, g,
+                              b, hits[first].second.time);
+          for (size_t i = 0; i < count; i++) {
+            surfaces[first + i] = color(r[i], g[i], b[i]);
+          }
+        },
+        threads, 1);
+  }
+
+  const PerfScope scope(PerfRegion::Shading);
+  auto sampled = world.samplesLights();
+  auto lightCount = world.lights.size();
+  // Sampled shading fills one slot with the ambient term (which no shadow
+  // ray can block) and the rest with weighted direct light.
+  auto slots = sampled ? world.maxLightSamples() + 1 : lightCount;
+  shadowRays.assign(hits.size() * slots, ShadowRay());
+  std::vector<std::optional<PathRay>> reflected(hits.size());
+  std::vector<std::optional<PathRay>> refracted(hits.size());
+  parallelFor(
+      hits.size(),
+      [&](size_t i) {
+        const auto &[pathIndex, comps] = hits[i];
+        const auto &path = paths[pathIndex];
+        const auto &material = comps.object->material;
+        if (sampled) {
+          auto *slot = &shadowRays[i * slots];
+          slot->lit = world.ambientLight(*comps.object, surfaces[i]);
+          slot->unlit = slot->lit;
+          slot->weight = path.weight;
+          slot->pixel = path.pixel;
+          for (const auto &sample :
+               world.lightSamples(comps.overPoint, comps.normal)) {
+            slot++;
+            auto lit =
+                comps.object->lighting(surfaces[i], *sample.light,
+                                       comps.overPoint, comps.eye,
+                                       comps.normal, false);
+            auto unlit =
+                comps.object->lighting(surfaces[i], *sample.light,
+                                       comps.overPoint, comps.eye,
+                                       comps.normal, true);
+            slot->point = comps.overPoint;
+            slot->time = comps.time;
+            slot->light = sample.light;
+            slot->weight = path.weight * sample.weight;
+            slot->lit = lit - unlit;
+            slot->unlit = color(0, 0, 0);
+            slot->pixel = path.pixel;
+          }
+        } else {
+          for (size_t l = 0; l < lightCount; l++) {
+            const auto &light = world.lights[l];
+            auto &shadow = shadowRays[i * slots + l];
+            shadow.point = comps.overPoint;
+            shadow.time = comps.time;
+            shadow.light = &light;
+            shadow.weight = path.weight;
+            shadow.lit =
+                comps.object->lighting(surfaces[i], light, comps.overPoint,
+                                       comps.eye, comps.normal, false);
+            shadow.unlit =
+                comps.object->lighting(surfaces[i], light, comps.overPoint,
+                                       comps.eye, comps.normal, true);
+            shadow.pixel = path.pixel;
+          }
+        }
+        if (path.remaining <= 0) {
+          return;
+        }
+        auto reflectWeight = material.reflective;
+        auto refractWeight = material.transparency;
+        if (material.reflective != 0 && material.transparency != 0) {
+          auto reflectance = comps.schlick();
+          reflectWeight *= reflectance;
+          refractWeight *= 1 - reflectance;
+        }
+        if (!approxEqual(material.reflective, 0.0)) {
+          reflected[i] =
+              PathRay{Ray(comps.overPoint, comps.reflect, comps.time),
+                      path.weight * reflectWeight, path.pixel,
+                      path.remaining - 1};
+        }
+        if (!approxEqual(material.transparency, 0.0)) {
+          auto ray = World::refractedRay(comps);
+          if (ray.has_value()) {
+            refracted[i] = PathRay{ray.value(), path.weight * refractWeight,
+                                   path.pixel, path.remaining - 1};
+          }
+        }
+      },
+      threads);
+  secondaryRays.clear();
+  for (size_t i = 0; i < hits.size(); i++) {
+    if (reflected[i].has_value()) {
+      secondaryRays.push_back(std::move(reflected[i].value()));
+    }
+    if (refracted[i].has_value()) {
+      secondaryRays.push_back(std::move(refracted[i].value()));
+    }
+  }
+}
+
+void Wavefront::traceShadows(const World &world,
+                             const std::vector<ShadowRay> &shadowRays,
+                             std::vector<Color> &pixels) const {
+  const PerfScope scope(PerfRegion::Shadows);
+  std::vector<char> occluded(shadowRays.size());
+  parallelFor(
+      shadowRays.size(),
+      [&](size_t i) {
+        occluded[i] = static_cast<char>(
+            shadowRays[i].light != nullptr &&
+            world.isShadowed(shadowRays[i].point, *shadowRays[i].light,
+                             shadowRays[i].time));
+      },
+      threads);
+  for (size_t i = 0; i < shadowRays.size(); i++) {
+    const auto &shadow = shadowRays[i];
+    auto &pixel = pixels[shadow.pixel];
+    pixel = pixel + (occluded[i] != 0 ? shadow.unlit : shadow.lit) *
+                        shadow.weight;
+  }
+}
+
+auto Wavefront::render(const World &world) const -> Canvas {
+  Canvas image(camera.hsize, camera.vsize);
+  auto total = static_cast<size_t>(camera.hsize) * camera.vsize;
+  std::vector<Color> pixels;
+  std::vector<ShadowRay> shadowRays;
+  std::vector<PathRay> secondaryRays;
+  for (size_t first = 0; first < total; first += batchSize) {
+    auto count = std::min(batchSize, total - first);
+    pixels.assign(count, color(0, 0, 0));
+    auto paths = generate(first, count);
+    while (!paths.empty()) {
+      auto hits = intersect(world, paths);
+      sortHits(hits);
+      shade(world, hits, paths, shadowRays, secondaryRays);
+      traceShadows(world, shadowRays, pixels);
+      std::swap(paths, secondaryRays);
+    }
+    for (size_t i = 0; i < count; i++) {
+      auto index = static_cast<int>(first + i);
+      image.writePixel(index % camera.hsize, index / camera.hsize, pixels[i]);
+    }
+  }
+  return image;
+}
+
+} // namespace RT
@@ -2,44 +2,342 @@
 #include "Matrix.hpp"
 #include "Shape.hpp"
 #include "Util.hpp"
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <utility>
 
 namespace RT {
 
-World::World(bool defaultWorld) {
+auto ShadowCacheStats::hitRate() const -> Real {
+  return lookups == 0 ? 0
+                      : static_cast<Real>(hits) / static_cast<Real>(lookups);
+}
+
+auto nextWorldId() -> uint64_t {
+  static std::atomic<uint64_t> next{1};
+  return next++;
+}
+
+constexpr size_t OCCLUDER_CACHE_WORLDS = 4;
+
+struct OccluderCache {
+  struct Slot {
+    uint64_t world = 0;
+    std::vector<std::optional<std::pair<ShapeType, size_t>>> occluders;
+  };
+  std::array<Slot, OCCLUDER_CACHE_WORLDS> slots;
+  size_t next = 0;
+  std::vector<Intersection> scratch;
+
+  auto forWorld(uint64_t world) -> Slot & {
+    for (auto &slot : slots) {
+      if (slot.world == world) {
+        return slot;
+      }
+    }
+    auto &slot = slots[next];
+    next = (next + 1) % slots.size();
+    slot.world = world;
+    slot.occluders.clear();
+    return slot;
+  }
+};
+
+thread_local OccluderCache occluderCache;
+
+World::World(bool defaultWorld) : worldId(nextWorldId()) {
 
   if (defaultWorld) {
-    objects.push_back(std::make_unique<Sphere>(Sphere()));
-    objects.push_back(std::make_unique<Sphere>(Sphere()));
+    auto s1 = Sphere();
+    s1.material.color = color(0.8, 1.0, 0.6);
+    s1.material.diffuse = 0.7;
+    s1.material.specular = 0.2;
+    add(std::make_unique<Sphere>(s1));
+    auto s2 = Sphere();
+    s2.transformation = scaling(0.5, 0.5, 0.5);
+    add(std::make_unique<Sphere>(s2));
     lights.emplace_back(point(-10, 10, -10), color(1, 1, 1));
-    objects[0]->material.color = color(0.8, 1.0, 0.6);
-    objects[0]->material.diffuse = 0.7;
-    objects[0]->material.specular = 0.2;
-    objects[1]->transformation = scaling(0.5, 0.5, 0.5);
   }
 }
 
+auto World::add(std::unique_ptr<Shape> object) -> ObjectId {
+  const auto &type = typeid(*object);
+  std::pair<ShapeType, size_t> slot;
+  if (type == typeid(Sphere)) {
+    slot = {ShapeType::Sphere, spheres.size()};
+    spheres.push(std::move(static_cast<Sphere &>(*object)));
+  } else if (type == typeid(Plane)) {
+    slot = {ShapeType::Plane, planes.size()};
+    planes.push(std::move(static_cast<Plane &>(*object)));
+  } else if (type == typeid(Cube)) {
+    slot = {ShapeType::Cube, cubes.size()};
+    cubes.push(std::move(static_cast<Cube &>(*object)));
+  } else if (type == typeid(Cylinder)) {
+    slot = {ShapeType::Cylinder, cylinders.size()};
+    cylinders.push(std::move(static_cast<Cylinder &>(*object)));
+  } else if (type == typeid(Cone)) {
+    slot = {ShapeType::Cone, cones.size()};
+    cones.push(std::move(static_cast<Cone &>(*object)));
+  } else {
+    slot = {ShapeType::Other, others.size()};
+    otherSlots.emplace(object.get(), slot.second);
+    others.push(std::move(object));
+  }
+  auto id = objects.size();
+  objects.emplace_back(slot);
+  exposed.push_back(false);
+  slotObjects[static_cast<size_t>(slot.first)].push_back(id);
+  auto box = bounds(id);
+  editLog.push_back({id, true, box, box});
+  return id;
+}
+
+// Remembered occluders name objects by slot, so the world takes a new
+// worldId and every thread's shadow cache for it starts over.
+void World::remove(ObjectId id) {
+  auto [type, slot] = slotOf(id);
+  auto before = bounds(id);
+  switch (type) {
+  case ShapeType::Sphere:
+    spheres.remove(slot);
+    break;
+  case ShapeType::Plane:
+    planes.remove(slot);
+    break;
+  case ShapeType::Cube:
+    cubes.remove(slot);
+    break;
+  case ShapeType::Cylinder:
+    cylinders.remove(slot);
+    break;
+  case ShapeType::Cone:
+    cones.remove(slot);
+    break;
+  case ShapeType::Other:
+    otherSlots.erase(others.shapes[slot].get());
+    others.remove(slot);
+    if (slot < others.size()) {
+      otherSlots[others.shapes[slot].get()] = slot;
+    }
+    break;
+  }
+  auto &owners = slotObjects[static_cast<size_t>(type)];
+  owners[slot] = owners.back();
+  owners.pop_back();
+  if (slot < owners.size()) {
+    objects[owners[slot]]->second = slot;
+  }
+  objects[id].reset();
+  worldId = nextWorldId();
+  editLog.push_back({id, true, before, BoundingBox()});
+}
+
+auto World::contains(ObjectId id) const -> bool {
+  return id < objects.size() && objects[id].has_value();
+}
+
 auto World::contains(const Shape &object) const -> bool {
-  return std::find_if(objects.begin(), objects.end(), [&](const auto &obj) {
-           return obj.get()->transformation == object.transformation &&
-                  obj.get()->material == object.material;
-         }) != objects.end();
+  return locate(&object).has_value();
 }
 
-void World::add(std::unique_ptr<Shape> object) {
-  objects.push_back(std::move(object));
+auto World::slotOf(ObjectId id) const -> std::pair<ShapeType, size_t> {
+  if (!contains(id)) {
+    throw std::out_of_range("no object with id " + std::to_string(id));
+  }
+  return objects[id].value();
 }
 
 auto World::count() const -> size_t { return objects.size(); }
 
+auto World::object(ObjectId id) const -> const Shape & {
+  auto [type, slot] = slotOf(id);
+  switch (type) {
+  case ShapeType::Sphere:
+    return spheres.shapes[slot];
+  case ShapeType::Plane:
+    return planes.shapes[slot];
+  case ShapeType::Cube:
+    return cubes.shapes[slot];
+  case ShapeType::Cylinder:
+    return cylinders.shapes[slot];
+  case ShapeType::Cone:
+    return cones.shapes[slot];
+  case ShapeType::Other:
+    break;
+  }
+  return *others.shapes[slot];
+}
+
+auto World::object(ObjectId id) -> Shape & {
+  auto &shape = storedObject(id);
+  exposed[id] = true;
+  return shape;
+}
+
+auto World::storedObject(ObjectId id) -> Shape & {
+  return const_cast<Shape &>(std::as_const(*this).object(id));
+}
+
+void World::setTransform(ObjectId id, const Transformation &transform) {
+  auto before = bounds(id);
+  storedObject(id).transformation = transform;
+  refit(id);
+  editLog.push_back({id, true, before, bounds(id)});
+}
+
+void World::setMaterial(ObjectId id, const Material &material) {
+  auto &stored = storedObject(id).material;
+  stored = material;
+  // Material's assignment only copies a pattern that is there.
+  if (!material.pattern) {
+    stored.pattern.reset();
+  }
+  refit(id);
+  editLog.push_back({id, false, BoundingBox(), BoundingBox()});
+}
+
+auto World::bounds(ObjectId id) const -> BoundingBox {
+  auto [type, slot] = slotOf(id);
+  switch (type) {
+  case ShapeType::Sphere:
+    return spheres.bounds.at(slot);
+  case ShapeType::Plane:
+    return planes.bounds.at(slot);
+  case ShapeType::Cube:
+    return cubes.bounds.at(slot);
+  case ShapeType::Cylinder:
+    return cylinders.bounds.at(slot);
+  case ShapeType::Cone:
+    return cones.bounds.at(slot);
+  case ShapeType::Other:
+    break;
+  }
+  return others.bounds.at(slot);
+}
+
+auto World::edits() const -> const std::vector<SceneEdit> & {
+  return editLog;
+}
+
+auto World::editCount() const -> size_t {
+  return clearedEdits + editLog.size();
+}
+
+void World::clearEdits() {
+  clearedEdits += editLog.size();
+  editLog.clear();
+  editLog.shrink_to_fit();
+}
+
+void World::refit(ObjectId id) {
+  auto [type, slot] = slotOf(id);
+  switch (type) {
+  case ShapeType::Sphere:
+    spheres.refit(slot);
+    break;
+  case ShapeType::Plane:
+    planes.refit(slot);
+    break;
+  case ShapeType::Cube:
+    cubes.refit(slot);
+    break;
+  case ShapeType::Cylinder:
+    cylinders.refit(slot);
+    break;
+  case ShapeType::Cone:
+    cones.refit(slot);
+    break;
+  case ShapeType::Other:
+    others.refit(slot);
+    break;
+  }
+}
+
+auto World::compiledPattern(const Shape &object) const
+    -> const CompiledPattern * {
+  if (object.parent != nullptr) {
+    return nullptr;
+  }
+  auto found = locate(&object);
+  if (!found.has_value()) {
+    return nullptr;
+  }
+  const std::optional<CompiledPattern> *compiled = nullptr;
+  auto [type, slot] = found.value();
+  switch (type) {
+  case ShapeType::Sphere:
+    compiled = &spheres.patterns[slot];
+    break;
+  case ShapeType::Plane:
+    compiled = &planes.patterns[slot];
+    break;
+  case ShapeType::Cube:
+    compiled = &cubes.patterns[slot];
+    break;
+  case ShapeType::Cylinder:
+    compiled = &cylinders.patterns[slot];
+    break;
+  case ShapeType::Cone:
+    compiled = &cones.patterns[slot];
+    break;
+  case ShapeType::Other:
+    compiled = &others.patterns[slot];
+    break;
+  }
+  // Objects are only edited behind the world's back once exposed.
+  if (!compiled->has_value() ||
+      (exposed[slotObjects[static_cast<size_t>(type)][slot]] &&
+       !compiled->value().isCurrent(object.material.pattern.get(),
+                                    object.transformation))) {
+    return nullptr;
+  }
+  return &compiled->value();
+}
+
+auto World::surfaceColor(const Shape &object, const Point &point,
+                         Real time) const -> Color {
+  if (!object.material.pattern) {
+    return object.material.color;
+  }
+  const auto *compiled = object.motion ? nullptr : compiledPattern(object);
+  if (compiled == nullptr) {
+    return object.patternAt(point, time);
+  }
+  return compiled->colorAt(point);
+}
+
+void World::surfaceColors(const Shape &object, size_t count, const Real *x,
+                          const Real *y, const Real *z, Real *r, Real *g,
+                          Real *b, Real time) const {
+  const auto *compiled = object.material.pattern && !object.motion
+                             ? compiledPattern(object)
+                             : nullptr;
+  if (compiled != nullptr) {
+    compiled->colorsAt(count, x, y, z, r, g, b);
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    auto c = surfaceColor(object, point(x[i], y[i], z[i]), time);
+    r[i] = c.red;
+    g[i] = c.green;
+    b[i] = c.blue;
+  }
+}
+
 auto World::intersect(const Ray &ray) const -> std::vector<Intersection> {
   std::vector<Intersection> result;
-  for (const std::unique_ptr<Shape> &object : objects) {
-    auto xs = object->intersect(ray);
-    for (auto &x : xs) {
-      result.push_back(x);
-    }
-  }
+  spheres.intersect(ray, result);
+  planes.intersect(ray, result);
+  cubes.intersect(ray, result);
+  cylinders.intersect(ray, result);
+  cones.intersect(ray, result);
+  others.intersect(ray, result);
 
   std::sort(result.begin(), result.end(),
             [](const Intersection &a, const Intersection &b) {
@@ -54,7 +352,7 @@ auto World::reflectedColor(const Computations &comps, int remaining) const
   if (approxEqual(comps.object->material.reflective, 0.0) || remaining <= 0) {
     return color(0, 0, 0);
   }
-  auto reflectRay = Ray(comps.overPoint, comps.reflect);
+  auto reflectRay = Ray(comps.overPoint, comps.reflect, comps.time);
   auto color = colorAt(reflectRay, remaining - 1);
   return color * comps.object->material.reflective;
 }
@@ -64,27 +362,55 @@ auto World::refractedColor(const Computations &comps, int remaining) const
   if (approxEqual(comps.object->material.transparency, 0.0) || remaining <= 0) {
     return color(0, 0, 0);
   }
+  auto refractRay = refractedRay(comps);
+  if (!refractRay) {
+    return color(0, 0, 0);
+  }
+  return colorAt(*refractRay, remaining - 1) *
+         comps.object->material.transparency;
+}
+
+auto World::refractedRay(const Computations &comps) -> std::optional<Ray> {
   auto nRatio = comps.n1 / comps.n2;
   auto cosI = dot(comps.eye, comps.normal);
   auto sin2T = nRatio * nRatio * (1 - cosI * cosI);
   if (sin2T > 1) {
-    return color(0, 0, 0);
+    return std::nullopt;
   }
-  auto cosT = std::sqrt(1.0 - sin2T);
+  auto cosT = std::sqrt(1 - sin2T);
   auto direction = comps.normal * (nRatio * cosI - cosT) - comps.eye * nRatio;
-  auto refractRay = Ray(comps.underPoint, direction);
-  return colorAt(refractRay, remaining - 1) *
-         comps.object->material.transparency;
+  return Ray(comps.underPoint, direction, comps.time);
 }
 
 auto World::shadeHit(const Computations &comps, int remaining) const -> Color {
+  return shadeHit(comps,
+                  surfaceColor(*comps.object, comps.overPoint, comps.time),
+                  remaining);
+}
 
+auto World::shadeHit(const Computations &comps, const Color &base,
+                     int remaining) const -> Color {
   RT::Color surface = RT::color(0, 0, 0);
-  for (const auto &light : lights) {
-    bool isShadowed = this->isShadowed(comps.overPoint, light);
-    surface =
-        surface + comps.object->lighting(light, comps.overPoint, comps.eye,
-                                         comps.normal, isShadowed);
+  if (samplesLights()) {
+    surface = ambientLight(*comps.object, base);
+    for (const auto &sample : lightSamples(comps.overPoint, comps.normal)) {
+      if (isShadowed(comps.overPoint, *sample.light, comps.time)) {
+        continue;
+      }
+      auto lit = comps.object->lighting(base, *sample.light, comps.overPoint,
+                                        comps.eye, comps.normal, false);
+      auto unlit = comps.object->lighting(base, *sample.light,
+                                          comps.overPoint, comps.eye,
+                                          comps.normal, true);
+      surface = surface + (lit - unlit) * sample.weight;
+    }
+  } else {
+    for (const auto &light : lights) {
+      bool isShadowed = this->isShadowed(comps.overPoint, light, comps.time);
+      surface = surface + comps.object->lighting(base, light, comps.overPoint,
+                                                 comps.eye, comps.normal,
+                                                 isShadowed);
+    }
   }
   auto reflected = reflectedColor(comps, remaining);
   auto refracted = refractedColor(comps, remaining);
@@ -99,21 +425,238 @@ auto World::shadeHit(const Computations &comps, int remaining) const -> Color {
 }
 
 auto World::colorAt(const Ray &ray, int remaining) const -> Color {
+  std::optional<Intersection> primary;
+  return colorAt(ray, primary, remaining);
+}
+
+auto World::colorAt(const Ray &ray, std::optional<Intersection> &primary,
+                    int remaining) const -> Color {
+  return trace(ray, primary, nullptr, remaining);
+}
+
+auto World::colorAt(const Ray &ray, std::optional<Intersection> &primary,
+                    std::optional<SurfaceSample> &surface,
+                    int remaining) const -> Color {
+  return trace(ray, primary, &surface, remaining);
+}
+
+auto World::trace(const Ray &ray, std::optional<Intersection> &primary,
+                  std::optional<SurfaceSample> *surface, int remaining) const
+    -> Color {
   auto xs = intersect(ray);
-  auto i = hit(xs);
-  if (i.has_value()) {
-    auto comps = Computations(i.value(), ray, xs);
-    return shadeHit(comps, remaining);
+  primary = hit(xs);
+  if (traceRecorder != nullptr) {
+    record(ray, xs, primary);
+  }
+  if (surface != nullptr) {
+    surface->reset();
+  }
+  if (primary.has_value()) {
+    auto comps = Computations(primary.value(), ray, xs);
+    auto base = surfaceColor(*comps.object, comps.overPoint, comps.time);
+    if (surface != nullptr) {
+      auto [type, slot] = locate(comps.object).value();
+      surface->emplace(SurfaceSample{
+          comps.t * ray.direction.magnitude(), comps.normal,
+          slotObjects[static_cast<size_t>(type)][slot], base});
+    }
+    return shadeHit(comps, base, remaining);
   }
   return color(0, 0, 0);
 }
-auto World::isShadowed(const Point &point, const Light &l) const -> bool {
+void World::sampleLights(size_t shadowRays, Real threshold) {
+  lightTree.emplace(lights);
+  lightSampleCount = shadowRays;
+  lightThreshold = threshold;
+}
+
+auto World::samplesLights() const -> bool {
+  return lightTree.has_value() && lightSampleCount > 0 &&
+         lightTree->lightCount() == lights.size();
+}
+
+auto World::maxLightSamples() const -> size_t { return lightSampleCount; }
+
+auto World::lightSamples(const Point &point, const Vector &normal) const
+    -> std::vector<LightSample> {
+  std::vector<LightSample> samples;
+  std::vector<size_t> candidates;
+  if (lightTree->collect(point, normal, lightThreshold, lightSampleCount,
+                         candidates)) {
+    std::sort(candidates.begin(), candidates.end());
+    for (auto light : candidates) {
+      samples.push_back(LightSample{&lights[light], 1});
+    }
+    return samples;
+  }
+  auto budget = static_cast<Real>(lightSampleCount);
+  for (size_t k = 0; k < lightSampleCount; k++) {
+    auto chosen = lightTree->sample(point, normal, lightThreshold,
+                                    shadingUniform(point, k));
+    if (chosen.has_value()) {
+      auto [light, pdf] = chosen.value();
+      samples.push_back(LightSample{&lights[light], 1 / (pdf * budget)});
+    }
+  }
+  return samples;
+}
+
+auto World::ambientLight(const Shape &object, const Color &surface) const
+    -> Color {
+  return hadamard(surface, lightTree->totalIntensity) *
+         object.material.ambient;
+}
+
+auto World::isShadowed(const Point &point, const Light &l, Real time) const
+    -> bool {
   auto v = l.position - point;
   auto distance = v.magnitude();
   auto direction = v.norm();
-  auto r = Ray(point, direction);
-  auto xs = intersect(r);
-  auto h = hit(xs);
-  return h.has_value() && h.value().first < distance;
+  auto r = Ray(point, direction, time);
+  if (traceRecorder != nullptr) {
+    traceRecorder->line(r, 0, distance);
+  }
+  std::less<const Light *> before;
+  auto cacheable = !lights.empty() && !before(&l, lights.data()) &&
+                   before(&l, lights.data() + lights.size());
+  auto &cache = occluderCache;
+  if (!cacheable) {
+    return firstOccluder(r, distance, cache.scratch).has_value();
+  }
+  auto &slot = cache.forWorld(worldId);
+  if (slot.occluders.size() < lights.size()) {
+    slot.occluders.resize(lights.size());
+  }
+  auto &occluder = slot.occluders[static_cast<size_t>(&l - lights.data())];
+  if (countingShadowCache) {
+    shadowLookups.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (occluder.has_value() &&
+      occludes(occluder.value(), r, distance, cache.scratch)) {
+    if (countingShadowCache) {
+      shadowHits.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+  }
+  auto found = firstOccluder(r, distance, cache.scratch);
+  if (found.has_value()) {
+    occluder = found;
+  }
+  return found.has_value();
+}
+
+// A pixel depends on the geometry along the whole line of each ray up to
+// its hit, since intersections behind the origin still decide refractive
+// indices, and on the materials of the objects met up to the hit.
+void World::record(const Ray &ray, const std::vector<Intersection> &xs,
+                   const std::optional<Intersection> &hit) const {
+  auto end = hit.has_value() ? hit->first
+                             : std::numeric_limits<Real>::infinity();
+  traceRecorder->line(ray, -std::numeric_limits<Real>::infinity(), end);
+  if (!hit.has_value()) {
+    return;
+  }
+  for (const auto &x : xs) {
+    if (x.first > end) {
+      break;
+    }
+    auto found = locate(x.second);
+    if (found.has_value()) {
+      auto [type, slot] = found.value();
+      traceRecorder->touched(slotObjects[static_cast<size_t>(type)][slot]);
+    }
+  }
+}
+
+// Each typed array holds exactly its type, so only one array is searched.
+auto World::locate(const Shape *object) const
+    -> std::optional<std::pair<ShapeType, size_t>> {
+  while (object->parent != nullptr) {
+    object = object->parent;
+  }
+  std::optional<std::pair<ShapeType, size_t>> found;
+  auto find = [&](ShapeType type, const auto &array) {
+    auto index = array.indexOf(object);
+    if (index.has_value()) {
+      found.emplace(type, index.value());
+    }
+  };
+  const auto &type = typeid(*object);
+  if (type == typeid(Sphere)) {
+    find(ShapeType::Sphere, spheres);
+  } else if (type == typeid(Plane)) {
+    find(ShapeType::Plane, planes);
+  } else if (type == typeid(Cube)) {
+    find(ShapeType::Cube, cubes);
+  } else if (type == typeid(Cylinder)) {
+    find(ShapeType::Cylinder, cylinders);
+  } else if (type == typeid(Cone)) {
+    find(ShapeType::Cone, cones);
+  } else {
+    auto slot = otherSlots.find(object);
+    if (slot != otherSlots.end()) {
+      found.emplace(ShapeType::Other, slot->second);
+    }
+  }
+  return found;
+}
+
+auto World::occludes(std::pair<ShapeType, size_t> object, const Ray &ray,
+                     Real distance, std::vector<Intersection> &xs) const
+    -> bool {
+  auto test = [&](const auto &array) {
+    return object.second < array.size() &&
+           array.occludesOne(object.second, ray, distance, xs);
+  };
+  switch (object.first) {
+  case ShapeType::Sphere:
+    return test(spheres);
+  case ShapeType::Plane:
+    return test(planes);
+  case ShapeType::Cube:
+    return test(cubes);
+  case ShapeType::Cylinder:
+    return test(cylinders);
+  case ShapeType::Cone:
+    return test(cones);
+  case ShapeType::Other:
+    break;
+  }
+  return test(others);
+}
+
+// Any shape blocking the segment will do for a shadow, so the query stops
+// at the first one instead of sorting every hit along the ray.
+auto World::firstOccluder(const Ray &ray, Real distance,
+                          std::vector<Intersection> &xs) const
+    -> std::optional<std::pair<ShapeType, size_t>> {
+  std::optional<std::pair<ShapeType, size_t>> found;
+  auto find = [&](ShapeType type, const auto &array) {
+    if (!found.has_value()) {
+      auto index = array.occluder(ray, distance, xs);
+      if (index.has_value()) {
+        found.emplace(type, index.value());
+      }
+    }
+  };
+  find(ShapeType::Sphere, spheres);
+  find(ShapeType::Plane, planes);
+  find(ShapeType::Cube, cubes);
+  find(ShapeType::Cylinder, cylinders);
+  find(ShapeType::Cone, cones);
+  find(ShapeType::Other, others);
+  return found;
+}
+
+void World::countShadowCache(bool enabled) { countingShadowCache = enabled; }
+
+auto World::shadowCacheStats() const -> ShadowCacheStats {
+  return {shadowLookups.load(std::memory_order_relaxed),
+          shadowHits.load(std::memory_order_relaxed)};
+}
+
+void World::resetShadowCacheStats() {
+  shadowLookups.store(0, std::memory_order_relaxed);
+  shadowHits.store(0, std::memory_order_relaxed);
 }
 } // namespace RT
\ No newline at end of file
@@ -0,0 +1,183 @@
+#include "Pattern.hpp"
+#include "PerfCounters.hpp"
+#include "SDF.hpp"
+#include "Wavefront.hpp"
+#include <RT.hpp>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Scene {
+  std::string name;
+  std::function<void(RT::World &)> build;
+};
+
+void addFloor(RT::World &world, std::unique_ptr<RT::Pattern> pattern) {
+  auto floor = std::make_unique<RT::Plane>();
+  floor->material.pattern = std::move(pattern);
+  floor->material.specular = 0;
+  world.add(std::move(floor));
+}
+
+void addSphereGrid(RT::World &world,
+                   const std::function<std::unique_ptr<RT::Shape>()> &make) {
+  world.lights.emplace_back(RT::point(-10, 12, -10), RT::color(1, 1, 1));
+  addFloor(world, std::make_unique<RT::CheckersPattern>(
+                      RT::color(0.9, 0.9, 0.9), RT::color(0.2, 0.2, 0.2)));
+  const int side = 12;
+  for (auto i = 0; i < side; i++) {
+    for (auto j = 0; j < side; j++) {
+      auto s = make();
+      s->transformation = RT::translation(i - side / 2.0, 0.35, j) *
+                          RT::scaling(0.35, 0.35, 0.35);
+      s->material.color = RT::color(0.2 + 0.05 * i, 0.3, 0.2 + 0.05 * j);
+      world.add(std::move(s));
+    }
+  }
+}
+
+// Many small spheres: dominated by intersection and shadow rays.
+void buildSpheres(RT::World &world) {
+  addSphereGrid(world, [] { return std::make_unique<RT::Sphere>(); });
+}
+
+// The same spheres sphere traced, to price tracing against the quadric.
+void buildSDFSpheres(RT::World &world) {
+  auto sphere = std::make_shared<RT::SDFSphere>();
+  addSphereGrid(world,
+                [&] { return std::make_unique<RT::SDFShape>(sphere); });
+}
+
+// Shapes only a distance function expresses compactly.
+void buildSDFBlend(RT::World &world) {
+  world.lights.emplace_back(RT::point(-10, 10, -10), RT::color(1, 1, 1));
+  addFloor(world, std::make_unique<RT::CheckersPattern>(
+                      RT::color(0.9, 0.9, 0.9), RT::color(0.2, 0.2, 0.2)));
+  auto torus = std::make_unique<RT::SDFShape>(
+      std::make_shared<RT::SDFTorus>(1, 0.3));
+  torus->transformation =
+      RT::translation(-2.5, 1, 2) * RT::rotationX(M_PI / 4);
+  world.add(std::move(torus));
+  auto blend = std::make_unique<RT::SDFShape>(
+      std::make_shared<RT::SDFSmoothUnion>(
+          std::make_shared<RT::SDFBox>(RT::vector(0.7, 0.7, 0.7), 0.15),
+          std::make_shared<RT::SDFTransform>(
+              std::make_shared<RT::SDFSphere>(0.6), RT::vector(0, 0.9, 0)),
+          0.4));
+  blend->transformation = RT::translation(0, 0.7, 2);
+  world.add(std::move(blend));
+  auto bulb = std::make_unique<RT::SDFShape>(
+      std::make_shared<RT::SDFMandelbulb>(8, 8, 1.5));
+  bulb->transformation = RT::translation(2.5, 1.2, 2);
+  bulb->material.color = RT::color(0.9, 0.6, 0.3);
+  world.add(std::move(bulb));
+}
+
+// Procedural textures on every surface: dominated by pattern evaluation.
+void buildPatterns(RT::World &world) {
+  world.lights.emplace_back(RT::point(-10, 10, -10), RT::color(1, 1, 1));
+  addFloor(world, std::make_unique<RT::FbmPattern>(RT::color(0.8, 0.7, 0.5),
+                                                   RT::color(0.3, 0.2, 0.1)));
+  for (auto i = 0; i < 3; i++) {
+    auto s = std::make_unique<RT::Sphere>();
+    s->transformation = RT::translation(i * 2.5 - 2.5, 1, 2);
+    auto turbulence = std::make_unique<RT::TurbulencePattern>(
+        RT::color(0.1, 0.3, 0.8), RT::color(0.9, 0.9, 1));
+    turbulence->transformation = RT::scaling(0.3, 0.3, 0.3);
+    s->material.pattern = std::move(turbulence);
+    world.add(std::move(s));
+  }
+}
+
+// Reflection and refraction: dominated by secondary rays.
+void buildGlass(RT::World &world) {
+  world.lights.emplace_back(RT::point(-10, 10, -10), RT::color(1, 1, 1));
+  auto floor = std::make_unique<RT::Plane>();
+  floor->material.reflective = 0.4;
+  world.add(std::move(floor));
+  for (auto i = 0; i < 4; i++) {
+    auto s = std::make_unique<RT::Sphere>(
+        RT::glassSphere(RT::translation(i * 2.0 - 3, 1, i % 2 == 0 ? 1 : 3)));
+    s->material.reflective = 0.9;
+    world.add(std::move(s));
+  }
+  auto cube = std::make_unique<RT::Cube>();
+  cube->transformation = RT::translation(0, 1, 6);
+  cube->material.color = RT::color(0.8, 0.2, 0.2);
+  world.add(std::move(cube));
+}
+
+auto main(int argc, char **argv) -> int {
+  int hsize = 320;
+  int vsize = 240;
+  int repeat = 3;
+  bool perf = false;
+  std::string only;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--size" && i + 2 < argc) {
+      hsize = std::stoi(argv[++i]);
+      vsize = std::stoi(argv[++i]);
+    } else if (arg == "--repeat" && i + 1 < argc) {
+      repeat = std::max(1, std::stoi(argv[++i]));
+    } else if (arg == "--scene" && i + 1 < argc) {
+      only = argv[++i];
+    } else if (arg == "--perf") {
+      perf = true;
+    } else {
+      std::cerr << "usage: " << argv[0]
+                << " [--size width height] [--repeat n] [--scene name]"
+                   " [--perf]\n";
+      return 1;
+    }
+  }
+
+  const std::vector<Scene> scenes{{"spheres", buildSpheres},
+                                  {"sdf-spheres", buildSDFSpheres},
+                                  {"sdf-blend", buildSDFBlend},
+                                  {"patterns", buildPatterns},
+                                  {"glass", buildGlass}};
+  auto camera = RT::Camera(hsize, vsize, M_PI / 3);
+  camera.transform = RT::viewTransform(
+      RT::point(0, 3, -8), RT::point(0, 0.5, 3), RT::vector(0, 1, 0));
+
+  std::cout << std::left << std::setw(12) << "scene" << std::right
+            << std::setw(12) << "best ms" << std::setw(14) << "Mpixels/s"
+            << "\n";
+  for (const auto &scene : scenes) {
+    if (!only.empty() && scene.name != only) {
+      continue;
+    }
+    RT::World world(false);
+    scene.build(world);
+    if (perf) {
+      RT::PerfCounters::reset();
+      RT::PerfCounters::enable();
+    }
+    auto best = std::numeric_limits<double>::infinity();
+    for (auto r = 0; r < repeat; r++) {
+      auto start = std::chrono::steady_clock::now();
+      auto image = RT::Wavefront(camera).render(world);
+      auto encoded = image.PPM();
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      best = std::min(best, elapsed.count());
+    }
+    RT::PerfCounters::disable();
+    std::cout << std::left << std::setw(12) << scene.name << std::right
+              << std::setw(12) << std::fixed << std::setprecision(2) << best
+              << std::setw(14)
+              << static_cast<double>(hsize) * vsize / (best * 1000) << "\n";
+    if (perf) {
+      RT::PerfCounters::report(std::cout);
+      std::cout << "\n";
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,52 @@
+#include "Canvas.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+auto main(int argc, char **argv) -> int {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0]
+              << " reference.ppm image.ppm [max-mean-difference]\n";
+    return 1;
+  }
+  auto reference = RT::Canvas::loadPPM(argv[1]);
+  auto image = RT::Canvas::loadPPM(argv[2]);
+  if (reference.width != image.width || reference.height != image.height) {
+    std::cerr << "image sizes differ\n";
+    return 1;
+  }
+  const double maxColorValue = 255;
+  double sum = 0;
+  double sumSquares = 0;
+  double maximum = 0;
+  int differing = 0;
+  for (auto y = 0; y < image.height; y++) {
+    for (auto x = 0; x < image.width; x++) {
+      auto a = reference.pixelAt(x, y);
+      auto b = image.pixelAt(x, y);
+      double pixelMaximum = 0;
+      for (auto c = 0; c < 3; c++) {
+        auto d = std::abs(static_cast<double>(a(c) - b(c))) * maxColorValue;
+        sum += d;
+        sumSquares += d * d;
+        pixelMaximum = std::max(pixelMaximum, d);
+      }
+      maximum = std::max(maximum, pixelMaximum);
+      if (pixelMaximum > 0) {
+        differing++;
+      }
+    }
+  }
+  auto samples = 3.0 * image.width * image.height;
+  auto mean = sum / samples;
+  std::cout << "pixels:          " << image.width * image.height << "\n"
+            << "differing:       " << differing << "\n"
+            << "mean difference: " << mean << "\n"
+            << "rms difference:  " << std::sqrt(sumSquares / samples) << "\n"
+            << "max difference:  " << maximum << "\n";
+  if (argc > 3 && mean > std::stod(argv[3])) {
+    return 1;
+  }
+  return 0;
+}
@@ -1,18 +1,31 @@
+#include "Animation.hpp"
+#include "Checkpoint.hpp"
+#include "Farm.hpp"
 #include "Matrix.hpp"
 #include "Pattern.hpp"
+#include "Progressive.hpp"
 #include "Tuple.hpp"
+#include "Wavefront.hpp"
 #include <RT.hpp>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
 #include <iostream>
 #include <memory>
-#include <random>
-
-auto main() -> int {
-
-  auto camera = RT::Camera(2000, 2000, 0.785398);
-  camera.transform = RT::viewTransform(
-      RT::point(-6, 6, -10), RT::point(6, 0, 6), RT::vector(-0.45, 1, 0));
-
-  auto world = RT::World(false);
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// Returns the glass sphere, which animateScene moves.
+auto buildScene(RT::World &world) -> RT::ObjectId {
   world.lights.emplace_back(RT::point(50, 100, -50), RT::color(1, 1, 1));
   world.lights.emplace_back(RT::point(-400, 50, -10), RT::color(0.2, 0.2, 0.2));
 
@@ -60,7 +73,7 @@ auto main() -> int {
   sphere1->material.transparency = 0.7;
   sphere1->material.refractiveIndex = 1.5;
   sphere1->transformation = largeObject;
-  world.add(std::move(sphere1));
+  auto glass = world.add(std::move(sphere1));
 
   auto cube1 = std::make_unique<RT::Cube>();
   cube1->material = whiteMaterial;
@@ -146,9 +159,375 @@ auto main() -> int {
   cube17->material = whiteMaterial;
   cube17->transformation = largeObject >>= RT::translation(-0.5, -8.5, 8);
   world.add(std::move(cube17));
+  return glass;
+}
 
-  auto canvas = camera.render(world);
-  canvas.savePPM("sample.ppm");
+// Turntable: the camera circles the scene while the glass sphere bobs.
+void animateScene(RT::Sequence &sequence, RT::ObjectId glass) {
+  const int orbitKeys = 16;
+  const auto center = RT::point(6, 0, 6);
+  for (auto i = 0; i <= orbitKeys; i++) {
+    auto angle = 2 * M_PI * i / orbitKeys;
+    auto from = center + RT::vector(-12 * std::cos(angle + 0.15), 6,
+                                    -12 * std::sin(angle + 0.15) - 4);
+    sequence.view.key(static_cast<RT::Real>(i) / orbitKeys,
+                      {from, center, RT::vector(0, 1, 0)});
+  }
+  RT::Track<RT::Pose> bob;
+  const RT::Real size = 1.75;
+  for (auto i = 0; i <= 4; i++) {
+    bob.key(static_cast<RT::Real>(i) / 4,
+            RT::Pose{RT::vector(3.5, i % 2 == 0 ? -3.5 : -1.5, 3.5),
+                     RT::vector(0, 0, 0), RT::vector(size, size, size)});
+  }
+  sequence.animate(glass, bob);
+}
+
+auto frameName(const std::string &output, int frame) -> std::string {
+  auto dot = output.rfind('.');
+  auto stem = dot == std::string::npos ? output : output.substr(0, dot);
+  auto extension = dot == std::string::npos ? "" : output.substr(dot);
+  std::array<char, 8> number{};
+  std::snprintf(number.data(), number.size(), "%04d", frame);
+  return stem + "_" + number.data() + extension;
+}
+
+// Identifies the image a checkpoint belongs to; the scene is built in.
+// Records are whole tiles, so the tile size is part of it too.
+auto renderKey(int hsize, int vsize, int tileSize, RT::Real aperture,
+               RT::Real focalDistance, RT::SampleSequence sampling)
+    -> uint64_t {
+  return std::hash<std::string>{}(
+      std::to_string(hsize) + " " + std::to_string(vsize) + " " +
+      std::to_string(tileSize) + " " + std::to_string(aperture) + " " +
+      std::to_string(focalDistance) + " " +
+      std::to_string(static_cast<int>(sampling)));
+}
+
+auto renderWithProgress(const RT::Camera &camera, const RT::World &world,
+                        RT::RenderOptions options) -> RT::Canvas {
+  auto render = camera.renderAsync(world, std::move(options));
+  const bool showProgress = isatty(STDERR_FILENO) != 0;
+  while (!render.finished()) {
+    if (showProgress) {
+      std::cerr << "\rRendering: " << static_cast<int>(render.progress() * 100)
+                << "%" << std::flush;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+  if (showProgress) {
+    std::cerr << "\rRendering: 100%\n";
+  }
+  return render.wait();
+}
+
+auto main(int argc, char **argv) -> int {
+  std::string output = "sample.ppm";
+  int hsize = 2000;
+  int vsize = 2000;
+  bool wavefront = false;
+  bool stats = false;
+  std::string worker;
+  std::string coordinator;
+  int farm = 0;
+  int tileSize = RT::DEFAULT_TILE_SIZE;
+  int frames = 0;
+  RT::Real aperture = 0;
+  RT::Real focalDistance = 1;
+  std::vector<RT::Tile> regions;
+  bool crop = false;
+  int budget = 0;
+  std::string checkpointFile;
+  bool resume = false;
+  std::string aovPrefix;
+  auto sampling = RT::SampleSequence::Sobol;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--output" && i + 1 < argc) {
+      output = argv[++i];
+    } else if (arg == "--size" && i + 2 < argc) {
+      hsize = std::stoi(argv[++i]);
+      vsize = std::stoi(argv[++i]);
+    } else if (arg == "--wavefront") {
+      wavefront = true;
+    } else if (arg == "--stats") {
+      stats = true;
+    } else if (arg == "--worker" && i + 1 < argc) {
+      worker = argv[++i];
+    } else if (arg == "--coordinator" && i + 1 < argc) {
+      coordinator = argv[++i];
+    } else if (arg == "--farm" && i + 1 < argc) {
+      farm = std::stoi(argv[++i]);
+    } else if (arg == "--tile-size" && i + 1 < argc) {
+      tileSize = std::stoi(argv[++i]);
+    } else if (arg == "--frames" && i + 1 < argc) {
+      frames = std::stoi(argv[++i]);
+    } else if (arg == "--aperture" && i + 1 < argc) {
+      aperture = std::stod(argv[++i]);
+    } else if (arg == "--focus" && i + 1 < argc) {
+      focalDistance = std::stod(argv[++i]);
+    } else if (arg == "--region" && i + 4 < argc) {
+      RT::Tile region{};
+      region.x = std::stoi(argv[++i]);
+      region.y = std::stoi(argv[++i]);
+      region.width = std::stoi(argv[++i]);
+      region.height = std::stoi(argv[++i]);
+      regions.push_back(region);
+    } else if (arg == "--crop") {
+      crop = true;
+    } else if (arg == "--budget" && i + 1 < argc) {
+      budget = std::stoi(argv[++i]);
+    } else if (arg == "--checkpoint" && i + 1 < argc) {
+      checkpointFile = argv[++i];
+    } else if (arg == "--resume") {
+      resume = true;
+    } else if (arg == "--aov" && i + 1 < argc) {
+      aovPrefix = argv[++i];
+    } else if (arg == "--sampler" && i + 1 < argc) {
+      std::string name = argv[++i];
+      sampling = name == "random"      ? RT::SampleSequence::Random
+                 : name == "bluenoise" ? RT::SampleSequence::BlueNoise
+                                       : RT::SampleSequence::Sobol;
+    } else {
+      std::cerr << "usage: " << argv[0]
+                << " [--output file.ppm] [--size width height] [--wavefront]"
+                   " [--stats] [--coordinator endpoint | --worker endpoint |"
+                   " --farm workers] [--tile-size n] [--frames n]"
+                   " [--aperture radius --focus distance]"
+                   " [--region x y width height]... [--crop]"
+                   " [--budget milliseconds]"
+                   " [--checkpoint file [--resume]] [--aov prefix]"
+                   " [--sampler sobol|bluenoise|random]\n";
+      return 1;
+    }
+  }
+  if (frames > 0 && (wavefront || !regions.empty() || crop || budget > 0 ||
+                     !coordinator.empty() || farm > 0)) {
+    std::cerr << "--frames renders whole frames in this process; it takes no"
+                 " --wavefront, --region, --crop, --budget, --farm or"
+                 " --coordinator\n";
+    return 1;
+  }
+  if (wavefront && !regions.empty()) {
+    std::cerr << "--region is not supported by the wavefront renderer\n";
+    return 1;
+  }
+  // Animations render their frames with the wavefront renderer too.
+  if ((wavefront || frames > 0) && aperture > 0) {
+    std::cerr << "--aperture is not supported by the wavefront renderer\n";
+    return 1;
+  }
+  if (budget > 0 &&
+      (wavefront || !regions.empty() || !coordinator.empty() || farm > 0)) {
+    std::cerr << "--budget renders the whole image in this process\n";
+    return 1;
+  }
+  if (!checkpointFile.empty() &&
+      (wavefront || budget > 0 || !coordinator.empty() || farm > 0 ||
+       frames > 0)) {
+    std::cerr << "--checkpoint only applies to the tile renderer\n";
+    return 1;
+  }
+  if (!aovPrefix.empty() &&
+      (wavefront || budget > 0 || !coordinator.empty() || farm > 0 ||
+       frames > 0 || !checkpointFile.empty())) {
+    std::cerr << "--aov needs every tile traced by the tile renderer in this"
+                 " process\n";
+    return 1;
+  }
+  if (resume && checkpointFile.empty()) {
+    std::cerr << "--resume needs a --checkpoint file\n";
+    return 1;
+  }
+
+  auto camera = RT::Camera(hsize, vsize, 0.785398);
+  camera.transform = RT::viewTransform(
+      RT::point(-6, 6, -10), RT::point(6, 0, 6), RT::vector(-0.45, 1, 0));
+  camera.aperture = aperture;
+  camera.focalDistance = focalDistance;
+  camera.sampling = sampling;
+
+  auto world = RT::World(false);
+  auto glass = buildScene(world);
+  world.countShadowCache(stats);
+
+  auto rays = camera.rays();
+  auto renderTile = [&](const RT::Tile &tile, std::vector<RT::Color> &pixels) {
+    std::vector<RT::Ray> row(static_cast<size_t>(tile.width));
+    for (auto y = 0; y < tile.height; y++) {
+      rays.row(tile.x, tile.y + y, row.size(), row.data());
+      for (auto x = 0; x < tile.width; x++) {
+        pixels[static_cast<size_t>(y) * tile.width + x] =
+            rays.multisampled()
+                ? RT::lensColor(world, rays, tile.x + x, tile.y + y).color
+                : world.colorAt(row[static_cast<size_t>(x)]);
+      }
+    }
+  };
+
+  // Workers are sent whole tiles, so the tile size is left out of the key.
+  auto farmKey = renderKey(hsize, vsize, 0, aperture, focalDistance, sampling);
+  if (!worker.empty()) {
+    try {
+      auto tiles = RT::runWorker(worker, renderTile, farmKey);
+      std::cerr << "worker rendered " << tiles << " tiles\n";
+    } catch (const std::runtime_error &e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (frames > 0) {
+    RT::Sequence sequence(camera, world);
+    animateScene(sequence, glass);
+    sequence.render(frames, 0, 1, [&](int frame, const RT::Canvas &image) {
+      image.savePPM(frameName(output, frame));
+    });
+    return 0;
+  }
+
+  if (farm > 0 && coordinator.empty()) {
+    coordinator = "unix:/tmp/rt-farm-" + std::to_string(getpid()) + ".sock";
+  }
+  auto tiles = regions.empty()
+                   ? RT::splitTiles(hsize, vsize, tileSize)
+                   : RT::splitTiles(regions, hsize, vsize, tileSize);
+  auto window = crop ? RT::boundingTile(tiles) : RT::Tile{0, 0, hsize, vsize};
+  if (!coordinator.empty()) {
+    auto canvas = RT::Canvas(window.width, window.height);
+    RT::Coordinator farmCoordinator(coordinator, farmKey);
+    std::cerr << "coordinator listening on " << farmCoordinator.endpoint()
+              << "\n";
+    std::vector<pid_t> children;
+    for (auto i = 0; i < farm; i++) {
+      auto pid = fork();
+      if (pid == 0) {
+        RT::runWorker(farmCoordinator.endpoint(), renderTile, farmKey);
+        _exit(0);
+      }
+      children.push_back(pid);
+    }
+    farmCoordinator.render(canvas, tiles, window);
+    farmCoordinator.shutdown();
+    for (auto pid : children) {
+      waitpid(pid, nullptr, 0);
+    }
+    if (farmCoordinator.reassigned() > 0) {
+      std::cerr << farmCoordinator.reassigned()
+                << " tiles reassigned from lost workers\n";
+    }
+    canvas.savePPM(output);
+    return 0;
+  }
+
+  if (budget > 0) {
+    auto result = RT::renderProgressive(camera, world,
+                                        std::chrono::milliseconds(budget));
+    const auto &report = result.report;
+    std::cerr << report.samplesPerPixel << " samples per pixel ("
+              << report.minSamples << " to " << report.maxSamples << ") in "
+              << report.passes << " passes, "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     report.elapsed)
+                     .count()
+              << " ms" << (report.converged ? ", converged" : "") << "\n";
+    result.image.savePPM(output);
+    return 0;
+  }
+
+  auto canvas = RT::Canvas(window.width, window.height);
+  std::string checkpointError;
+  std::string aovError;
+  if (wavefront) {
+    canvas = RT::Wavefront(camera).render(world);
+  } else {
+    RT::RenderOptions options;
+    options.tileSize = tileSize;
+    options.regions = regions;
+    options.crop = crop;
+    std::optional<RT::Checkpoint> checkpoint;
+    if (!checkpointFile.empty()) {
+      // Tiles are saved and restored in image coordinates, so the canvas
+      // is cropped once they are all in.
+      try {
+        checkpoint.emplace(checkpointFile, hsize, vsize,
+                           renderKey(hsize, vsize, tileSize, aperture,
+                                     focalDistance, sampling),
+                           resume);
+      } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+      }
+      options.regions = checkpoint->missing(tiles);
+      if (options.regions.size() < tiles.size()) {
+        std::cerr << "resuming with " << tiles.size() - options.regions.size()
+                  << " of " << tiles.size() << " tiles done\n";
+      }
+      options.crop = false;
+      options.onPixels = [&](const RT::Tile &tile,
+                             const std::vector<RT::Color> &pixels) {
+        checkpoint->save(tile, pixels);
+      };
+    }
+    // Each AOV streams to its own PFM file as tiles finish.
+    std::vector<std::unique_ptr<RT::PFMWriter>> aovWriters;
+    if (!aovPrefix.empty()) {
+      const std::array<const char *, 4> names{"depth", "normal", "object",
+                                              "albedo"};
+      const std::array<int, 4> channels{1, 3, 1, 3};
+      try {
+        for (size_t i = 0; i < names.size(); i++) {
+          aovWriters.push_back(std::make_unique<RT::PFMWriter>(
+              aovPrefix + "." + names[i] + ".pfm", window.width,
+              window.height, channels[i]));
+        }
+      } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+      }
+      options.aovs = true;
+      options.onAOVs = [&](const RT::Tile &tile, const RT::AOVImages &aovs) {
+        aovWriters[0]->write(tile, aovs.depth);
+        aovWriters[1]->write(tile, aovs.normal);
+        aovWriters[2]->write(tile, aovs.object);
+        aovWriters[3]->write(tile, aovs.albedo);
+      };
+    }
+    if (checkpoint && options.regions.empty()) {
+      canvas = RT::Canvas(hsize, vsize);
+    } else {
+      canvas = renderWithProgress(camera, world, options);
+    }
+    if (checkpoint) {
+      checkpoint->restore(canvas);
+      if (crop) {
+        canvas = canvas.crop(window);
+      }
+      checkpointError = checkpoint->error();
+    }
+    for (const auto &writer : aovWriters) {
+      if (aovError.empty()) {
+        aovError = writer->error();
+      }
+    }
+  }
+  canvas.savePPM(output);
+  if (!checkpointError.empty()) {
+    std::cerr << checkpointError << "; the render finished but cannot be"
+                 " resumed from it\n";
+    return 1;
+  }
+  if (!aovError.empty()) {
+    std::cerr << aovError << "; the image was saved without its AOVs\n";
+    return 1;
+  }
+  if (stats) {
+    auto shadows = world.shadowCacheStats();
+    std::cerr << "shadow occluder cache: " << shadows.hits << " of "
+              << shadows.lookups << " lookups hit ("
+              << shadows.hitRate() * 100 << "%)\n";
+  }
 
   return 0;
 }
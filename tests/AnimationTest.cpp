@@ -0,0 +1,122 @@
+#include "Animation.hpp"
+#include "Wavefront.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+
+auto movingSphere(const RT::Transformation &transform) -> RT::Sphere {
+  auto s = RT::Sphere();
+  s.material.color = RT::color(0.2, 0.4, 0.9);
+  s.transformation = transform;
+  return s;
+}
+
+} // namespace
+
+TEST_CASE("A track holds its first and last keys", "[Animation]") {
+  RT::Track<RT::Pose> track;
+  track.key(1, RT::Pose{RT::vector(1, 0, 0)});
+  track.key(3, RT::Pose{RT::vector(5, 0, 0)});
+  REQUIRE(track.at(0).translation == RT::vector(1, 0, 0));
+  REQUIRE(track.at(4).translation == RT::vector(5, 0, 0));
+}
+
+TEST_CASE("A track interpolates between keys added out of order",
+          "[Animation]") {
+  RT::Track<RT::Pose> track;
+  track.key(2, RT::Pose{RT::vector(0, 4, 0), RT::vector(0, M_PI, 0),
+                        RT::vector(3, 3, 3)});
+  track.key(0, RT::Pose{});
+  auto p = track.at(1);
+  REQUIRE(p.translation == RT::vector(0, 2, 0));
+  REQUIRE(p.rotation == RT::vector(0, M_PI / 2, 0));
+  REQUIRE(p.scale == RT::vector(2, 2, 2));
+}
+
+TEST_CASE("A pose scales, then rotates, then translates", "[Animation]") {
+  auto p = RT::Pose{RT::vector(1, 2, 3), RT::vector(M_PI / 2, 0, M_PI / 4),
+                    RT::vector(2, 2, 2)};
+  auto expected = RT::translation(1, 2, 3) * RT::rotationZ(M_PI / 4) *
+                  RT::rotationY(0) * RT::rotationX(M_PI / 2) *
+                  RT::scaling(2, 2, 2);
+  REQUIRE(p.transform() == expected);
+}
+
+TEST_CASE("Moving an object refits its cached inverse and bounds",
+          "[Animation]") {
+  RT::World w(false);
+  w.add(std::make_unique<RT::Sphere>(movingSphere(RT::identityMatrix<4>())));
+  w.setTransform(0, RT::translation(0, 0, 10));
+  auto r = RT::Ray(RT::point(0, 0, -5), RT::vector(0, 0, 1));
+  auto xs = w.intersect(r);
+  REQUIRE(xs.size() == 2);
+  REQUIRE(RT::approxEqual(xs[0].first, 14));
+  REQUIRE(w.intersect(RT::Ray(RT::point(0, 0, -5), RT::vector(0, 1, 0)))
+              .empty());
+}
+
+TEST_CASE("A sequence renders each frame like a freshly built world",
+          "[Animation]") {
+  auto scene = [](RT::World &w, const RT::Transformation &moving) {
+    w.lights.emplace_back(RT::point(-10, 10, -10), RT::color(1, 1, 1));
+    auto floor = RT::Plane();
+    floor.transformation = RT::translation(0, -1, 0);
+    w.add(std::make_unique<RT::Plane>(floor));
+    w.add(std::make_unique<RT::Sphere>(movingSphere(moving)));
+  };
+  RT::World world(false);
+  scene(world, RT::identityMatrix<4>());
+  RT::Camera camera(16, 12, M_PI / 3);
+  RT::Sequence sequence(camera, world);
+  sequence.view.key(0, {RT::point(0, 1, -6), RT::point(0, 0, 0),
+                        RT::vector(0, 1, 0)});
+  sequence.view.key(1, {RT::point(6, 1, 0), RT::point(0, 0, 0),
+                        RT::vector(0, 1, 0)});
+  RT::Track<RT::Pose> bounce;
+  bounce.key(0, RT::Pose{});
+  bounce.key(0.5, RT::Pose{RT::vector(0, 1, 0)});
+  sequence.animate(1, bounce);
+
+  std::map<int, RT::Canvas> frames;
+  sequence.render(5, 0, 1, [&](int frame, const RT::Canvas &image) {
+    frames.emplace(frame, image);
+  });
+  REQUIRE(frames.size() == 5);
+  // The sphere holds its last key for the final two frames.
+  REQUIRE(sequence.refits() == 3);
+  REQUIRE(world.edits().empty());
+  REQUIRE(world.editCount() > 3);
+
+  for (auto frame = 0; frame < 5; frame++) {
+    auto time = frame / RT::Real{4};
+    RT::World fresh(false);
+    scene(fresh, bounce.at(time).transform());
+    auto v = sequence.view.at(time);
+    RT::Camera c(16, 12, M_PI / 3,
+                 RT::viewTransform(v.from, v.to, v.up));
+    auto expected = RT::Wavefront(c).render(fresh);
+    const auto &image = frames.at(frame);
+    for (auto y = 0; y < c.vsize; y++) {
+      for (auto x = 0; x < c.hsize; x++) {
+        REQUIRE(image.pixelAt(x, y) == expected.pixelAt(x, y));
+      }
+    }
+  }
+}
+
+TEST_CASE("A failing frame writer stops the sequence", "[Animation]") {
+  RT::World world;
+  RT::Camera camera(4, 4, M_PI / 2);
+  RT::Sequence sequence(camera, world);
+  auto written = 0;
+  REQUIRE_THROWS_AS(sequence.render(10, 0, 1,
+                                    [&](int, const RT::Canvas &) {
+                                      written++;
+                                      throw std::runtime_error("disk full");
+                                    }),
+                    std::runtime_error);
+  REQUIRE(written == 1);
+}
@@ -0,0 +1,65 @@
+#include "Bounds.hpp"
+#include "Matrix.hpp"
+#include "Ray.hpp"
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Creating an empty bounding box", "[Bounds]") {
+  RT::BoundingBox box;
+  REQUIRE(box.isEmpty());
+  box.add(RT::point(-5, 2, 0));
+  box.add(RT::point(7, 0, -3));
+  REQUIRE(!box.isEmpty());
+  REQUIRE(box.min == RT::point(-5, 0, -3));
+  REQUIRE(box.max == RT::point(7, 2, 0));
+}
+
+TEST_CASE("Transforming a bounding box", "[Bounds]") {
+  RT::BoundingBox box(RT::point(-1, -1, -1), RT::point(1, 1, 1));
+  auto m = RT::rotationX(M_PI / 4) * RT::rotationY(M_PI / 4);
+  auto transformed = box.transform(m);
+  REQUIRE(transformed.min == RT::point(-1.41421, -1.70710, -1.70710));
+  REQUIRE(transformed.max == RT::point(1.41421, 1.70710, 1.70710));
+}
+
+TEST_CASE("Transforming an infinite bounding box", "[Bounds]") {
+  auto box = RT::BoundingBox::infinite();
+  REQUIRE(!box.transform(RT::translation(1, 2, 3)).isFinite());
+}
+
+TEST_CASE("Intersecting a ray with a bounding box", "[Bounds]") {
+  RT::BoundingBox box(RT::point(5, -2, 0), RT::point(11, 4, 7));
+  REQUIRE(box.intersects(RT::Ray(RT::point(15, 1, 2), RT::vector(-1, 0, 0))));
+  REQUIRE(box.intersects(RT::Ray(RT::point(7, 6, 5), RT::vector(0, -1, 0))));
+  REQUIRE(box.intersects(RT::Ray(RT::point(8, 1, -8), RT::vector(0, 0, 1))));
+  REQUIRE(!box.intersects(RT::Ray(RT::point(9, -1, -8), RT::vector(0, 0, -1))
+                               .transform(RT::translation(0, 10, 0))));
+  REQUIRE(!box.intersects(RT::Ray(RT::point(12, 5, 4), RT::vector(0, 1, 0))));
+}
+
+TEST_CASE("Testing a block of bounds against a ray", "[Bounds]") {
+  RT::BoundsArray bounds;
+  bounds.push(RT::BoundingBox(RT::point(-1, -1, -1), RT::point(1, 1, 1)));
+  bounds.push(RT::BoundingBox(RT::point(4, -1, -1), RT::point(6, 1, 1)));
+  bounds.push(RT::BoundingBox::infinite());
+  std::array<unsigned char, 3> mask{};
+  auto r = RT::Ray(RT::point(0, 0, -5), RT::vector(0, 0, 1));
+  bounds.hits(r, 0, 3, mask.data());
+  REQUIRE(mask[0] != 0);
+  REQUIRE(mask[1] == 0);
+  REQUIRE(mask[2] != 0);
+}
+
+TEST_CASE("The span of a ray's line through a bounding box", "[Bounds]") {
+  RT::BoundingBox box(RT::point(-1, -1, -1), RT::point(1, 1, 1));
+  const auto ahead =
+      box.span(RT::Ray(RT::point(0, 0, -5), RT::vector(0, 0, 2)));
+  REQUIRE(ahead.has_value());
+  REQUIRE(RT::approxEqual(ahead->first, 2.0));
+  REQUIRE(RT::approxEqual(ahead->second, 3.0));
+  const auto behind =
+      box.span(RT::Ray(RT::point(0, 0, 5), RT::vector(0, 0, 1)));
+  REQUIRE(behind.has_value());
+  REQUIRE(RT::approxEqual(behind->first, -6.0));
+  REQUIRE_FALSE(box.span(RT::Ray(RT::point(2, 0, -5), RT::vector(0, 0, 1)))
+                    .has_value());
+}
@@ -1,6 +1,13 @@
 #include "Camera.hpp"
+#include "RenderFixture.hpp"
 #include "Util.h"
+#include <atomic>
 #include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
 
 TEST_CASE("Constructing a camera", "[Camera]") {
   auto hsize = 160;
@@ -9,7 +16,7 @@ TEST_CASE("Constructing a camera", "[Camera]") {
   RT::Camera c(hsize, vsize, fieldOfView);
   REQUIRE(c.hsize == 160);
   REQUIRE(c.vsize == 120);
-  REQUIRE(c.fieldOfView == M_PI / 2);
+  REQUIRE(RT::approxEqual(c.fieldOfView, M_PI / 2));
   REQUIRE(c.transform == RT::identityMatrix<4>());
 }
 
@@ -45,6 +52,85 @@ TEST_CASE("Constructing a ray when the camera is transformed", "[Camera]") {
   REQUIRE(r.direction == RT::vector(std::sqrt(2) / 2, 0, -std::sqrt(2) / 2));
 }
 
+TEST_CASE("Generating rows of rays", "[Camera]") {
+  RT::Camera c(201, 101, M_PI / 2);
+  c.transform = RT::rotationY(M_PI / 4) * RT::translation(0, -2, 5);
+  auto rays = c.rays();
+  REQUIRE(rays.ray(100, 50).origin == RT::point(0, 2, -5));
+  REQUIRE(rays.ray(100, 50).direction ==
+          RT::vector(std::sqrt(2) / 2, 0, -std::sqrt(2) / 2));
+  std::vector<RT::Ray> row(150);
+  for (auto y : {0, 37, 100}) {
+    rays.row(3, y, row.size(), row.data());
+    for (size_t i = 0; i < row.size(); i++) {
+      auto x = static_cast<int>(i) + 3;
+      auto expected = rays.ray(x, y);
+      REQUIRE(RT::identical(row[i].origin, expected.origin));
+      REQUIRE(RT::identical(row[i].direction, expected.direction));
+      REQUIRE(row[i].direction == c.rayForPixel(x, y).direction);
+    }
+  }
+}
+
+TEST_CASE("Anti-aliasing samples stay inside their pixel", "[Camera]") {
+  RT::Camera c(201, 101, M_PI / 2);
+  c.transform = RT::rotationY(M_PI / 4) * RT::translation(0, -2, 5);
+  auto rays = c.rays();
+  auto center = rays.sampleRay(100, 50, 0);
+  REQUIRE(RT::identical(center.direction, rays.ray(100, 50).direction));
+  auto footprint = c.pixelSize * std::sqrt(2) / 2;
+  for (auto i = 1; i < 16; i++) {
+    auto r = rays.sampleRay(100, 50, i);
+    REQUIRE(r.origin == center.origin);
+    auto offset = (r.direction - center.direction).magnitude();
+    REQUIRE(offset > 0);
+    REQUIRE(offset < footprint);
+  }
+}
+
+TEST_CASE("Lens rays meet on the focal plane", "[Camera]") {
+  RT::Camera c(201, 101, M_PI / 2);
+  c.transform = RT::rotationY(M_PI / 4) * RT::translation(0, -2, 5);
+  c.aperture = 0.5;
+  c.focalDistance = 3;
+  auto rays = c.rays();
+  REQUIRE(rays.multisampled());
+  auto pinhole = rays.ray(100, 50);
+  auto focus = pinhole.position(3);
+  for (auto i = 0; i < c.lensSamples; i++) {
+    auto r = rays.lensRay(100, 50, i);
+    auto offset = r.origin - pinhole.origin;
+    REQUIRE(offset.magnitude() <= 0.5 + EPSILON);
+    REQUIRE(RT::approxEqual(RT::dot(offset, pinhole.direction), 0.0));
+    REQUIRE(r.position((focus - r.origin).magnitude()) == focus);
+  }
+  c.aperture = 0;
+  REQUIRE_FALSE(c.rays().multisampled());
+}
+
+TEST_CASE("In-focus pixels stop after the pilot lens samples", "[Camera]") {
+  RT::World w;
+  RT::Camera c(11, 11, M_PI / 2);
+  c.transform = RT::viewTransform(RT::point(0, 0, -5), RT::point(0, 0, 0),
+                                  RT::vector(0, 1, 0));
+  c.aperture = 0.2;
+  c.focalDistance = 4;
+  auto rays = c.rays();
+  auto sharp = RT::lensColor(w, rays, 5, 5);
+  REQUIRE(sharp.samples == RT::LENS_PILOT_SAMPLES);
+  REQUIRE(sharp.color == w.colorAt(c.rayForPixel(5, 5)));
+  auto sky = RT::lensColor(w, rays, 0, 0);
+  REQUIRE(sky.samples == RT::LENS_PILOT_SAMPLES);
+
+  // A wide lens focused far behind the sphere blurs its silhouette.
+  c.aperture = 1;
+  c.focalDistance = 20;
+  auto blurred = RT::lensColor(w, c.rays(), 4, 5);
+  REQUIRE(blurred.samples == c.lensSamples);
+  auto image = c.render(w);
+  REQUIRE(image.pixelAt(4, 5) == blurred.color);
+}
+
 TEST_CASE("Rendering a world with a camera", "[Camera]") {
   RT::World w;
   RT::Camera c(11, 11, M_PI / 2);
@@ -54,4 +140,248 @@ TEST_CASE("Rendering a world with a camera", "[Camera]") {
   c.transform = RT::viewTransform(from, to, up);
   auto image = c.render(w);
   REQUIRE(image.pixelAt(5, 5) == RT::color(0.38066, 0.47583, 0.2855));
-}
\ No newline at end of file
+}
+namespace {
+
+void lookDevWorld(RT::World &w) {
+  auto floor = RT::Plane();
+  floor.transformation = RT::translation(0, -1, 0);
+  w.add(std::make_unique<RT::Plane>(floor));
+  auto glass = RT::glassSphere(RT::translation(-1.5, -0.5, -1) *
+                               RT::scaling(0.5, 0.5, 0.5));
+  w.add(std::make_unique<RT::Sphere>(glass));
+  auto cube = RT::Cube();
+  cube.transformation =
+      RT::translation(2.5, -0.6, 1.5) * RT::scaling(0.4, 0.4, 0.4);
+  cube.material.color = RT::color(0.9, 0.2, 0.2);
+  w.add(std::make_unique<RT::Cube>(cube));
+}
+
+} // namespace
+
+TEST_CASE("A trace grid marks the cells a ray crosses", "[Camera]") {
+  RT::TraceGrid grid(RT::BoundingBox(RT::point(0, 0, 0), RT::point(16, 16, 16)));
+  std::vector<uint64_t> cells(grid.words(), 0);
+  grid.mark(cells, RT::Ray(RT::point(-5, 0.5, 0.5), RT::vector(1, 0, 0)), 0,
+            10);
+  REQUIRE(grid.overlaps(cells, RT::BoundingBox(RT::point(4.2, 0.2, 0.2),
+                                               RT::point(4.8, 0.8, 0.8))));
+  REQUIRE_FALSE(grid.overlaps(cells, RT::BoundingBox(RT::point(8, 0, 0),
+                                                     RT::point(9, 1, 1))));
+  REQUIRE_FALSE(grid.overlaps(cells, RT::BoundingBox(RT::point(2, 8, 8),
+                                                     RT::point(3, 9, 9))));
+}
+
+TEST_CASE("A recorded render matches a plain render", "[Camera]") {
+  RT::World w;
+  lookDevWorld(w);
+  auto c = testCamera(64, 48);
+  RT::RenderRecord record;
+  requireIdentical(c.render(w, record), c.render(w));
+  REQUIRE(record.tiles.size() == 12);
+}
+
+TEST_CASE("Moving an object retraces only the tiles it can change",
+          "[Camera]") {
+  RT::World w;
+  lookDevWorld(w);
+  auto c = testCamera(64, 48);
+  RT::RenderRecord record;
+  record.tileSize = 8;
+  auto image = c.render(w, record);
+  REQUIRE(c.update(w, record, image) == 0);
+  w.setTransform(4, RT::translation(2.5, -0.6, 0.5) *
+                        RT::scaling(0.4, 0.4, 0.4));
+  auto retraced = c.update(w, record, image);
+  REQUIRE(retraced > 0);
+  REQUIRE(retraced < record.tiles.size());
+  requireIdentical(image, c.render(w));
+}
+
+TEST_CASE("Cleared edits are caught up with a full render", "[Camera]") {
+  RT::World w;
+  lookDevWorld(w);
+  auto c = testCamera(64, 48);
+  RT::RenderRecord record;
+  record.tileSize = 8;
+  auto image = c.render(w, record);
+  w.setTransform(4, RT::translation(2.5, -0.6, 0.5) *
+                        RT::scaling(0.4, 0.4, 0.4));
+  w.clearEdits();
+  REQUIRE(w.edits().empty());
+  REQUIRE(c.update(w, record, image) == record.tiles.size());
+  requireIdentical(image, c.render(w));
+  w.setTransform(4, RT::translation(2.5, -0.6, 0.3) *
+                        RT::scaling(0.4, 0.4, 0.4));
+  auto retraced = c.update(w, record, image);
+  REQUIRE(retraced > 0);
+  REQUIRE(retraced < record.tiles.size());
+  requireIdentical(image, c.render(w));
+}
+
+TEST_CASE("Changing a material retraces the tiles that saw it", "[Camera]") {
+  RT::World w;
+  lookDevWorld(w);
+  auto c = testCamera(64, 48);
+  RT::RenderRecord record;
+  record.tileSize = 8;
+  auto image = c.render(w, record);
+  auto m = w.object(4).material;
+  m.color = RT::color(0.1, 0.8, 0.1);
+  w.setMaterial(4, m);
+  auto retraced = c.update(w, record, image);
+  REQUIRE(retraced > 0);
+  REQUIRE(retraced < record.tiles.size());
+  requireIdentical(image, c.render(w));
+}
+
+TEST_CASE("Removing an object retraces the tiles that saw it", "[Camera]") {
+  RT::World w;
+  lookDevWorld(w);
+  auto c = testCamera(64, 48);
+  RT::RenderRecord record;
+  record.tileSize = 8;
+  auto image = c.render(w, record);
+  w.remove(0);
+  REQUIRE(c.update(w, record, image) > 0);
+  requireIdentical(image, c.render(w));
+}
+
+TEST_CASE("Moving the camera or a light retraces everything", "[Camera]") {
+  RT::World w;
+  lookDevWorld(w);
+  auto c = testCamera(64, 48);
+  RT::RenderRecord record;
+  auto image = c.render(w, record);
+  w.lights[0].position = RT::point(-8, 10, -10);
+  REQUIRE(c.update(w, record, image) == record.tiles.size());
+  requireIdentical(image, c.render(w));
+  c.transform = RT::viewTransform(RT::point(1, 1.5, -7), RT::point(0, 0, 0),
+                                  RT::vector(0, 1, 0));
+  REQUIRE(c.update(w, record, image) == record.tiles.size());
+  requireIdentical(image, c.render(w));
+}
+
+TEST_CASE("An asynchronous render reports every tile", "[Camera]") {
+  RT::World w;
+  auto c = testCamera(64, 48);
+  std::atomic<size_t> tiles = 0;
+  RT::RenderOptions options;
+  options.tileSize = 16;
+  options.onTile = [&](const RT::Tile &tile, RT::Real progress) {
+    REQUIRE(tile.width <= 16);
+    REQUIRE(progress > 0);
+    tiles++;
+  };
+  auto handle = c.renderAsync(w, options);
+  const auto &image = handle.wait();
+  REQUIRE(handle.finished());
+  REQUIRE_FALSE(handle.cancelled());
+  REQUIRE(tiles == 12);
+  REQUIRE(handle.pixelsDone() == handle.totalPixels());
+  REQUIRE(handle.progress() == 1);
+  requireIdentical(image, handle.snapshot());
+}
+
+TEST_CASE("Cancelling a render keeps the tiles already finished",
+          "[Camera]") {
+  RT::World w;
+  lookDevWorld(w);
+  auto c = testCamera(64, 48);
+  std::atomic<bool> started = false;
+  std::atomic<bool> released = false;
+  RT::RenderOptions options;
+  options.tileSize = 8;
+  options.threads = 1;
+  options.onTile = [&](const RT::Tile &, RT::Real) {
+    started = true;
+    while (!released) {
+      std::this_thread::yield();
+    }
+  };
+  auto handle = c.renderAsync(w, options);
+  while (!started) {
+    std::this_thread::yield();
+  }
+  handle.cancel();
+  released = true;
+  handle.wait();
+  REQUIRE(handle.cancelled());
+  REQUIRE(handle.pixelsDone() == 64);
+  auto partial = handle.snapshot();
+  auto full = c.render(w);
+  REQUIRE(partial.pixelAt(3, 3) == full.pixelAt(3, 3));
+  REQUIRE(partial.pixelAt(40, 40) == RT::color(0, 0, 0));
+}
+
+TEST_CASE("Rendering regions of interest", "[Camera]") {
+  RT::World w;
+  lookDevWorld(w);
+  auto c = testCamera(64, 48);
+  auto full = c.render(w);
+  RT::RenderOptions options;
+  options.tileSize = 8;
+  options.regions = {{5, 3, 12, 10}, {40, 20, 30, 40}};
+  auto partial = c.render(w, options);
+  REQUIRE(partial.width == c.hsize);
+  REQUIRE(partial.height == c.vsize);
+  REQUIRE(partial.pixelAt(5, 3) == full.pixelAt(5, 3));
+  REQUIRE(partial.pixelAt(16, 12) == full.pixelAt(16, 12));
+  REQUIRE(partial.pixelAt(17, 12) == RT::color(0, 0, 0));
+  requireIdentical(partial.crop(RT::Tile{40, 20, 24, 28}),
+                   full.crop(RT::Tile{40, 20, 24, 28}));
+
+  options.crop = true;
+  auto handle = c.renderAsync(w, options);
+  REQUIRE(handle.totalPixels() == 12 * 10 + 24 * 28);
+  const auto &cropped = handle.wait();
+  REQUIRE(cropped.width == 59);
+  REQUIRE(cropped.height == 45);
+  requireIdentical(cropped, partial.crop(RT::Tile{5, 3, 59, 45}));
+}
+
+TEST_CASE("AOVs come from the same pass as the colors", "[Camera]") {
+  RT::World w;
+  lookDevWorld(w);
+  auto c = testCamera(64, 48);
+  auto plain = c.render(w);
+  RT::RenderOptions options;
+  options.tileSize = 8;
+  options.aovs = true;
+  std::atomic<size_t> aovPixels{0};
+  options.onAOVs = [&](const RT::Tile &tile, const RT::AOVImages &) {
+    aovPixels += static_cast<size_t>(tile.width) * tile.height;
+  };
+  auto handle = c.renderAsync(w, options);
+  requireIdentical(handle.wait(), plain);
+  REQUIRE(aovPixels == static_cast<size_t>(c.hsize) * c.vsize);
+  const auto &aovs = handle.aovs().value();
+  for (auto [x, y] : {std::pair{32, 40}, std::pair{12, 34}}) {
+    std::optional<RT::Intersection> primary;
+    std::optional<RT::SurfaceSample> surface;
+    (void)w.colorAt(c.rayForPixel(x, y), primary, surface);
+    REQUIRE(surface.has_value());
+    REQUIRE(aovs.depth.at(x, y, 0) == static_cast<float>(surface->depth));
+    REQUIRE(aovs.object.at(x, y, 0) == static_cast<float>(surface->object));
+    REQUIRE(aovs.normal.at(x, y, 1) ==
+            static_cast<float>(surface->normal.y));
+    REQUIRE(aovs.albedo.at(x, y, 0) ==
+            static_cast<float>(surface->albedo.red));
+  }
+  REQUIRE(aovs.object.at(3, 2, 0) == -1);
+  REQUIRE(std::isinf(aovs.depth.at(3, 2, 0)));
+  REQUIRE(aovs.albedo.at(32, 40, 1) == 1);
+  REQUIRE(!c.renderAsync(w).aovs().has_value());
+
+  // Multisampled pixels take their first lens sample's hit.
+  c.aperture = 0.3;
+  c.focalDistance = 5;
+  options.crop = true;
+  options.regions = {{20, 30, 16, 12}};
+  auto blurred = c.renderAsync(w, options);
+  (void)blurred.wait();
+  std::optional<RT::SurfaceSample> first;
+  (void)RT::lensColor(w, c.rays(), 25, 35, &first);
+  REQUIRE(blurred.aovs()->depth.at(5, 5, 0) ==
+          static_cast<float>(first->depth));
+}
@@ -2,6 +2,8 @@
 #define private public
 #include "Canvas.hpp"
 #include <catch2/catch_test_macros.hpp>
+#include <fstream>
+#include <vector>
 
 TEST_CASE("Creating a canvas", "[Canvas]") {
   RT::Canvas c = RT::Canvas(10, 20);
@@ -39,4 +41,92 @@ TEST_CASE("Constructing the PPM pixel data", "[Canvas]") {
       255, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  128,
       0,   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 255};
   REQUIRE(ppm == expected);
-}
\ No newline at end of file
+}
+TEST_CASE("Reading a PPM file back into a canvas", "[Canvas]") {
+  RT::Canvas c = RT::Canvas(5, 3);
+  c.writePixel(0, 0, RT::color(1, 0, 0));
+  c.writePixel(2, 1, RT::color(0, 0.5, 0));
+  c.writePixel(4, 2, RT::color(0, 0, 1));
+  c.savePPM("canvas_roundtrip.ppm");
+  auto loaded = RT::Canvas::loadPPM("canvas_roundtrip.ppm");
+  REQUIRE(loaded.width == 5);
+  REQUIRE(loaded.height == 3);
+  REQUIRE(loaded.pixelAt(0, 0) == RT::color(1, 0, 0));
+  REQUIRE(RT::approxEqual(loaded.pixelAt(2, 1).green, 128.0 / 255));
+  REQUIRE(loaded.pixelAt(4, 2) == RT::color(0, 0, 1));
+  REQUIRE(loaded.pixelAt(1, 1) == RT::color(0, 0, 0));
+}
+
+TEST_CASE("Streaming a PFM file tile by tile", "[Canvas]") {
+  RT::FloatImage image(5, 3, 3);
+  for (auto y = 0; y < 3; y++) {
+    for (auto x = 0; x < 5; x++) {
+      for (auto c = 0; c < 3; c++) {
+        image.set(x, y, c, static_cast<float>(x * 100 + y * 10 + c) / 7);
+      }
+    }
+  }
+  {
+    const RT::PFMWriter writer("stream.pfm", 5, 3, 3);
+    writer.write(RT::Tile{3, 0, 2, 3}, image);
+    writer.write(RT::Tile{0, 1, 3, 2}, image);
+  }
+  auto loaded = RT::FloatImage::loadPFM("stream.pfm");
+  REQUIRE(loaded.width == 5);
+  REQUIRE(loaded.height == 3);
+  REQUIRE(loaded.channels == 3);
+  REQUIRE(loaded.at(4, 0, 2) == image.at(4, 0, 2));
+  REQUIRE(loaded.at(1, 2, 0) == image.at(1, 2, 0));
+  REQUIRE(loaded.at(0, 0, 1) == 0);
+
+  RT::FloatImage depth(2, 2, 1, -1);
+  depth.set(1, 0, 0, 2.5F);
+  depth.savePFM("depth.pfm");
+  std::ifstream file("depth.pfm", std::ios::binary);
+  std::string header(RT::PFMHeader(2, 2, 1).size(), ' ');
+  file.read(header.data(), static_cast<std::streamsize>(header.size()));
+  REQUIRE(header == "Pf\n2 2\n-1.0\n");
+  // The top row is stored last.
+  std::vector<float> values(4);
+  file.read(reinterpret_cast<char *>(values.data()), 16);
+  REQUIRE(values == std::vector<float>{-1, -1, -1, 2.5F});
+}
+
+TEST_CASE("Splitting an image into tiles", "[Canvas]") {
+  auto tiles = RT::splitTiles(70, 40, 32);
+  REQUIRE(tiles.size() == 6);
+  REQUIRE(tiles[0] == RT::Tile{0, 0, 32, 32});
+  REQUIRE(tiles[2] == RT::Tile{64, 0, 6, 32});
+  REQUIRE(tiles[5] == RT::Tile{64, 32, 6, 8});
+  auto area = 0;
+  for (const auto &t : tiles) {
+    area += t.width * t.height;
+  }
+  REQUIRE(area == 70 * 40);
+}
+
+TEST_CASE("Splitting regions of an image into tiles", "[Canvas]") {
+  REQUIRE(RT::clipTile(RT::Tile{-5, 30, 20, 20}, 70, 40) ==
+          RT::Tile{0, 30, 15, 10});
+  REQUIRE(RT::clipTile(RT::Tile{80, 0, 5, 5}, 70, 40).width == 0);
+
+  const std::vector<RT::Tile> regions{{10, 5, 40, 10}, {60, 30, 20, 20}};
+  auto tiles = RT::splitTiles(regions, 70, 40, 32);
+  REQUIRE(tiles.size() == 3);
+  REQUIRE(tiles[0] == RT::Tile{10, 5, 32, 10});
+  REQUIRE(tiles[1] == RT::Tile{42, 5, 8, 10});
+  REQUIRE(tiles[2] == RT::Tile{60, 30, 10, 10});
+  REQUIRE(RT::boundingTile(tiles) == RT::Tile{10, 5, 60, 35});
+  REQUIRE(RT::boundingTile({}) == RT::Tile{0, 0, 0, 0});
+}
+
+TEST_CASE("Cropping a canvas", "[Canvas]") {
+  RT::Canvas c(10, 8);
+  c.writePixel(3, 2, RT::color(1, 0, 0));
+  c.writePixel(6, 5, RT::color(0, 1, 0));
+  auto cropped = c.crop(RT::Tile{3, 2, 4, 4});
+  REQUIRE(cropped.width == 4);
+  REQUIRE(cropped.height == 4);
+  REQUIRE(cropped.pixelAt(0, 0) == RT::color(1, 0, 0));
+  REQUIRE(cropped.pixelAt(3, 3) == RT::color(0, 1, 0));
+}
@@ -0,0 +1,97 @@
+#include "Checkpoint.hpp"
+#include "RenderFixture.hpp"
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Renders the tiles the checkpoint lacks, saving no more than keep of
+// them, as if the process had been killed after that.
+auto resumeRender(const RT::Camera &c, const RT::World &w,
+                  RT::Checkpoint &checkpoint, size_t keep) -> RT::Canvas {
+  RT::RenderOptions options;
+  options.tileSize = 8;
+  options.regions = checkpoint.missing(RT::splitTiles(c.hsize, c.vsize, 8));
+  std::atomic<size_t> saved{0};
+  options.onPixels = [&](const RT::Tile &tile,
+                         const std::vector<RT::Color> &pixels) {
+    if (saved.fetch_add(1) < keep) {
+      checkpoint.save(tile, pixels);
+    }
+  };
+  auto image = c.render(w, options);
+  checkpoint.restore(image);
+  return image;
+}
+
+} // namespace
+
+TEST_CASE("A resumed render matches an uninterrupted one", "[Checkpoint]") {
+  RT::World w;
+  auto c = testCamera(48, 32);
+  auto full = c.render(w);
+  {
+    RT::Checkpoint checkpoint("resume.ckpt", c.hsize, c.vsize, 7, false);
+    REQUIRE(checkpoint.tiles().empty());
+    resumeRender(c, w, checkpoint, 10);
+  }
+  RT::Checkpoint checkpoint("resume.ckpt", c.hsize, c.vsize, 7, true);
+  REQUIRE(checkpoint.tiles().size() == 10);
+  REQUIRE(checkpoint.missing(RT::splitTiles(c.hsize, c.vsize, 8)).size() ==
+          14);
+  requireIdentical(resumeRender(c, w, checkpoint, 24), full);
+
+  RT::Checkpoint finished("resume.ckpt", c.hsize, c.vsize, 7, true);
+  REQUIRE(finished.tiles().size() == 24);
+  RT::Canvas restored(c.hsize, c.vsize);
+  finished.restore(restored);
+  requireIdentical(restored, full);
+  RT::Canvas cropped(16, 8);
+  finished.restore(cropped, RT::Tile{8, 16, 16, 8});
+  requireIdentical(cropped, full.crop(RT::Tile{8, 16, 16, 8}));
+}
+
+TEST_CASE("A record cut short by a crash is dropped", "[Checkpoint]") {
+  RT::World w;
+  auto c = testCamera(48, 32);
+  {
+    RT::Checkpoint checkpoint("torn.ckpt", c.hsize, c.vsize, 7, false);
+    resumeRender(c, w, checkpoint, 3);
+  }
+  {
+    std::ofstream file("torn.ckpt", std::ios::binary | std::ios::app);
+    const std::vector<int32_t> partial{0, 0, 8, 8, 12345};
+    file.write(reinterpret_cast<const char *>(partial.data()),
+               static_cast<std::streamsize>(partial.size() * 4));
+  }
+  {
+    RT::Checkpoint checkpoint("torn.ckpt", c.hsize, c.vsize, 7, true);
+    REQUIRE(checkpoint.tiles().size() == 3);
+    resumeRender(c, w, checkpoint, 2);
+  }
+  RT::Checkpoint checkpoint("torn.ckpt", c.hsize, c.vsize, 7, true);
+  REQUIRE(checkpoint.tiles().size() == 5);
+}
+
+TEST_CASE("A checkpoint only resumes the render it was written for",
+          "[Checkpoint]") {
+  {
+    RT::Checkpoint checkpoint("other.ckpt", 16, 16, 1, false);
+    checkpoint.save(RT::Tile{0, 0, 1, 1}, {RT::color(1, 0, 0)});
+  }
+  REQUIRE_THROWS_AS(RT::Checkpoint("other.ckpt", 16, 16, 2, true),
+                    std::runtime_error);
+  REQUIRE_THROWS_AS(RT::Checkpoint("other.ckpt", 16, 8, 1, true),
+                    std::runtime_error);
+  {
+    std::ofstream file("other.ckpt", std::ios::binary);
+    file << "P3\n2 2\n255\n0 0 0 0 0 0\n0 0 0 0 0 0\n";
+  }
+  REQUIRE_THROWS_AS(RT::Checkpoint("other.ckpt", 16, 16, 1, true),
+                    std::runtime_error);
+  RT::Checkpoint fresh("other.ckpt", 16, 16, 2, false);
+  REQUIRE(fresh.tiles().empty());
+}
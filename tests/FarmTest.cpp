@@ -0,0 +1,196 @@
+#include "Farm.hpp"
+#include "RenderFixture.hpp"
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+auto tileRenderer(const RT::Camera &c, const RT::World &w)
+    -> RT::TileRenderer {
+  return [&c, &w](const RT::Tile &tile, std::vector<RT::Color> &pixels) {
+    for (auto y = 0; y < tile.height; y++) {
+      for (auto x = 0; x < tile.width; x++) {
+        pixels[static_cast<size_t>(y) * tile.width + x] =
+            w.colorAt(c.rayForPixel(tile.x + x, tile.y + y));
+      }
+    }
+  };
+}
+
+auto socketPath(const std::string &name) -> std::string {
+  return "unix:/tmp/rt-farm-test-" + name + "-" + std::to_string(getpid()) +
+         ".sock";
+}
+
+} // namespace
+
+TEST_CASE("Parsing farm endpoints", "[Farm]") {
+  auto u = RT::Endpoint::parse("unix:/tmp/rt.sock");
+  REQUIRE(u.kind == RT::Endpoint::Kind::Unix);
+  REQUIRE(u.address == "/tmp/rt.sock");
+  auto t = RT::Endpoint::parse("tcp:127.0.0.1:9000");
+  REQUIRE(t.kind == RT::Endpoint::Kind::Tcp);
+  REQUIRE(t.address == "127.0.0.1");
+  REQUIRE(t.port == 9000);
+  REQUIRE(t.str() == "tcp:127.0.0.1:9000");
+  REQUIRE(RT::Endpoint::parse("localhost:80").kind == RT::Endpoint::Kind::Tcp);
+}
+
+TEST_CASE("A farm of workers renders the same image as the camera",
+          "[Farm]") {
+  RT::World w;
+  auto c = testCamera(40, 30);
+  auto render = tileRenderer(c, w);
+  RT::Coordinator coordinator(socketPath("unix"));
+  std::vector<std::thread> workers;
+  for (auto i = 0; i < 3; i++) {
+    workers.emplace_back([&] { RT::runWorker(coordinator.endpoint(), render); });
+  }
+  RT::Canvas image(c.hsize, c.vsize);
+  coordinator.render(image, RT::splitTiles(c.hsize, c.vsize, 8));
+  coordinator.shutdown();
+  for (auto &t : workers) {
+    t.join();
+  }
+  REQUIRE(coordinator.reassigned() == 0);
+  requireIdentical(image, c.render(w));
+}
+
+TEST_CASE("A farm renders regions into a cropped canvas", "[Farm]") {
+  RT::World w;
+  auto c = testCamera(40, 30);
+  auto render = tileRenderer(c, w);
+  RT::Coordinator coordinator(socketPath("crop"));
+  std::thread worker([&] { RT::runWorker(coordinator.endpoint(), render); });
+  auto tiles = RT::splitTiles({{6, 4, 10, 9}, {20, 15, 30, 30}}, c.hsize,
+                              c.vsize, 8);
+  auto window = RT::boundingTile(tiles);
+  REQUIRE(window == RT::Tile{6, 4, 34, 26});
+  RT::Canvas image(window.width, window.height);
+  coordinator.render(image, tiles, window);
+  coordinator.shutdown();
+  worker.join();
+  RT::RenderOptions options;
+  options.regions = {{6, 4, 10, 9}, {20, 15, 30, 30}};
+  options.crop = true;
+  requireIdentical(image, c.render(w, options));
+}
+
+TEST_CASE("Tiles held by a worker that dies are reassigned", "[Farm]") {
+  RT::World w;
+  auto c = testCamera(40, 30);
+  auto render = tileRenderer(c, w);
+  RT::Coordinator coordinator(socketPath("dying"));
+  std::atomic<bool> lost = false;
+  std::thread dying([&] {
+    try {
+      RT::runWorker(coordinator.endpoint(),
+                    [&](const RT::Tile &, std::vector<RT::Color> &) {
+                      lost = true;
+                      throw std::runtime_error("worker lost");
+                    });
+    } catch (const std::runtime_error &) {
+    }
+  });
+  std::thread healthy([&] {
+    RT::runWorker(coordinator.endpoint(),
+                  [&](const RT::Tile &tile, std::vector<RT::Color> &pixels) {
+                    while (!lost) {
+                      std::this_thread::yield();
+                    }
+                    render(tile, pixels);
+                  });
+  });
+  RT::Canvas image(c.hsize, c.vsize);
+  coordinator.render(image, RT::splitTiles(c.hsize, c.vsize, 8));
+  coordinator.shutdown();
+  healthy.join();
+  dying.join();
+  REQUIRE(coordinator.reassigned() > 0);
+  requireIdentical(image, c.render(w));
+}
+
+TEST_CASE("Workers can connect over TCP on localhost", "[Farm]") {
+  RT::World w;
+  auto c = testCamera(40, 30);
+  auto render = tileRenderer(c, w);
+  RT::Coordinator coordinator("tcp:127.0.0.1:0");
+  REQUIRE(RT::Endpoint::parse(coordinator.endpoint()).port != 0);
+  std::thread worker([&] { RT::runWorker(coordinator.endpoint(), render); });
+  RT::Canvas image(c.hsize, c.vsize);
+  coordinator.render(image, RT::splitTiles(c.hsize, c.vsize));
+  coordinator.shutdown();
+  worker.join();
+  REQUIRE(coordinator.workerCount() == 0);
+  requireIdentical(image, c.render(w));
+}
+
+TEST_CASE("Workers rendering a different image are turned away", "[Farm]") {
+  RT::World w;
+  auto c = testCamera(40, 30);
+  auto render = tileRenderer(c, w);
+  RT::Coordinator coordinator(socketPath("hello"), 7);
+  std::atomic<bool> refused = false;
+  std::atomic<size_t> strayTiles = 0;
+  std::thread stray([&] {
+    try {
+      RT::runWorker(coordinator.endpoint(),
+                    [&](const RT::Tile &, std::vector<RT::Color> &) {
+                      strayTiles++;
+                    },
+                    8);
+    } catch (const std::runtime_error &) {
+      refused = true;
+    }
+  });
+  std::thread matching([&] {
+    while (!refused) {
+      std::this_thread::yield();
+    }
+    RT::runWorker(coordinator.endpoint(), render, 7);
+  });
+  RT::Canvas image(c.hsize, c.vsize);
+  coordinator.render(image, RT::splitTiles(c.hsize, c.vsize, 8));
+  coordinator.shutdown();
+  matching.join();
+  stray.join();
+  REQUIRE(strayTiles == 0);
+  requireIdentical(image, c.render(w));
+}
+
+TEST_CASE("Tiles held by a hung worker are reassigned", "[Farm]") {
+  RT::World w;
+  auto c = testCamera(40, 30);
+  auto render = tileRenderer(c, w);
+  RT::Coordinator coordinator(socketPath("hung"), 0,
+                              std::chrono::milliseconds(200));
+  std::atomic<bool> hung = false;
+  std::atomic<bool> released = false;
+  std::thread stuck([&] {
+    RT::runWorker(coordinator.endpoint(),
+                  [&](const RT::Tile &, std::vector<RT::Color> &) {
+                    hung = true;
+                    while (!released) {
+                      std::this_thread::yield();
+                    }
+                  });
+  });
+  std::thread healthy([&] {
+    while (!hung) {
+      std::this_thread::yield();
+    }
+    RT::runWorker(coordinator.endpoint(), render);
+  });
+  RT::Canvas image(c.hsize, c.vsize);
+  coordinator.render(image, RT::splitTiles(c.hsize, c.vsize, 8));
+  released = true;
+  coordinator.shutdown();
+  healthy.join();
+  stuck.join();
+  REQUIRE(coordinator.reassigned() > 0);
+  requireIdentical(image, c.render(w));
+}
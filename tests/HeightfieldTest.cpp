@@ -0,0 +1,157 @@
+#include "Heightfield.hpp"
+#include "Matrix.hpp"
+#include "Ray.hpp"
+#include "Util.hpp"
+#include "World.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Samples of h(x, z) on a width x depth grid over the unit square.
+template <typename F>
+auto sampleGrid(int width, int depth, F h) -> std::vector<float> {
+  std::vector<float> samples;
+  for (auto z = 0; z < depth; z++) {
+    for (auto x = 0; x < width; x++) {
+      samples.push_back(static_cast<float>(
+          h(static_cast<double>(x) / (width - 1),
+            static_cast<double>(z) / (depth - 1))));
+    }
+  }
+  return samples;
+}
+
+auto tilted(double x, double z) -> double { return 0.25 + 0.5 * x - 0.25 * z; }
+
+} // namespace
+
+TEST_CASE("Converting between float and float16", "[Heightfield]") {
+  for (auto value : {0.0F, 1.0F, -2.5F, 0.333251953125F, 65504.0F,
+                     6.103515625e-05F, 5.9604644775390625e-08F}) {
+    REQUIRE(RT::halfToFloat(RT::floatToHalf(value)) == value);
+  }
+  REQUIRE(RT::floatToHalf(1.0F) == 0x3C00);
+  REQUIRE(RT::floatToHalf(-2.0F) == 0xC000);
+  REQUIRE(std::isinf(RT::halfToFloat(RT::floatToHalf(1e6F))));
+  // 1 + 2^-11 lies halfway between two halves and rounds to the even one.
+  REQUIRE(RT::floatToHalf(1.00048828125F) == 0x3C00);
+}
+
+TEST_CASE("Elevation grids in memory and memory mapped", "[Heightfield]") {
+  auto samples = sampleGrid(5, 3, tilted);
+  auto grid32 = RT::ElevationGrid::fromSamples(5, 3, samples);
+  auto grid16 = RT::ElevationGrid::fromSamples(5, 3, samples,
+                                               RT::ElevationFormat::Float16);
+  REQUIRE(grid32->bytes() == 60);
+  REQUIRE(grid16->bytes() == 30);
+  REQUIRE(grid32->at(4, 2) == samples[14]);
+  REQUIRE(std::abs(grid16->at(4, 2) - samples[14]) < 1e-3);
+
+  std::vector<uint16_t> halves;
+  for (auto s : samples) {
+    halves.push_back(RT::floatToHalf(s));
+  }
+  {
+    std::ofstream file("heightfield.r16", std::ios::binary);
+    file.write("HDR!", 4);
+    file.write(reinterpret_cast<const char *>(halves.data()),
+               static_cast<std::streamsize>(halves.size() * 2));
+  }
+  auto mapped = RT::ElevationGrid::map("heightfield.r16", 5, 3,
+                                       RT::ElevationFormat::Float16, 4);
+  REQUIRE(mapped->at(3, 1) == grid16->at(3, 1));
+  REQUIRE_THROWS(RT::ElevationGrid::map("heightfield.r16", 5, 4,
+                                        RT::ElevationFormat::Float16, 4));
+  REQUIRE_THROWS(RT::ElevationGrid::fromSamples(1, 3, {1, 2, 3}));
+}
+
+TEST_CASE("A heightfield's bounds and pyramid", "[Heightfield]") {
+  auto grid = RT::ElevationGrid::fromSamples(
+      33, 17, sampleGrid(33, 17, tilted));
+  RT::Heightfield field(grid);
+  // Leaves cover 4x4 cells: 8x4 leaves, then 4x2, 2x1 and 1x1.
+  REQUIRE(field.pyramidLevels() == 4);
+  auto box = field.bounds();
+  REQUIRE(box.min == RT::point(0, 0, 0));
+  REQUIRE(box.max == RT::point(1, 0.75, 1));
+}
+
+TEST_CASE("Rays hit a planar heightfield where the plane is",
+          "[Heightfield]") {
+  const int size = 65;
+  RT::Heightfield field(RT::ElevationGrid::fromSamples(
+      size, size, sampleGrid(size, size, tilted)));
+  for (auto x = 0.05; x < 0.8; x += 0.13) {
+    for (auto z = 0.07; z < 0.9; z += 0.17) {
+      RT::Ray down(RT::point(x, 2, z), RT::vector(0.1, -1, 0.05));
+      auto xs = field.localIntersect(down);
+      REQUIRE(xs.size() == 1);
+      auto p = down.position(xs[0].first);
+      REQUIRE(RT::approxEqual(p.y, tilted(p.x, p.z)));
+      REQUIRE(field.localNormalAt(p).norm() ==
+              RT::vector(-0.5, 1, 0.25).norm());
+    }
+  }
+  RT::Ray above(RT::point(-1, 1, 0.5), RT::vector(1, 0, 0));
+  REQUIRE(field.localIntersect(above).empty());
+  RT::Ray outside(RT::point(2, 2, 2), RT::vector(0, -1, 0));
+  REQUIRE(field.localIntersect(outside).empty());
+}
+
+TEST_CASE("A ray through a ridge crosses it twice", "[Heightfield]") {
+  auto ridge = [](double x, double /*z*/) {
+    return std::max(0.0, 0.5 - 4 * std::abs(x - 0.5));
+  };
+  RT::Heightfield field(RT::ElevationGrid::fromSamples(
+      129, 9, sampleGrid(129, 9, ridge), RT::ElevationFormat::Float16));
+  RT::Ray r(RT::point(0, 0.25, 0.45), RT::vector(1, 0, 0));
+  auto xs = field.localIntersect(r);
+  REQUIRE(xs.size() == 2);
+  REQUIRE(std::abs(xs[0].first - 0.4375) < 1e-3);
+  REQUIRE(std::abs(xs[1].first - 0.5625) < 1e-3);
+  std::vector<RT::Intersection> scratch;
+  REQUIRE(field.occludes(r, 0.5, scratch));
+  REQUIRE_FALSE(field.occludes(r, 0.4, scratch));
+  REQUIRE_FALSE(field.occludes(RT::Ray(RT::point(0.7, 0.25, 0.45),
+                                       RT::vector(1, 0, 0)),
+                               10, scratch));
+}
+
+TEST_CASE("Heightfield normals are smooth across cells", "[Heightfield]") {
+  auto bowl = [](double x, double z) {
+    return (x - 0.5) * (x - 0.5) + (z - 0.5) * (z - 0.5);
+  };
+  RT::Heightfield field(RT::ElevationGrid::fromSamples(
+      17, 17, sampleGrid(17, 17, bowl)));
+  auto exact = [](double x, double z) {
+    return RT::vector(-2 * (x - 0.5), 1, -2 * (z - 0.5)).norm();
+  };
+  // Normals vary continuously over a cell edge rather than per facet.
+  auto a = field.localNormalAt(RT::point(0.25 - 1e-6, 0, 0.3)).norm();
+  auto b = field.localNormalAt(RT::point(0.25 + 1e-6, 0, 0.3)).norm();
+  REQUIRE(a == b);
+  REQUIRE(field.localNormalAt(RT::point(0.25, 0, 0.375)).norm() ==
+          exact(0.25, 0.375));
+}
+
+TEST_CASE("A transformed heightfield in a world", "[Heightfield]") {
+  RT::World w(false);
+  w.lights.emplace_back(RT::point(0, 10, 0), RT::color(1, 1, 1));
+  auto field = std::make_unique<RT::Heightfield>(RT::ElevationGrid::fromSamples(
+      9, 9, sampleGrid(9, 9, tilted)));
+  field->transformation = RT::translation(-5, 0, -5) * RT::scaling(10, 2, 10);
+  w.add(std::move(field));
+  auto xs = w.intersect(RT::Ray(RT::point(0, 5, 0), RT::vector(0, -1, 0)));
+  REQUIRE(xs.size() == 1);
+  REQUIRE(RT::approxEqual(xs[0].first, 5 - 2 * tilted(0.5, 0.5)));
+  REQUIRE(!w.isShadowed(RT::point(0, 2 * tilted(0.5, 0.5) + 0.01, 0),
+                        w.lights[0]));
+  REQUIRE(w.isShadowed(RT::point(0, -1, 0), w.lights[0]));
+}
@@ -0,0 +1,126 @@
+#include "LightTree.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include <cmath>
+#include <vector>
+
+namespace {
+
+auto gridOfLights() -> std::vector<RT::Light> {
+  std::vector<RT::Light> lights;
+  for (auto i = 0; i < 10; i++) {
+    for (auto j = 0; j < 10; j++) {
+      auto y = (i + j) % 3 == 0 ? -4.0 : 5.0 + j;
+      lights.emplace_back(RT::point(i * 3 - 15, y, j * 2 - 10),
+                          RT::color(0.1 * (i + 1), 0.05 * (j + 1), 0.2));
+    }
+  }
+  return lights;
+}
+
+} // namespace
+
+TEST_CASE("A light tree has one leaf per light", "[LightTree]") {
+  auto lights = gridOfLights();
+  RT::LightTree tree(lights);
+  REQUIRE(tree.lightCount() == lights.size());
+  REQUIRE(tree.nodes.size() == 2 * lights.size() - 1);
+  for (size_t l = 0; l < lights.size(); l++) {
+    const auto &leaf = tree.nodes[tree.leaves[l]];
+    REQUIRE(leaf.light == static_cast<int>(l));
+    REQUIRE(leaf.bounds.contains(lights[l].position));
+  }
+  auto total = RT::color(0, 0, 0);
+  for (const auto &light : lights) {
+    total = total + light.intensity;
+  }
+  REQUIRE(tree.totalIntensity == total);
+  REQUIRE(tree.nodes[0].intensity == total);
+}
+
+TEST_CASE("Lights behind the surface are never chosen", "[LightTree]") {
+  auto lights = gridOfLights();
+  RT::LightTree tree(lights);
+  auto p = RT::point(0, 0, 0);
+  auto n = RT::vector(0, 1, 0);
+  RT::Real sum = 0;
+  for (size_t l = 0; l < lights.size(); l++) {
+    auto pdf = tree.probability(p, n, 0, l);
+    if (lights[l].position.y < 0) {
+      REQUIRE(pdf == 0);
+    } else {
+      REQUIRE(pdf > 0);
+    }
+    sum += pdf;
+  }
+  REQUIRE(RT::approxEqual(sum, 1));
+  std::vector<size_t> front;
+  REQUIRE(tree.collect(p, n, 0, lights.size(), front));
+  for (auto l : front) {
+    REQUIRE(lights[l].position.y > 0);
+  }
+  REQUIRE(!tree.collect(p, n, 0, 3, front));
+}
+
+TEST_CASE("Sampling a light reports its probability", "[LightTree]") {
+  auto lights = gridOfLights();
+  RT::LightTree tree(lights);
+  auto p = RT::point(1, 0.5, -2);
+  auto n = RT::vector(0.6, 0.8, 0);
+  for (auto i = 0; i < 50; i++) {
+    auto chosen = tree.sample(p, n, 0, (i + 0.5) / 50);
+    REQUIRE(chosen.has_value());
+    auto [light, pdf] = chosen.value();
+    REQUIRE(RT::approxEqual(pdf, tree.probability(p, n, 0, light)));
+  }
+}
+
+TEST_CASE("The sampled light estimate is unbiased", "[LightTree]") {
+  auto lights = gridOfLights();
+  RT::LightTree tree(lights);
+  auto p = RT::point(-2, 0, 3);
+  auto n = RT::vector(0, 1, 0);
+  auto contribution = [&](size_t l) {
+    auto toLight = (lights[l].position - p).norm();
+    return std::max(RT::dot(toLight, n), RT::Real{0}) *
+           lights[l].intensity.red;
+  };
+  RT::Real exact = 0;
+  for (size_t l = 0; l < lights.size(); l++) {
+    exact += contribution(l);
+  }
+  const auto samples = 20000;
+  RT::Real estimate = 0;
+  for (auto i = 0; i < samples; i++) {
+    auto chosen = tree.sample(p, n, 0, (i + 0.5) / samples);
+    auto [light, pdf] = chosen.value();
+    estimate += contribution(light) / pdf;
+  }
+  estimate /= samples;
+  REQUIRE(std::abs(estimate - exact) < exact * 0.01);
+}
+
+TEST_CASE("A threshold culls dim lights", "[LightTree]") {
+  std::vector<RT::Light> lights{
+      RT::Light(RT::point(0, 5, 0), RT::color(1, 1, 1)),
+      RT::Light(RT::point(3, 5, 0), RT::color(0.01, 0.01, 0.01)),
+      RT::Light(RT::point(-3, 5, 1), RT::color(0.5, 0.5, 0.5))};
+  RT::LightTree tree(lights);
+  auto p = RT::point(0, 0, 0);
+  auto n = RT::vector(0, 1, 0);
+  REQUIRE(tree.probability(p, n, 0.1, 1) == 0);
+  REQUIRE(tree.probability(p, n, 0.1, 0) > 0);
+  std::vector<size_t> bright;
+  REQUIRE(tree.collect(p, n, 0.1, 3, bright));
+  REQUIRE(bright.size() == 2);
+}
+
+TEST_CASE("Shading uniforms are deterministic and in range", "[LightTree]") {
+  auto p = RT::point(0.5, -1.25, 3);
+  for (auto k = 0; k < 100; k++) {
+    auto u = RT::shadingUniform(p, k);
+    REQUIRE(u >= 0);
+    REQUIRE(u < 1);
+    REQUIRE(u == RT::shadingUniform(p, k));
+  }
+  REQUIRE(RT::shadingUniform(p, 0) != RT::shadingUniform(p, 1));
+}
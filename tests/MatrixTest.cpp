@@ -164,9 +164,9 @@ TEST_CASE("Calculating the inverse of a matrix", "[Matrix]") {
   RT::Matrix<4> b = a.inverse();
   REQUIRE(a.determinant() == 532);
   REQUIRE(a.cofactor(2, 3) == -160);
-  REQUIRE(b(3, 2) == -160.0 / 532);
+  REQUIRE(RT::approxEqual(b(3, 2), -160.0 / 532));
   REQUIRE(a.cofactor(3, 2) == 105);
-  REQUIRE(b(2, 3) == 105.0 / 532);
+  REQUIRE(RT::approxEqual(b(2, 3), 105.0 / 532));
   RT::Matrix<4> expected =
       RT::Matrix<4>({0.21805, 0.45113, 0.24060, -0.04511, -0.80827, -1.45677,
                      -0.44361, 0.52068, -0.07895, -0.22368, -0.05263, 0.19737,
@@ -0,0 +1,123 @@
+#include "Motion.hpp"
+#include "Camera.hpp"
+#include "Matrix.hpp"
+#include "World.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace {
+
+auto slidingSphere() -> std::unique_ptr<RT::Sphere> {
+  auto s = std::make_unique<RT::Sphere>();
+  s->material.color = RT::color(1, 0.2, 0.2);
+  s->motion = std::make_shared<RT::Motion>(RT::Pose{RT::vector(-2, 0, 0)},
+                                           RT::Pose{RT::vector(2, 0, 0)});
+  return s;
+}
+
+} // namespace
+
+TEST_CASE("A pose is inverted in closed form", "[Motion]") {
+  const std::vector<RT::Pose> poses{
+      RT::Pose{},
+      RT::Pose{RT::vector(1, 2, 3), RT::vector(0.3, -1.2, 2),
+               RT::vector(2, 0.5, 3)},
+      RT::Pose{RT::vector(-4, 0, 1), RT::vector(M_PI / 2, 0, M_PI / 4),
+               RT::vector(1, 1, 1)}};
+  for (const auto &p : poses) {
+    REQUIRE(p.inverse() == p.transform().inverse());
+  }
+}
+
+TEST_CASE("A motion interpolates poses between its keys", "[Motion]") {
+  RT::Motion m;
+  m.key(1, RT::Pose{RT::vector(0, 2, 0), RT::vector(0, M_PI, 0)});
+  m.key(0, RT::Pose{});
+  REQUIRE(m.pose(-1).translation == RT::vector(0, 0, 0));
+  REQUIRE(m.pose(0.5).translation == RT::vector(0, 1, 0));
+  REQUIRE(m.pose(0.5).rotation == RT::vector(0, M_PI / 2, 0));
+  REQUIRE(m.pose(3).translation == RT::vector(0, 2, 0));
+  REQUIRE(m.transformAt(0.5) == RT::translation(0, 1, 0) *
+                                    RT::rotationY(M_PI / 2));
+  REQUIRE(m.inverseAt(0.25) == m.transformAt(0.25).inverse());
+  REQUIRE(m.inverseAt(1) == m.transformAt(1).inverse());
+}
+
+TEST_CASE("A motion's sweep bounds the shape at every time", "[Motion]") {
+  RT::BoundingBox box(RT::point(-1, -1, -1), RT::point(1, 1, 1));
+  RT::Motion slide(RT::Pose{RT::vector(-2, 0, 0)},
+                   RT::Pose{RT::vector(2, 0, 0), RT::vector(0, 0, 0),
+                            RT::vector(1, 2, 1)});
+  auto swept = slide.sweep(box);
+  REQUIRE(swept.min == RT::point(-3, -2, -1));
+  REQUIRE(swept.max == RT::point(3, 2, 1));
+
+  RT::Motion spin;
+  spin.key(0, RT::Pose{RT::vector(0, 0, 0), RT::vector(0, 0, 0),
+                       RT::vector(3, 1, 1)});
+  spin.key(1, RT::Pose{RT::vector(1, 0, 0), RT::vector(0, M_PI / 2, 0),
+                       RT::vector(3, 1, 1)});
+  swept = spin.sweep(box).padded(EPSILON);
+  for (auto t = 0.0; t <= 1; t += 0.05) {
+    auto at = box.transform(spin.transformAt(t));
+    REQUIRE(swept.contains(at.min));
+    REQUIRE(swept.contains(at.max));
+  }
+}
+
+TEST_CASE("Rays meet a moving shape where it is at their time", "[Motion]") {
+  RT::World w(false);
+  auto id = w.add(slidingSphere());
+  RT::Ray late(RT::point(2, 0, -5), RT::vector(0, 0, 1), 1);
+  RT::Ray early(RT::point(2, 0, -5), RT::vector(0, 0, 1), 0);
+  REQUIRE(w.intersect(late).size() == 2);
+  REQUIRE(w.intersect(early).empty());
+  REQUIRE(RT::approxEqual(w.intersect(late)[0].first, 4.0));
+  REQUIRE(w.bounds(id).min.x < -2.9);
+  REQUIRE(w.bounds(id).max.x > 2.9);
+
+  auto xs = w.intersect(late);
+  RT::Computations comps(xs[0], late, xs);
+  REQUIRE(comps.time == 1);
+  REQUIRE(comps.normal == RT::vector(0, 0, -1));
+  REQUIRE(w.object(id).normalAt(RT::point(2, 1, 0), 1) ==
+          RT::vector(0, 1, 0));
+
+  w.lights.emplace_back(RT::point(2, 10, 0), RT::color(1, 1, 1));
+  REQUIRE(w.isShadowed(RT::point(2, -2, 0), w.lights[0], 1));
+  REQUIRE_FALSE(w.isShadowed(RT::point(2, -2, 0), w.lights[0], 0));
+}
+
+TEST_CASE("An open shutter blurs moving shapes only", "[Motion]") {
+  RT::World w(false);
+  w.lights.emplace_back(RT::point(-10, 10, -10), RT::color(1, 1, 1));
+  w.add(slidingSphere());
+  w.add(std::make_unique<RT::Sphere>(RT::translation(0, 2.5, 0),
+                                     RT::Material()));
+  RT::Camera c(40, 40, M_PI / 3);
+  c.transform = RT::viewTransform(RT::point(0, 0, -10), RT::point(0, 0, 0),
+                                  RT::vector(0, 1, 0));
+  auto still = c.render(w);
+  c.shutterClose = 1;
+  c.lensSamples = 32;
+  auto rays = c.rays();
+  REQUIRE(rays.multisampled());
+
+  // The sliding sphere covers the middle of the image only part of the
+  // time, so its color is diluted there.
+  auto middle = rays.ray(20, 20);
+  auto covered = w.colorAt(RT::Ray(middle.origin, middle.direction, 0.5));
+  auto blurred = RT::lensColor(w, rays, 20, 20);
+  REQUIRE(blurred.samples == c.lensSamples);
+  REQUIRE(still.pixelAt(20, 20) == RT::color(0, 0, 0));
+  REQUIRE(blurred.color.red > 0.1);
+  REQUIRE(blurred.color.red < covered.red - 0.1);
+
+  // The static sphere above it stays sharp and stops early.
+  auto sharp = RT::lensColor(w, rays, 20, 6);
+  REQUIRE(sharp.samples == RT::LENS_PILOT_SAMPLES);
+  REQUIRE(sharp.color == still.pixelAt(20, 6));
+  REQUIRE(c.render(w).pixelAt(20, 20) == blurred.color);
+}
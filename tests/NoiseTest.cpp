@@ -0,0 +1,72 @@
+#include "Noise.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include <cmath>
+#include <vector>
+
+TEST_CASE("Noise vanishes on the integer lattice", "[Noise]") {
+  REQUIRE(RT::perlinNoise(0, 0, 0) == 0);
+  REQUIRE(RT::perlinNoise(3, -7, 12) == 0);
+  REQUIRE(RT::perlinNoise(-250, 100, 255) == 0);
+}
+
+TEST_CASE("Noise is bounded and not constant", "[Noise]") {
+  RT::Real lowest = 1;
+  RT::Real highest = -1;
+  for (auto i = 0; i < 1000; i++) {
+    auto n = RT::perlinNoise(i * 0.173, i * 0.291, i * -0.057);
+    lowest = std::min(lowest, n);
+    highest = std::max(highest, n);
+  }
+  REQUIRE(lowest >= -1.05);
+  REQUIRE(highest <= 1.05);
+  REQUIRE(highest - lowest > 0.5);
+}
+
+TEST_CASE("Noise repeats every 256 units", "[Noise]") {
+  auto n = RT::perlinNoise(0.3, 1.7, -2.2);
+  REQUIRE(RT::approxEqual(RT::perlinNoise(256.3, 1.7, -2.2), n));
+  REQUIRE(RT::approxEqual(RT::perlinNoise(0.3, -254.3, -2.2), n));
+}
+
+TEST_CASE("Batched noise matches noise at single points", "[Noise]") {
+  const size_t count = 100;
+  std::vector<RT::Real> x(count), y(count), z(count), out(count);
+  for (size_t i = 0; i < count; i++) {
+    x[i] = static_cast<RT::Real>(i) * 0.37 - 10;
+    y[i] = static_cast<RT::Real>(i) * -0.11 + 2;
+    z[i] = static_cast<RT::Real>(i) * 0.05;
+  }
+  RT::perlinNoise(count, x.data(), y.data(), z.data(), out.data());
+  for (size_t i = 0; i < count; i++) {
+    REQUIRE(out[i] == RT::perlinNoise(x[i], y[i], z[i]));
+  }
+}
+
+TEST_CASE("A single octave of fbm is plain noise", "[Noise]") {
+  RT::Real x = 0.4, y = -1.3, z = 2.6;
+  RT::Real fbm = 0;
+  RT::Real turbulence = 0;
+  RT::fbmNoise(1, &x, &y, &z, &fbm, 1);
+  RT::turbulenceNoise(1, &x, &y, &z, &turbulence, 1);
+  REQUIRE(fbm == RT::perlinNoise(x, y, z));
+  REQUIRE(turbulence == std::abs(RT::perlinNoise(x, y, z)));
+}
+
+TEST_CASE("Fbm and turbulence stay normalized", "[Noise]") {
+  const size_t count = 500;
+  std::vector<RT::Real> x(count), y(count), z(count), fbm(count),
+      turbulence(count);
+  for (size_t i = 0; i < count; i++) {
+    x[i] = static_cast<RT::Real>(i) * 0.093;
+    y[i] = static_cast<RT::Real>(i) * 0.041 - 3;
+    z[i] = static_cast<RT::Real>(i) * -0.077;
+  }
+  RT::fbmNoise(count, x.data(), y.data(), z.data(), fbm.data(), 6);
+  RT::turbulenceNoise(count, x.data(), y.data(), z.data(), turbulence.data(),
+                      6);
+  for (size_t i = 0; i < count; i++) {
+    REQUIRE(std::abs(fbm[i]) <= 1.05);
+    REQUIRE(turbulence[i] >= 0);
+    REQUIRE(turbulence[i] <= 1.05);
+  }
+}
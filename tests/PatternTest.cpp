@@ -2,6 +2,7 @@
 #include "Light.hpp"
 #include "Shape.hpp"
 #include "catch2/catch_test_macros.hpp"
+#include <fstream>
 #include <memory>
 
 TEST_CASE("Creating a stripe pattern", "[Pattern]") {
@@ -166,3 +167,127 @@ TEST_CASE("Checkers should repeat in z", "[Pattern]") {
   REQUIRE(pattern.patternAt(RT::point(0, 0, 0.99)) == RT::color(1, 1, 1));
   REQUIRE(pattern.patternAt(RT::point(0, 0, 1.01)) == RT::color(0, 0, 0));
 }
+
+TEST_CASE("A compiled pattern combines object and pattern transformations",
+          "[Pattern]") {
+  RT::TestPattern pattern;
+  pattern.transformation = RT::translation(0.5, 1, 1.5);
+  RT::CompiledPattern compiled(pattern, RT::scaling(2, 2, 2));
+  REQUIRE(compiled.kernel.has_value());
+  REQUIRE(compiled.colorAt(RT::point(2.5, 3, 3.5)) ==
+          RT::color(0.75, 0.5, 0.25));
+}
+
+TEST_CASE("A compiled pattern is stale once its sources change", "[Pattern]") {
+  RT::StripePattern pattern;
+  auto object = RT::translation(1, 0, 0);
+  RT::CompiledPattern compiled(pattern, object);
+  REQUIRE(compiled.isCurrent(&pattern, object));
+  REQUIRE(!compiled.isCurrent(&pattern, RT::translation(2, 0, 0)));
+  pattern.transformation = RT::scaling(2, 2, 2);
+  REQUIRE(!compiled.isCurrent(&pattern, object));
+
+  RT::StripePattern edited;
+  RT::CompiledPattern before(edited, object);
+  edited.a = RT::color(1, 0, 0);
+  REQUIRE(!before.isCurrent(&edited, object));
+  RT::StripePattern inner;
+  RT::PerturbPattern perturbed(inner);
+  RT::CompiledPattern wrapped(perturbed, object);
+  REQUIRE(wrapped.isCurrent(&perturbed, object));
+  std::static_pointer_cast<RT::StripePattern>(perturbed.pattern)->b =
+      RT::color(0, 0, 1);
+  REQUIRE(!wrapped.isCurrent(&perturbed, object));
+}
+
+TEST_CASE("Evaluating a pattern for many points at once", "[Pattern]") {
+  RT::CheckersPattern checkers(RT::color(1, 0.5, 0), RT::color(0, 0.5, 1));
+  RT::RingPattern rings(RT::color(0.2, 0.4, 0.6), RT::color(0, 0, 0));
+  RT::GradientPattern gradient(RT::color(1, 0, 0), RT::color(0, 0, 1));
+  std::vector<std::unique_ptr<RT::Pattern>> patterns;
+  patterns.push_back(checkers.clone());
+  patterns.push_back(rings.clone());
+  patterns.push_back(gradient.clone());
+  patterns.push_back(
+      RT::FbmPattern(RT::color(1, 1, 1), RT::color(0.2, 0.1, 0), 5).clone());
+  patterns.push_back(
+      RT::TurbulencePattern(RT::color(0, 0, 0), RT::color(0.9, 0.8, 1))
+          .clone());
+  patterns.push_back(RT::PerturbPattern(rings, 0.5).clone());
+  for (const auto &pattern : patterns) {
+    pattern->transformation = RT::rotationY(0.3) * RT::scaling(0.7, 0.7, 0.7);
+    RT::CompiledPattern compiled(*pattern, RT::translation(0.25, 0, -1));
+    const size_t count = 150;
+    std::vector<RT::Real> x(count), y(count), z(count), r(count), g(count),
+        b(count);
+    for (size_t i = 0; i < count; i++) {
+      x[i] = -3 + 0.043 * i;
+      y[i] = 0.5 - 0.011 * i;
+      z[i] = 2 - 0.027 * i;
+    }
+    compiled.colorsAt(count, x.data(), y.data(), z.data(), r.data(), g.data(),
+                      b.data());
+    RT::Sphere s;
+    s.transformation = RT::translation(0.25, 0, -1);
+    s.material.pattern = pattern->clone();
+    for (size_t i = 0; i < count; i++) {
+      REQUIRE(RT::color(r[i], g[i], b[i]) ==
+              s.patternAt(RT::point(x[i], y[i], z[i])));
+    }
+  }
+}
+
+TEST_CASE("Noise patterns blend between their two colors", "[Pattern]") {
+  RT::NoisePattern noise(RT::color(1, 0, 0), RT::color(0, 0, 1));
+  REQUIRE(noise.patternAt(RT::point(2, -3, 4)) == RT::color(0.5, 0, 0.5));
+  RT::TurbulencePattern turbulence(RT::color(1, 0, 0), RT::color(0, 0, 1));
+  REQUIRE(turbulence.patternAt(RT::point(2, -3, 4)) == RT::color(1, 0, 0));
+  for (auto i = 0; i < 50; i++) {
+    auto c = noise.patternAt(RT::point(i * 0.31, i * 0.17, i * -0.23));
+    REQUIRE(c.red >= 0);
+    REQUIRE(c.blue >= 0);
+    REQUIRE(RT::approxEqual(c.red + c.blue, 1));
+  }
+}
+
+TEST_CASE("A perturbed pattern jitters the points it looks up", "[Pattern]") {
+  RT::StripePattern stripes;
+  stripes.transformation = RT::scaling(0.5, 1, 1);
+  RT::PerturbPattern still(stripes, 0);
+  RT::PerturbPattern jittered(stripes, 1);
+  auto differences = 0;
+  for (auto i = 0; i < 100; i++) {
+    auto p = RT::point(i * 0.049, i * 0.31, i * -0.13);
+    REQUIRE(still.patternAt(p) == stripes.patternAt(RT::scaling(2, 1, 1) * p));
+    if (!(jittered.patternAt(p) == still.patternAt(p))) {
+      differences++;
+    }
+  }
+  REQUIRE(differences > 0);
+}
+
+TEST_CASE("Cloning a perturbed pattern copies the wrapped pattern",
+          "[Pattern]") {
+  RT::PerturbPattern perturbed(RT::StripePattern(), 0);
+  auto copy = perturbed.clone();
+  perturbed.pattern->transformation = RT::translation(1, 0, 0);
+  REQUIRE(copy->patternAt(RT::point(0.5, 0, 0)) == RT::color(1, 1, 1));
+  REQUIRE(perturbed.patternAt(RT::point(0.5, 0, 0)) == RT::color(0, 0, 0));
+}
+
+TEST_CASE("An image pattern looks points up through a UV mapping",
+          "[Pattern]") {
+  {
+    std::ofstream file("pattern_image.ppm");
+    file << "P3\n2 1\n255\n255 0 0 0 0 255\n";
+  }
+  auto texture = RT::Texture::load("pattern_image.ppm");
+  RT::ImagePattern planar(texture, RT::UVMapping::Planar,
+                          RT::TextureFilter::Nearest);
+  REQUIRE(planar.patternAt(RT::point(0.2, 0, 0.5)) == RT::color(1, 0, 0));
+  REQUIRE(planar.patternAt(RT::point(1.7, 3, 0.5)) == RT::color(0, 0, 1));
+  RT::ImagePattern spherical(texture, RT::UVMapping::Spherical,
+                             RT::TextureFilter::Nearest);
+  REQUIRE(spherical.patternAt(RT::point(1, 0, 0)) == RT::color(1, 0, 0));
+  REQUIRE(spherical.patternAt(RT::point(-1, 0, 0)) == RT::color(0, 0, 1));
+}
@@ -0,0 +1,67 @@
+#include "PerfCounters.hpp"
+#include "Parallel.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <sstream>
+#include <vector>
+
+TEST_CASE("Regions record nothing while counters are disabled", "[Perf]") {
+  RT::PerfCounters::reset();
+  RT::PerfCounters::disable();
+  { const RT::PerfScope scope(RT::PerfRegion::Shading); }
+  REQUIRE(RT::PerfCounters::counts(RT::PerfRegion::Shading).calls == 0);
+}
+
+TEST_CASE("Regions record calls and time while enabled", "[Perf]") {
+  RT::PerfCounters::reset();
+  RT::PerfCounters::enable();
+  volatile double sink = 0;
+  for (auto i = 0; i < 3; i++) {
+    const RT::PerfScope scope(RT::PerfRegion::Intersection);
+    for (auto j = 0; j < 100000; j++) {
+      sink = sink + j * 0.5;
+    }
+  }
+  RT::PerfCounters::disable();
+  auto c = RT::PerfCounters::counts(RT::PerfRegion::Intersection);
+  REQUIRE(c.calls == 3);
+  REQUIRE(c.nanoseconds > 0);
+  if (RT::PerfCounters::hardwareAvailable()) {
+    REQUIRE(c.instructions > 300000);
+    REQUIRE(c.ipc() > 0);
+  } else {
+    REQUIRE(c.instructions == 0);
+  }
+  std::ostringstream out;
+  RT::PerfCounters::report(out);
+  REQUIRE(out.str().find("intersection") != std::string::npos);
+  REQUIRE(out.str().find("shading") == std::string::npos);
+}
+
+TEST_CASE("Pool threads count towards the region their loop started in",
+          "[Perf]") {
+  RT::PerfCounters::reset();
+  RT::PerfCounters::enable();
+  REQUIRE_FALSE(RT::PerfCounters::openRegion().has_value());
+  std::vector<double> sums(8);
+  for (auto pass = 0; pass < 2; pass++) {
+    const RT::PerfScope scope(RT::PerfRegion::Shadows);
+    REQUIRE(RT::PerfCounters::openRegion() == RT::PerfRegion::Shadows);
+    RT::parallelFor(
+        sums.size(),
+        [&](size_t i) {
+          volatile double sink = 0;
+          for (auto j = 0; j < 100000; j++) {
+            sink = sink + j * 0.5;
+          }
+          sums[i] = sink;
+        },
+        4, 1);
+  }
+  RT::PerfCounters::disable();
+  REQUIRE_FALSE(RT::PerfCounters::openRegion().has_value());
+  auto c = RT::PerfCounters::counts(RT::PerfRegion::Shadows);
+  REQUIRE(c.calls == 2);
+  if (RT::PerfCounters::hardwareAvailable()) {
+    REQUIRE(c.instructions > 2 * 8 * 100000);
+  }
+}
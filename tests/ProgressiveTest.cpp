@@ -0,0 +1,76 @@
+#include "Progressive.hpp"
+#include "RenderFixture.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+
+TEST_CASE("A sample buffer averages samples and estimates their error",
+          "[Progressive]") {
+  RT::SampleBuffer b(8, 8);
+  REQUIRE(b.samples(1, 1) == 0);
+  b.add(1, 1, RT::color(1, 1, 1));
+  b.add(1, 1, RT::color(0, 0, 0));
+  REQUIRE(b.samples(1, 1) == 2);
+  REQUIRE(b.mean(1, 1) == RT::color(0.5, 0.5, 0.5));
+  REQUIRE(RT::approxEqual(b.error(1, 1), 0.25));
+
+  // A lone sample is judged by the steps to its neighbours.
+  b.add(2, 1, RT::color(0.5, 0.5, 0.5));
+  b.add(3, 1, RT::color(0.5, 0.5, 0.5));
+  b.add(4, 1, RT::color(1, 1, 1));
+  REQUIRE(RT::approxEqual(b.error(2, 1), 0.0));
+  REQUIRE(RT::approxEqual(b.error(3, 1), 0.25));
+
+  // Pixels without samples show their preview block.
+  b.add(4, 4, RT::color(0, 0, 1));
+  auto image = b.image();
+  REQUIRE(image.pixelAt(7, 7) == RT::color(0, 0, 1));
+  REQUIRE(image.pixelAt(1, 1) == RT::color(0.5, 0.5, 0.5));
+}
+
+TEST_CASE("An expired budget still returns a complete image",
+          "[Progressive]") {
+  RT::World w;
+  auto c = testCamera(40, 30);
+  auto full = c.render(w);
+  auto result = RT::renderProgressive(c, w, std::chrono::seconds(0));
+  REQUIRE(result.report.passes == 1);
+  REQUIRE(result.report.minSamples == 0);
+  REQUIRE(result.report.maxSamples == 1);
+  REQUIRE(RT::approxEqual(result.report.samplesPerPixel,
+                          (10.0 * 8) / (40 * 30)));
+  for (auto y = 0; y < c.vsize; y++) {
+    for (auto x = 0; x < c.hsize; x++) {
+      REQUIRE(result.image.pixelAt(x, y) ==
+              full.pixelAt(x - x % 4, y - y % 4));
+    }
+  }
+}
+
+TEST_CASE("Refinement adds samples where the image changes",
+          "[Progressive]") {
+  RT::World w;
+  auto c = testCamera(40, 30);
+  auto full = c.render(w);
+  RT::ProgressiveOptions options;
+  options.maxSamples = 8;
+  auto result = RT::renderProgressive(c, w, std::chrono::minutes(1), options);
+  const auto &report = result.report;
+  REQUIRE(report.converged);
+  REQUIRE(report.passes > 2);
+  REQUIRE(report.minSamples == 1);
+  REQUIRE(report.maxSamples == 8);
+  REQUIRE(report.samplesPerPixel > 1);
+  REQUIRE(report.samplesPerPixel < 2);
+  // The background is flat and keeps its single sample, while the sphere's
+  // silhouette is anti-aliased.
+  REQUIRE(result.image.pixelAt(0, 0) == full.pixelAt(0, 0));
+  auto smoothed = 0;
+  for (auto y = 0; y < c.vsize; y++) {
+    for (auto x = 0; x < c.hsize; x++) {
+      if (!(result.image.pixelAt(x, y) == full.pixelAt(x, y))) {
+        smoothed++;
+      }
+    }
+  }
+  REQUIRE(smoothed > 0);
+}
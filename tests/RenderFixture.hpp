@@ -0,0 +1,27 @@
+#pragma once
+#include "Camera.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+
+// A camera looking down at the default world's spheres from the front.
+inline auto testCamera(int hsize, int vsize) -> RT::Camera {
+  RT::Camera c(hsize, vsize, M_PI / 3);
+  c.transform = RT::viewTransform(RT::point(0, 1.5, -5), RT::point(0, 0, 0),
+                                  RT::vector(0, 1, 0));
+  return c;
+}
+
+// Renders that must agree bit for bit, which Color's == does not check.
+inline void requireIdentical(const RT::Canvas &a, const RT::Canvas &b) {
+  REQUIRE(a.width == b.width);
+  REQUIRE(a.height == b.height);
+  for (auto y = 0; y < a.height; y++) {
+    for (auto x = 0; x < a.width; x++) {
+      auto p = a.pixelAt(x, y);
+      auto q = b.pixelAt(x, y);
+      REQUIRE(p.red == q.red);
+      REQUIRE(p.green == q.green);
+      REQUIRE(p.blue == q.blue);
+    }
+  }
+}
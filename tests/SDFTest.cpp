@@ -0,0 +1,151 @@
+#include "SDF.hpp"
+#include "Matrix.hpp"
+#include "Ray.hpp"
+#include "Util.hpp"
+#include "World.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+TEST_CASE("Distances to SDF primitives", "[SDF]") {
+  RT::SDFSphere sphere(2);
+  REQUIRE(RT::approxEqual(sphere.distance(RT::point(0, 3, 0)), 1.0));
+  REQUIRE(RT::approxEqual(sphere.distance(RT::point(0, 0, 0)), -2.0));
+
+  RT::SDFBox box(RT::vector(1, 2, 3));
+  REQUIRE(RT::approxEqual(box.distance(RT::point(2, 0, 0)), 1.0));
+  REQUIRE(RT::approxEqual(box.distance(RT::point(0, 0, 0)), -1.0));
+  REQUIRE(RT::approxEqual(box.distance(RT::point(2, 3, 3)), std::sqrt(2.0)));
+
+  RT::SDFBox rounded(RT::vector(1, 1, 1), 0.25);
+  REQUIRE(RT::approxEqual(rounded.distance(RT::point(2, 0, 0)), 1.0));
+  REQUIRE(rounded.distance(RT::point(1, 1, 1)) > 0);
+
+  RT::SDFTorus torus(2, 0.5);
+  REQUIRE(RT::approxEqual(torus.distance(RT::point(2, 0, 0)), -0.5));
+  REQUIRE(RT::approxEqual(torus.distance(RT::point(0, 0, 0)), 1.5));
+  REQUIRE(RT::approxEqual(torus.distance(RT::point(0, 1, -2)), 0.5));
+}
+
+TEST_CASE("Combining SDF nodes", "[SDF]") {
+  auto a = std::make_shared<RT::SDFSphere>(1);
+  auto b = std::make_shared<RT::SDFTransform>(a, RT::vector(1.5, 0, 0));
+  RT::SDFCombine u(RT::SDFOperation::Union, a, b);
+  RT::SDFCombine i(RT::SDFOperation::Intersection, a, b);
+  RT::SDFCombine d(RT::SDFOperation::Difference, a, b);
+  auto p = RT::point(-2, 0, 0);
+  REQUIRE(RT::approxEqual(u.distance(p), 1.0));
+  REQUIRE(RT::approxEqual(i.distance(p), 2.5));
+  REQUIRE(RT::approxEqual(d.distance(p), 1.0));
+  REQUIRE(RT::approxEqual(d.distance(RT::point(0.75, 0, 0)), 0.25));
+  REQUIRE(u.bounds().max == RT::point(2.5, 1, 1));
+  REQUIRE(i.bounds().min == RT::point(0.5, -1, -1));
+
+  RT::SDFSmoothUnion s(a, b, 0.5);
+  REQUIRE(s.distance(RT::point(0.75, 1, 0)) < u.distance(RT::point(0.75, 1, 0)));
+  REQUIRE(RT::approxEqual(s.distance(p), 1.0));
+
+  RT::SDFTransform scaled(a, RT::vector(0, 0, 0), 3);
+  REQUIRE(RT::approxEqual(scaled.distance(RT::point(0, 5, 0)), 2.0));
+  REQUIRE(scaled.bounds().max == RT::point(3, 3, 3));
+}
+
+TEST_CASE("Sphere tracing an SDF sphere matches the analytic sphere",
+          "[SDF]") {
+  RT::SDFShape shape(std::make_shared<RT::SDFSphere>());
+  RT::Sphere sphere;
+  const std::vector<RT::Ray> rays{
+      RT::Ray(RT::point(0, 0, -5), RT::vector(0, 0, 1)),
+      RT::Ray(RT::point(0.3, 0.4, -5), RT::vector(0, 0, 1)),
+      RT::Ray(RT::point(0, 0, 0), RT::vector(0, 0, 1)),
+      RT::Ray(RT::point(0, 0, 5), RT::vector(0, 0, 1)),
+      RT::Ray(RT::point(-4, -3, -2), RT::vector(4, 3.5, 2).norm())};
+  for (const auto &r : rays) {
+    auto expected = sphere.localIntersect(r);
+    auto xs = shape.localIntersect(r);
+    REQUIRE(xs.size() == expected.size());
+    for (size_t i = 0; i < xs.size(); i++) {
+      REQUIRE(std::abs(xs[i].first - expected[i].first) < EPSILON);
+      REQUIRE(xs[i].second == &shape);
+    }
+  }
+  REQUIRE(shape.localIntersect(RT::Ray(RT::point(0, 2, -5),
+                                       RT::vector(0, 0, 1)))
+              .empty());
+}
+
+TEST_CASE("Sphere tracing accounts for the shape's transformation", "[SDF]") {
+  RT::SDFShape shape(std::make_shared<RT::SDFSphere>());
+  shape.transformation = RT::scaling(2, 2, 2);
+  auto xs = shape.intersect(RT::Ray(RT::point(0, 0, -5), RT::vector(0, 0, 1)));
+  REQUIRE(xs.size() == 2);
+  REQUIRE(std::abs(xs[0].first - 3) < EPSILON);
+  REQUIRE(std::abs(xs[1].first - 7) < EPSILON);
+}
+
+TEST_CASE("The step budget bounds the work of a ray", "[SDF]") {
+  RT::SDFShape shape(std::make_shared<RT::SDFTorus>(1, 0.25), 4);
+  std::vector<RT::Intersection> xs;
+  auto steps = shape.march(
+      RT::Ray(RT::point(-2, 0.3, 0), RT::vector(1, -0.001, 0)), 0, 4, xs);
+  REQUIRE(steps <= 4);
+  RT::SDFShape full(std::make_shared<RT::SDFTorus>(1, 0.25));
+  xs.clear();
+  steps = full.march(RT::Ray(RT::point(-2, 0, 0), RT::vector(1, 0, 0)), 0, 4,
+                     xs);
+  REQUIRE(xs.size() == 4);
+  REQUIRE(steps <= RT::DEFAULT_SDF_STEPS);
+}
+
+TEST_CASE("Normals of SDF shapes", "[SDF]") {
+  RT::SDFShape sphere(std::make_shared<RT::SDFSphere>());
+  auto n = sphere.normalAt(RT::point(0, 0, -1));
+  REQUIRE(n == RT::vector(0, 0, -1));
+
+  // A box has no analytic gradient, so its normal comes from differences.
+  RT::SDFShape box(std::make_shared<RT::SDFBox>(RT::vector(1, 1, 1), 0.1));
+  n = box.normalAt(RT::point(1, 0.2, 0.3));
+  REQUIRE(n == RT::vector(1, 0, 0));
+
+  RT::SDFShape torus(std::make_shared<RT::SDFTorus>(2, 0.5));
+  n = torus.normalAt(RT::point(0, 0.5, 2));
+  REQUIRE(n == RT::vector(0, 1, 0));
+}
+
+TEST_CASE("An SDF shape occludes only within the queried distance", "[SDF]") {
+  RT::SDFShape shape(std::make_shared<RT::SDFSphere>());
+  std::vector<RT::Intersection> scratch;
+  RT::Ray r(RT::point(0, 0, -5), RT::vector(0, 0, 1));
+  REQUIRE(shape.occludes(r, 5, scratch));
+  REQUIRE_FALSE(shape.occludes(r, 3.9, scratch));
+  REQUIRE_FALSE(
+      shape.occludes(RT::Ray(RT::point(0, 0, 2), RT::vector(0, 0, 1)), 10,
+                     scratch));
+}
+
+void sphereWorld(RT::World &w, bool traced) {
+  w.lights.emplace_back(RT::point(-10, 10, -10), RT::color(1, 1, 1));
+  w.add(std::make_unique<RT::Plane>(RT::translation(0, -1, 0),
+                                    RT::Material()));
+  if (traced) {
+    w.add(std::make_unique<RT::SDFShape>(std::make_shared<RT::SDFSphere>()));
+  } else {
+    w.add(std::make_unique<RT::Sphere>());
+  }
+  w.object(1).material.color = RT::color(0.8, 0.3, 0.2);
+}
+
+TEST_CASE("A world shades SDF shapes like the analytic ones", "[SDF]") {
+  RT::World analytic(false);
+  RT::World traced(false);
+  sphereWorld(analytic, false);
+  sphereWorld(traced, true);
+  for (auto x = -0.9; x < 1; x += 0.3) {
+    RT::Ray r(RT::point(x, 0.1, -5), RT::vector(0, 0, 1));
+    REQUIRE(traced.colorAt(r) == analytic.colorAt(r));
+  }
+  // The sphere's shadow on the floor.
+  RT::Ray floor(RT::point(1.5, 5, 1.5), RT::vector(0, -1, 0));
+  REQUIRE(traced.colorAt(floor) == analytic.colorAt(floor));
+}
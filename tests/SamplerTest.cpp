@@ -0,0 +1,112 @@
+#include "Sampler.hpp"
+#include "Camera.hpp"
+#include "Matrix.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <memory>
+#include <set>
+#include <vector>
+
+TEST_CASE("Philox matches its known answer", "[Sampler]") {
+  auto zero = RT::philox({0, 0, 0, 0}, {0, 0});
+  REQUIRE(zero[0] == 0x6627e8d5U);
+  REQUIRE(zero[1] == 0xe169c58dU);
+  REQUIRE(zero[2] == 0xbc57ac4cU);
+  REQUIRE(zero[3] == 0x9b00dbd8U);
+  auto ones = RT::philox({0xffffffffU, 0xffffffffU, 0xffffffffU, 0xffffffffU},
+                         {0xffffffffU, 0xffffffffU});
+  REQUIRE(ones[0] == 0x408f276dU);
+  REQUIRE(ones[1] == 0x41c83b0eU);
+  REQUIRE(ones[2] == 0xa20bc7c6U);
+  REQUIRE(ones[3] == 0x6d5451fdU);
+  REQUIRE(RT::toUniform(0xffffffffU) < 1);
+  REQUIRE(RT::toUniform(~uint64_t{0}) < 1);
+}
+
+TEST_CASE("Scrambled Sobol points stratify every power of two", "[Sampler]") {
+  REQUIRE(RT::sobol(1, 1) == 0x80000000U);
+  REQUIRE(RT::sobol(2, 1) == 0xc0000000U);
+  REQUIRE(RT::sobol(3, 1) == 0x40000000U);
+  REQUIRE(RT::sobol(3, 0) == 0xc0000000U);
+  RT::PixelSampler sampler(12, 7);
+  // 16 points fill each of the 1x16, 2x8, 4x4, 8x2 and 16x1 grids once.
+  for (auto columns : {1, 2, 4, 8, 16}) {
+    auto rows = 16 / columns;
+    std::set<int> cells;
+    for (uint32_t i = 0; i < 16; i++) {
+      auto [u, v] = sampler.get2D(i, 1);
+      cells.insert(static_cast<int>(u * columns) * rows +
+                   static_cast<int>(v * rows));
+    }
+    REQUIRE(cells.size() == 16);
+  }
+  RT::PixelSampler shifted(12, 7, RT::SampleSequence::BlueNoise);
+  for (uint32_t i = 0; i < 64; i++) {
+    auto [u, v] = shifted.get2D(i, 3);
+    REQUIRE(u >= 0);
+    REQUIRE(u < 1);
+    REQUIRE(v >= 0);
+    REQUIRE(v < 1);
+  }
+  RT::PixelSampler a(0, 0);
+  RT::PixelSampler b(1, 0);
+  REQUIRE(a.get2D(0, 0) != b.get2D(0, 0));
+  REQUIRE(a.get2D(0, 0) != a.get2D(0, 1));
+  REQUIRE(a.get2D(5, 2) == RT::PixelSampler(0, 0).get2D(5, 2));
+}
+
+TEST_CASE("The blue noise mask ranks every pixel and spreads them apart",
+          "[Sampler]") {
+  std::set<RT::Real> values;
+  RT::Real blueSteps = 0;
+  RT::Real whiteSteps = 0;
+  for (auto y = 0; y < RT::BLUE_NOISE_SIZE; y++) {
+    for (auto x = 0; x < RT::BLUE_NOISE_SIZE; x++) {
+      values.insert(RT::blueNoise(x, y));
+      blueSteps += std::abs(RT::blueNoise(x, y) - RT::blueNoise(x + 1, y));
+      RT::PixelSampler here(x, y, RT::SampleSequence::Random);
+      RT::PixelSampler right(x + 1, y, RT::SampleSequence::Random);
+      whiteSteps += std::abs(here.get1D(0, 0) - right.get1D(0, 0));
+    }
+  }
+  REQUIRE(values.size() == RT::BLUE_NOISE_SIZE * RT::BLUE_NOISE_SIZE);
+  REQUIRE(RT::blueNoise(-1, 3) ==
+          RT::blueNoise(RT::BLUE_NOISE_SIZE - 1, 3 + RT::BLUE_NOISE_SIZE));
+  REQUIRE(blueSteps > whiteSteps * 1.1);
+}
+
+TEST_CASE("Sampled images do not depend on tiles or threads", "[Sampler]") {
+  RT::World w(false);
+  w.lights.emplace_back(RT::point(-10, 10, -10), RT::color(1, 1, 1));
+  w.add(std::make_unique<RT::Plane>(RT::translation(0, -1, 0),
+                                    RT::Material()));
+  auto s = std::make_unique<RT::Sphere>();
+  s->motion = std::make_shared<RT::Motion>(RT::Pose{},
+                                           RT::Pose{RT::vector(0.5, 0, 0)});
+  w.add(std::move(s));
+  RT::Camera c(32, 24, M_PI / 3);
+  c.transform = RT::viewTransform(RT::point(0, 1, -5), RT::point(0, 0, 0),
+                                  RT::vector(0, 1, 0));
+  c.aperture = 0.2;
+  c.focalDistance = 3;
+  c.shutterClose = 1;
+  c.lensSamples = 8;
+  for (auto sequence :
+       {RT::SampleSequence::Random, RT::SampleSequence::Sobol,
+        RT::SampleSequence::BlueNoise}) {
+    c.sampling = sequence;
+    RT::RenderOptions serial;
+    serial.threads = 1;
+    serial.tileSize = 32;
+    RT::RenderOptions parallel;
+    parallel.threads = 4;
+    parallel.tileSize = 5;
+    auto a = c.render(w, serial);
+    auto b = c.render(w, parallel);
+    for (auto y = 0; y < c.vsize; y++) {
+      for (auto x = 0; x < c.hsize; x++) {
+        REQUIRE(RT::identical(a.pixelAt(x, y), b.pixelAt(x, y)));
+      }
+    }
+  }
+}
@@ -2,6 +2,9 @@
 #include "Matrix.hpp"
 #include "Ray.hpp"
 #include "Util.hpp"
+#include <array>
+#include <memory>
+#include <vector>
 #include <catch2/catch_test_macros.hpp>
 
 TEST_CASE("The normal on a sphere at a point on the x axis", "[Sphere]") {
@@ -51,9 +54,9 @@ TEST_CASE("Computing the normal on a transformed sphere", "[Sphere]") {
 TEST_CASE("The default material", "[Material]") {
   auto m = RT::Material();
   REQUIRE(m.color == RT::color(1, 1, 1));
-  REQUIRE(m.ambient == 0.1);
-  REQUIRE(m.diffuse == 0.9);
-  REQUIRE(m.specular == 0.9);
+  REQUIRE(RT::approxEqual(m.ambient, 0.1));
+  REQUIRE(RT::approxEqual(m.diffuse, 0.9));
+  REQUIRE(RT::approxEqual(m.specular, 0.9));
   REQUIRE(m.shininess == 200);
 }
 
@@ -611,4 +614,149 @@ TEST_CASE("Intersecting a cone's end caps") {
   r = RT::Ray(RT::point(0, 0, -0.25), RT::vector(0, 1, 0));
   xs = c.intersect(r);
   REQUIRE(xs.size() == 4);
-}
\ No newline at end of file
+}
+TEST_CASE("CSG is created with an operation and two shapes", "[CSG]") {
+  auto s1 = std::make_unique<RT::Sphere>();
+  auto c1 = std::make_unique<RT::Cube>();
+  const auto *s = s1.get();
+  const auto *c = c1.get();
+  RT::CSG csg(RT::CSGOperation::Union, std::move(s1), std::move(c1));
+  REQUIRE(csg.operation == RT::CSGOperation::Union);
+  REQUIRE(&csg.left() == s);
+  REQUIRE(&csg.right() == c);
+  REQUIRE(s->parent == &csg);
+  REQUIRE(c->parent == &csg);
+
+  RT::CSG moved(std::move(csg));
+  REQUIRE(s->parent == &moved);
+  REQUIRE(c->parent == &moved);
+}
+
+TEST_CASE("Evaluating the rule for a CSG operation", "[CSG]") {
+  using Op = RT::CSGOperation;
+  // lhit, inl, inr, union, intersection, difference
+  const std::vector<std::array<bool, 6>> rules{
+      {true, true, true, false, true, false},
+      {true, true, false, true, false, true},
+      {true, false, true, false, true, false},
+      {true, false, false, true, false, true},
+      {false, true, true, false, true, true},
+      {false, true, false, false, true, true},
+      {false, false, true, true, false, false},
+      {false, false, false, true, false, false}};
+  for (const auto &r : rules) {
+    REQUIRE(RT::CSG::intersectionAllowed(Op::Union, r[0], r[1], r[2]) == r[3]);
+    REQUIRE(RT::CSG::intersectionAllowed(Op::Intersection, r[0], r[1], r[2]) ==
+            r[4]);
+    REQUIRE(RT::CSG::intersectionAllowed(Op::Difference, r[0], r[1], r[2]) ==
+            r[5]);
+  }
+}
+
+TEST_CASE("Filtering intersections of overlapping spheres", "[CSG]") {
+  // Spheres centered at z = 0 and z = 0.5 are crossed at t = 4, 4.5, 6, 6.5
+  // by a ray from z = -5.
+  auto make = [](RT::CSGOperation op) {
+    auto s2 = std::make_unique<RT::Sphere>();
+    s2->transformation = RT::translation(0, 0, 0.5);
+    return RT::CSG(op, std::make_unique<RT::Sphere>(), std::move(s2));
+  };
+  RT::Ray r(RT::point(0, 0, -5), RT::vector(0, 0, 1));
+
+  auto u = make(RT::CSGOperation::Union);
+  auto xs = u.intersect(r);
+  REQUIRE(xs.size() == 2);
+  REQUIRE(RT::approxEqual(xs[0].first, 4.0));
+  REQUIRE(xs[0].second == &u.left());
+  REQUIRE(RT::approxEqual(xs[1].first, 6.5));
+  REQUIRE(xs[1].second == &u.right());
+
+  auto i = make(RT::CSGOperation::Intersection);
+  xs = i.intersect(r);
+  REQUIRE(xs.size() == 2);
+  REQUIRE(RT::approxEqual(xs[0].first, 4.5));
+  REQUIRE(xs[0].second == &i.right());
+  REQUIRE(RT::approxEqual(xs[1].first, 6.0));
+  REQUIRE(xs[1].second == &i.left());
+
+  auto d = make(RT::CSGOperation::Difference);
+  xs = d.intersect(r);
+  REQUIRE(xs.size() == 2);
+  REQUIRE(RT::approxEqual(xs[0].first, 4.0));
+  REQUIRE(xs[0].second == &d.left());
+  REQUIRE(RT::approxEqual(xs[1].first, 4.5));
+  REQUIRE(xs[1].second == &d.right());
+}
+
+TEST_CASE("A ray misses a CSG object", "[CSG]") {
+  RT::CSG c(RT::CSGOperation::Union, std::make_unique<RT::Sphere>(),
+            std::make_unique<RT::Cube>());
+  RT::Ray r(RT::point(0, 2, -5), RT::vector(0, 0, 1));
+  REQUIRE(c.intersect(r).empty());
+}
+
+TEST_CASE("A ray missing the left child's bounds skips a difference",
+          "[CSG]") {
+  auto s2 = std::make_unique<RT::Sphere>();
+  s2->transformation = RT::translation(0, 3, 0);
+  RT::CSG c(RT::CSGOperation::Difference, std::make_unique<RT::Sphere>(),
+            std::move(s2));
+  RT::Ray r(RT::point(0, 3, -5), RT::vector(0, 0, 1));
+  REQUIRE(c.intersect(r).empty());
+  // Child bounds are padded by EPSILON when they are cached.
+  REQUIRE(c.bounds().max ==
+          RT::point(1, 1, 1) + RT::vector(EPSILON, EPSILON, EPSILON));
+}
+
+TEST_CASE("Nested CSG shapes keep the hits of the right leaves", "[CSG]") {
+  // A cube with a spherical bite taken out, unioned with a far sphere.
+  auto bite = std::make_unique<RT::Sphere>();
+  bite->transformation = RT::translation(0, 0, -1);
+  auto inner = std::make_unique<RT::CSG>(RT::CSGOperation::Difference,
+                                         std::make_unique<RT::Cube>(),
+                                         std::move(bite));
+  const auto *cube = &inner->left();
+  const auto *hole = &inner->right();
+  auto far = std::make_unique<RT::Sphere>();
+  far->transformation = RT::translation(0, 0, 4);
+  const auto *farSphere = far.get();
+  RT::CSG outer(RT::CSGOperation::Union, std::move(inner), std::move(far));
+
+  RT::Ray r(RT::point(0, 0, -5), RT::vector(0, 0, 1));
+  auto xs = outer.intersect(r);
+  REQUIRE(xs.size() == 4);
+  REQUIRE(RT::approxEqual(xs[0].first, 5.0));
+  REQUIRE(xs[0].second == hole);
+  REQUIRE(RT::approxEqual(xs[1].first, 6.0));
+  REQUIRE(xs[1].second == cube);
+  REQUIRE(RT::approxEqual(xs[2].first, 8.0));
+  REQUIRE(xs[2].second == farSphere);
+  REQUIRE(RT::approxEqual(xs[3].first, 10.0));
+  REQUIRE(xs[3].second == farSphere);
+}
+
+TEST_CASE("A CSG occlusion query agrees with its intersections", "[CSG]") {
+  auto s2 = std::make_unique<RT::Sphere>();
+  s2->transformation = RT::translation(0, 0, 0.5);
+  RT::CSG c(RT::CSGOperation::Intersection, std::make_unique<RT::Sphere>(),
+            std::move(s2));
+  RT::Ray r(RT::point(0, 0, -5), RT::vector(0, 0, 1));
+  std::vector<RT::Intersection> scratch;
+  REQUIRE(c.occludes(r, 5, scratch));
+  REQUIRE_FALSE(c.occludes(r, 4.4, scratch));
+  // From inside the lens the exit at t = 1 still blocks.
+  RT::Ray inside(RT::point(0, 0, 0), RT::vector(0, 0, 1));
+  REQUIRE(c.occludes(inside, 1.5, scratch));
+  REQUIRE_FALSE(c.occludes(inside, 0.5, scratch));
+}
+
+TEST_CASE("The normal on a child of a transformed CSG", "[CSG]") {
+  auto s1 = std::make_unique<RT::Sphere>();
+  s1->transformation = RT::translation(5, 0, 0);
+  const auto *s = s1.get();
+  RT::CSG c(RT::CSGOperation::Union, std::move(s1),
+            std::make_unique<RT::Cube>());
+  c.transformation = RT::scaling(1, 2, 3);
+  auto n = s->normalAt(RT::point(5.5774, 1.1547, -1.7321));
+  REQUIRE(n == RT::vector(0.8571, 0.4286, -0.2857));
+}
@@ -0,0 +1,212 @@
+#include "Texture.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void writeFile(const std::string &filename, const std::string &header,
+               const std::vector<unsigned char> &body) {
+  std::ofstream file(filename, std::ios::binary);
+  file.write(header.data(), static_cast<std::streamsize>(header.size()));
+  file.write(reinterpret_cast<const char *>(body.data()),
+             static_cast<std::streamsize>(body.size()));
+}
+
+// Writes an 8-bit binary PPM where texel (x, y) has red x, green y.
+void writeRamp(const std::string &filename, int width, int height) {
+  std::vector<unsigned char> body;
+  for (auto y = 0; y < height; y++) {
+    for (auto x = 0; x < width; x++) {
+      body.push_back(static_cast<unsigned char>(x));
+      body.push_back(static_cast<unsigned char>(y));
+      body.push_back(0);
+    }
+  }
+  writeFile(filename,
+            "P6\n" + std::to_string(width) + " " + std::to_string(height) +
+                "\n255\n",
+            body);
+}
+
+} // namespace
+
+TEST_CASE("Using a spherical mapping on a 3D point", "[Texture]") {
+  auto check = [](RT::Point p, RT::Real u, RT::Real v) {
+    auto uv = RT::sphericalMap(p);
+    REQUIRE(RT::approxEqual(uv.u, u));
+    REQUIRE(RT::approxEqual(uv.v, v));
+  };
+  check(RT::point(0, 0, -1), 0.0, 0.5);
+  check(RT::point(1, 0, 0), 0.25, 0.5);
+  check(RT::point(0, 0, 1), 0.5, 0.5);
+  check(RT::point(-1, 0, 0), 0.75, 0.5);
+  check(RT::point(0, 1, 0), 0.5, 1.0);
+  check(RT::point(0, -1, 0), 0.5, 0.0);
+  check(RT::point(std::sqrt(2) / 2, std::sqrt(2) / 2, 0), 0.25, 0.75);
+}
+
+TEST_CASE("Using a planar mapping on a 3D point", "[Texture]") {
+  auto check = [](RT::Point p, RT::Real u, RT::Real v) {
+    auto uv = RT::planarMap(p);
+    REQUIRE(RT::approxEqual(uv.u, u));
+    REQUIRE(RT::approxEqual(uv.v, v));
+  };
+  check(RT::point(0.25, 0, 0.5), 0.25, 0.5);
+  check(RT::point(0.25, 0, -0.25), 0.25, 0.75);
+  check(RT::point(0.25, 0.5, -0.25), 0.25, 0.75);
+  check(RT::point(1.25, 0, 0.5), 0.25, 0.5);
+  check(RT::point(0.25, 0, -1.75), 0.25, 0.25);
+  check(RT::point(1, 0, -1), 0.0, 0.0);
+  check(RT::point(0, 0, 0), 0.0, 0.0);
+}
+
+TEST_CASE("Using a cylindrical mapping on a 3D point", "[Texture]") {
+  auto check = [](RT::Point p, RT::Real u, RT::Real v) {
+    auto uv = RT::cylindricalMap(p);
+    REQUIRE(RT::approxEqual(uv.u, u));
+    REQUIRE(RT::approxEqual(uv.v, v));
+  };
+  check(RT::point(0, 0, -1), 0.0, 0.0);
+  check(RT::point(0, 0.5, -1), 0.0, 0.5);
+  check(RT::point(0, 1, -1), 0.0, 0.0);
+  check(RT::point(0.70711, 0.5, -0.70711), 0.125, 0.5);
+  check(RT::point(1, 0.5, 0), 0.25, 0.5);
+  check(RT::point(0.70711, 0.5, 0.70711), 0.375, 0.5);
+  check(RT::point(0, -0.25, 1), 0.5, 0.75);
+  check(RT::point(-0.70711, 0.5, 0.70711), 0.625, 0.5);
+  check(RT::point(-1, 1.25, 0), 0.75, 0.25);
+  check(RT::point(-0.70711, 0.5, -0.70711), 0.875, 0.5);
+}
+
+TEST_CASE("Identifying the face of a cube from a point", "[Texture]") {
+  REQUIRE(RT::cubeFace(RT::point(-1, 0.5, -0.25)) == RT::CubeFace::Left);
+  REQUIRE(RT::cubeFace(RT::point(1.1, -0.75, 0.8)) == RT::CubeFace::Right);
+  REQUIRE(RT::cubeFace(RT::point(0.1, 0.6, 0.9)) == RT::CubeFace::Front);
+  REQUIRE(RT::cubeFace(RT::point(-0.7, 0, -2)) == RT::CubeFace::Back);
+  REQUIRE(RT::cubeFace(RT::point(0.5, 1, 0.9)) == RT::CubeFace::Up);
+  REQUIRE(RT::cubeFace(RT::point(-0.2, -1.3, 1.1)) == RT::CubeFace::Down);
+}
+
+TEST_CASE("Cube faces map into their slot of a texture strip", "[Texture]") {
+  auto front = RT::cubeFaceMap(RT::CubeFace::Front, RT::point(-0.5, 0.5, 1));
+  REQUIRE(RT::approxEqual(front.u, 0.25));
+  REQUIRE(RT::approxEqual(front.v, 0.75));
+  auto up = RT::cubeFaceMap(RT::CubeFace::Up, RT::point(-0.5, 1, -0.5));
+  REQUIRE(RT::approxEqual(up.u, 0.25));
+  REQUIRE(RT::approxEqual(up.v, 0.75));
+  auto strip = RT::cubicMap(RT::point(-0.5, 0.5, 1));
+  REQUIRE(RT::approxEqual(strip.u, (1 + 0.25) / 6));
+  REQUIRE(RT::approxEqual(strip.v, 0.75));
+}
+
+TEST_CASE("Loading textures from PPM and PFM files", "[Texture]") {
+  auto cache = std::make_shared<RT::TextureCache>();
+  writeFile("texture_ascii.ppm", "P3\n2 1\n# comment\n255\n255 0 0 0 51 255\n",
+            {});
+  auto ascii = RT::Texture::load("texture_ascii.ppm", cache);
+  REQUIRE(ascii->width == 2);
+  REQUIRE(ascii->height == 1);
+  REQUIRE(ascii->texel(0, 0, 0) == RT::color(1, 0, 0));
+  REQUIRE(ascii->texel(0, 1, 0) == RT::color(0, 0.2, 1));
+
+  writeFile("texture_wide.ppm", "P6\n1 1\n65535\n",
+            {0xFF, 0xFF, 0x80, 0x00, 0x00, 0x00});
+  auto wide = RT::Texture::load("texture_wide.ppm", cache);
+  REQUIRE(wide->texel(0, 0, 0) == RT::color(1, 0.50001, 0));
+
+  // PFM rows run bottom to top; a negative scale marks little endian.
+  std::vector<float> values{0.25F, 0.5F, 4.0F, 1, 2, 3};
+  std::vector<unsigned char> body(values.size() * sizeof(float));
+  for (size_t i = 0; i < values.size(); i++) {
+    uint32_t bits = 0;
+    std::memcpy(&bits, &values[i], sizeof(bits));
+    for (auto byte = 0U; byte < 4U; byte++) {
+      body[i * 4 + byte] = static_cast<unsigned char>(bits >> (8U * byte));
+    }
+  }
+  writeFile("texture.pfm", "PF\n1 2\n-1.0\n", body);
+  auto pfm = RT::Texture::load("texture.pfm", cache);
+  REQUIRE(pfm->texel(0, 0, 0) == RT::color(1, 2, 3));
+  REQUIRE(pfm->texel(0, 0, 1) == RT::color(0.25, 0.5, 4));
+
+  REQUIRE_THROWS(RT::Texture::load("texture_missing.ppm", cache));
+}
+
+TEST_CASE("Bilinear filtering blends the nearest four texels", "[Texture]") {
+  writeFile("texture_bilinear.ppm", "P6\n2 2\n255\n",
+            {255, 0, 0, 0, 255, 0, 0, 0, 255, 255, 255, 255});
+  auto texture = RT::Texture::load("texture_bilinear.ppm",
+                                   std::make_shared<RT::TextureCache>());
+  REQUIRE(texture->sample({0.5, 0.5}) == RT::color(0.5, 0.5, 0.5));
+  REQUIRE(texture->sample({0.25, 0.75}) == RT::color(1, 0, 0));
+  REQUIRE(texture->sample({0.25, 0.5}) == RT::color(0.5, 0, 0.5));
+  REQUIRE(texture->sample({0.3, 0.8}, 0, RT::TextureFilter::Nearest) ==
+          RT::color(1, 0, 0));
+}
+
+TEST_CASE("Mip levels average the level below", "[Texture]") {
+  writeRamp("texture_ramp.ppm", 8, 4);
+  auto texture = RT::Texture::load("texture_ramp.ppm",
+                                   std::make_shared<RT::TextureCache>());
+  REQUIRE(texture->levels() == 4);
+  REQUIRE(texture->levelWidth(1) == 4);
+  REQUIRE(texture->levelHeight(2) == 1);
+  REQUIRE(texture->levelWidth(3) == 1);
+  REQUIRE(texture->texel(1, 1, 1) == RT::color(2.5 / 255, 2.5 / 255, 0));
+  REQUIRE(texture->texel(3, 0, 0) == RT::color(3.5 / 255, 1.5 / 255, 0));
+  auto fine = texture->sample({0.5, 0.5}, 2);
+  auto coarse = texture->sample({0.5, 0.5}, 3);
+  auto blended =
+      texture->sample({0.5, 0.5}, 2.25, RT::TextureFilter::Trilinear);
+  REQUIRE(blended == fine * 0.75 + coarse * 0.25);
+}
+
+TEST_CASE("The tile cache stays within its byte budget", "[Texture]") {
+  const size_t tileBytes = static_cast<size_t>(RT::TEXTURE_TILE_SIZE) *
+                           RT::TEXTURE_TILE_SIZE * 3 * sizeof(float);
+  auto cache = std::make_shared<RT::TextureCache>(2 * tileBytes);
+  writeRamp("texture_tiles.ppm", 100, 70);
+  auto texture = RT::Texture::load("texture_tiles.ppm", cache);
+  for (auto pass = 0; pass < 2; pass++) {
+    for (auto y = 0; y < 70; y += 3) {
+      for (auto x = 0; x < 100; x += 7) {
+        REQUIRE(texture->texel(0, x, y) == RT::color(x / 255.0, y / 255.0, 0));
+        REQUIRE(cache->resident() <= cache->capacity());
+      }
+    }
+  }
+  REQUIRE(cache->misses() > 12);
+  // Another thread holds no handles yet and finds the tile in the cache.
+  auto corner = RT::color(0, 0, 0);
+  std::thread([&] { corner = texture->texel(0, 99, 69); }).join();
+  REQUIRE(corner == RT::color(99 / 255.0, 69 / 255.0, 0));
+  REQUIRE(cache->hits() > 0);
+  texture.reset();
+  REQUIRE(cache->resident() == 0);
+}
+
+TEST_CASE("Tiles used through thread handles are not evicted first",
+          "[Texture]") {
+  const size_t tileBytes = static_cast<size_t>(RT::TEXTURE_TILE_SIZE) *
+                           RT::TEXTURE_TILE_SIZE * 3 * sizeof(float);
+  auto cache = std::make_shared<RT::TextureCache>(2 * tileBytes);
+  writeRamp("texture_handles.ppm", 100, 8);
+  auto texture = RT::Texture::load("texture_handles.ppm", cache);
+  REQUIRE(texture->texel(0, 0, 0) == RT::color(0, 0, 0));
+  REQUIRE(texture->texel(0, 40, 0) == RT::color(40 / 255.0, 0, 0));
+  // Served by this thread's handle, without a lookup in the cache.
+  REQUIRE(texture->texel(0, 1, 0) == RT::color(1 / 255.0, 0, 0));
+  REQUIRE(texture->texel(0, 80, 0) == RT::color(80 / 255.0, 0, 0));
+  auto misses = cache->misses();
+  std::thread([&] { (void)texture->texel(0, 2, 0); }).join();
+  REQUIRE(cache->misses() == misses);
+  std::thread([&] { (void)texture->texel(0, 41, 0); }).join();
+  REQUIRE(cache->misses() == misses + 1);
+}
@@ -3,17 +3,17 @@
 
 TEST_CASE("Vector, Point", "[Tuple]") {
   RT::Tuple a = RT::Tuple(4.3, -4.2, 3.1, 1.0);
-  REQUIRE(a.x == 4.3);
-  REQUIRE(a.y == -4.2);
-  REQUIRE(a.z == 3.1);
+  REQUIRE(RT::approxEqual(a.x, 4.3));
+  REQUIRE(RT::approxEqual(a.y, -4.2));
+  REQUIRE(RT::approxEqual(a.z, 3.1));
   REQUIRE(a.w == 1.0);
   REQUIRE(a.isPoint() == true);
   REQUIRE(a.isVector() == false);
 
   RT::Tuple b = RT::Tuple(4.3, -4.2, 3.1, 0.0);
-  REQUIRE(b.x == 4.3);
-  REQUIRE(b.y == -4.2);
-  REQUIRE(b.z == 3.1);
+  REQUIRE(RT::approxEqual(b.x, 4.3));
+  REQUIRE(RT::approxEqual(b.y, -4.2));
+  REQUIRE(RT::approxEqual(b.z, 3.1));
   REQUIRE(b.w == 0.0);
   REQUIRE(b.isPoint() == false);
   REQUIRE(b.isVector() == true);
@@ -61,15 +61,15 @@ TEST_CASE("Vector magnitude", "[Tuple]") {
   REQUIRE(RT::vector(1, 0, 0).magnitude() == 1);
   REQUIRE(RT::vector(0, 1, 0).magnitude() == 1);
   REQUIRE(RT::vector(0, 0, 1).magnitude() == 1);
-  REQUIRE(RT::vector(1, 2, 3).magnitude() == std::sqrt(14));
-  REQUIRE(RT::vector(-1, -2, -3).magnitude() == std::sqrt(14));
+  REQUIRE(RT::approxEqual(RT::vector(1, 2, 3).magnitude(), std::sqrt(14)));
+  REQUIRE(RT::approxEqual(RT::vector(-1, -2, -3).magnitude(), std::sqrt(14)));
 }
 
 TEST_CASE("Vector normalization", "[Tuple]") {
   REQUIRE(RT::vector(4, 0, 0).normalize() == RT::vector(1, 0, 0));
   REQUIRE(RT::vector(1, 2, 3).normalize() ==
           RT::vector(1 / std::sqrt(14), 2 / std::sqrt(14), 3 / std::sqrt(14)));
-  REQUIRE(RT::vector(1, 2, 3).normalize().magnitude() == 1);
+  REQUIRE(RT::approxEqual(RT::vector(1, 2, 3).normalize().magnitude(), 1));
 }
 
 TEST_CASE("Vector dot product", "[Tuple]") {
@@ -87,8 +87,8 @@ TEST_CASE("Vector cross product", "[Tuple]") {
 TEST_CASE("Colors are (r,g,b) tuples", "[Tuple]") {
   RT::Tuple c = RT::color(-0.5, 0.4, 1.7);
   REQUIRE(c.red == -0.5);
-  REQUIRE(c.green == 0.4);
-  REQUIRE(c.blue == 1.7);
+  REQUIRE(RT::approxEqual(c.green, 0.4));
+  REQUIRE(RT::approxEqual(c.blue, 1.7));
 }
 
 TEST_CASE("Adding colors", "[Tuple]") {
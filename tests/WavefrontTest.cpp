@@ -0,0 +1,97 @@
+#include "Wavefront.hpp"
+#include "Camera.hpp"
+#include "Motion.hpp"
+#include "World.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <memory>
+
+TEST_CASE("Rendering a world with the wavefront renderer", "[Wavefront]") {
+  RT::World w;
+  RT::Camera c(11, 11, M_PI / 2);
+  c.transform = RT::viewTransform(RT::point(0, 0, -5), RT::point(0, 0, 0),
+                                  RT::vector(0, 1, 0));
+  auto image = RT::Wavefront(c).render(w);
+  REQUIRE(image.pixelAt(5, 5) == RT::color(0.38066, 0.47583, 0.2855));
+}
+
+TEST_CASE("The wavefront renderer matches the recursive renderer",
+          "[Wavefront]") {
+  RT::World w;
+  auto floor = RT::Plane();
+  floor.transformation = RT::translation(0, -1, 0);
+  floor.material.reflective = 0.5;
+  floor.material.transparency = 0.5;
+  floor.material.refractiveIndex = 1.5;
+  floor.material.pattern = std::make_unique<RT::CheckersPattern>();
+  w.add(std::make_unique<RT::Plane>(floor));
+  auto ball = RT::glassSphere(RT::translation(1, -0.25, -1.5));
+  ball.material.reflective = 0.9;
+  w.add(std::make_unique<RT::Sphere>(ball));
+  auto cube = RT::Cube();
+  cube.transformation = RT::translation(-2, 0, 1) * RT::scaling(0.5, 0.5, 0.5);
+  w.add(std::make_unique<RT::Cube>(cube));
+  w.lights.emplace_back(RT::point(5, 8, -6), RT::color(0.3, 0.3, 0.3));
+
+  RT::Camera c(24, 18, M_PI / 3);
+  c.transform = RT::viewTransform(RT::point(0, 1.5, -6), RT::point(0, 0, 0),
+                                  RT::vector(0, 1, 0));
+  auto expected = c.render(w);
+  auto image = RT::Wavefront(c, 37, 3).render(w);
+  for (auto y = 0; y < c.vsize; y++) {
+    for (auto x = 0; x < c.hsize; x++) {
+      REQUIRE(image.pixelAt(x, y) == expected.pixelAt(x, y));
+    }
+  }
+}
+
+TEST_CASE("The wavefront renderer samples lights like the recursive renderer",
+          "[Wavefront]") {
+  RT::World w;
+  auto floor = RT::Plane();
+  floor.transformation = RT::translation(0, -1, 0);
+  floor.material.reflective = 0.3;
+  w.add(std::make_unique<RT::Plane>(floor));
+  for (auto i = 0; i < 40; i++) {
+    w.lights.emplace_back(RT::point(i % 8 - 4, 3 + i % 3, i / 8 - 6),
+                          RT::color(0.05, 0.04, 0.03));
+  }
+  w.sampleLights(4);
+  RT::Camera c(16, 12, M_PI / 3);
+  c.transform = RT::viewTransform(RT::point(0, 1.5, -6), RT::point(0, 0, 0),
+                                  RT::vector(0, 1, 0));
+  auto expected = c.render(w);
+  auto image = RT::Wavefront(c, 50, 2).render(w);
+  for (auto y = 0; y < c.vsize; y++) {
+    for (auto x = 0; x < c.hsize; x++) {
+      REQUIRE(image.pixelAt(x, y) == expected.pixelAt(x, y));
+    }
+  }
+}
+
+TEST_CASE("Wavefront rays keep the time of the shutter", "[Wavefront]") {
+  RT::World w;
+  auto floor = RT::Plane();
+  floor.transformation = RT::translation(0, -1, 0);
+  floor.material.reflective = 0.5;
+  floor.material.pattern = std::make_unique<RT::CheckersPattern>();
+  floor.motion = std::make_shared<RT::Motion>(
+      RT::Pose{}, RT::Pose{RT::vector(0.7, 0, 0.4)});
+  w.add(std::make_unique<RT::Plane>(floor));
+  auto ball = RT::Sphere();
+  ball.motion = std::make_shared<RT::Motion>(RT::Pose{RT::vector(-1, 0, 0)},
+                                             RT::Pose{RT::vector(1, 0, 0)});
+  w.add(std::make_unique<RT::Sphere>(ball));
+
+  RT::Camera c(40, 40, M_PI / 3);
+  c.transform = RT::viewTransform(RT::point(0, 1.5, -6), RT::point(0, 0, 0),
+                                  RT::vector(0, 1, 0));
+  c.shutterOpen = 0.5;
+  c.shutterClose = 0.5;
+  auto expected = c.render(w);
+  auto image = RT::Wavefront(c, 101, 2).render(w);
+  for (auto y = 0; y < c.vsize; y++) {
+    for (auto x = 0; x < c.hsize; x++) {
+      REQUIRE(image.pixelAt(x, y) == expected.pixelAt(x, y));
+    }
+  }
+}
@@ -1,7 +1,10 @@
 #include "Pattern.hpp"
 #include <memory>
+#include <stdexcept>
+#include <utility>
 #define private public
 #include "World.hpp"
+#include "Parallel.hpp"
 #include <catch2/catch_test_macros.hpp>
 
 TEST_CASE("Creating a world") {
@@ -18,8 +21,54 @@ TEST_CASE("Creating a world") {
   auto s2 = RT::Sphere();
   s2.transformation = RT::scaling(0.5, 0.5, 0.5);
 
-  REQUIRE(w.contains(s1));
-  REQUIRE(w.contains(s2));
+  REQUIRE(w.contains(0));
+  REQUIRE(w.contains(1));
+  REQUIRE(w.object(0).material == s1.material);
+  REQUIRE(w.object(1).transformation == s2.transformation);
+  REQUIRE(w.contains(w.object(1)));
+  REQUIRE_FALSE(w.contains(s1));
+}
+
+TEST_CASE("Objects keep their ids when others are removed") {
+  RT::World w(false);
+  auto a = w.add(std::make_unique<RT::Sphere>(RT::translation(-3, 0, 0),
+                                              RT::Material()));
+  auto b = w.add(std::make_unique<RT::Cube>());
+  auto c = w.add(std::make_unique<RT::Sphere>(RT::translation(3, 0, 0),
+                                              RT::Material()));
+  REQUIRE(a == 0);
+  REQUIRE(b == 1);
+  REQUIRE(c == 2);
+  w.remove(a);
+  REQUIRE_FALSE(w.contains(a));
+  REQUIRE(w.contains(c));
+  REQUIRE(w.count() == 3);
+  REQUIRE(w.object(c).transformation == RT::translation(3, 0, 0));
+  REQUIRE(w.bounds(c).min == RT::point(2, -1, -1) - RT::vector(EPSILON, EPSILON, EPSILON));
+  REQUIRE_THROWS_AS(w.object(a), std::out_of_range);
+  REQUIRE_THROWS_AS(w.remove(a), std::out_of_range);
+  REQUIRE(w.intersect(RT::Ray(RT::point(-3, 0, -5), RT::vector(0, 0, 1)))
+              .empty());
+  REQUIRE(w.intersect(RT::Ray(RT::point(3, 0, -5), RT::vector(0, 0, 1)))
+              .size() == 2);
+  REQUIRE(w.edits().back().object == a);
+  REQUIRE(w.edits().back().after.isEmpty());
+
+  w.setTransform(c, RT::translation(0, 3, 0));
+  REQUIRE(w.intersect(RT::Ray(RT::point(0, 3, -5), RT::vector(0, 0, 1)))[0]
+              .second == &w.object(c));
+  auto d = w.add(std::make_unique<RT::Sphere>());
+  REQUIRE(d == 3);
+}
+
+TEST_CASE("Removing an occluder clears the remembered shadow") {
+  RT::World w;
+  auto p = RT::point(10, -10, 10);
+  REQUIRE(w.isShadowed(p, w.lights[0]));
+  w.remove(0);
+  REQUIRE(w.isShadowed(p, w.lights[0]));
+  w.remove(1);
+  REQUIRE_FALSE(w.isShadowed(p, w.lights[0]));
 }
 
 TEST_CASE("Intersect a world with a ray") {
@@ -36,7 +85,7 @@ TEST_CASE("Intersect a world with a ray") {
 TEST_CASE("Shading an intersection") {
   RT::World w;
   auto r = RT::Ray(RT::point(0, 0, -5), RT::vector(0, 0, 1));
-  auto shape = w.objects[0].get();
+  auto shape = &w.object(0);
   auto i = RT::Intersection(4, shape);
   auto comps = RT::Computations(i, r);
   auto c = w.shadeHit(comps);
@@ -47,7 +96,7 @@ TEST_CASE("Shading an intersection from the inside") {
   RT::World w;
   w.lights[0] = RT::Light(RT::point(0, 0.25, 0), RT::color(1, 1, 1));
   auto r = RT::Ray(RT::point(0, 0, 0), RT::vector(0, 0, 1));
-  auto *shape = w.objects[1].get();
+  auto *shape = &w.object(1);
   auto i = RT::Intersection(0.5, shape);
   auto comps = RT::Computations(i, r);
   auto c = w.shadeHit(comps);
@@ -68,11 +117,34 @@ TEST_CASE("The color when a ray hits") {
   REQUIRE(c == RT::color(0.38066, 0.47583, 0.2855));
 }
 
+TEST_CASE("Describing the surface a ray hits") {
+  RT::World w;
+  auto r = RT::Ray(RT::point(0, 0, -5), RT::vector(0, 0, 2));
+  std::optional<RT::Intersection> primary;
+  std::optional<RT::SurfaceSample> surface;
+  auto c = w.colorAt(r, primary, surface);
+  REQUIRE(c == w.colorAt(r));
+  REQUIRE(surface.has_value());
+  REQUIRE(RT::approxEqual(surface->depth, 4));
+  REQUIRE(surface->normal == RT::vector(0, 0, -1));
+  REQUIRE(surface->object == 0);
+  REQUIRE(surface->albedo == RT::color(0.8, 1.0, 0.6));
+
+  auto inside = RT::Ray(RT::point(0, 0, 0.75), RT::vector(0, 0, -1));
+  (void)w.colorAt(inside, primary, surface);
+  REQUIRE(surface->object == 1);
+  REQUIRE(RT::approxEqual(surface->depth, 0.25));
+
+  auto miss = RT::Ray(RT::point(0, 0, -5), RT::vector(0, 1, 0));
+  (void)w.colorAt(miss, primary, surface);
+  REQUIRE_FALSE(surface.has_value());
+}
+
 TEST_CASE("The color with an intersection behind the ray") {
   RT::World w;
-  auto outer = w.objects[0].get();
+  auto outer = &w.object(0);
   outer->material.ambient = 1;
-  auto inner = w.objects[1].get();
+  auto inner = &w.object(1);
   inner->material.ambient = 1;
   auto r = RT::Ray(RT::point(0, 0, 0.75), RT::vector(0, 0, -1));
   auto c = w.colorAt(r);
@@ -120,7 +192,7 @@ TEST_CASE("shadeHit() is given an intersection in shadow") {
 TEST_CASE("The reflected color for a nonreflective material") {
   RT::World w;
   auto r = RT::Ray(RT::point(0, 0, 0), RT::vector(0, 0, 1));
-  auto shape = w.objects[1].get();
+  auto shape = &w.object(1);
   shape->material.ambient = 1;
   auto i = RT::Intersection(1, shape);
   auto comps = RT::Computations(i, r);
@@ -174,7 +246,7 @@ TEST_CASE("colorAt() with mutually reflective surfaces") {
 
 TEST_CASE("The refracted color with an opaque surface") {
   RT::World w;
-  auto shape = w.objects[0].get();
+  auto shape = &w.object(0);
   auto r = RT::Ray(RT::point(0, 0, -5), RT::vector(0, 0, 1));
   auto xs =
       RT::intersections(RT::Intersection(4, shape), RT::Intersection(6, shape));
@@ -185,7 +257,7 @@ TEST_CASE("The refracted color with an opaque surface") {
 
 TEST_CASE("The refracted color at the maximum recursive depth") {
   RT::World w;
-  auto shape = w.objects[0].get();
+  auto shape = &w.object(0);
   shape->material.transparency = 1.0;
   shape->material.refractiveIndex = 1.5;
   auto r = RT::Ray(RT::point(0, 0, -5), RT::vector(0, 0, 1));
@@ -198,7 +270,7 @@ TEST_CASE("The refracted color at the maximum recursive depth") {
 
 TEST_CASE("The refracted color under total internal reflection") {
   RT::World w;
-  auto shape = w.objects[0].get();
+  auto shape = &w.object(0);
   shape->material.transparency = 1.0;
   shape->material.refractiveIndex = 1.5;
   auto r = RT::Ray(RT::point(0, 0, sqrt(2) / 2), RT::vector(0, 1, 0));
@@ -211,10 +283,10 @@ TEST_CASE("The refracted color under total internal reflection") {
 
 TEST_CASE("The refracted color with a refracted ray") {
   RT::World w;
-  auto a = w.objects[0].get();
+  auto a = &w.object(0);
   a->material.ambient = 1;
   a->material.pattern = std::make_unique<RT::TestPattern>(RT::TestPattern());
-  auto b = w.objects[1].get();
+  auto b = &w.object(1);
   b->material.transparency = 1.0;
   b->material.refractiveIndex = 1.5;
   auto r = RT::Ray(RT::point(0, 0, 0.1), RT::vector(0, 1, 0));
@@ -223,7 +295,9 @@ TEST_CASE("The refracted color with a refracted ray") {
       RT::Intersection(0.4899, b), RT::Intersection(0.9899, a));
   auto comps = RT::Computations(xs[2], r, xs);
   auto c = w.refractedColor(comps, 5);
-  REQUIRE(c == RT::color(0, 0.99888, 0.04725));
+  // The refracted ray starts EPSILON under the surface and the test pattern
+  // returns the point it is evaluated at, so the color moves with EPSILON.
+  REQUIRE((c - RT::color(0, 0.99888, 0.04725)).magnitude() < 2 * EPSILON);
 }
 
 TEST_CASE("shadeHit() with a transparent material") {
@@ -266,3 +340,204 @@ TEST_CASE("shadeHit() with a reflective, transparent material") {
   auto c = w.shadeHit(comps, 5);
   REQUIRE(c == RT::color(0.93391, 0.69643, 0.69243));
 }
+
+TEST_CASE("Surface colors follow patterns changed in place") {
+  RT::World w(false);
+  auto s = std::make_unique<RT::Sphere>();
+  s->material.pattern = std::make_unique<RT::StripePattern>();
+  auto id = w.add(std::move(s));
+  const auto &sphere = std::as_const(w).object(id);
+  auto p = RT::point(0.5, 0, 0);
+  REQUIRE(w.surfaceColor(sphere, p) == RT::color(1, 1, 1));
+  auto &pattern = w.object(id).material.pattern;
+  dynamic_cast<RT::StripePattern &>(*pattern).a = RT::color(1, 0, 0);
+  REQUIRE(w.surfaceColor(sphere, p) == RT::color(1, 0, 0));
+  // The replacement is likely to reuse the freed pattern's address.
+  pattern.reset();
+  pattern = std::make_unique<RT::StripePattern>(RT::color(0, 1, 0),
+                                                RT::color(0, 0, 0));
+  REQUIRE(w.surfaceColor(sphere, p) == RT::color(0, 1, 0));
+}
+
+TEST_CASE("Only objects handed out for editing have their patterns checked") {
+  RT::World w(false);
+  auto s = std::make_unique<RT::Sphere>();
+  s->material.pattern = std::make_unique<RT::StripePattern>();
+  auto id = w.add(std::move(s));
+  REQUIRE_FALSE(w.exposed[id]);
+  auto striped = RT::Material();
+  striped.pattern = std::make_unique<RT::StripePattern>(RT::color(0, 0, 1),
+                                                        RT::color(0, 0, 0));
+  w.setMaterial(id, striped);
+  w.setTransform(id, RT::translation(1, 0, 0));
+  REQUIRE_FALSE(w.exposed[id]);
+  const auto &sphere = std::as_const(w).object(id);
+  REQUIRE(w.surfaceColor(sphere, RT::point(1.5, 0, 0)) == RT::color(0, 0, 1));
+  (void)w.object(id);
+  REQUIRE(w.exposed[id]);
+}
+
+TEST_CASE("Setting a flat material drops the object's pattern") {
+  RT::World w(false);
+  auto s = std::make_unique<RT::Sphere>();
+  s->material.pattern = std::make_unique<RT::StripePattern>();
+  auto id = w.add(std::move(s));
+  auto flat = RT::Material();
+  flat.color = RT::color(1, 0, 0);
+  w.setMaterial(id, flat);
+  const auto &sphere = std::as_const(w).object(id);
+  REQUIRE(!sphere.material.pattern);
+  REQUIRE(w.surfaceColor(sphere, RT::point(1.5, 0, 0)) == RT::color(1, 0, 0));
+}
+
+TEST_CASE("Shapes of every type are stored and intersected by the world") {
+  RT::World w(false);
+  w.add(std::make_unique<RT::Cube>());
+  auto cylinder = RT::Cylinder(RT::translation(3, 0, 0), RT::Material(), -1,
+                               1, true);
+  w.add(std::make_unique<RT::Cylinder>(cylinder));
+  auto cone = RT::Cone(RT::translation(-3, 0, 0), RT::Material(), -1, 0, true);
+  w.add(std::make_unique<RT::Cone>(cone));
+  w.add(std::make_unique<RT::Sphere>(RT::glassSphere()));
+  REQUIRE(w.count() == 4);
+  REQUIRE(dynamic_cast<const RT::Cylinder *>(&w.object(1)) != nullptr);
+  REQUIRE(w.object(3).material.transparency == 1.0);
+  auto xs = w.intersect(RT::Ray(RT::point(-10, -0.5, 0), RT::vector(1, 0, 0)));
+  REQUIRE(xs.size() == 8);
+  REQUIRE(xs[0].second == &w.object(2));
+  REQUIRE(xs[7].second == &w.object(1));
+  xs = w.intersect(RT::Ray(RT::point(0, 5, 5), RT::vector(0, 0, -1)));
+  REQUIRE(xs.empty());
+}
+
+TEST_CASE("Sampled lights shade exactly while the budget covers them") {
+  RT::World w;
+  w.lights.emplace_back(RT::point(10, -10, 10), RT::color(0.5, 0.5, 0.5));
+  w.lights.emplace_back(RT::point(0, 0, -20), RT::color(0.2, 0.3, 0.1));
+  auto r = RT::Ray(RT::point(0, 0, -5), RT::vector(0, 0, 1));
+  auto i = RT::Intersection(4, &w.object(0));
+  auto comps = RT::Computations(i, r, {i});
+  auto exact = w.shadeHit(comps);
+  w.sampleLights(2);
+  REQUIRE(w.samplesLights());
+  REQUIRE(w.lightSamples(comps.overPoint, comps.normal).size() == 2);
+  REQUIRE(w.shadeHit(comps) == exact);
+  w.lights.pop_back();
+  REQUIRE(!w.samplesLights());
+}
+
+TEST_CASE("Sampled lights are weighted by their probability") {
+  RT::World w(false);
+  for (auto i = 0; i < 30; i++) {
+    w.lights.emplace_back(RT::point(i - 15, 5, 2), RT::color(0.1, 0.1, 0.1));
+  }
+  w.sampleLights(3);
+  auto p = RT::point(0, 0, 0);
+  auto n = RT::vector(0, 1, 0);
+  auto samples = w.lightSamples(p, n);
+  REQUIRE(samples.size() == 3);
+  for (const auto &sample : samples) {
+    REQUIRE(sample.weight > 1);
+  }
+}
+
+TEST_CASE("A CSG shape is shaded and casts shadows through its children") {
+  RT::World w(false);
+  w.lights.emplace_back(RT::point(0, 10, 0), RT::color(1, 1, 1));
+  // A cube with its middle drilled out along y.
+  auto drill = std::make_unique<RT::Cylinder>(RT::scaling(0.5, 1, 0.5),
+                                              RT::Material(), -2, 2, true);
+  auto block = std::make_unique<RT::Cube>();
+  block->material.color = RT::color(1, 0, 0);
+  block->material.specular = 0;
+  w.add(std::make_unique<RT::CSG>(RT::CSGOperation::Difference,
+                                  std::move(block), std::move(drill)));
+  REQUIRE(w.isShadowed(RT::point(0.8, -5, 0), w.lights[0]));
+  REQUIRE(!w.isShadowed(RT::point(0, -5, 0), w.lights[0]));
+  auto xs = w.intersect(RT::Ray(RT::point(0.8, 5, 0), RT::vector(0, -1, 0)));
+  REQUIRE(xs.size() == 2);
+  const auto &csg = dynamic_cast<const RT::CSG &>(w.object(0));
+  REQUIRE(xs[0].second == &csg.left());
+  auto c = w.colorAt(RT::Ray(RT::point(0.8, 5, 0), RT::vector(0, -1, 0)));
+  REQUIRE(c.red > 0);
+  REQUIRE(RT::approxEqual(c.green, 0.0));
+}
+
+TEST_CASE("Surface samples name CSG objects across removals") {
+  RT::World w(false);
+  auto pair = [](RT::Real x) {
+    return std::make_unique<RT::CSG>(
+        RT::CSGOperation::Union,
+        std::make_unique<RT::Sphere>(RT::translation(x, 0, 0),
+                                     RT::Material()),
+        std::make_unique<RT::Cube>(RT::translation(x, 0, 0), RT::Material()));
+  };
+  auto first = w.add(pair(-3));
+  auto second = w.add(pair(3));
+  auto third = w.add(pair(9));
+  std::optional<RT::Intersection> primary;
+  std::optional<RT::SurfaceSample> surface;
+  auto at = [&](RT::Real x) {
+    (void)w.colorAt(RT::Ray(RT::point(x, 0, -5), RT::vector(0, 0, 1)),
+                    primary, surface);
+    return surface->object;
+  };
+  REQUIRE(at(3) == second);
+  w.remove(first);
+  auto fourth = w.add(pair(15));
+  REQUIRE(at(3) == second);
+  REQUIRE(at(9) == third);
+  REQUIRE(at(15) == fourth);
+  REQUIRE(w.contains(w.object(third)));
+}
+
+TEST_CASE("The last occluder answers repeated shadow queries") {
+  RT::World w;
+  auto p = RT::point(10, -10, 10);
+  w.countShadowCache();
+  REQUIRE(w.isShadowed(p, w.lights[0]));
+  REQUIRE(w.isShadowed(RT::point(10, -10.5, 10), w.lights[0]));
+  REQUIRE(!w.isShadowed(RT::point(-20, 20, -20), w.lights[0]));
+  auto stats = w.shadowCacheStats();
+  REQUIRE(stats.lookups == 3);
+  REQUIRE(stats.hits == 1);
+  REQUIRE(RT::approxEqual(stats.hitRate(), 1.0 / 3));
+  w.resetShadowCacheStats();
+  REQUIRE(w.shadowCacheStats().lookups == 0);
+  w.countShadowCache(false);
+  REQUIRE(w.isShadowed(p, w.lights[0]));
+  REQUIRE(w.shadowCacheStats().lookups == 0);
+}
+
+TEST_CASE("Occluder caches stay correct across threads and worlds") {
+  RT::World w;
+  RT::World other;
+  w.countShadowCache();
+  std::vector<RT::Point> points;
+  for (auto i = 0; i < 400; i++) {
+    auto dx = (i % 20) * 0.05;
+    auto dz = (i / 20) * 0.05;
+    points.push_back(i % 7 == 0 ? RT::point(-20 + dx, 20, -20 + dz)
+                                : RT::point(10 + dx, -10, 10 + dz));
+  }
+  std::vector<char> expected;
+  for (const auto &p : points) {
+    auto xs = w.intersect(RT::Ray(p, (w.lights[0].position - p).norm()));
+    auto h = RT::hit(xs);
+    expected.push_back(static_cast<char>(
+        h.has_value() &&
+        h.value().first < (w.lights[0].position - p).magnitude()));
+  }
+  std::vector<char> seen(points.size());
+  RT::parallelFor(
+      points.size(),
+      [&](size_t i) {
+        auto j = points.size() - 1 - i;
+        seen[j] = static_cast<char>(w.isShadowed(points[j], w.lights[0]));
+        (void)other.isShadowed(points[j], other.lights[0]);
+      },
+      4, 16);
+  REQUIRE(seen == expected);
+  REQUIRE(w.shadowCacheStats().lookups == points.size());
+  REQUIRE(w.shadowCacheStats().hits > 0);
+}